@@ -0,0 +1,171 @@
+#include <stdlib.h>
+
+#include "arena.h"
+#include "worker.h"
+#include "logger.h"
+
+#define _HEADER ((sizeof(arena_chunk_t) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+#define _ROUND(size) (((size) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+static task_t* _current_task()
+{
+    worker_t *worker = worker_self();
+
+    return worker != NULL ? worker->current_task : NULL;
+}
+
+// pooled chunks and the chunks of a task are all ARENA_CHUNK sized, except
+// the ones made for a large allocation
+static arena_chunk_t* _take_chunk(ppos_core_t *core, size_t size)
+{
+    arena_chunk_t *chunk = NULL;
+
+    if (size <= ARENA_CHUNK) {
+        core->lock_core();
+        chunk = core->arena_pool;
+        if (chunk != NULL) {
+            core->arena_pool = chunk->next;
+            core->nr_arena_pool--;
+        }
+        core->unlock_core();
+
+        size = ARENA_CHUNK;
+    }
+
+    if (chunk == NULL) {
+        // the allocator is not reentrant, so no other task may run meanwhile
+        core->block_task_switch();
+        chunk = malloc(_HEADER + size);
+        core->enable_task_switch();
+
+        if (chunk == NULL) {
+            LOG_WARN("task_alloc: failed to allocate a chunk of %zu bytes", size);
+            return NULL;
+        }
+
+        chunk->size = size;
+    }
+
+    chunk->used = 0;
+    return chunk;
+}
+
+// chunks past ARENA_POOL_MAX and large chunks go back to the heap
+static void _give_chunks(ppos_core_t *core, arena_chunk_t *chunks)
+{
+    arena_chunk_t *spare = NULL;
+
+    core->lock_core();
+    while (chunks != NULL) {
+        arena_chunk_t *chunk = chunks;
+        chunks = chunk->next;
+
+        if (chunk->size == ARENA_CHUNK && core->nr_arena_pool < ARENA_POOL_MAX) {
+            chunk->next = core->arena_pool;
+            core->arena_pool = chunk;
+            core->nr_arena_pool++;
+        } else {
+            chunk->next = spare;
+            spare = chunk;
+        }
+    }
+    core->unlock_core();
+
+    core->block_task_switch();
+    while (spare != NULL) {
+        arena_chunk_t *chunk = spare;
+        spare = chunk->next;
+        free(chunk);
+    }
+    core->enable_task_switch();
+}
+
+void* task_alloc(size_t size)
+{
+    task_t *task = _current_task();
+
+    if (task == NULL) {
+        LOG_WARN0("task_alloc: no current task");
+        return NULL;
+    }
+
+    size = _ROUND(size > 0 ? size : 1);
+    arena_chunk_t *chunk = task->arena;
+
+    if (chunk == NULL || chunk->size - chunk->used < size) {
+        arena_chunk_t *fresh = _take_chunk(worker_core(), size);
+
+        if (fresh == NULL) {
+            return NULL;
+        }
+
+        // a large chunk is full at once, it goes behind the current one
+        if (chunk != NULL && fresh->size > ARENA_CHUNK) {
+            fresh->next = chunk->next;
+            chunk->next = fresh;
+            fresh->used = size;
+            return (char *)fresh + _HEADER;
+        }
+
+        fresh->next = chunk;
+        task->arena = chunk = fresh;
+    }
+
+    void *memory = (char *)chunk + _HEADER + chunk->used;
+    chunk->used += size;
+    return memory;
+}
+
+void task_arena_reset()
+{
+    task_t *task = _current_task();
+
+    if (task == NULL || task->arena == NULL) {
+        return;
+    }
+
+    // one regular chunk stays with the task, the others go back
+    arena_chunk_t *keep = NULL;
+    arena_chunk_t *others = NULL;
+
+    while (task->arena != NULL) {
+        arena_chunk_t *chunk = task->arena;
+        task->arena = chunk->next;
+
+        if (keep == NULL && chunk->size == ARENA_CHUNK) {
+            keep = chunk;
+        } else {
+            chunk->next = others;
+            others = chunk;
+        }
+    }
+
+    if (others != NULL) {
+        _give_chunks(worker_core(), others);
+    }
+
+    if (keep != NULL) {
+        keep->next = NULL;
+        keep->used = 0;
+        task->arena = keep;
+    }
+}
+
+void arena_release(task_t *task)
+{
+    if (task->arena != NULL) {
+        _give_chunks(worker_core(), task->arena);
+        task->arena = NULL;
+    }
+}
+
+void arena_destroy(ppos_core_t *core)
+{
+    while (core->arena_pool != NULL) {
+        arena_chunk_t *chunk = core->arena_pool;
+        core->arena_pool = chunk->next;
+        free(chunk);
+    }
+
+    core->nr_arena_pool = 0;
+}
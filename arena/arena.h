@@ -0,0 +1,63 @@
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+#include <stddef.h>
+
+#include "ppos_data.h"
+
+/*
+ * Per-task arena. task_alloc bumps a pointer through chunks owned by the
+ * current task, without a lock and without a header per allocation; the
+ * memory is never freed one allocation at a time, all of it goes back at
+ * once on task_arena_reset or when the task terminates. Chunks of
+ * ARENA_CHUNK bytes go back to a pool of the runtime, where the next task
+ * needing a chunk finds them; larger allocations get a chunk of their own,
+ * returned to the heap. The memory of a task is only valid for that task's
+ * lifetime, and must not be used by other tasks after it terminates
+ */
+
+#define ARENA_CHUNK (64 * 1024)
+#define ARENA_ALIGN 16
+#define ARENA_POOL_MAX 64
+
+typedef struct arena_chunk_t
+{
+    struct arena_chunk_t *next;
+    size_t size;    // usable bytes after the header
+    size_t used;
+} arena_chunk_t;
+
+/*
+ * @brief Allocate memory owned by the current task, aligned to ARENA_ALIGN
+ *        and not zeroed, valid until the task terminates or resets it
+ * @param size: bytes to allocate
+ * @return the memory, NULL on error or outside a task
+ */
+void* task_alloc(size_t size);
+
+/*
+ * @brief Release everything allocated by the current task with task_alloc,
+ *        keeping one chunk for the next allocations
+ * @return void
+ */
+void task_arena_reset();
+
+/*
+ * Runtime internals, used by the core
+ */
+
+/*
+ * @brief Give the chunks of a terminating task back to its runtime
+ * @param task: terminating task
+ * @return void
+ */
+void arena_release(task_t *task);
+
+/*
+ * @brief Free the pooled chunks of a runtime
+ * @param core: runtime being destroyed
+ * @return void
+ */
+void arena_destroy(ppos_core_t *core);
+
+#endif
@@ -0,0 +1,102 @@
+// PingPongOS - PingPong Operating System
+
+// Benchmark do quantum adaptativo: trocas de contexto das tarefas CPU-bound
+// e latencia de despertar das tarefas em rajadas, com o ajuste desligado e
+// ligado, primeiro so com tarefas CPU-bound e depois com a carga mista
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "ppos.h"
+#include "quantum.h"
+
+#define CPU_TASKS 4
+#define BURSTY_TASKS 4
+#define WORKLOAD 12000
+#define BURST_WORKLOAD 300
+#define BURSTS 40
+#define BURST_SLEEP 40
+
+task_t cpu[4][CPU_TASKS], bursty[4][BURSTY_TASKS] ;
+
+unsigned int latency_sum, latency_max, latency_samples ;
+
+// simula um processamento pesado
+int hardwork (int n)
+{
+   int i, j, soma ;
+
+   soma = 0 ;
+   for (i=0; i<n; i++)
+      for (j=0; j<n; j++)
+         soma += j ;
+   return (soma) ;
+}
+
+void CpuBody (void * arg)
+{
+   hardwork (WORKLOAD) ;
+   task_exit (0) ;
+}
+
+// dorme, mede o atraso do despertar e faz uma rajada curta de trabalho
+void BurstyBody (void * arg)
+{
+   int i ;
+   unsigned int target, latency ;
+
+   for (i=0; i<BURSTS; i++)
+   {
+      target = systime () + BURST_SLEEP ;
+      task_sleep (BURST_SLEEP) ;
+      latency = systime () - target ;
+
+      latency_sum += latency ;
+      latency_samples++ ;
+      if (latency > latency_max)
+         latency_max = latency ;
+
+      hardwork (BURST_WORKLOAD) ;
+   }
+   task_exit (0) ;
+}
+
+void run (int round, int adaptive, int mixed)
+{
+   int i ;
+   unsigned int start, switches ;
+
+   task_adaptive_quantum (adaptive) ;
+   latency_sum = latency_max = latency_samples = 0 ;
+   start = systime () ;
+
+   for (i=0; i<CPU_TASKS; i++)
+      task_init (&cpu[round][i], CpuBody, NULL) ;
+   for (i=0; mixed && i<BURSTY_TASKS; i++)
+      task_init (&bursty[round][i], BurstyBody, NULL) ;
+
+   switches = 0 ;
+   for (i=0; i<CPU_TASKS; i++)
+   {
+      task_wait (&cpu[round][i]) ;
+      switches += cpu[round][i].time.activations ;
+   }
+   for (i=0; mixed && i<BURSTY_TASKS; i++)
+      task_wait (&bursty[round][i]) ;
+
+   printf ("%-5s %-8s: cpu-bound switches %6u, bursty latency avg %5.2f ms max %3u ms, elapsed %6u ms\n",
+           mixed ? "mixed" : "cpu", adaptive ? "adaptive" : "fixed", switches,
+           latency_samples ? (double) latency_sum / latency_samples : 0.0,
+           latency_max, systime () - start) ;
+}
+
+int main (int argc, char *argv[])
+{
+   ppos_init () ;
+
+   run (0, 0, 0) ;
+   run (1, 1, 0) ;
+   run (2, 0, 1) ;
+   run (3, 1, 1) ;
+
+   task_exit (0) ;
+}
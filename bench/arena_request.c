@@ -0,0 +1,105 @@
+// PingPongOS - PingPong Operating System
+
+// Arena por tarefa contra malloc/free num padrao tipico de requisicao:
+// cada requisicao e uma tarefa que faz muitas alocacoes pequenas (16 a 512
+// bytes), escreve nelas e, ao terminar, libera tudo. Com malloc cada bloco
+// e liberado com free; com a arena os blocos voltam juntos na saida da
+// tarefa. As requisicoes rodam em levas de tarefas criadas com task_spawn.
+// Imprime uma linha CSV por alocador, com o tempo medio por requisicao e
+// por alocacao.
+// Uso: arena_request [requisicoes] [alocacoes] [workers]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+// ppos.h proibe clock_gettime, o relogio e definido antes dele
+static uint64_t now_ns ()
+{
+   struct timespec ts ;
+
+   clock_gettime (CLOCK_MONOTONIC, &ts) ;
+   return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec ;
+}
+
+#include "ppos.h"
+#include "ppos_runtime.h"
+#include "worker.h"
+#include "arena.h"
+
+#define WAVE 64
+#define MAX_ALLOCS 2048
+
+int num_requests = 20000, num_allocs = 200, num_workers = 1, use_arena ;
+uint64_t elapsed ;
+
+void Request (void * arg)
+{
+   void *blocks[MAX_ALLOCS] ;
+   unsigned int seed = (uintptr_t) arg ;
+   size_t size ;
+   int i ;
+
+   for (i=0; i<num_allocs; i++)
+   {
+      seed = seed * 1103515245 + 12345 ;
+      size = 16 + (seed >> 8) % 497 ;
+      blocks[i] = use_arena ? task_alloc (size) : malloc (size) ;
+      memset (blocks[i], i, size) ;
+   }
+
+   if (!use_arena)
+      for (i=0; i<num_allocs; i++)
+         free (blocks[i]) ;
+   task_exit (0) ;
+}
+
+void Main (void * arg)
+{
+   task_handle_t wave[WAVE] ;
+   uint64_t t0 ;
+   int done, i, n ;
+
+   t0 = now_ns () ;
+   for (done=0; done<num_requests; done+=n)
+   {
+      n = num_requests - done < WAVE ? num_requests - done : WAVE ;
+      for (i=0; i<n; i++)
+         wave[i] = task_spawn (Request, (void *) (uintptr_t) (done + i)) ;
+      for (i=0; i<n; i++)
+         task_join (wave[i], NULL) ;
+   }
+   elapsed = now_ns () - t0 ;
+   task_exit (0) ;
+}
+
+int main (int argc, char *argv[])
+{
+   if (argc > 1)
+      num_requests = atoi (argv[1]) ;
+   if (argc > 2)
+      num_allocs = atoi (argv[2]) ;
+   if (argc > 3)
+      num_workers = atoi (argv[3]) ;
+   if (num_requests < 1 || num_allocs < 1 || num_allocs > MAX_ALLOCS || num_workers < 1)
+   {
+      fprintf (stderr, "Uso: %s [requisicoes] [alocacoes (1-%d)] [workers]\n", argv[0], MAX_ALLOCS) ;
+      exit (1) ;
+   }
+
+   printf ("alocador,requisicoes,alocacoes,workers,us_por_requisicao,ns_por_alocacao\n") ;
+   for (use_arena=0; use_arena<2; use_arena++)
+   {
+      ppos_workers (num_workers) ;
+      if (ppos_run (Main, NULL) < 0)
+      {
+         fprintf (stderr, "arena_request: erro ao executar\n") ;
+         exit (1) ;
+      }
+      printf ("%s,%d,%d,%d,%.2f,%.1f\n", use_arena ? "arena" : "malloc", num_requests, num_allocs,
+              num_workers, elapsed / 1000.0 / num_requests, (double) elapsed / num_requests / num_allocs) ;
+   }
+   exit (0) ;
+}
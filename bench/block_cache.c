@@ -0,0 +1,105 @@
+// PingPongOS - PingPong Operating System
+
+// Benchmark da cache de blocos: cada tarefa varre sequencialmente sua faixa
+// do disco, rele blocos aleatorios da faixa e reescreve alguns deles, direto
+// no disco simulado e atraves da cache.
+// Uso: block_cache [tarefas] [blocos por tarefa]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "ppos.h"
+#include "disk.h"
+#include "cache.h"
+
+#define MAX_TASKS 64
+#define IMAGE "/tmp/ppos_cache_bench.img"
+
+task_t tasks[MAX_TASKS] ;
+int num_tasks, blocks, num_blocks, block_size, cached ;
+
+int do_read (int block, void *buf)
+{
+   return cached ? cache_block_read (block, buf) : disk_block_read (block, buf) ;
+}
+
+int do_write (int block, void *buf)
+{
+   return cached ? cache_block_write (block, buf) : disk_block_write (block, buf) ;
+}
+
+void Body (void * arg)
+{
+   int id = (int)(long) arg ;
+   unsigned int seed = id + 1 ;
+   char buf[DISK_DEFAULT_BLOCK_SIZE] ;
+   int i, first = id * blocks ;
+
+   for (i=0; i<blocks; i++)
+      do_read (first + i, buf) ;
+
+   for (i=0; i<blocks; i++)
+      do_read (first + rand_r (&seed) % blocks, buf) ;
+
+   for (i=0; i<blocks/4; i++)
+      do_write (first + rand_r (&seed) % blocks, buf) ;
+
+   task_exit (0) ;
+}
+
+int main (int argc, char *argv[])
+{
+   disk_config_t config ;
+   cache_stats_t stats ;
+   unsigned int start, elapsed ;
+   int i ;
+
+   num_tasks = (argc > 1) ? atoi (argv[1]) : 8 ;
+   blocks = (argc > 2) ? atoi (argv[2]) : 256 ;
+   if (num_tasks < 1 || num_tasks > MAX_TASKS)
+      num_tasks = MAX_TASKS ;
+
+   ppos_init () ;
+
+   memset (&config, 0, sizeof(config)) ;
+   config.image = IMAGE ;
+   config.num_blocks = num_tasks * blocks ;
+   disk_mgr_config (&config) ;
+   if (disk_mgr_init (&num_blocks, &block_size) < 0)
+      exit (1) ;
+
+   printf ("block_cache: %d tarefas x %d blocos, %d blocos de %d bytes\n",
+           num_tasks, blocks, num_blocks, block_size) ;
+
+   for (cached=0; cached<2; cached++)
+   {
+      if (cached && cache_init (NULL, NULL) < 0)
+         exit (1) ;
+
+      start = systime () ;
+      for (i=0; i<num_tasks; i++)
+         task_init (&tasks[i], Body, (void *)(long) i) ;
+      for (i=0; i<num_tasks; i++)
+         task_wait (&tasks[i]) ;
+      elapsed = systime () - start ;
+
+      if (!cached)
+      {
+         printf ("block_cache: disco: %u ms\n", elapsed) ;
+         continue ;
+      }
+
+      cache_sync () ;
+      cache_getstats (&stats) ;
+      printf ("block_cache: cache: %u ms (%u ms com o flush)\n", elapsed, systime () - start) ;
+      printf ("block_cache: acertos %u, faltas %u, taxa de acerto %.1f%%\n", stats.hits, stats.misses,
+              100.0 * stats.hits / (stats.hits + stats.misses)) ;
+      printf ("block_cache: leitura antecipada %u blocos, %u usados\n", stats.readahead, stats.readahead_hits) ;
+      printf ("block_cache: flush de %u blocos em %u lotes, media %.1f, maior %u\n", stats.flushed, stats.flushes,
+              stats.flushes ? (double) stats.flushed / stats.flushes : 0.0, stats.max_batch) ;
+   }
+
+   unlink (IMAGE) ;
+   task_exit (0) ;
+}
@@ -0,0 +1,75 @@
+// PingPongOS - PingPong Operating System
+
+// Benchmark das politicas de escalonamento do disco simulado: leituras
+// aleatorias de varias tarefas concorrentes, com deslocamento total da
+// cabeca e tempo de servico medio e p99 de cada politica.
+// Uso: disk_policies [tarefas] [pedidos por tarefa]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "ppos.h"
+#include "disk.h"
+
+#define MAX_TASKS 256
+#define IMAGE "/tmp/ppos_disk_bench.img"
+
+task_t tasks[MAX_TASKS] ;
+int num_tasks, requests, num_blocks, block_size ;
+
+// le blocos aleatorios, com a mesma sequencia em todas as politicas
+void Reader (void * arg)
+{
+   unsigned int seed = (unsigned int)(long) arg ;
+   char buf[DISK_DEFAULT_BLOCK_SIZE] ;
+   int i ;
+
+   for (i=0; i<requests; i++)
+      disk_block_read (rand_r (&seed) % num_blocks, buf) ;
+   task_exit (0) ;
+}
+
+int main (int argc, char *argv[])
+{
+   disk_config_t config ;
+   disk_stats_t stats ;
+   unsigned int start, elapsed ;
+   int i, policy ;
+
+   num_tasks = (argc > 1) ? atoi (argv[1]) : 32 ;
+   requests = (argc > 2) ? atoi (argv[2]) : 64 ;
+   if (num_tasks < 1 || num_tasks > MAX_TASKS)
+      num_tasks = MAX_TASKS ;
+
+   ppos_init () ;
+
+   memset (&config, 0, sizeof(config)) ;
+   config.image = IMAGE ;
+   disk_mgr_config (&config) ;
+   if (disk_mgr_init (&num_blocks, &block_size) < 0)
+      exit (1) ;
+
+   printf ("disk_policies: %d tarefas x %d leituras, %d blocos, %d blocos por trilha\n",
+           num_tasks, requests, num_blocks, DISK_DEFAULT_BLOCKS_PER_TRACK) ;
+   printf ("disk_policies: politica  pedidos  trilhas  media(us)  p99(us)  max(us)  tempo(ms)\n") ;
+
+   for (policy=0; policy<DISK_POLICIES; policy++)
+   {
+      disk_set_policy (policy) ;
+
+      start = systime () ;
+      for (i=0; i<num_tasks; i++)
+         task_init (&tasks[i], Reader, (void *)(long)(i + 1)) ;
+      for (i=0; i<num_tasks; i++)
+         task_wait (&tasks[i]) ;
+      elapsed = systime () - start ;
+
+      disk_getstats (policy, &stats) ;
+      printf ("disk_policies: %-8s %8u %8llu %10u %8u %8u %10u\n", disk_policy_name (policy),
+              stats.requests, stats.head_travel, stats.mean_us, stats.p99_us, stats.max_us, elapsed) ;
+   }
+
+   unlink (IMAGE) ;
+   task_exit (0) ;
+}
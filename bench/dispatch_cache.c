@@ -0,0 +1,169 @@
+// PingPongOS - PingPong Operating System
+
+// Custo de cache do dispatcher: N tarefas com prioridades variadas cedem o
+// processador em rodadas, e cada escolha do escalonador percorre toda a
+// fila de prontas. Mede o tempo e, com perf_event_open, as faltas de cache
+// (L1 de dados e ultimo nivel) por despacho, junto com o deslocamento dos
+// campos do task_t lidos na varredura. Sem acesso aos contadores do perf
+// (perf_event_paranoid ou conteiner), so o tempo e medido.
+// Uso: dispatch_cache [tarefas] [rodadas]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+// ppos.h proibe clock_gettime, o relogio e definido antes dele
+static uint64_t now_ns ()
+{
+   struct timespec ts ;
+
+   clock_gettime (CLOCK_MONOTONIC, &ts) ;
+   return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec ;
+}
+
+enum { L1D_MISSES, LLC_MISSES, COUNTERS } ;
+
+const char *counter_names[COUNTERS] = { "faltas_l1d", "faltas_llc" } ;
+int counters[COUNTERS] = { -1, -1 } ;
+
+// contadores da thread que chama, que tambem roda as tarefas (um worker)
+static int counters_open ()
+{
+   struct perf_event_attr attr ;
+   uint64_t configs[COUNTERS] = {
+      PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+      PERF_COUNT_HW_CACHE_MISSES,
+   } ;
+   int i, opened = 0 ;
+
+   for (i=0; i<COUNTERS; i++)
+   {
+      memset (&attr, 0, sizeof(attr)) ;
+      attr.size = sizeof(attr) ;
+      attr.type = (i == L1D_MISSES) ? PERF_TYPE_HW_CACHE : PERF_TYPE_HARDWARE ;
+      attr.config = configs[i] ;
+      attr.disabled = 1 ;
+      attr.exclude_kernel = 1 ;
+      attr.exclude_hv = 1 ;
+      counters[i] = syscall (__NR_perf_event_open, &attr, 0, -1, -1, 0) ;
+      opened += counters[i] >= 0 ;
+   }
+   return opened ;
+}
+
+static void counters_switch (int on)
+{
+   int i ;
+
+   for (i=0; i<COUNTERS; i++)
+      if (counters[i] >= 0)
+      {
+         if (on)
+            ioctl (counters[i], PERF_EVENT_IOC_RESET, 0) ;
+         ioctl (counters[i], on ? PERF_EVENT_IOC_ENABLE : PERF_EVENT_IOC_DISABLE, 0) ;
+      }
+}
+
+static int64_t counter_read (int i)
+{
+   uint64_t value ;
+
+   if (counters[i] < 0 || read (counters[i], &value, sizeof(value)) != sizeof(value))
+      return -1 ;
+   return value ;
+}
+
+#include "ppos.h"
+#include "ppos_runtime.h"
+#include "worker.h"
+
+#define MAX_TASKS 20000
+
+task_t tasks[MAX_TASKS] ;
+int order[MAX_TASKS] ;
+int num_tasks = 2000, rounds = 20 ;
+
+void Yielder (void * arg)
+{
+   int i ;
+
+   for (i=0; i<rounds; i++)
+      task_yield () ;
+   task_exit (0) ;
+}
+
+void Main (void * arg)
+{
+   uint64_t t0, elapsed ;
+   long dispatches ;
+   int i, j, swap ;
+
+   // a fila visita os descritores fora da ordem da memoria, como numa
+   // aplicacao real, para que o prefetcher nao esconda as faltas
+   srand (1) ;
+   for (i=0; i<num_tasks; i++)
+      order[i] = i ;
+   for (i=num_tasks - 1; i>0; i--)
+   {
+      j = rand () % (i + 1) ;
+      swap = order[i] ; order[i] = order[j] ; order[j] = swap ;
+   }
+
+   for (i=0; i<num_tasks; i++)
+   {
+      task_init (&tasks[order[i]], Yielder, NULL) ;
+      task_setprio (&tasks[order[i]], (i % 41) - 20) ;
+   }
+
+   counters_switch (1) ;
+   t0 = now_ns () ;
+   for (i=0; i<num_tasks; i++)
+      task_wait (&tasks[i]) ;
+   elapsed = now_ns () - t0 ;
+   counters_switch (0) ;
+
+   dispatches = (long) num_tasks * (rounds + 1) ;
+   printf ("tarefas,rodadas,despachos,ns_por_despacho") ;
+   for (i=0; i<COUNTERS; i++)
+      printf (",%s_por_despacho", counter_names[i]) ;
+   printf ("\n%d,%d,%ld,%.1f", num_tasks, rounds, dispatches, (double) elapsed / dispatches) ;
+   for (i=0; i<COUNTERS; i++)
+   {
+      int64_t value = counter_read (i) ;
+      if (value < 0)
+         printf (",") ;
+      else
+         printf (",%.2f", (double) value / dispatches) ;
+   }
+   printf ("\n") ;
+   task_exit (0) ;
+}
+
+int main (int argc, char *argv[])
+{
+   if (argc > 1)
+      num_tasks = atoi (argv[1]) ;
+   if (argc > 2)
+      rounds = atoi (argv[2]) ;
+   if (num_tasks < 1 || num_tasks > MAX_TASKS || rounds < 1)
+   {
+      fprintf (stderr, "Uso: %s [tarefas (1-%d)] [rodadas]\n", argv[0], MAX_TASKS) ;
+      exit (1) ;
+   }
+
+   printf ("task_t: %zu bytes, varredura le prev/next em %zu e dynamic_priority em %zu, contexto em %zu\n",
+           sizeof(task_t), offsetof(task_t, next), offsetof(task_t, dynamic_priority), offsetof(task_t, context)) ;
+   if (counters_open () == 0)
+      printf ("contadores de cache indisponiveis, medindo so o tempo\n") ;
+
+   ppos_workers (1) ;
+   ppos_run (Main, NULL) ;
+   exit (0) ;
+}
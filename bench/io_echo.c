@@ -0,0 +1,165 @@
+// PingPongOS - PingPong Operating System
+
+// Benchmark de E/S assincrona: servidor de eco sobre TCP local, com uma
+// tarefa por conexao em cada lado, todas na mesma thread do host.
+// Uso: io_echo [conexoes] [rodadas]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include "ppos.h"
+#include "io.h"
+
+#define MSG_SIZE 64
+
+task_t acceptor, *servers, *clients ;
+int listen_fd, connections, rounds ;
+struct sockaddr_in server_addr ;
+int failed = 0 ;
+
+// le exatamente size bytes
+int read_all (int fd, char *buf, int size)
+{
+   int got = 0 ;
+   ssize_t n ;
+
+   while (got < size)
+   {
+      n = task_read (fd, buf + got, size - got) ;
+      if (n <= 0)
+         return -1 ;
+      got += n ;
+   }
+   return got ;
+}
+
+// devolve tudo o que recebe ate o cliente fechar a conexao
+void Server (void * arg)
+{
+   int fd = (int)(long) arg ;
+   char buf[MSG_SIZE] ;
+   ssize_t n ;
+
+   while ((n = task_read (fd, buf, sizeof(buf))) > 0)
+      if (task_write (fd, buf, n) != n)
+         break ;
+
+   task_close (fd) ;
+   task_exit (0) ;
+}
+
+// aceita as conexoes e cria uma tarefa servidora para cada uma
+void Acceptor (void * arg)
+{
+   int i, fd ;
+
+   for (i=0; i<connections; i++)
+   {
+      fd = task_accept (listen_fd, NULL, NULL) ;
+      if (fd < 0)
+      {
+         perror ("Acceptor: accept") ;
+         failed++ ;
+         break ;
+      }
+      task_init (&servers[i], Server, (void *)(long) fd) ;
+   }
+   task_exit (0) ;
+}
+
+// envia mensagens e espera o eco de cada uma
+void Client (void * arg)
+{
+   char out[MSG_SIZE], in[MSG_SIZE] ;
+   int i, fd ;
+
+   fd = socket (AF_INET, SOCK_STREAM, 0) ;
+   if (fd < 0 || (connect (fd, (struct sockaddr *) &server_addr, sizeof(server_addr)) < 0
+                  && errno != EINTR && errno != EINPROGRESS))
+   {
+      failed++ ;
+      task_exit (1) ;
+   }
+
+   // um connect interrompido termina em segundo plano
+   task_wait_fd (fd, IO_WRITE, -1) ;
+
+   memset (out, 'a' + (int)(long) arg % 26, sizeof(out)) ;
+   for (i=0; i<rounds; i++)
+   {
+      if (task_write (fd, out, sizeof(out)) != sizeof(out) ||
+          read_all (fd, in, sizeof(in)) < 0 || memcmp (in, out, sizeof(in)))
+      {
+         failed++ ;
+         break ;
+      }
+   }
+
+   task_close (fd) ;
+   task_exit (0) ;
+}
+
+int main (int argc, char *argv[])
+{
+   struct rlimit limit ;
+   socklen_t len = sizeof(server_addr) ;
+   unsigned int start, elapsed ;
+   int i ;
+
+   connections = (argc > 1) ? atoi (argv[1]) : 2000 ;
+   rounds = (argc > 2) ? atoi (argv[2]) : 20 ;
+
+   // cada conexao usa dois descritores
+   getrlimit (RLIMIT_NOFILE, &limit) ;
+   limit.rlim_cur = limit.rlim_max ;
+   setrlimit (RLIMIT_NOFILE, &limit) ;
+   if ((rlim_t)(2 * connections + 16) > limit.rlim_cur)
+   {
+      printf ("io_echo: limite de %ld descritores e pequeno demais\n", (long) limit.rlim_cur) ;
+      exit (1) ;
+   }
+
+   servers = calloc (connections, sizeof(task_t)) ;
+   clients = calloc (connections, sizeof(task_t)) ;
+
+   listen_fd = socket (AF_INET, SOCK_STREAM, 0) ;
+   memset (&server_addr, 0, sizeof(server_addr)) ;
+   server_addr.sin_family = AF_INET ;
+   server_addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK) ;
+   if (listen_fd < 0
+       || bind (listen_fd, (struct sockaddr *) &server_addr, sizeof(server_addr)) < 0
+       || listen (listen_fd, SOMAXCONN) < 0
+       || getsockname (listen_fd, (struct sockaddr *) &server_addr, &len) < 0)
+   {
+      perror ("io_echo: listen") ;
+      exit (1) ;
+   }
+
+   ppos_init () ;
+
+   start = systime () ;
+   task_init (&acceptor, Acceptor, NULL) ;
+   for (i=0; i<connections; i++)
+      task_init (&clients[i], Client, (void *)(long) i) ;
+
+   task_wait (&acceptor) ;
+   for (i=0; i<connections; i++)
+      task_wait (&clients[i]) ;
+   for (i=0; i<connections; i++)
+      task_wait (&servers[i]) ;
+   elapsed = systime () - start ;
+
+   printf ("io_echo: %d conexoes, %d rodadas de %d bytes, %d falhas\n",
+           connections, rounds, MSG_SIZE, failed) ;
+   printf ("io_echo: %u ms, %.0f ecos/s\n", elapsed,
+           elapsed ? (double) connections * rounds * 1000.0 / elapsed : 0.0) ;
+
+   task_close (listen_fd) ;
+   task_exit (0) ;
+}
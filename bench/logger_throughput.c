@@ -0,0 +1,83 @@
+// PingPongOS - PingPong Operating System
+
+// Benchmark do log: mensagens registradas por varias tarefas com uma
+// escrita por mensagem (como o printf sem buffer) e pelo anel assincrono,
+// esvaziado com writev em lotes pelo dispatcher. As tarefas cedem o
+// processador a cada YIELD mensagens nos dois casos.
+// Uso: logger_throughput [tarefas] [mensagens por tarefa] [arquivo]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "ppos.h"
+#include "logger.h"
+
+#define MAX_TASKS 64
+#define YIELD 256
+
+task_t tasks[MAX_TASKS] ;
+int num_tasks, records, fd, async ;
+
+void Body (void * arg)
+{
+   int id = (int)(long) arg ;
+   char line[128] ;
+   int i, len ;
+
+   for (i=0; i<records; i++)
+   {
+      if (async)
+         log_write (fd, "[INFO] tarefa %d registro %d\n", id, i) ;
+      else
+      {
+         len = snprintf (line, sizeof(line), "[INFO] tarefa %d registro %d\n", id, i) ;
+         if (write (fd, line, len) < 0)
+            break ;
+      }
+      if (i % YIELD == YIELD - 1)
+         task_yield () ;
+   }
+   task_exit (0) ;
+}
+
+int main (int argc, char *argv[])
+{
+   unsigned int start, elapsed ;
+   unsigned long dropped ;
+   int i ;
+
+   num_tasks = (argc > 1) ? atoi (argv[1]) : 8 ;
+   records = (argc > 2) ? atoi (argv[2]) : 100000 ;
+   if (num_tasks < 1 || num_tasks > MAX_TASKS)
+      num_tasks = MAX_TASKS ;
+
+   fd = open ((argc > 3) ? argv[3] : "/dev/null", O_WRONLY | O_CREAT | O_APPEND, 0644) ;
+   if (fd < 0)
+      exit (1) ;
+
+   ppos_init () ;
+
+   printf ("logger_throughput: %d tarefas x %d mensagens\n", num_tasks, records) ;
+
+   for (async=0; async<2; async++)
+   {
+      dropped = log_dropped () ;
+
+      start = systime () ;
+      for (i=0; i<num_tasks; i++)
+         task_init (&tasks[i], Body, (void *)(long) i) ;
+      for (i=0; i<num_tasks; i++)
+         task_wait (&tasks[i]) ;
+      log_flush () ;
+      elapsed = systime () - start ;
+
+      printf ("logger_throughput: %-9s %6u ms, %8.0f mensagens/ms, %lu descartadas\n",
+              async ? "anel" : "write", elapsed,
+              (double) num_tasks * records / (elapsed ? elapsed : 1), log_dropped () - dropped) ;
+   }
+
+   close (fd) ;
+   task_exit (0) ;
+}
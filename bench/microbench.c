@@ -0,0 +1,436 @@
+// PingPongOS - PingPong Operating System
+
+// Microbenchmarks do nucleo: ida e volta de task_yield e de task_switch,
+// criacao e termino de tarefas (task_init e task_spawn), leitura de valores
+// locais de tarefa, precisao de task_sleep, custo das filas por tamanho e
+// custo do dispatcher por tamanho da fila de prontas. Cada medida gera
+// min/mediana/p99 em ns num arquivo JSON; com uma linha de base salva,
+// medianas acima do limiar e do ruido da medida (um decimo da
+// distancia entre mediana e p99 da base) sao regressoes (saida 1).
+// Uso: microbench [-o resultados.json] [-c base.json] [-t limiar%]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+
+// ppos.h proibe clock_gettime, o relogio e definido antes dele
+static uint64_t now_ns ()
+{
+   struct timespec ts ;
+
+   clock_gettime (CLOCK_MONOTONIC, &ts) ;
+   return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec ;
+}
+
+#include "ppos.h"
+#include "ppos_runtime.h"
+#include "queue.h"
+#include "tls.h"
+
+#define MAX_SAMPLES 20000
+#define MAX_RESULTS 32
+#define MAX_TASKS 500
+#define MAX_QUEUE 10000
+#define QUEUE_BATCH 10
+#define MIN_REGRESSION_NS 50
+
+typedef struct
+{
+   char name[32] ;
+   int samples ;
+   uint64_t min, median, p99 ;
+} result_t ;
+
+typedef struct node_t
+{
+   struct node_t *prev, *next ;
+} node_t ;
+
+result_t results[MAX_RESULTS] ;
+int num_results ;
+
+uint64_t samples[MAX_SAMPLES] ;
+int num_samples, target ;
+volatile int done ;
+
+task_t tasks[MAX_TASKS], ping, pong, sping, spong ;
+node_t nodes[MAX_QUEUE + 1] ;
+
+int compare (const void *a, const void *b)
+{
+   uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b ;
+   return x < y ? -1 : x > y ;
+}
+
+// ordena as amostras e guarda min/mediana/p99
+void summarize (const char *name)
+{
+   result_t *r = &results[num_results++] ;
+
+   qsort (samples, num_samples, sizeof(uint64_t), compare) ;
+   snprintf (r->name, sizeof(r->name), "%s", name) ;
+   r->samples = num_samples ;
+   r->min = samples[0] ;
+   r->median = samples[num_samples / 2] ;
+   r->p99 = samples[(num_samples * 99) / 100] ;
+
+   printf ("%-20s %6d amostras  min %8lu  mediana %8lu  p99 %8lu ns\n", r->name, r->samples,
+           (unsigned long) r->min, (unsigned long) r->median, (unsigned long) r->p99) ;
+   num_samples = 0 ;
+}
+
+void record (uint64_t ns)
+{
+   if (num_samples < MAX_SAMPLES)
+      samples[num_samples++] = ns ;
+}
+
+// --- ida e volta de task_yield entre duas tarefas ---
+
+void YieldMeasure (void * arg)
+{
+   uint64_t t0 ;
+
+   while (num_samples < target)
+   {
+      t0 = now_ns () ;
+      task_yield () ;
+      record (now_ns () - t0) ;
+   }
+   done = 1 ;
+   task_exit (0) ;
+}
+
+void YieldPeer (void * arg)
+{
+   while (!done)
+      task_yield () ;
+   task_exit (0) ;
+}
+
+void bench_yield ()
+{
+   done = 0 ;
+   target = MAX_SAMPLES ;
+   task_init (&ping, YieldMeasure, NULL) ;
+   task_init (&pong, YieldPeer, NULL) ;
+   task_wait (&ping) ;
+   task_wait (&pong) ;
+   summarize ("yield_roundtrip") ;
+}
+
+// --- ida e volta de task_switch direto entre duas tarefas ---
+
+// uma tarefa que troca diretamente de contexto sai do conjunto de prontas:
+// SwitchPing fica parada na ultima troca e so SwitchPong termina
+void SwitchPing (void * arg)
+{
+   uint64_t t0 ;
+
+   while (num_samples < target)
+   {
+      t0 = now_ns () ;
+      task_switch (&spong) ;
+      record (now_ns () - t0) ;
+   }
+   done = 1 ;
+   task_switch (&spong) ;
+}
+
+void SwitchPong (void * arg)
+{
+   while (!done)
+      task_switch (&sping) ;
+   task_exit (0) ;
+}
+
+void bench_switch ()
+{
+   done = 0 ;
+   target = MAX_SAMPLES ;
+   task_init (&sping, SwitchPing, NULL) ;
+   task_init (&spong, SwitchPong, NULL) ;
+   task_wait (&spong) ;
+   summarize ("switch_roundtrip") ;
+}
+
+// --- criacao e termino de tarefas ---
+
+void Empty (void * arg)
+{
+   task_exit (0) ;
+}
+
+void bench_spawn ()
+{
+   uint64_t t0 ;
+   int i ;
+
+   // as pilhas das tarefas terminadas nao sao liberadas
+   for (i=0; i<MAX_TASKS; i++)
+   {
+      t0 = now_ns () ;
+      task_init (&tasks[i], Empty, NULL) ;
+      task_wait (&tasks[i]) ;
+      record (now_ns () - t0) ;
+   }
+   summarize ("spawn_exit") ;
+}
+
+// descritores do slab do sistema, reciclados com a pilha a cada join
+void bench_spawn_join ()
+{
+   uint64_t t0 ;
+   int i ;
+
+   for (i=0; i<MAX_SAMPLES; i++)
+   {
+      t0 = now_ns () ;
+      task_join (task_spawn (Empty, NULL), NULL) ;
+      record (now_ns () - t0) ;
+   }
+   summarize ("spawn_join") ;
+}
+
+// --- task_getspecific de uma chave no descritor e de uma no transbordo ---
+
+void bench_specific ()
+{
+   task_key_t keys[TASK_KEYS_INLINE + 1] ;
+   volatile uintptr_t sum = 0 ;
+   char name[32] ;
+   uint64_t t0 ;
+   int i, j, k ;
+
+   for (k=0; k<=TASK_KEYS_INLINE; k++)
+   {
+      task_key_create (&keys[k], NULL) ;
+      task_setspecific (keys[k], &keys[k]) ;
+   }
+
+   for (k=0; k<=TASK_KEYS_INLINE; k+=TASK_KEYS_INLINE)
+   {
+      for (i=0; i<MAX_SAMPLES / 4; i++)
+      {
+         t0 = now_ns () ;
+         for (j=0; j<QUEUE_BATCH; j++)
+            sum += (uintptr_t) task_getspecific (keys[k]) ;
+         record ((now_ns () - t0) / QUEUE_BATCH) ;
+      }
+      snprintf (name, sizeof(name), "getspecific_%s", k < TASK_KEYS_INLINE ? "inline" : "overflow") ;
+      summarize (name) ;
+   }
+
+   for (k=0; k<=TASK_KEYS_INLINE; k++)
+      task_key_delete (keys[k]) ;
+}
+
+// --- precisao de task_sleep: distancia entre o tempo dormido e o pedido ---
+
+void bench_sleep ()
+{
+   uint64_t t0, slept ;
+   int i ;
+
+   for (i=0; i<300; i++)
+   {
+      t0 = now_ns () ;
+      task_sleep (2) ;
+      slept = now_ns () - t0 ;
+      record (slept > 2000000 ? slept - 2000000 : 2000000 - slept) ;
+   }
+   summarize ("sleep_2ms_error") ;
+}
+
+// --- queue_append + queue_remove do ultimo elemento de uma fila ---
+
+void bench_queue (int length)
+{
+   queue_t *queue = NULL ;
+   char name[32] ;
+   uint64_t t0 ;
+   int i, j ;
+
+   memset (nodes, 0, sizeof(nodes)) ;
+   for (i=0; i<length; i++)
+      queue_append (&queue, (queue_t *) &nodes[i]) ;
+
+   for (i=0; i<MAX_SAMPLES / 4; i++)
+   {
+      t0 = now_ns () ;
+      for (j=0; j<QUEUE_BATCH; j++)
+      {
+         queue_append (&queue, (queue_t *) &nodes[length]) ;
+         queue_remove (&queue, (queue_t *) &nodes[length]) ;
+      }
+      record ((now_ns () - t0) / QUEUE_BATCH) ;
+   }
+
+   snprintf (name, sizeof(name), "queue_%d", length) ;
+   summarize (name) ;
+}
+
+// --- custo de uma passagem pelo dispatcher com N tarefas prontas ---
+
+void DispatchMeasure (void * arg)
+{
+   long ready = (long) arg ;
+   uint64_t t0 ;
+
+   while (num_samples < target)
+   {
+      t0 = now_ns () ;
+      task_yield () ;
+      record ((now_ns () - t0) / ready) ;
+   }
+   done = 1 ;
+   task_exit (0) ;
+}
+
+void bench_dispatch (long ready)
+{
+   char name[32] ;
+   int i ;
+
+   done = 0 ;
+   target = MAX_SAMPLES / 4 ;
+   task_init (&tasks[0], DispatchMeasure, (void *) ready) ;
+   for (i=1; i<ready; i++)
+      task_init (&tasks[i], YieldPeer, NULL) ;
+   for (i=0; i<ready; i++)
+      task_wait (&tasks[i]) ;
+
+   snprintf (name, sizeof(name), "dispatch_%ld", ready) ;
+   summarize (name) ;
+}
+
+// --- resultados ---
+
+int write_json (const char *path)
+{
+   FILE *file = fopen (path, "w") ;
+   int i ;
+
+   if (!file)
+      return -1 ;
+
+   fprintf (file, "{\n  \"suite\": \"ppos-microbench\",\n  \"unit\": \"ns\",\n  \"results\": [\n") ;
+   for (i=0; i<num_results; i++)
+      fprintf (file, "    {\"name\": \"%s\", \"samples\": %d, \"min\": %lu, \"median\": %lu, \"p99\": %lu}%s\n",
+               results[i].name, results[i].samples, (unsigned long) results[i].min,
+               (unsigned long) results[i].median, (unsigned long) results[i].p99,
+               i < num_results - 1 ? "," : "") ;
+   fprintf (file, "  ]\n}\n") ;
+
+   return fclose (file) ;
+}
+
+// procura um campo de uma medida num JSON gravado por write_json
+long baseline_value (const char *json, const char *name, const char *field)
+{
+   char key[64] ;
+   const char *entry, *value ;
+
+   snprintf (key, sizeof(key), "\"name\": \"%s\"", name) ;
+   entry = strstr (json, key) ;
+   if (!entry)
+      return -1 ;
+   snprintf (key, sizeof(key), "\"%s\":", field) ;
+   value = strstr (entry, key) ;
+   if (!value)
+      return -1 ;
+   return atol (value + strlen (key)) ;
+}
+
+int compare_baseline (const char *path, double threshold)
+{
+   static char json[65536] ;
+   FILE *file = fopen (path, "r") ;
+   int i, regressions = 0 ;
+   size_t len ;
+   long base, spread, change_ns ;
+
+   if (!file)
+   {
+      printf ("microbench: linha de base %s nao encontrada\n", path) ;
+      return -1 ;
+   }
+   len = fread (json, 1, sizeof(json) - 1, file) ;
+   json[len] = 0 ;
+   fclose (file) ;
+
+   printf ("\ncomparacao com %s (limiar %.0f%%):\n", path, threshold) ;
+   for (i=0; i<num_results; i++)
+   {
+      base = baseline_value (json, results[i].name, "median") ;
+      spread = baseline_value (json, results[i].name, "p99") - base ;
+      if (base < 0)
+      {
+         printf ("%-20s sem linha de base\n", results[i].name) ;
+         continue ;
+      }
+
+      // medidas ruidosas, como a do sleep, so regridem alem do seu ruido
+      change_ns = (long) results[i].median - base ;
+      double change = base ? 100.0 * change_ns / base : 0.0 ;
+      int regressed = change > threshold && change_ns > MIN_REGRESSION_NS && change_ns > spread / 10 ;
+
+      printf ("%-20s %8ld -> %8lu ns  %+7.1f%%%s\n", results[i].name, base,
+              (unsigned long) results[i].median, change, regressed ? "  REGRESSAO" : "") ;
+      regressions += regressed ;
+   }
+
+   return regressions ;
+}
+
+int main (int argc, char *argv[])
+{
+   const char *output = "bench/results.json", *baseline = NULL ;
+   double threshold = 20.0 ;
+   int opt, regressions = 0 ;
+
+   while ((opt = getopt (argc, argv, "o:c:t:")) != -1)
+   {
+      switch (opt)
+      {
+         case 'o': output = optarg ; break ;
+         case 'c': baseline = optarg ; break ;
+         case 't': threshold = atof (optarg) ; break ;
+         default:
+            fprintf (stderr, "Uso: %s [-o resultados.json] [-c base.json] [-t limiar%%]\n", argv[0]) ;
+            exit (2) ;
+      }
+   }
+
+   ppos_init () ;
+
+   bench_yield () ;
+   bench_switch () ;
+   bench_spawn () ;
+   bench_spawn_join () ;
+   bench_specific () ;
+   bench_sleep () ;
+   bench_queue (10) ;
+   bench_queue (100) ;
+   bench_queue (1000) ;
+   bench_queue (MAX_QUEUE) ;
+   bench_dispatch (1) ;
+   bench_dispatch (10) ;
+   bench_dispatch (100) ;
+
+   if (write_json (output) < 0)
+      printf ("microbench: erro ao gravar %s\n", output) ;
+   else
+      printf ("microbench: resultados em %s\n", output) ;
+
+   if (baseline)
+      regressions = compare_baseline (baseline, threshold) ;
+
+   if (regressions > 0)
+      printf ("microbench: %d regressoes\n", regressions) ;
+
+   exit (regressions != 0 ? 1 : 0) ;
+}
@@ -0,0 +1,60 @@
+// PingPongOS - PingPong Operating System
+
+// Benchmark do runtime com varios workers: vazao de tarefas CPU-bound
+// independentes. Uso: parallel_scaling [workers]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "ppos.h"
+#include "worker.h"
+
+#define TASKS 64
+#define WORKLOAD 4000
+
+task_t tasks[TASKS] ;
+
+// simula um processamento pesado
+int hardwork (int n)
+{
+   int i, j, soma ;
+
+   soma = 0 ;
+   for (i=0; i<n; i++)
+      for (j=0; j<n; j++)
+         soma += j ;
+   return (soma) ;
+}
+
+void Body (void * arg)
+{
+   hardwork (WORKLOAD) ;
+   task_exit (0) ;
+}
+
+int main (int argc, char *argv[])
+{
+   int i, workers ;
+   unsigned int start, elapsed ;
+
+   workers = (argc > 1) ? atoi (argv[1]) : 1 ;
+   if (ppos_workers (workers) < 0)
+      exit (1) ;
+
+   ppos_init () ;
+
+   start = systime () ;
+   for (i=0; i<TASKS; i++)
+      task_init (&tasks[i], Body, NULL) ;
+
+   for (i=0; i<TASKS; i++)
+      task_wait (&tasks[i]) ;
+
+   elapsed = systime () - start ;
+   if (elapsed == 0)
+      elapsed = 1 ;
+
+   printf ("workers %2d: %d tasks in %5u ms, %7.1f tasks/s\n", workers, TASKS,
+           elapsed, TASKS * 1000.0 / elapsed) ;
+
+   task_exit (0) ;
+}
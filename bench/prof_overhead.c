@@ -0,0 +1,87 @@
+// PingPongOS - PingPong Operating System
+
+// Benchmark do custo do profiler: tarefas executam uma quantidade fixa de
+// trabalho com o profiler desligado e amostrando a cada tick (1 kHz); com
+// um arquivo, as pilhas dobradas sao gravadas para um flame graph.
+// Uso: prof_overhead [tarefas] [iteracoes por tarefa] [arquivo]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "ppos.h"
+#include "prof.h"
+
+#define MAX_TASKS 64
+#define ROUNDS 3
+
+task_t tasks[MAX_TASKS] ;
+int num_tasks ;
+long iterations ;
+volatile unsigned long sink ;
+
+unsigned long work (long n)
+{
+   unsigned long x = 1 ;
+   long i ;
+
+   for (i=0; i<n; i++)
+      x = x * 6364136223846793005UL + 1442695040888963407UL ;
+   return x ;
+}
+
+void Body (void * arg)
+{
+   sink += work (iterations) ;
+   task_exit (0) ;
+}
+
+// tempo para todas as tarefas terminarem o trabalho
+unsigned int run ()
+{
+   unsigned int start = systime () ;
+   int i ;
+
+   for (i=0; i<num_tasks; i++)
+      task_init (&tasks[i], Body, NULL) ;
+   for (i=0; i<num_tasks; i++)
+      task_wait (&tasks[i]) ;
+
+   return systime () - start ;
+}
+
+int main (int argc, char *argv[])
+{
+   unsigned int off = 0, on = 0 ;
+   long samples ;
+   int r ;
+
+   num_tasks = (argc > 1) ? atoi (argv[1]) : 4 ;
+   iterations = (argc > 2) ? atol (argv[2]) : 100000000L ;
+   if (num_tasks < 1 || num_tasks > MAX_TASKS)
+      num_tasks = MAX_TASKS ;
+
+   ppos_init () ;
+
+   printf ("prof_overhead: %d tarefas x %ld iteracoes\n", num_tasks, iterations) ;
+
+   // rodadas alternadas, para que variacoes da maquina afetem os dois lados
+   for (r=0; r<ROUNDS; r++)
+   {
+      off += run () ;
+
+      if (prof_start (1, 1000000) < 0)
+         exit (1) ;
+      on += run () ;
+      prof_stop () ;
+   }
+
+   printf ("prof_overhead: desligado %u ms\n", off) ;
+   printf ("prof_overhead: ligado    %u ms, custo %.2f%%\n", on, off ? 100.0 * ((double) on - off) / off : 0.0) ;
+
+   if (argc > 3)
+   {
+      samples = prof_dump (argv[3]) ;
+      printf ("prof_overhead: %ld amostras gravadas em %s\n", samples, argv[3]) ;
+   }
+
+   task_exit (0) ;
+}
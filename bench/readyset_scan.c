@@ -0,0 +1,165 @@
+// PingPongOS - PingPong Operating System
+
+// Custo da escolha do escalonador por prioridade: a varredura da fila de
+// prontas, que segue os ponteiros dos descritores, contra a escolha no
+// conjunto de prontas em vetores, com argmin e envelhecimento escalares,
+// SSE4.1 e AVX2. As tarefas nao executam, so a escolha e medida, de 64 ate
+// o numero pedido de tarefas prontas, dobrando. Imprime uma linha CSV por
+// tamanho, com o tempo medio de uma escolha em ns (vazio se a CPU nao
+// suporta o modo).
+// Uso: readyset_scan [max_tarefas] [escolhas]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+// ppos.h proibe clock_gettime, o relogio e definido antes dele
+static uint64_t now_ns ()
+{
+   struct timespec ts ;
+
+   clock_gettime (CLOCK_MONOTONIC, &ts) ;
+   return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec ;
+}
+
+#include "ppos.h"
+#include "readyset.h"
+#include "dispatcher.h"
+
+#define MIN_TASKS 64
+#define MAX_TASKS 65536
+
+task_t *tasks ;
+int *order ;
+volatile long sink ;
+
+// a mesma varredura do _scheduler do dispatcher
+static task_t *scan (task_t *head)
+{
+   task_t *pick = head, *task ;
+   int visited, len = queue_size ((queue_t *) head) ;
+
+   for (task=head->next, visited=0; visited<len; task=task->next, visited++)
+      if (task->dynamic_priority < pick->dynamic_priority)
+      {
+         pick->dynamic_priority -= TASK_AGING_DECAY ;
+         pick = task ;
+      }
+      else
+         task->dynamic_priority -= TASK_AGING_DECAY ;
+   return pick ;
+}
+
+static void setup (int num_tasks)
+{
+   int i ;
+
+   for (i=0; i<num_tasks; i++)
+   {
+      tasks[order[i]].prev = tasks[order[i]].next = NULL ;
+      tasks[order[i]].dynamic_priority = (i % 41) - 20 ;
+   }
+}
+
+// a escolhida volta a prioridade estatica, como ao ser despachada
+static double time_queue (int num_tasks, int picks)
+{
+   task_t *queue = NULL, *pick ;
+   uint64_t t0 ;
+   int i ;
+
+   setup (num_tasks) ;
+   for (i=0; i<num_tasks; i++)
+      queue_append ((queue_t **) &queue, (queue_t *) &tasks[order[i]]) ;
+
+   t0 = now_ns () ;
+   for (i=0; i<picks; i++)
+   {
+      pick = scan (queue) ;
+      pick->dynamic_priority = 20 ;
+      sink += pick->id ;
+   }
+   return (double) (now_ns () - t0) / picks ;
+}
+
+static double time_set (readyset_mode_t mode, int num_tasks, int picks)
+{
+   readyset_t *set = readyset_create (mode) ;
+   task_t *pick ;
+   uint64_t t0 ;
+   int i ;
+
+   setup (num_tasks) ;
+   for (i=0; i<num_tasks; i++)
+      readyset_add (set, &tasks[order[i]]) ;
+
+   t0 = now_ns () ;
+   for (i=0; i<picks; i++)
+   {
+      pick = readyset_pick (set) ;
+      set->priority[set->picked] = 20 ;
+      sink += pick->id ;
+   }
+   t0 = now_ns () - t0 ;
+
+   readyset_destroy (set) ;
+   return (double) t0 / picks ;
+}
+
+int main (int argc, char *argv[])
+{
+   const char *names[] = { "fila", "", "escalar", "sse", "avx2" } ;
+   int max_tasks = 16384, picks = 2000, num_tasks, i, j, swap, mode ;
+
+   if (argc > 1)
+      max_tasks = atoi (argv[1]) ;
+   if (argc > 2)
+      picks = atoi (argv[2]) ;
+   if (max_tasks < MIN_TASKS || max_tasks > MAX_TASKS || picks < 1)
+   {
+      fprintf (stderr, "Uso: %s [max_tarefas (%d-%d)] [escolhas]\n", argv[0], MIN_TASKS, MAX_TASKS) ;
+      exit (1) ;
+   }
+
+   tasks = calloc (max_tasks, sizeof(task_t)) ;
+   order = malloc (max_tasks * sizeof(int)) ;
+   if (tasks == NULL || order == NULL)
+   {
+      fprintf (stderr, "sem memoria para %d tarefas\n", max_tasks) ;
+      exit (1) ;
+   }
+
+   // a fila visita os descritores fora da ordem da memoria, como no
+   // dispatch_cache
+   srand (1) ;
+   for (i=0; i<max_tasks; i++)
+   {
+      order[i] = i ;
+      tasks[i].id = i ;
+   }
+   for (i=max_tasks - 1; i>0; i--)
+   {
+      j = rand () % (i + 1) ;
+      swap = order[i] ; order[i] = order[j] ; order[j] = swap ;
+   }
+
+   printf ("tarefas,%s_ns,%s_ns,%s_ns,%s_ns\n", names[READYSET_OFF], names[READYSET_SCALAR],
+           names[READYSET_SSE], names[READYSET_AVX2]) ;
+   for (num_tasks=MIN_TASKS; num_tasks<=max_tasks; num_tasks*=2)
+   {
+      printf ("%d,%.1f", num_tasks, time_queue (num_tasks, picks)) ;
+      for (mode=READYSET_SCALAR; mode<=READYSET_AVX2; mode++)
+      {
+         if (mode == READYSET_SCALAR || ppos_readyset (mode) == 0)
+            printf (",%.1f", time_set (mode, num_tasks, picks)) ;
+         else
+            printf (",") ;
+      }
+      printf ("\n") ;
+   }
+
+   free (tasks) ;
+   free (order) ;
+   exit (0) ;
+}
@@ -0,0 +1,345 @@
+// PingPongOS - PingPong Operating System
+
+// Teste de carga com muitas tarefas: para cada N, cria N tarefas com uma
+// mistura de tarefas que gastam CPU, dormem, esperam outra tarefa e cedem o
+// processador, e mede a taxa de criacao, a memoria residente por tarefa, o
+// custo de cada troca de contexto e o atraso do despertar de task_sleep.
+// Cada N roda num processo filho; os resultados saem como CSV, uma linha
+// por N, para acompanhar o crescimento dos caminhos O(n) do nucleo.
+// Uso: stress [-n 100,1000,...] [-m cpu:dorme:espera:cede] [-d duracao ms]
+//             [-s sono max ms] [-w workers] [-o resultados.csv]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/wait.h>
+
+// ppos.h proibe clock_gettime, o relogio e definido antes dele
+static uint64_t now_ns ()
+{
+   struct timespec ts ;
+
+   clock_gettime (CLOCK_MONOTONIC, &ts) ;
+   return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec ;
+}
+
+// e fork: cada medida roda num processo novo, antes do ppos_init
+static pid_t new_process ()
+{
+   return fork () ;
+}
+
+#include "ppos.h"
+#include "worker.h"
+#include "stats.h"
+
+#define MAX_SIZES 16
+#define MAX_WAKEUPS (1 << 20)
+
+enum { SPINNER, SLEEPER, WAITER, YIELDER, ROLES } ;
+
+const char *role_names[ROLES] = { "cpu", "dorme", "espera", "cede" } ;
+
+// parametros
+long sizes[MAX_SIZES] = { 100, 1000, 10000 } ;
+int num_sizes = 3 ;
+int mix[ROLES] = { 0, 40, 20, 40 } ;
+int duration = 2000, max_sleep = 20, workers = 1 ;
+
+// estado do processo filho
+task_t *tasks, *start_queue ;
+unsigned char *roles ;
+long num_tasks, counts[ROLES] ;
+volatile int stop ;
+long parked, yields, sleeps ;
+int32_t *wakeups ;
+volatile unsigned long sink ;
+
+// memoria residente do processo, sem alocar
+long rss_bytes ()
+{
+   char buf[128] ;
+   long size = 0, resident = 0 ;
+   int fd = open ("/proc/self/statm", O_RDONLY) ;
+   ssize_t len ;
+
+   if (fd < 0)
+      return 0 ;
+   len = read (fd, buf, sizeof(buf) - 1) ;
+   close (fd) ;
+   if (len <= 0)
+      return 0 ;
+   buf[len] = 0 ;
+   sscanf (buf, "%ld %ld", &size, &resident) ;
+   return resident * sysconf (_SC_PAGESIZE) ;
+}
+
+// toda tarefa para na fila de partida ate todas terem sido criadas
+void park ()
+{
+   __atomic_add_fetch (&parked, 1, __ATOMIC_RELAXED) ;
+   task_suspend (&start_queue) ;
+}
+
+void Spinner (void * arg)
+{
+   unsigned long x = (long) arg ;
+
+   park () ;
+   while (!stop)
+      x = x * 6364136223846793005UL + 1442695040888963407UL ;
+   sink += x ;
+   task_exit (0) ;
+}
+
+void Sleeper (void * arg)
+{
+   unsigned int seed = (long) arg ;
+   uint64_t t0 ;
+   int64_t late ;
+   long slot ;
+   int ms ;
+
+   park () ;
+   while (!stop)
+   {
+      seed = seed * 1103515245 + 12345 ;
+      ms = 1 + (seed >> 16) % max_sleep ;
+      t0 = now_ns () ;
+      task_sleep (ms) ;
+      late = (int64_t) (now_ns () - t0) - ms * 1000000LL ;
+
+      slot = __atomic_fetch_add (&sleeps, 1, __ATOMIC_RELAXED) ;
+      if (slot < MAX_WAKEUPS)
+         wakeups[slot] = late / 1000 ;
+   }
+   task_exit (0) ;
+}
+
+// espera a proxima tarefa que nao espera, que so termina no fim da medida
+void Waiter (void * arg)
+{
+   long i = (long) arg ;
+
+   park () ;
+   do
+      i = (i + 1) % num_tasks ;
+   while (roles[i] == WAITER) ;
+   task_wait (&tasks[i]) ;
+   task_exit (0) ;
+}
+
+void Yielder (void * arg)
+{
+   long n = 0 ;
+
+   park () ;
+   while (!stop)
+   {
+      task_yield () ;
+      n++ ;
+   }
+   __atomic_add_fetch (&yields, n, __ATOMIC_RELAXED) ;
+   task_exit (0) ;
+}
+
+void (*bodies[ROLES]) (void *) = { Spinner, Sleeper, Waiter, Yielder } ;
+
+int compare (const void *a, const void *b)
+{
+   int32_t x = *(const int32_t *) a, y = *(const int32_t *) b ;
+   return x < y ? -1 : x > y ;
+}
+
+// papel da tarefa i: os papeis se intercalam segundo a mistura
+int role_of (long i)
+{
+   int total = 0, r, slot ;
+
+   for (r=0; r<ROLES; r++)
+      total += mix[r] ;
+   slot = i % total ;
+   for (r=0; r<ROLES; r++)
+   {
+      if (slot < mix[r])
+         return r ;
+      slot -= mix[r] ;
+   }
+   return YIELDER ;
+}
+
+// roda uma medida com n tarefas e grava sua linha do CSV em fd
+void run (long n, int fd)
+{
+   uint64_t t0, create_ns, start_ns, phase_ns, teardown_ns ;
+   long rss_base, rss_created, rss_running, i, awakened ;
+   ppos_stats_t before, after ;
+   unsigned long long switches ;
+   double mean = 0 ;
+   long count ;
+
+   num_tasks = n ;
+   tasks = calloc (n, sizeof(task_t)) ;
+   roles = calloc (n, 1) ;
+   wakeups = calloc (MAX_WAKEUPS, sizeof(int32_t)) ;
+   if (!tasks || !roles || !wakeups)
+   {
+      fprintf (stderr, "stress: sem memoria para %ld tarefas\n", n) ;
+      exit (1) ;
+   }
+
+   if (workers > 1 && ppos_workers (workers) < 0)
+      exit (1) ;
+   ppos_init () ;
+   rss_base = rss_bytes () ;
+
+   // criacao: as tarefas rodam uma vez e param na fila de partida
+   t0 = now_ns () ;
+   for (i=0; i<n; i++)
+   {
+      roles[i] = role_of (i) ;
+      counts[roles[i]]++ ;
+      if (task_init (&tasks[i], bodies[roles[i]], (void *) i) < 0)
+      {
+         fprintf (stderr, "stress: falha ao criar a tarefa %ld\n", i) ;
+         exit (1) ;
+      }
+   }
+   create_ns = now_ns () - t0 ;
+
+   while (__atomic_load_n (&parked, __ATOMIC_RELAXED) < n)
+      task_yield () ;
+   rss_created = rss_bytes () ;
+
+   // medida: todas partem e main acorda ao fim dela para parar as tarefas
+   ppos_getstats (&before) ;
+   start_ns = now_ns () ;
+   for (awakened = 0; awakened < n; )
+   {
+      if (start_queue)
+      {
+         task_awake (start_queue, &start_queue) ;
+         awakened++ ;
+      }
+      else
+         task_yield () ;
+   }
+   task_sleep (duration) ;
+   rss_running = rss_bytes () ;
+   stop = 1 ;
+   phase_ns = now_ns () - start_ns ;
+   ppos_getstats (&after) ;
+
+   t0 = now_ns () ;
+   for (i=0; i<n; i++)
+      task_wait (&tasks[i]) ;
+   teardown_ns = now_ns () - t0 ;
+
+   switches = after.switches - before.switches ;
+   count = sleeps < MAX_WAKEUPS ? sleeps : MAX_WAKEUPS ;
+   for (i=0; i<count; i++)
+      mean += wakeups[i] ;
+   if (count)
+   {
+      mean /= count ;
+      qsort (wakeups, count, sizeof(int32_t), compare) ;
+   }
+
+   dprintf (fd, "%ld,%ld,%ld,%ld,%ld,%.1f,%.0f,%ld,%ld,%.1f,%llu,%.0f,%ld,%ld,%.0f,%d,%d,%.1f,ok\n",
+            n, counts[SPINNER], counts[SLEEPER], counts[WAITER], counts[YIELDER],
+            create_ns / 1e6, n * 1e9 / (create_ns ? create_ns : 1),
+            (rss_created - rss_base) / n, (rss_running - rss_base) / n,
+            phase_ns / 1e6, switches, switches ? (double) phase_ns / switches : 0.0,
+            yields, sleeps, mean, count ? wakeups[(count * 99) / 100] : 0,
+            count ? wakeups[count - 1] : 0, teardown_ns / 1e6) ;
+
+   task_exit (0) ;
+}
+
+void usage (const char *name)
+{
+   fprintf (stderr, "Uso: %s [-n 100,1000,...] [-m cpu:dorme:espera:cede] [-d duracao ms]\n"
+                    "          [-s sono max ms] [-w workers] [-o resultados.csv]\n", name) ;
+   exit (2) ;
+}
+
+int main (int argc, char *argv[])
+{
+   const char *output = "bench/stress.csv" ;
+   char *item, *save ;
+   int opt, fd, status, r, i ;
+   pid_t pid ;
+
+   while ((opt = getopt (argc, argv, "n:m:d:s:w:o:")) != -1)
+   {
+      switch (opt)
+      {
+         case 'n':
+            num_sizes = 0 ;
+            for (item = strtok_r (optarg, ",", &save); item && num_sizes < MAX_SIZES; item = strtok_r (NULL, ",", &save))
+               sizes[num_sizes++] = atol (item) ;
+            break ;
+         case 'm':
+            if (sscanf (optarg, "%d:%d:%d:%d", &mix[SPINNER], &mix[SLEEPER], &mix[WAITER], &mix[YIELDER]) != 4)
+               usage (argv[0]) ;
+            break ;
+         case 'd': duration = atoi (optarg) ; break ;
+         case 's': max_sleep = atoi (optarg) ; break ;
+         case 'w': workers = atoi (optarg) ; break ;
+         case 'o': output = optarg ; break ;
+         default: usage (argv[0]) ;
+      }
+   }
+
+   for (r=0; r<ROLES; r++)
+      if (mix[r] < 0)
+         usage (argv[0]) ;
+   // tarefas que esperam precisam de alguem que termine
+   if (mix[SPINNER] + mix[SLEEPER] + mix[YIELDER] == 0 || max_sleep < 1 || duration < 1)
+      usage (argv[0]) ;
+
+   fd = open (output, O_WRONLY | O_CREAT | O_TRUNC, 0644) ;
+   if (fd < 0)
+   {
+      perror (output) ;
+      exit (1) ;
+   }
+   dprintf (fd, "tasks,spinners,sleepers,waiters,yielders,create_ms,create_per_s,"
+                "rss_created_per_task,rss_running_per_task,phase_ms,switches,switch_ns,"
+                "yields,sleeps,wake_late_mean_us,wake_late_p99_us,wake_late_max_us,"
+                "teardown_ms,status\n") ;
+
+   fprintf (stderr, "stress: mistura %s %d%% %s %d%% %s %d%% %s %d%%, %d ms por medida\n",
+           role_names[SPINNER], mix[SPINNER], role_names[SLEEPER], mix[SLEEPER],
+           role_names[WAITER], mix[WAITER], role_names[YIELDER], mix[YIELDER], duration) ;
+
+   // um processo por N: as pilhas das tarefas terminadas nao sao liberadas
+   for (i=0; i<num_sizes; i++)
+   {
+      fprintf (stderr, "stress: %ld tarefas\n", sizes[i]) ;
+      fflush (stdout) ;
+
+      pid = new_process () ;
+      if (pid < 0)
+      {
+         perror ("fork") ;
+         exit (1) ;
+      }
+      if (pid == 0)
+         run (sizes[i], fd) ;
+
+      if (waitpid (pid, &status, 0) < 0 || !WIFEXITED (status) || WEXITSTATUS (status) != 0)
+      {
+         fprintf (stderr, "stress: medida com %ld tarefas falhou\n", sizes[i]) ;
+         dprintf (fd, "%ld,,,,,,,,,,,,,,,,,,failed\n", sizes[i]) ;
+      }
+   }
+
+   close (fd) ;
+   fprintf (stderr, "stress: resultados em %s\n", output) ;
+   exit (0) ;
+}
@@ -0,0 +1,127 @@
+// PingPongOS - PingPong Operating System
+
+// Pool de tarefas contra uma tarefa por trabalho: o mesmo numero de
+// trabalhos curtos roda com task_init (pilha e contexto novos a cada
+// trabalho), com task_spawn (descritor e pilha reciclados do slab) e num
+// pool de tarefas de vida longa. Os trabalhos sao criados em levas e
+// esperados ao fim de cada leva. Imprime uma linha CSV por modo, com
+// trabalhos por segundo.
+// Uso: task_pool [trabalhos] [iteracoes_por_trabalho] [tarefas_do_pool] [workers]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+// ppos.h proibe clock_gettime, o relogio e definido antes dele
+static uint64_t now_ns ()
+{
+   struct timespec ts ;
+
+   clock_gettime (CLOCK_MONOTONIC, &ts) ;
+   return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec ;
+}
+
+#include "ppos.h"
+#include "ppos_runtime.h"
+#include "worker.h"
+#include "pool.h"
+
+#define WAVE 64
+
+enum { TASK_INIT, TASK_SPAWN, TASK_POOL, MODES } ;
+
+const char *mode_names[MODES] = { "task_init", "task_spawn", "pool" } ;
+
+int num_jobs = 50000, work = 100, pool_size = 4, num_workers = 1, mode ;
+volatile long sink ;
+uint64_t elapsed ;
+task_t wave_tasks[WAVE] ;
+
+void Work (void * arg)
+{
+   long sum = 0 ;
+   int i ;
+
+   for (i=0; i<work; i++)
+      sum += i ^ (long) arg ;
+   sink += sum ;
+}
+
+void JobTask (void * arg)
+{
+   Work (arg) ;
+   task_exit (0) ;
+}
+
+void Main (void * arg)
+{
+   task_handle_t handles[WAVE] ;
+   task_pool_t *pool = NULL ;
+   uint64_t t0 ;
+   int done, i, n ;
+
+   if (mode == TASK_POOL)
+      pool = task_pool_create (pool_size) ;
+
+   t0 = now_ns () ;
+   for (done=0; done<num_jobs; done+=n)
+   {
+      n = num_jobs - done < WAVE ? num_jobs - done : WAVE ;
+      for (i=0; i<n; i++)
+      {
+         if (mode == TASK_INIT)
+            task_init (&wave_tasks[i], JobTask, (void *) (long) (done + i)) ;
+         else if (mode == TASK_SPAWN)
+            handles[i] = task_spawn (JobTask, (void *) (long) (done + i)) ;
+         else
+            task_pool_submit (pool, Work, (void *) (long) (done + i)) ;
+      }
+
+      if (mode == TASK_POOL)
+         task_pool_flush (pool) ;
+      for (i=0; i<n && mode != TASK_POOL; i++)
+      {
+         if (mode == TASK_INIT)
+            task_wait (&wave_tasks[i]) ;
+         else
+            task_join (handles[i], NULL) ;
+      }
+   }
+   elapsed = now_ns () - t0 ;
+
+   if (pool != NULL)
+      task_pool_destroy (pool) ;
+   task_exit (0) ;
+}
+
+int main (int argc, char *argv[])
+{
+   if (argc > 1)
+      num_jobs = atoi (argv[1]) ;
+   if (argc > 2)
+      work = atoi (argv[2]) ;
+   if (argc > 3)
+      pool_size = atoi (argv[3]) ;
+   if (argc > 4)
+      num_workers = atoi (argv[4]) ;
+   if (num_jobs < 1 || work < 0 || pool_size < 1 || num_workers < 1)
+   {
+      fprintf (stderr, "Uso: %s [trabalhos] [iteracoes_por_trabalho] [tarefas_do_pool] [workers]\n", argv[0]) ;
+      exit (1) ;
+   }
+
+   printf ("modo,trabalhos,iteracoes,tarefas_do_pool,workers,trabalhos_por_s\n") ;
+   for (mode=0; mode<MODES; mode++)
+   {
+      ppos_workers (num_workers) ;
+      if (ppos_run (Main, NULL) < 0)
+      {
+         fprintf (stderr, "task_pool: erro ao executar\n") ;
+         exit (1) ;
+      }
+      printf ("%s,%d,%d,%d,%d,%.0f\n", mode_names[mode], num_jobs, work, pool_size, num_workers,
+              num_jobs * 1e9 / elapsed) ;
+   }
+   exit (0) ;
+}
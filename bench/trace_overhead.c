@@ -0,0 +1,73 @@
+// PingPongOS - PingPong Operating System
+
+// Benchmark do custo do rastreamento: tarefas cedem o processador em laco
+// com o rastreamento desligado e ligado; com um arquivo, o rastreamento e
+// gravado para o conversor (tools/bin/trace_convert).
+// Uso: trace_overhead [tarefas] [yields por tarefa] [arquivo]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "ppos.h"
+#include "trace.h"
+
+#define MAX_TASKS 64
+
+task_t tasks[MAX_TASKS] ;
+int num_tasks, yields ;
+
+void Body (void * arg)
+{
+   int i ;
+
+   for (i=0; i<yields; i++)
+      task_yield () ;
+   task_exit (0) ;
+}
+
+// tempo para todas as tarefas cederem o processador yields vezes
+unsigned int run ()
+{
+   unsigned int start = systime () ;
+   int i ;
+
+   for (i=0; i<num_tasks; i++)
+      task_init (&tasks[i], Body, NULL) ;
+   for (i=0; i<num_tasks; i++)
+      task_wait (&tasks[i]) ;
+
+   return systime () - start ;
+}
+
+int main (int argc, char *argv[])
+{
+   unsigned int off, on ;
+   long events ;
+
+   num_tasks = (argc > 1) ? atoi (argv[1]) : 4 ;
+   yields = (argc > 2) ? atoi (argv[2]) : 50000 ;
+   if (num_tasks < 1 || num_tasks > MAX_TASKS)
+      num_tasks = MAX_TASKS ;
+
+   ppos_init () ;
+
+   printf ("trace_overhead: %d tarefas x %d yields\n", num_tasks, yields) ;
+
+   off = run () ;
+
+   // cada yield gera um evento de yield e duas trocas de contexto
+   if (trace_start (3 * yields * num_tasks + 1024) < 0)
+      exit (1) ;
+   on = run () ;
+   trace_stop () ;
+
+   printf ("trace_overhead: desligado %u ms, %.0f yields/ms\n", off, (double) num_tasks * yields / (off ? off : 1)) ;
+   printf ("trace_overhead: ligado    %u ms, %.0f yields/ms\n", on, (double) num_tasks * yields / (on ? on : 1)) ;
+
+   if (argc > 3)
+   {
+      events = trace_dump (argv[3]) ;
+      printf ("trace_overhead: %ld eventos gravados em %s\n", events, argv[3]) ;
+   }
+
+   task_exit (0) ;
+}
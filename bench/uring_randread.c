@@ -0,0 +1,116 @@
+// PingPongOS - PingPong Operating System
+
+// Benchmark de leituras aleatorias de 4 KiB num arquivo local, com
+// profundidades de fila de 1 a 256 (uma tarefa por requisicao em voo).
+// Uso: uring_randread [arquivo] [MiB] [leituras] [direct]
+// PPOS_URING=0 mede o caminho sincrono; "direct" evita o cache de paginas
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// O_DIRECT exige _GNU_SOURCE, e ppos.h define o seu proprio _XOPEN_SOURCE
+#undef _XOPEN_SOURCE
+#include "ppos.h"
+#include "uring.h"
+
+#define BLOCK_SIZE 4096
+#define MAX_DEPTH 256
+
+task_t tasks[MAX_DEPTH] ;
+int fd, reads_per_task, errors = 0 ;
+long blocks ;
+
+// le blocos aleatorios do arquivo
+void Reader (void * arg)
+{
+   unsigned int seed = (unsigned int)(long) arg ;
+   char buf[BLOCK_SIZE] __attribute__((aligned(BLOCK_SIZE))) ;
+   off_t offset ;
+   int i ;
+
+   for (i=0; i<reads_per_task; i++)
+   {
+      offset = (off_t)(rand_r (&seed) % blocks) * BLOCK_SIZE ;
+      if (task_pread (fd, buf, sizeof(buf), offset) != sizeof(buf))
+         errors++ ;
+   }
+   task_exit (0) ;
+}
+
+// cria o arquivo de teste, se preciso
+int prepare_file (const char *path, long size, int direct)
+{
+   char buf[BLOCK_SIZE] ;
+   long i ;
+
+   fd = open (path, O_RDWR | O_CREAT, 0644) ;
+   if (fd < 0)
+      return -1 ;
+
+   if (lseek (fd, 0, SEEK_END) < size)
+   {
+      for (i=0; i<size / BLOCK_SIZE; i++)
+      {
+         memset (buf, (int) i, sizeof(buf)) ;
+         if (pwrite (fd, buf, sizeof(buf), i * BLOCK_SIZE) != sizeof(buf))
+            return -1 ;
+      }
+      if (fsync (fd) < 0)
+         return -1 ;
+   }
+
+   if (!direct)
+      return 0 ;
+
+   close (fd) ;
+   fd = open (path, O_RDONLY | O_DIRECT) ;
+   return fd < 0 ? -1 : 0 ;
+}
+
+int main (int argc, char *argv[])
+{
+   const char *path = (argc > 1) ? argv[1] : "/tmp/ppos_randread.dat" ;
+   long size = ((argc > 2) ? atol (argv[2]) : 64) * 1024 * 1024 ;
+   int reads = (argc > 3) ? atoi (argv[3]) : 16384 ;
+   int direct = (argc > 4) && !strcmp (argv[4], "direct") ;
+   unsigned int start, elapsed ;
+   int depth, i ;
+
+   if (prepare_file (path, size, direct) < 0)
+   {
+      perror ("uring_randread: erro ao preparar o arquivo") ;
+      exit (1) ;
+   }
+   blocks = size / BLOCK_SIZE ;
+
+   ppos_init () ;
+
+   printf ("uring_randread: %s, %ld MiB, %d leituras por profundidade, modo %s%s\n",
+           path, size / (1024 * 1024), reads, ppos_uring () ? "io_uring" : "sincrono",
+           direct ? ", O_DIRECT" : "") ;
+
+   for (depth=1; depth<=MAX_DEPTH; depth*=2)
+   {
+      reads_per_task = reads / depth ;
+
+      start = systime () ;
+      for (i=0; i<depth; i++)
+         task_init (&tasks[i], Reader, (void *)(long)(depth * MAX_DEPTH + i)) ;
+      for (i=0; i<depth; i++)
+         task_wait (&tasks[i]) ;
+      elapsed = systime () - start ;
+
+      printf ("uring_randread: qd %3d: %5u ms, %8.0f IOPS\n", depth, elapsed,
+              elapsed ? (double) reads_per_task * depth * 1000.0 / elapsed : 0.0) ;
+   }
+
+   printf ("uring_randread: %d erros\n", errors) ;
+
+   close (fd) ;
+   task_exit (0) ;
+}
@@ -0,0 +1,621 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/mman.h>
+
+#include "cache.h"
+#include "disk.h"
+#include "queue.h"
+#include "quantum.h"
+#include "worker.h"
+#include "trace.h"
+#include "ppos.h"
+#include "logger.h"
+
+#define BITS_PER_WORD (8 * sizeof(unsigned long))
+
+/*
+ * A sequential scan: the last block read, how many blocks in a row were
+ * read and the last block already queued for read-ahead
+ */
+typedef struct cache_stream_t
+{
+    int last;
+    int run;
+    int ahead;
+    unsigned int used;
+} cache_stream_t;
+
+/*
+ * Every block has a state in five bitmaps: present once it was read from
+ * (or written to) the cache, dirty until the flusher writes it back,
+ * wanted while it waits for a read-ahead task, loading while a disk read
+ * for it is in flight and prefetched while it was brought in by read-ahead
+ * and not yet used. The mapping is
+ * private, so only the flusher updates the image and a block is only ever
+ * copied in or out of the mapping with the core lock held
+ */
+typedef struct cache_t
+{
+    char *map;
+    size_t size;
+    int num_blocks;
+    int block_size;
+    unsigned long *present;
+    unsigned long *dirty;
+    unsigned long *wanted;
+    unsigned long *loading;
+    unsigned long *prefetched;
+    unsigned int nr_dirty;
+    unsigned int nr_wanted;
+    unsigned int flushing;
+    cache_stream_t streams[CACHE_STREAMS];
+    unsigned int clock;
+    char *ra_buffers;
+    char *flush_buffer;
+    task_t flusher;
+    task_t readers[CACHE_READERS];
+    bool flusher_idle;
+    int idle_readers;
+    task_t *flusher_queue;
+    task_t *reader_queue;
+    task_t *load_waiters;
+    cache_stats_t stats;
+} cache_t;
+
+static bool _test(unsigned long *bitmap, int block)
+{
+    return (bitmap[block / BITS_PER_WORD] >> (block % BITS_PER_WORD)) & 1;
+}
+
+static void _set(unsigned long *bitmap, int block)
+{
+    bitmap[block / BITS_PER_WORD] |= 1UL << (block % BITS_PER_WORD);
+}
+
+static void _clear(unsigned long *bitmap, int block)
+{
+    bitmap[block / BITS_PER_WORD] &= ~(1UL << (block % BITS_PER_WORD));
+}
+
+// first set bit at or after block, num_blocks if there is none
+static int _next_set(cache_t *cache, unsigned long *bitmap, int block)
+{
+    int words = (cache->num_blocks + BITS_PER_WORD - 1) / BITS_PER_WORD;
+    int word = block / BITS_PER_WORD;
+
+    if (word >= words) {
+        return cache->num_blocks;
+    }
+
+    unsigned long bits = bitmap[word] & (~0UL << (block % BITS_PER_WORD));
+
+    while (bits == 0) {
+        if (++word == words) {
+            return cache->num_blocks;
+        }
+        bits = bitmap[word];
+    }
+
+    return word * BITS_PER_WORD + __builtin_ctzl(bits);
+}
+
+static char* _data(cache_t *cache, int block)
+{
+    return cache->map + (size_t)block * cache->block_size;
+}
+
+static int _check(cache_t *cache, int block, void *buffer, const char *func)
+{
+    (void)func;
+
+    if (cache == NULL) {
+        LOG_ERR("%s: cache not initialized", func);
+        return -1;
+    }
+
+    if (block < 0 || block >= cache->num_blocks || buffer == NULL) {
+        LOG_ERR("%s: invalid block %d or NULL buffer", func, block);
+        return -1;
+    }
+
+    return 0;
+}
+
+// called with the core lock held: makes every task of the queue ready and
+// moves it to woken, to be enqueued once the lock is released
+static void _take_all(ppos_core_t *core, task_t **queue, task_t **woken)
+{
+    task_t *task;
+
+    while ((task = *queue) != NULL) {
+        queue_remove((queue_t**)queue, (queue_t*)task);
+        task->status = TASK_STATUS_READY;
+        TRACE(TRACE_WAKE, task->id, 0);
+        __atomic_add_fetch(&core->nr_runnable, 1, __ATOMIC_RELAXED);
+        queue_append((queue_t**)woken, (queue_t*)task);
+    }
+}
+
+static void _enqueue_all(ppos_core_t *core, task_t **woken)
+{
+    task_t *task;
+
+    while ((task = *woken) != NULL) {
+        queue_remove((queue_t**)woken, (queue_t*)task);
+        core->ready_enqueue(task);
+    }
+}
+
+// called with the core lock held: a read of the block right after the
+// last one of a stream extends that scan, any other read replaces the least
+// recently used stream. Once a scan is long enough, the blocks after it
+// that are not cached yet become wanted and the idle readers are woken
+static void _detect_scan(ppos_core_t *core, cache_t *cache, int block, task_t **woken)
+{
+    cache_stream_t *stream = NULL;
+    cache_stream_t *oldest = &cache->streams[0];
+
+    for (int i = 0; i < CACHE_STREAMS && stream == NULL; i++) {
+        if (cache->streams[i].last + 1 == block) {
+            stream = &cache->streams[i];
+        } else if (cache->streams[i].used < oldest->used) {
+            oldest = &cache->streams[i];
+        }
+    }
+
+    if (stream != NULL) {
+        stream->run++;
+    } else {
+        stream = oldest;
+        stream->run = 0;
+        stream->ahead = block;
+    }
+
+    stream->last = block;
+    stream->used = ++cache->clock;
+
+    if (stream->run < CACHE_SCAN_MIN) {
+        return;
+    }
+
+    int end = block + CACHE_READAHEAD;
+    if (end >= cache->num_blocks) {
+        end = cache->num_blocks - 1;
+    }
+
+    for (int next = stream->ahead > block ? stream->ahead + 1 : block + 1; next <= end; next++) {
+        if (!_test(cache->present, next) && !_test(cache->loading, next) && !_test(cache->wanted, next)) {
+            _set(cache->wanted, next);
+            cache->nr_wanted++;
+        }
+    }
+
+    if (end > stream->ahead) {
+        stream->ahead = end;
+    }
+
+    if (cache->nr_wanted > 0 && cache->idle_readers > 0) {
+        cache->idle_readers = 0;
+        _take_all(core, &cache->reader_queue, woken);
+    }
+}
+
+// reads a missing block into buffer and installs it, unless a write made
+// the block present meanwhile, then wakes the tasks waiting for it
+static int _load(ppos_core_t *core, cache_t *cache, int block, void *buffer)
+{
+    int result = disk_block_read(block, buffer);
+    task_t *woken = NULL;
+
+    core->lock_core();
+
+    _clear(cache->loading, block);
+
+    if (_test(cache->present, block)) {
+        memcpy(buffer, _data(cache, block), cache->block_size);
+        result = 0;
+    } else if (result == 0) {
+        memcpy(_data(cache, block), buffer, cache->block_size);
+        _set(cache->present, block);
+    }
+
+    _take_all(core, &cache->load_waiters, &woken);
+
+    core->unlock_core();
+
+    _enqueue_all(core, &woken);
+
+    return result;
+}
+
+// writes the dirty blocks back in ascending batches, sweeping the disk
+// once; blocks dirtied behind the sweep are left for the next one. A batch
+// is copied to staging, CACHE_FLUSH_BATCH blocks, under the lock, so a
+// write of a block while it goes to the disk never tears it
+static int _flush(ppos_core_t *core, cache_t *cache, char *staging)
+{
+    int batch[CACHE_FLUSH_BATCH];
+    int cursor = 0;
+    int result = 0;
+
+    while (true) {
+        int count = 0;
+
+        core->lock_core();
+
+        while (count < CACHE_FLUSH_BATCH) {
+            cursor = _next_set(cache, cache->dirty, cursor);
+            if (cursor == cache->num_blocks) {
+                break;
+            }
+
+            _clear(cache->dirty, cursor);
+            memcpy(staging + (size_t)count * cache->block_size, _data(cache, cursor), cache->block_size);
+            batch[count++] = cursor++;
+        }
+
+        if (count > 0) {
+            cache->nr_dirty -= count;
+            cache->flushing += count;
+            cache->stats.flushes++;
+            cache->stats.flushed += count;
+
+            if ((unsigned int)count > cache->stats.max_batch) {
+                cache->stats.max_batch = count;
+            }
+        }
+
+        core->unlock_core();
+
+        if (count == 0) {
+            return result;
+        }
+
+        LOG_INFO("cache_flush: writing %d blocks from %d to %d", count, batch[0], batch[count - 1]);
+
+        for (int i = 0; i < count; i++) {
+            if (disk_block_write(batch[i], staging + (size_t)i * cache->block_size) < 0) {
+                LOG_ERR("cache_flush: failed to write block %d", batch[i]);
+                result = -1;
+            }
+        }
+
+        core->lock_core();
+        cache->flushing -= count;
+        core->unlock_core();
+    }
+}
+
+// background task: waits for dirty blocks, lets more writes gather for a
+// while and writes them back
+static void _flusher_body(void *arg)
+{
+    cache_t *cache = arg;
+    ppos_core_t *core = worker_core();
+
+    while (true) {
+        task_t *task = worker_self()->current_task;
+
+        quantum_release(task, false);
+        core->ready_dequeue(task);
+
+        core->lock_core();
+
+        if (cache->nr_dirty == 0) {
+            cache->flusher_idle = true;
+            core->suspend_locked(&cache->flusher_queue);
+            continue;
+        }
+
+        core->unlock_core();
+
+        task_sleep(CACHE_FLUSH_MS);
+        _flush(core, cache, cache->flush_buffer);
+    }
+}
+
+// background task: reads the wanted blocks, lowest first. Several readers
+// take blocks at the same time, so a read-ahead window is queued on the
+// disk at once
+static void _reader_body(void *arg)
+{
+    cache_t *cache = arg;
+    ppos_core_t *core = worker_core();
+    char *buffer = cache->ra_buffers + (worker_self()->current_task - cache->readers) * cache->block_size;
+
+    while (true) {
+        task_t *task = worker_self()->current_task;
+
+        quantum_release(task, false);
+        core->ready_dequeue(task);
+
+        core->lock_core();
+
+        // a read or a write of a wanted block may have got to it first
+        int block = _next_set(cache, cache->wanted, 0);
+        while (block < cache->num_blocks && (_test(cache->present, block) || _test(cache->loading, block))) {
+            _clear(cache->wanted, block);
+            cache->nr_wanted--;
+            block = _next_set(cache, cache->wanted, block + 1);
+        }
+
+        if (block == cache->num_blocks) {
+            cache->idle_readers++;
+            core->suspend_locked(&cache->reader_queue);
+            continue;
+        }
+
+        _clear(cache->wanted, block);
+        cache->nr_wanted--;
+        _set(cache->loading, block);
+        _set(cache->prefetched, block);
+        cache->stats.readahead++;
+
+        core->unlock_core();
+
+        LOG_DEBUG("cache_reader: prefetching block %d", block);
+        _load(core, cache, block, buffer);
+    }
+}
+
+static void _destroy(cache_t *cache)
+{
+    if (cache->map != NULL && cache->map != MAP_FAILED) {
+        munmap(cache->map, cache->size);
+    }
+
+    free(cache->present);
+    free(cache->dirty);
+    free(cache->wanted);
+    free(cache->loading);
+    free(cache->prefetched);
+    free(cache->ra_buffers);
+    free(cache->flush_buffer);
+    free(cache);
+}
+
+int cache_init(int *num_blocks, int *block_size)
+{
+    ppos_core_t *core = worker_core();
+
+    if (core->cache == NULL) {
+        int blocks, size;
+
+        if (disk_mgr_init(&blocks, &size) < 0) {
+            LOG_ERR0("cache_init: failed to start the disk");
+            return -1;
+        }
+
+        size_t words = (blocks + BITS_PER_WORD - 1) / BITS_PER_WORD;
+
+        // the allocator is not reentrant, so no other task may run meanwhile
+        core->block_task_switch();
+
+        cache_t *cache = calloc(1, sizeof(cache_t));
+        if (cache != NULL) {
+            cache->present = calloc(words, sizeof(unsigned long));
+            cache->dirty = calloc(words, sizeof(unsigned long));
+            cache->wanted = calloc(words, sizeof(unsigned long));
+            cache->loading = calloc(words, sizeof(unsigned long));
+            cache->prefetched = calloc(words, sizeof(unsigned long));
+            cache->ra_buffers = malloc((size_t)CACHE_READERS * size);
+            cache->flush_buffer = malloc((size_t)CACHE_FLUSH_BATCH * size);
+        }
+
+        core->enable_task_switch();
+
+        if (cache == NULL || cache->present == NULL || cache->dirty == NULL || cache->wanted == NULL ||
+            cache->loading == NULL || cache->prefetched == NULL || cache->ra_buffers == NULL ||
+            cache->flush_buffer == NULL) {
+            LOG_ERR0("cache_init: failed to allocate cache");
+            if (cache != NULL) {
+                _destroy(cache);
+            }
+            return -1;
+        }
+
+        cache->num_blocks = blocks;
+        cache->block_size = size;
+        cache->size = (size_t)blocks * size;
+
+        for (int i = 0; i < CACHE_STREAMS; i++) {
+            cache->streams[i].last = -2;
+        }
+
+        cache->map = mmap(NULL, cache->size, PROT_READ | PROT_WRITE, MAP_PRIVATE, disk_image_fd(), 0);
+
+        if (cache->map == MAP_FAILED) {
+            LOG_ERR("cache_init: failed to map the disk image: \"%s\"", strerror(errno));
+            _destroy(cache);
+            return -1;
+        }
+
+        core->cache = cache;
+
+        task_init(&cache->flusher, _flusher_body, cache);
+        for (int i = 0; i < CACHE_READERS; i++) {
+            task_init(&cache->readers[i], _reader_body, cache);
+        }
+
+        LOG_INFO("cache_init: caching %d blocks of %d bytes", blocks, size);
+    }
+
+    if (num_blocks != NULL) {
+        *num_blocks = core->cache->num_blocks;
+    }
+
+    if (block_size != NULL) {
+        *block_size = core->cache->block_size;
+    }
+
+    return 0;
+}
+
+int cache_block_read(int block, void *buffer)
+{
+    ppos_core_t *core = worker_core();
+    cache_t *cache = core->cache;
+
+    if (_check(cache, block, buffer, "cache_block_read") < 0) {
+        return -1;
+    }
+
+    task_t *woken = NULL;
+
+    core->lock_core();
+
+    _detect_scan(core, cache, block, &woken);
+    bool hit = _test(cache->present, block);
+    bool load = !hit && !_test(cache->loading, block);
+
+    if (hit) {
+        memcpy(buffer, _data(cache, block), cache->block_size);
+        cache->stats.hits++;
+
+        if (_test(cache->prefetched, block)) {
+            _clear(cache->prefetched, block);
+            cache->stats.readahead_hits++;
+        }
+    } else {
+        cache->stats.misses++;
+
+        if (load) {
+            _set(cache->loading, block);
+        }
+    }
+
+    core->unlock_core();
+
+    _enqueue_all(core, &woken);
+
+    if (hit) {
+        return 0;
+    }
+
+    if (load) {
+        return _load(core, cache, block, buffer);
+    }
+
+    // another task is reading the block: wait until it is installed
+    task_t *task = worker_self()->current_task;
+
+    while (true) {
+        quantum_release(task, false);
+        core->ready_dequeue(task);
+
+        core->lock_core();
+
+        if (_test(cache->present, block)) {
+            memcpy(buffer, _data(cache, block), cache->block_size);
+            core->unlock_core();
+            return 0;
+        }
+
+        if (!_test(cache->loading, block)) {
+            core->unlock_core();
+            LOG_ERR("cache_block_read: failed to read block %d", block);
+            return -1;
+        }
+
+        LOG_DEBUG("cache_block_read: task %d waiting for block %d", task->id, block);
+        core->suspend_locked(&cache->load_waiters);
+    }
+}
+
+int cache_block_write(int block, void *buffer)
+{
+    ppos_core_t *core = worker_core();
+    cache_t *cache = core->cache;
+
+    if (_check(cache, block, buffer, "cache_block_write") < 0) {
+        return -1;
+    }
+
+    core->lock_core();
+
+    memcpy(_data(cache, block), buffer, cache->block_size);
+    _set(cache->present, block);
+
+    if (!_test(cache->dirty, block)) {
+        _set(cache->dirty, block);
+        cache->nr_dirty++;
+    }
+
+    bool wake_flusher = cache->flusher_idle;
+    cache->flusher_idle = false;
+
+    core->unlock_core();
+
+    if (wake_flusher) {
+        task_awake(&cache->flusher, &cache->flusher_queue);
+    }
+
+    return 0;
+}
+
+int cache_sync()
+{
+    ppos_core_t *core = worker_core();
+    cache_t *cache = core->cache;
+
+    if (cache == NULL) {
+        LOG_ERR0("cache_sync: cache not initialized");
+        return -1;
+    }
+
+    // the flusher stages its batches in its own buffer
+    core->block_task_switch();
+    char *staging = malloc((size_t)CACHE_FLUSH_BATCH * cache->block_size);
+    core->enable_task_switch();
+
+    if (staging == NULL) {
+        LOG_ERR0("cache_sync: failed to allocate staging buffer");
+        return -1;
+    }
+
+    int result = _flush(core, cache, staging);
+
+    // the flusher may still be writing blocks it took before the sweep
+    while (__atomic_load_n(&cache->flushing, __ATOMIC_RELAXED) > 0 ||
+           __atomic_load_n(&cache->nr_dirty, __ATOMIC_RELAXED) > 0) {
+        if (__atomic_load_n(&cache->nr_dirty, __ATOMIC_RELAXED) == 0) {
+            task_sleep(1);
+        } else if (_flush(core, cache, staging) < 0) {
+            result = -1;
+        }
+    }
+
+    core->block_task_switch();
+    free(staging);
+    core->enable_task_switch();
+
+    return result;
+}
+
+int cache_getstats(cache_stats_t *stats)
+{
+    ppos_core_t *core = worker_core();
+
+    if (core->cache == NULL || stats == NULL) {
+        LOG_ERR0("cache_getstats: cache not initialized or NULL stats");
+        return -1;
+    }
+
+    core->lock_core();
+    *stats = core->cache->stats;
+    stats->dirty = core->cache->nr_dirty;
+    core->unlock_core();
+
+    return 0;
+}
+
+void cache_destroy(ppos_core_t *core)
+{
+    if (core == NULL || core->cache == NULL) {
+        return;
+    }
+
+    _destroy(core->cache);
+    core->cache = NULL;
+}
@@ -0,0 +1,84 @@
+#ifndef __CACHE_H__
+#define __CACHE_H__
+
+#include "ppos_data.h"
+
+#define CACHE_FLUSH_MS 20
+#define CACHE_FLUSH_BATCH 64
+#define CACHE_SCAN_MIN 2
+#define CACHE_READAHEAD 8
+#define CACHE_READERS 4
+#define CACHE_STREAMS 16
+
+/*
+ * Block cache in front of the simulated disk: the disk image is mapped
+ * privately, so a block costs one disk read the first time it is used and
+ * is served from memory afterwards. Writes only mark the block dirty; a
+ * flusher task writes dirty blocks back in ascending batches, and
+ * read-ahead tasks prefetch the blocks after a sequential scan
+ */
+
+typedef struct cache_stats_t
+{
+    unsigned int hits;
+    unsigned int misses;
+    unsigned int readahead;
+    unsigned int readahead_hits;
+    unsigned int flushes;
+    unsigned int flushed;
+    unsigned int max_batch;
+    unsigned int dirty;
+} cache_stats_t;
+
+/*
+ * @brief Put the cache in front of the disk of the calling task's runtime,
+ *        starting the disk manager if needed
+ * @param num_blocks: receives the number of blocks of the disk
+ * @param block_size: receives the size of a block in bytes
+ * @return 0 on success, < 0 on error
+ */
+int cache_init(int *num_blocks, int *block_size);
+
+/*
+ * @brief Read a block; cached blocks are copied without suspending, misses
+ *        suspend the task until the disk read completes
+ * @param block: block number
+ * @param buffer: destination, block_size bytes
+ * @return 0 on success, < 0 on error
+ */
+int cache_block_read(int block, void *buffer);
+
+/*
+ * @brief Write a block into the cache and mark it dirty, never suspending
+ * @param block: block number
+ * @param buffer: source, block_size bytes
+ * @return 0 on success, < 0 on error
+ */
+int cache_block_write(int block, void *buffer);
+
+/*
+ * @brief Write every dirty block back to the disk, suspending the current
+ *        task until they are all written
+ * @return 0 on success, < 0 on error
+ */
+int cache_sync();
+
+/*
+ * @brief Get the cache counters
+ * @param stats: receives the counters
+ * @return 0 on success, < 0 on error
+ */
+int cache_getstats(cache_stats_t *stats);
+
+/*
+ * Runtime internals, used by the core
+ */
+
+/*
+ * @brief Unmap the cache of a runtime
+ * @param core: pointer to the ppos core
+ * @return void
+ */
+void cache_destroy(ppos_core_t *core);
+
+#endif
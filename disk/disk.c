@@ -0,0 +1,525 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "disk.h"
+#include "queue.h"
+#include "quantum.h"
+#include "timer.h"
+#include "worker.h"
+#include "trace.h"
+#include "ppos.h"
+#include "logger.h"
+
+#define DISK_TICK_MS 1
+#define DISK_SAMPLES_MIN 256
+
+typedef struct disk_request_t
+{
+    struct disk_request_t *prev, *next;
+    int block;
+    void *buffer;
+    bool write;
+    task_t *task;
+    unsigned long long arrival_us;
+    int result;
+} disk_request_t;
+
+typedef struct disk_policy_stats_t
+{
+    unsigned int *samples;
+    unsigned int count;
+    unsigned int capacity;
+    unsigned long long total_us;
+    unsigned long long head_travel;
+    unsigned int max_us;
+} disk_policy_stats_t;
+
+typedef struct disk_t
+{
+    int fd;
+    disk_config_t config;
+    disk_policy_t policy;
+    disk_request_t* (*pick)(struct disk_t *disk);
+    disk_request_t *queue;
+    disk_request_t *current;
+    unsigned long long done_us;
+    int head;
+    int irq;
+    disk_policy_stats_t stats[DISK_POLICIES];
+} disk_t;
+
+static disk_config_t _config = {
+    .image = DISK_DEFAULT_IMAGE,
+    .block_size = DISK_DEFAULT_BLOCK_SIZE,
+    .num_blocks = DISK_DEFAULT_BLOCKS,
+    .blocks_per_track = DISK_DEFAULT_BLOCKS_PER_TRACK,
+    .seek_min_us = DISK_DEFAULT_SEEK_MIN_US,
+    .seek_track_us = DISK_DEFAULT_SEEK_TRACK_US,
+    .transfer_us = DISK_DEFAULT_TRANSFER_US,
+    .policy = DISK_FCFS,
+};
+
+static const char *_policy_names[DISK_POLICIES] = { "FCFS", "SSTF", "CSCAN" };
+
+static unsigned long long _now_us()
+{
+    return (unsigned long long)systime() * 1000;
+}
+
+static int _track(disk_t *disk, int block)
+{
+    return block / disk->config.blocks_per_track;
+}
+
+static disk_request_t* _pick_fcfs(disk_t *disk)
+{
+    return disk->queue;
+}
+
+// shortest seek first, the oldest request wins a tie
+static disk_request_t* _pick_sstf(disk_t *disk)
+{
+    disk_request_t *best = disk->queue;
+    int best_distance = abs(best->block - disk->head);
+
+    int len = queue_size((queue_t*)disk->queue);
+    disk_request_t *request = disk->queue->next;
+    for (int i = 1; i < len; i++, request = request->next) {
+        int distance = abs(request->block - disk->head);
+
+        if (distance < best_distance) {
+            best = request;
+            best_distance = distance;
+        }
+    }
+
+    return best;
+}
+
+// the head only serves requests while moving up, then jumps back to the
+// lowest pending block
+static disk_request_t* _pick_cscan(disk_t *disk)
+{
+    disk_request_t *ahead = NULL;
+    disk_request_t *lowest = disk->queue;
+
+    int len = queue_size((queue_t*)disk->queue);
+    disk_request_t *request = disk->queue;
+    for (int i = 0; i < len; i++, request = request->next) {
+        if (request->block >= disk->head && (ahead == NULL || request->block < ahead->block)) {
+            ahead = request;
+        }
+
+        if (request->block < lowest->block) {
+            lowest = request;
+        }
+    }
+
+    return ahead != NULL ? ahead : lowest;
+}
+
+static disk_request_t* (*_pickers[DISK_POLICIES])(disk_t *disk) = {
+    _pick_fcfs,
+    _pick_sstf,
+    _pick_cscan,
+};
+
+// called with the core lock held: starts the next request once the device
+// is free, at the later of its arrival and the time the device freed up
+static void _start_next(disk_t *disk, unsigned long long free_us)
+{
+    if (disk->current != NULL || disk->queue == NULL) {
+        return;
+    }
+
+    disk_request_t *request = disk->pick(disk);
+    queue_remove((queue_t**)&disk->queue, (queue_t*)request);
+
+    unsigned int distance = abs(_track(disk, request->block) - _track(disk, disk->head));
+    unsigned long long service_us = disk->config.transfer_us;
+
+    if (distance > 0) {
+        service_us += disk->config.seek_min_us + (unsigned long long)distance * disk->config.seek_track_us;
+    }
+
+    unsigned long long start_us = request->arrival_us > free_us ? request->arrival_us : free_us;
+
+    disk->stats[disk->policy].head_travel += distance;
+    disk->head = request->block;
+    disk->current = request;
+    __atomic_store_n(&disk->done_us, start_us + service_us, __ATOMIC_RELEASE);
+
+    LOG_DEBUG("disk: serving block %d of task %d, %u tracks, done at %llu us",
+              request->block, request->task->id, distance, disk->done_us);
+}
+
+static void _record(disk_policy_stats_t *stats, unsigned int service_us)
+{
+    if (stats->count == stats->capacity) {
+        unsigned int capacity = stats->capacity > 0 ? stats->capacity * 2 : DISK_SAMPLES_MIN;
+        unsigned int *samples = realloc(stats->samples, capacity * sizeof(unsigned int));
+
+        if (samples == NULL) {
+            LOG_WARN0("disk_record: failed to grow service time samples");
+            return;
+        }
+
+        stats->samples = samples;
+        stats->capacity = capacity;
+    }
+
+    stats->samples[stats->count++] = service_us;
+    stats->total_us += service_us;
+
+    if (service_us > stats->max_us) {
+        stats->max_us = service_us;
+    }
+}
+
+static int _transfer(disk_t *disk, disk_request_t *request)
+{
+    off_t offset = (off_t)request->block * disk->config.block_size;
+    ssize_t ret;
+
+    do {
+        if (request->write) {
+            ret = pwrite(disk->fd, request->buffer, disk->config.block_size, offset);
+        } else {
+            ret = pread(disk->fd, request->buffer, disk->config.block_size, offset);
+        }
+    } while (ret < 0 && errno == EINTR);
+
+    return ret == disk->config.block_size ? 0 : -1;
+}
+
+// runs from the timer signal: only raises the interrupt, the dispatcher
+// completes the request
+static void _disk_tick(int signum)
+{
+    (void)signum;
+
+    ppos_core_t *core = worker_core();
+
+    if (core == NULL || core->disk == NULL) {
+        return;
+    }
+
+    disk_t *disk = core->disk;
+
+    if (__atomic_load_n(&disk->current, __ATOMIC_ACQUIRE) != NULL &&
+        _now_us() >= __atomic_load_n(&disk->done_us, __ATOMIC_ACQUIRE)) {
+        __atomic_store_n(&disk->irq, 1, __ATOMIC_RELEASE);
+    }
+}
+
+static int _request(int block, void *buffer, bool write)
+{
+    ppos_core_t *core = worker_core();
+    disk_t *disk = core->disk;
+
+    if (disk == NULL) {
+        LOG_ERR0("disk_request: disk manager not initialized");
+        return -1;
+    }
+
+    if (block < 0 || block >= disk->config.num_blocks || buffer == NULL) {
+        LOG_ERR("disk_request: invalid block %d or NULL buffer", block);
+        return -1;
+    }
+
+    task_t *task = worker_self()->current_task;
+    disk_request_t request;
+
+    memset(&request, 0, sizeof(request));
+    request.block = block;
+    request.buffer = buffer;
+    request.write = write;
+    request.task = task;
+
+    quantum_release(task, false);
+    core->ready_dequeue(task);
+
+    core->lock_core();
+
+    request.arrival_us = _now_us();
+    queue_append((queue_t**)&disk->queue, (queue_t*)&request);
+    _start_next(disk, request.arrival_us);
+    core->io_waiting++;
+
+    LOG_INFO("disk_request: task %d %s block %d", task->id, write ? "writing" : "reading", block);
+    core->suspend_locked(NULL);
+
+    return request.result;
+}
+
+int disk_mgr_config(const disk_config_t *config)
+{
+    if (config == NULL) {
+        LOG_ERR0("disk_mgr_config: config must not be NULL");
+        return -1;
+    }
+
+    if (config->block_size < 0 || config->num_blocks < 0 || config->blocks_per_track < 0 ||
+        config->policy < 0 || config->policy >= DISK_POLICIES) {
+        LOG_ERR0("disk_mgr_config: invalid configuration");
+        return -1;
+    }
+
+    disk_config_t defaults = _config;
+    _config = *config;
+
+    if (_config.image == NULL) {
+        _config.image = defaults.image;
+    }
+
+    if (_config.block_size == 0) {
+        _config.block_size = defaults.block_size;
+    }
+
+    if (_config.num_blocks == 0) {
+        _config.num_blocks = defaults.num_blocks;
+    }
+
+    if (_config.blocks_per_track == 0) {
+        _config.blocks_per_track = defaults.blocks_per_track;
+    }
+
+    if (_config.seek_min_us == 0 && _config.seek_track_us == 0 && _config.transfer_us == 0) {
+        _config.seek_min_us = defaults.seek_min_us;
+        _config.seek_track_us = defaults.seek_track_us;
+        _config.transfer_us = defaults.transfer_us;
+    }
+
+    return 0;
+}
+
+int disk_mgr_init(int *num_blocks, int *block_size)
+{
+    ppos_core_t *core = worker_core();
+
+    if (core->disk == NULL) {
+        disk_t *disk = calloc(1, sizeof(disk_t));
+        if (disk == NULL) {
+            LOG_ERR0("disk_mgr_init: failed to allocate disk");
+            return -1;
+        }
+
+        disk->config = _config;
+        disk->fd = open(disk->config.image, O_RDWR | O_CREAT, 0644);
+
+        off_t size = (off_t)disk->config.num_blocks * disk->config.block_size;
+        if (disk->fd < 0 || (lseek(disk->fd, 0, SEEK_END) < size && ftruncate(disk->fd, size) < 0)) {
+            LOG_ERR("disk_mgr_init: failed to open image \"%s\": \"%s\"", disk->config.image, strerror(errno));
+            if (disk->fd >= 0) {
+                close(disk->fd);
+            }
+            free(disk);
+            return -1;
+        }
+
+        disk->policy = disk->config.policy;
+        disk->pick = _pickers[disk->policy];
+        core->disk = disk;
+
+        register_timer(_disk_tick, DISK_TICK_MS);
+        LOG_INFO("disk_mgr_init: %d blocks of %d bytes on \"%s\", policy %s", disk->config.num_blocks,
+                 disk->config.block_size, disk->config.image, _policy_names[disk->policy]);
+    }
+
+    if (num_blocks != NULL) {
+        *num_blocks = core->disk->config.num_blocks;
+    }
+
+    if (block_size != NULL) {
+        *block_size = core->disk->config.block_size;
+    }
+
+    return 0;
+}
+
+int disk_block_read(int block, void *buffer)
+{
+    return _request(block, buffer, false);
+}
+
+int disk_block_write(int block, void *buffer)
+{
+    return _request(block, buffer, true);
+}
+
+int disk_set_policy(disk_policy_t policy)
+{
+    ppos_core_t *core = worker_core();
+
+    if (core->disk == NULL || policy < 0 || policy >= DISK_POLICIES) {
+        LOG_ERR("disk_set_policy: disk not initialized or invalid policy %d", policy);
+        return -1;
+    }
+
+    core->lock_core();
+    core->disk->policy = policy;
+    core->disk->pick = _pickers[policy];
+    core->unlock_core();
+
+    LOG_INFO("disk_set_policy: serving requests with %s", _policy_names[policy]);
+    return 0;
+}
+
+static int _compare_samples(const void *a, const void *b)
+{
+    unsigned int x = *(const unsigned int*)a;
+    unsigned int y = *(const unsigned int*)b;
+
+    return (x > y) - (x < y);
+}
+
+int disk_getstats(disk_policy_t policy, disk_stats_t *stats)
+{
+    ppos_core_t *core = worker_core();
+
+    if (core->disk == NULL || policy < 0 || policy >= DISK_POLICIES || stats == NULL) {
+        LOG_ERR0("disk_getstats: disk not initialized, invalid policy or NULL stats");
+        return -1;
+    }
+
+    memset(stats, 0, sizeof(disk_stats_t));
+
+    core->lock_core();
+    disk_policy_stats_t *policy_stats = &core->disk->stats[policy];
+    unsigned int count = policy_stats->count;
+    unsigned int *samples = count > 0 ? malloc(count * sizeof(unsigned int)) : NULL;
+
+    stats->requests = count;
+    stats->head_travel = policy_stats->head_travel;
+    stats->max_us = policy_stats->max_us;
+
+    if (count > 0) {
+        stats->mean_us = policy_stats->total_us / count;
+    }
+
+    if (samples != NULL) {
+        memcpy(samples, policy_stats->samples, count * sizeof(unsigned int));
+    }
+    core->unlock_core();
+
+    if (samples != NULL) {
+        qsort(samples, count, sizeof(unsigned int), _compare_samples);
+        stats->p99_us = samples[(count * 99 + 99) / 100 - 1];
+        core->block_task_switch();
+        free(samples);
+        core->enable_task_switch();
+    }
+
+    return 0;
+}
+
+const char* disk_policy_name(disk_policy_t policy)
+{
+    if (policy < 0 || policy >= DISK_POLICIES) {
+        return "?";
+    }
+
+    return _policy_names[policy];
+}
+
+void disk_resetstats()
+{
+    ppos_core_t *core = worker_core();
+
+    if (core->disk == NULL) {
+        return;
+    }
+
+    core->lock_core();
+    for (int i = 0; i < DISK_POLICIES; i++) {
+        disk_policy_stats_t *stats = &core->disk->stats[i];
+
+        stats->count = 0;
+        stats->total_us = 0;
+        stats->head_travel = 0;
+        stats->max_us = 0;
+    }
+    core->unlock_core();
+}
+
+int disk_poll()
+{
+    ppos_core_t *core = worker_core();
+    disk_t *disk = core->disk;
+
+    if (disk == NULL || !__atomic_exchange_n(&disk->irq, 0, __ATOMIC_ACQ_REL)) {
+        return 0;
+    }
+
+    task_t *woken = NULL;
+    int nr_woken = 0;
+
+    core->lock_core();
+
+    unsigned long long now_us = _now_us();
+
+    while (disk->current != NULL && disk->done_us <= now_us) {
+        disk_request_t *request = disk->current;
+        task_t *task = request->task;
+
+        request->result = _transfer(disk, request);
+        _record(&disk->stats[disk->policy], disk->done_us - request->arrival_us);
+
+        LOG_INFO("disk_poll: block %d of task %d done", request->block, task->id);
+        task->status = TASK_STATUS_READY;
+        TRACE(TRACE_WAKE, task->id, 0);
+        core->io_waiting--;
+        __atomic_add_fetch(&core->nr_runnable, 1, __ATOMIC_RELAXED);
+        queue_append((queue_t**)&woken, (queue_t*)task);
+
+        __atomic_store_n(&disk->current, NULL, __ATOMIC_RELEASE);
+        _start_next(disk, disk->done_us);
+    }
+
+    core->unlock_core();
+
+    task_t *task;
+    while ((task = woken) != NULL) {
+        queue_remove((queue_t**)&woken, (queue_t*)task);
+        core->ready_enqueue(task);
+        nr_woken++;
+    }
+
+    return nr_woken;
+}
+
+unsigned int disk_deadline()
+{
+    disk_t *disk = worker_core()->disk;
+
+    if (disk == NULL || __atomic_load_n(&disk->current, __ATOMIC_ACQUIRE) == NULL) {
+        return (unsigned int)-1;
+    }
+
+    return (__atomic_load_n(&disk->done_us, __ATOMIC_ACQUIRE) + 999) / 1000;
+}
+
+int disk_image_fd()
+{
+    disk_t *disk = worker_core()->disk;
+
+    return disk != NULL ? disk->fd : -1;
+}
+
+void disk_destroy(ppos_core_t *core)
+{
+    if (core == NULL || core->disk == NULL) {
+        return;
+    }
+
+    for (int i = 0; i < DISK_POLICIES; i++) {
+        free(core->disk->stats[i].samples);
+    }
+
+    close(core->disk->fd);
+    free(core->disk);
+    core->disk = NULL;
+}
@@ -0,0 +1,144 @@
+#ifndef __DISK_H__
+#define __DISK_H__
+
+#include <stdbool.h>
+
+#include "ppos_data.h"
+
+#define DISK_DEFAULT_IMAGE "disk.dat"
+#define DISK_DEFAULT_BLOCK_SIZE 512
+#define DISK_DEFAULT_BLOCKS 4096
+#define DISK_DEFAULT_BLOCKS_PER_TRACK 16
+#define DISK_DEFAULT_SEEK_MIN_US 500
+#define DISK_DEFAULT_SEEK_TRACK_US 20
+#define DISK_DEFAULT_TRANSFER_US 100
+
+typedef enum {
+    DISK_FCFS = 0,
+    DISK_SSTF,
+    DISK_CSCAN,
+    DISK_POLICIES,
+} disk_policy_t;
+
+/*
+ * Head-movement model: moving the head across d tracks takes
+ * seek_min_us + d * seek_track_us (nothing when d is 0), then each block
+ * takes transfer_us to read or write
+ */
+typedef struct disk_config_t
+{
+    const char *image;
+    int block_size;
+    int num_blocks;
+    int blocks_per_track;
+    unsigned int seek_min_us;
+    unsigned int seek_track_us;
+    unsigned int transfer_us;
+    disk_policy_t policy;
+} disk_config_t;
+
+/*
+ * Service time runs from the moment a task issues a request to its
+ * completion, so it includes the time spent queued behind other requests
+ */
+typedef struct disk_stats_t
+{
+    unsigned int requests;
+    unsigned long long head_travel;
+    unsigned int mean_us;
+    unsigned int p99_us;
+    unsigned int max_us;
+} disk_stats_t;
+
+/*
+ * @brief Set the device model used by disk_mgr_init; must be called before
+ *        disk_mgr_init. Fields left at 0 (or NULL) take the defaults
+ * @param config: device configuration
+ * @return 0 on success, < 0 if the configuration is invalid
+ */
+int disk_mgr_config(const disk_config_t *config);
+
+/*
+ * @brief Attach the simulated disk to the runtime of the calling task,
+ *        creating its image file if needed
+ * @param num_blocks: receives the number of blocks of the disk
+ * @param block_size: receives the size of a block in bytes
+ * @return 0 on success, < 0 on error
+ */
+int disk_mgr_init(int *num_blocks, int *block_size);
+
+/*
+ * @brief Read a block, suspending the current task until it is done
+ * @param block: block number
+ * @param buffer: destination, block_size bytes
+ * @return 0 on success, < 0 on error
+ */
+int disk_block_read(int block, void *buffer);
+
+/*
+ * @brief Write a block, suspending the current task until it is done
+ * @param block: block number
+ * @param buffer: source, block_size bytes
+ * @return 0 on success, < 0 on error
+ */
+int disk_block_write(int block, void *buffer);
+
+/*
+ * @brief Change the order in which queued requests are served
+ * @param policy: DISK_FCFS, DISK_SSTF or DISK_CSCAN
+ * @return 0 on success, < 0 on error
+ */
+int disk_set_policy(disk_policy_t policy);
+
+/*
+ * @brief Get the statistics of the requests served under a policy
+ * @param policy: policy to query
+ * @param stats: receives the statistics
+ * @return 0 on success, < 0 on error
+ */
+int disk_getstats(disk_policy_t policy, disk_stats_t *stats);
+
+/*
+ * @brief Get the name of a policy
+ * @param policy: policy to name
+ * @return the name, or "?" for an invalid policy
+ */
+const char* disk_policy_name(disk_policy_t policy);
+
+/*
+ * @brief Clear the statistics of every policy
+ * @return void
+ */
+void disk_resetstats();
+
+/*
+ * Runtime internals, used by the core and the dispatcher
+ */
+
+/*
+ * @brief Complete the requests whose service time has elapsed, once the
+ *        disk tick raised its interrupt, and start the next ones
+ * @return number of tasks made ready
+ */
+int disk_poll();
+
+/*
+ * @brief Get the time the request being served completes
+ * @return completion time in ms, (unsigned int)-1 if the disk is idle
+ */
+unsigned int disk_deadline();
+
+/*
+ * @brief Get the image file of the calling task's disk, mapped by the cache
+ * @return the file descriptor, -1 if the disk is not initialized
+ */
+int disk_image_fd();
+
+/*
+ * @brief Release the disk of a runtime
+ * @param core: pointer to the ppos core
+ * @return void
+ */
+void disk_destroy(ppos_core_t *core);
+
+#endif
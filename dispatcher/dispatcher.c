@@ -2,41 +2,53 @@
 #include <valgrind/valgrind.h>
 
 #include "dispatcher.h"
+#include "group.h"
+#include "worker.h"
+#include "trace.h"
+#include "io.h"
+#include "uring.h"
+#include "disk.h"
+#include "timer.h"
+#include "replay.h"
+#include "readyset.h"
 #include "ppos_data.h"
 #include "ppos.h"
 #include "logger.h"
 
-#define TASK_AGING_DECAY 1
-
-static ppos_core_t *_core;
-
-static task_t* _scheduler()
+static task_t* _scheduler(task_group_t *group)
 {
-    task_t *queue_head = _core->ready_queue;
+    task_t *queue_head = group->ready_queue;
     task_t* priority_task = queue_head;
 
-    LOG_TRACE("scheduler: starting with task %d (%d) as priority", priority_task->id, priority_task->dynamic_priority);
+    if (group->ready_set != NULL) {
+        priority_task = readyset_pick(group->ready_set);
+    }
+    else {
+        LOG_TRACE("scheduler: starting with task %d (%d) as priority", priority_task->id, priority_task->dynamic_priority);
 
-    int visited = 0;
-    int queue_len = queue_size((queue_t*)_core->ready_queue);
-    for (task_t *queue = queue_head->next; visited < queue_len; queue = queue->next) {
-        LOG_TRACE("scheduler: checking task %d (%d)", queue->id, queue->dynamic_priority);
+        int visited = 0;
+        int queue_len = queue_size((queue_t*)group->ready_queue);
+        for (task_t *queue = queue_head->next; visited < queue_len; queue = queue->next) {
+            LOG_TRACE("scheduler: checking task %d (%d)", queue->id, queue->dynamic_priority);
 
-        task_t *task = queue;
+            task_t *task = queue;
 
-        if (task->dynamic_priority < priority_task->dynamic_priority) {
-            priority_task->dynamic_priority -= TASK_AGING_DECAY;
-            priority_task = task;
+            if (task->dynamic_priority < priority_task->dynamic_priority) {
+                priority_task->dynamic_priority -= TASK_AGING_DECAY;
+                priority_task = task;
+            }
+            else {
+                task->dynamic_priority -= TASK_AGING_DECAY;
+            }
+            visited++;
         }
-        else {
-            task->dynamic_priority -= TASK_AGING_DECAY;
-        }
-        visited++;
     }
 
     LOG_INFO("scheduler: selected task %d with priority %d and quantum %d", priority_task->id, priority_task->dynamic_priority, priority_task->remaining_quantum);
 
-    if (_core->remove_task_from_queue(priority_task, &_core->ready_queue) >= 0) {
+    priority_task = replay_pick(queue_head, priority_task);
+
+    if (group_dequeue(priority_task) >= 0) {
         priority_task->dynamic_priority = priority_task->priority;
         priority_task->remaining_quantum = priority_task->quantum;
     }
@@ -48,21 +60,29 @@ static task_t* _scheduler()
     return priority_task;
 }
 
-static void _schedule_next_task() {
-    LOG_DEBUG("schedule_next_task: ready queue size: %d", queue_size((queue_t*)_core->ready_queue));        
-    task_t *next_task = _scheduler();
+static void _run_task(task_t *next_task)
+{
+    ppos_core_t *core = worker_core();
+    task_t *dispatcher_task = worker_self()->dispatcher_task;
 
-    _core->dispatcher_task->status = TASK_STATUS_SUSPENDED;
-    _core->enable_task_switch();
+    dispatcher_task->status = TASK_STATUS_SUSPENDED;
+    core->enable_task_switch();
 
-    LOG_TRACE("schedule_next_task: running task %d", next_task->id);
+    LOG_TRACE("run_task: running task %d", next_task->id);
 
     task_switch(next_task);
     
-    _core->block_task_switch();
-    _core->dispatcher_task->status = TASK_STATUS_RUNNING;
+    core->block_task_switch();
+    dispatcher_task->status = TASK_STATUS_RUNNING;
+
+    LOG_TRACE("run_task: task %d returned", next_task->id);
+}
 
-    LOG_TRACE("schedule_next_task: task %d returned", next_task->id);
+static void _schedule_next_task(task_group_t *group) {
+    LOG_DEBUG("schedule_next_task: group %d ready queue size: %d", group->id, queue_size((queue_t*)group->ready_queue));
+    task_t *next_task = _scheduler(group);
+
+    _run_task(next_task);
 
     if (next_task->status == TASK_STATUS_RUNNING)
     {    
@@ -71,48 +91,229 @@ static void _schedule_next_task() {
 }
 
 static void _wakeup_sleeping_tasks() {
-    LOG_DEBUG("wakeup_sleeping_tasks: sleep queue size: %d", queue_size((queue_t*)_core->sleep_queue));
+    ppos_core_t *core = worker_core();
+    task_t *woken = NULL;
+
+    core->lock_core();
+    LOG_DEBUG("wakeup_sleeping_tasks: sleep queue size: %d", queue_size((queue_t*)core->sleep_queue));
         
-    int queue_len = queue_size((queue_t*)_core->sleep_queue);
-    int visited = 0;
+    int queue_len = queue_size((queue_t*)core->sleep_queue);
     unsigned int current_time = systime();
+    unsigned int next_wakeup = (unsigned int)-1;
 
-    for (task_t *task = _core->sleep_queue; visited < queue_len; task = task->next) {
-        visited++;
+    task_t *task = core->sleep_queue;
+    for (int visited = 0; visited < queue_len; visited++) {
+        task_t *next = task->next;
 
         if (task->wakeup_time > current_time) {
             LOG_TRACE("wakeup_sleeping_tasks: task %d not ready to wake up (%d > %d)", task->id, task->wakeup_time, current_time);
-            continue;
+
+            if (task->wakeup_time < next_wakeup) {
+                next_wakeup = task->wakeup_time;
+            }
+        } else {
+            LOG_INFO("wakeup_sleeping_tasks: waking up task %d", task->id);
+            queue_remove((queue_t**)&core->sleep_queue, (queue_t*)task);
+            task->status = TASK_STATUS_READY;
+            TRACE(TRACE_WAKE, task->id, 0);
+            __atomic_add_fetch(&core->nr_runnable, 1, __ATOMIC_RELAXED);
+            queue_append((queue_t**)&woken, (queue_t*)task);
         }
 
-        LOG_INFO("wakeup_sleeping_tasks: waking up task %d", task->id);
-        task_awake(task, &_core->sleep_queue);
+        task = next;
     }
+
+    core->next_wakeup = next_wakeup;
+    core->unlock_core();
+
+    while ((task = woken) != NULL) {
+        queue_remove((queue_t**)&woken, (queue_t*)task);
+        core->ready_enqueue(task);
+    }
+}
+
+static void _park_throttled_task(task_t *task)
+{
+    ppos_core_t *core = worker_core();
+    LOG_DEBUG("park_throttled_task: task %d group is throttled", task->id);
+
+    core->lock_core();
+    queue_append((queue_t**)&core->throttled_queue, (queue_t*)task);
+    core->unlock_core();
+}
+
+static void _release_throttled_tasks()
+{
+    ppos_core_t *core = worker_core();
+    if (__atomic_load_n(&core->throttled_queue, __ATOMIC_RELAXED) == NULL) {
+        return;
+    }
+
+    task_t *released = NULL;
+
+    core->lock_core();
+    group_refresh(core->root_group, systime());
+
+    int queue_len = queue_size((queue_t*)core->throttled_queue);
+    task_t *task = core->throttled_queue;
+    for (int visited = 0; visited < queue_len; visited++) {
+        task_t *next = task->next;
+
+        if (!group_is_throttled(task->group)) {
+            queue_remove((queue_t**)&core->throttled_queue, (queue_t*)task);
+            queue_append((queue_t**)&released, (queue_t*)task);
+        }
+
+        task = next;
+    }
+    core->unlock_core();
+
+    while ((task = released) != NULL) {
+        queue_remove((queue_t**)&released, (queue_t*)task);
+        core->ready_enqueue(task);
+    }
+}
+
+// longest time the dispatcher may block in the poller when it has nothing
+// to run: until the next sleeping task, I/O timeout or disk completion
+static int _idle_timeout()
+{
+    ppos_core_t *core = worker_core();
+    unsigned int deadline = (unsigned int)-1;
+
+    if (core->sleep_queue != NULL) {
+        deadline = core->next_wakeup;
+    }
+
+    if (core->io_timed > 0 && core->io_next_deadline < deadline) {
+        deadline = core->io_next_deadline;
+    }
+
+    if (disk_deadline() < deadline) {
+        deadline = disk_deadline();
+    }
+
+    if (deadline == (unsigned int)-1) {
+        return -1;
+    }
+
+    unsigned int now = systime();
+    return deadline > now ? (int)(deadline - now) : 0;
+}
+
+// tasks only become runnable again from a running task, from the sleep
+// queue or from the poller, so once this holds it holds for good
+static bool _no_runnable_tasks()
+{
+    ppos_core_t *core = worker_core();
+    if (__atomic_load_n(&core->nr_runnable, __ATOMIC_RELAXED) > 0) {
+        return false;
+    }
+
+    core->lock_core();
+    bool done = core->nr_runnable == 0 && core->sleep_queue == NULL && core->io_waiting == 0;
+    core->unlock_core();
+
+    return done;
+}
+
+// loop of each worker when the runtime runs on several threads
+static void _dispatch_worker()
+{
+    ppos_core_t *core = worker_core();
+    task_t *dispatcher_task = worker_self()->dispatcher_task;
+
+    while (true) {
+        core->block_task_switch();
+        dispatcher_task->status = TASK_STATUS_RUNNING;
+
+        if (_no_runnable_tasks()) {
+            break;
+        }
+
+        if (__atomic_load_n(&core->sleep_queue, __ATOMIC_RELAXED) != NULL && core->next_wakeup <= systime()) {
+            _wakeup_sleeping_tasks();
+        }
+
+        _release_throttled_tasks();
+
+        // other workers may fill the run queues meanwhile, so the idle wait
+        // in the poller is kept short
+        task_t *next_task = worker_next_task();
+        bool io_waiting = __atomic_load_n(&core->io_waiting, __ATOMIC_RELAXED) > 0;
+
+        log_poll(next_task == NULL);
+
+        if (io_waiting) {
+            uring_submit(next_task == NULL);
+            io_poll(next_task == NULL ? IO_IDLE_MS : 0);
+            uring_reap();
+            disk_poll();
+        }
+
+        if (next_task == NULL) {
+            if (!io_waiting) {
+                worker_idle();
+            }
+        } else if (group_is_throttled(next_task->group)) {
+            _park_throttled_task(next_task);
+        } else {
+            next_task->remaining_quantum = next_task->quantum;
+            _run_task(next_task);
+        }
+
+        dispatcher_task->status = TASK_STATUS_SUSPENDED;
+        core->enable_task_switch();
+    }
+
+    LOG_INFO("dispatcher: worker %d has no more tasks, exiting", worker_self()->id);
+    task_exit(0);
 }
 
 void dispatcher(ppos_core_t *core)
 {
-    _core = core;
+    if (core->nr_workers > 1) {
+        _dispatch_worker();
+        return;
+    }
+
+    task_t *dispatcher_task = worker_self()->dispatcher_task;
 
     while (true) {
-        _core->block_task_switch();
-        _core->dispatcher_task->status = TASK_STATUS_RUNNING;
+        core->block_task_switch();
+        dispatcher_task->status = TASK_STATUS_RUNNING;
 
-        if (queue_size((queue_t*)_core->sleep_queue) == 0 && queue_size((queue_t*)_core->ready_queue) == 0) {
+        group_refresh(core->root_group, systime());
+
+        if (queue_size((queue_t*)core->sleep_queue) == 0 && core->root_group->nr_ready == 0 && core->io_waiting == 0) {
             break;
         }
 
+        log_poll(core->root_group->nr_ready == 0);
+
+        if (core->io_waiting > 0) {
+            bool idle = core->root_group->nr_ready == 0;
+
+            uring_submit(idle);
+            io_poll(idle ? _idle_timeout() : 0);
+            uring_reap();
+            disk_poll();
+        }
 
-        if (queue_size((queue_t*)_core->sleep_queue) > 0) {
+        if (queue_size((queue_t*)core->sleep_queue) > 0) {
             _wakeup_sleeping_tasks();
         }
 
-        if (queue_size((queue_t*)_core->ready_queue) > 0) {
-            _schedule_next_task();
+        task_group_t *group = group_pick(core->root_group);
+        if (group != NULL) {
+            _schedule_next_task(group);
+        } else if (core->io_waiting == 0 && core->throttled_queue == NULL && core->sleep_queue != NULL) {
+            // only a sleeping task can run next
+            timer_idle_until(core->next_wakeup);
         }
         
-        _core->dispatcher_task->status = TASK_STATUS_SUSPENDED;
-        _core->enable_task_switch();
+        dispatcher_task->status = TASK_STATUS_SUSPENDED;
+        core->enable_task_switch();
     }
     
     LOG_INFO("dispatcher: no more tasks in sleep queue or ready queue, exiting");
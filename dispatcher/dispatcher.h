@@ -4,6 +4,9 @@
 #include "ppos_data.h"
 #include "queue.h"
 
+// dynamic priority lost by each ready task passed over by the scheduler
+#define TASK_AGING_DECAY 1
+
 /*
  * @brief Dispatcher function
  * @param core: pointer to the ppos core
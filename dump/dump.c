@@ -0,0 +1,344 @@
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <signal.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "dump.h"
+#include "worker.h"
+#include "timer.h"
+#include "stats.h"
+#include "ppos.h"
+#include "logger.h"
+
+#define DUMP_BUFFER 2048
+#define DUMP_LOCK_ATTEMPTS 1000
+#define DUMP_MAX_HANDLERS 8
+// bounds every list walk, a wedged runtime may have a corrupted queue
+#define DUMP_MAX_WALK 1000000
+
+typedef struct dump_t
+{
+    int fd;
+    int error;
+    size_t used;
+    char buffer[DUMP_BUFFER];
+} dump_t;
+
+static ppos_core_t *_signal_core = NULL;
+static int _signal_fd = -1;
+static int _signal_num = 0;
+
+static const char *_status_names[] = {
+    "created", "ready", "running", "suspended", "terminated",
+};
+
+static void _flush(dump_t *dump)
+{
+    size_t done = 0;
+
+    while (done < dump->used && !dump->error) {
+        ssize_t ret = write(dump->fd, dump->buffer + done, dump->used - done);
+
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (ret <= 0) {
+            dump->error = 1;
+            break;
+        }
+
+        done += ret;
+    }
+
+    dump->used = 0;
+}
+
+// vsnprintf with integer and string conversions only touches the buffer
+static void _print(dump_t *dump, const char *fmt, ...)
+{
+    if (dump->used > DUMP_BUFFER / 2) {
+        _flush(dump);
+    }
+
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(dump->buffer + dump->used, DUMP_BUFFER - dump->used, fmt, args);
+    va_end(args);
+
+    if (len > 0) {
+        dump->used += (size_t)len < DUMP_BUFFER - dump->used ? (size_t)len : DUMP_BUFFER - dump->used - 1;
+    }
+}
+
+static unsigned int _length(task_t *queue)
+{
+    unsigned int count = 0;
+
+    if (queue == NULL) {
+        return 0;
+    }
+
+    task_t *task = queue;
+    do {
+        count++;
+        task = task->next;
+    } while (task != NULL && task != queue && count < DUMP_MAX_WALK);
+
+    return count;
+}
+
+static unsigned int _ready_length(ppos_core_t *core)
+{
+    if (core->nr_workers <= 1) {
+        return core->root_group != NULL ? core->root_group->nr_ready : 0;
+    }
+
+    // run queue entries may be stale, a claimed task is not ready anymore
+    unsigned int count = _length(core->global_queue);
+
+    for (int i = 0; i < core->nr_workers; i++) {
+        runq_t *runq = &core->workers[i].runq;
+        long top = __atomic_load_n(&runq->top, __ATOMIC_ACQUIRE);
+        long bottom = __atomic_load_n(&runq->bottom, __ATOMIC_ACQUIRE);
+
+        if (bottom > top) {
+            count += bottom - top;
+        }
+    }
+
+    return count;
+}
+
+static void _queue_name(ppos_core_t *core, task_t *task, char *name, size_t size)
+{
+    switch (task->status) {
+    case TASK_STATUS_CREATED:
+    case TASK_STATUS_READY:
+        snprintf(name, size, "ready");
+        return;
+    case TASK_STATUS_RUNNING:
+        snprintf(name, size, "worker %d", task->last_worker);
+        return;
+    case TASK_STATUS_SUSPENDED:
+        break;
+    default:
+        snprintf(name, size, "-");
+        return;
+    }
+
+    if (task->blocked_on == &core->sleep_queue) {
+        snprintf(name, size, "sleep");
+        return;
+    }
+
+    if (task->blocked_on == NULL) {
+        snprintf(name, size, "io");
+        return;
+    }
+
+    unsigned int walked = 0;
+    for (task_t *t = core->all_tasks; t != NULL && walked < DUMP_MAX_WALK; t = t->all_next, walked++) {
+        if (task->blocked_on == (task_t**)&t->waiting_queue) {
+            snprintf(name, size, "join %d", t->id);
+            return;
+        }
+    }
+
+    for (int fd = 0; fd < core->io_nfds; fd++) {
+        if (core->io_fds[fd] != NULL && task->blocked_on == &core->io_fds[fd]->waiting) {
+            snprintf(name, size, "fd %d", fd);
+            return;
+        }
+    }
+
+    snprintf(name, size, "queue %p", (void*)task->blocked_on);
+}
+
+static void _print_task(dump_t *dump, ppos_core_t *core, task_t *task, unsigned int now)
+{
+    char queue[32];
+    char wakeup[16];
+    unsigned int cpu = task->time.total_cpu_time;
+
+    _queue_name(core, task, queue, sizeof(queue));
+
+    if (task->status == TASK_STATUS_SUSPENDED && task->blocked_on == &core->sleep_queue) {
+        snprintf(wakeup, sizeof(wakeup), "%u", task->wakeup_time);
+    } else {
+        snprintf(wakeup, sizeof(wakeup), "-");
+    }
+
+    if (task->status == TASK_STATUS_RUNNING && task->time.last_start != 0) {
+        cpu += now - task->time.last_start;
+    }
+
+    _print(dump, "%5d %-15s %-10s %4d %5d %-12s %8s %8u %zu/%zu\n",
+           task->id,
+           task->name[0] != '\0' ? task->name : "-",
+           task->status <= TASK_STATUS_TERMINATED ? _status_names[task->status] : "?",
+           task->priority,
+           task->dynamic_priority,
+           queue,
+           wakeup,
+           cpu,
+           stats_stack_peak(task),
+           task->context.uc_stack.ss_size);
+}
+
+static int _dump(ppos_core_t *core, int fd)
+{
+    dump_t dump;
+    void (*handlers[DUMP_MAX_HANDLERS])(int);
+    unsigned int intervals[DUMP_MAX_HANDLERS];
+
+    dump.fd = fd;
+    dump.error = 0;
+    dump.used = 0;
+
+    worker_t *self = worker_self();
+    bool blocked = self != NULL && self->core == core && self->current_task != NULL;
+
+    // the tick skips a task with switching blocked, so the snapshot is not
+    // interrupted by a switch on this worker
+    if (blocked) {
+        core->block_task_switch();
+    }
+
+    bool locked = spin_trylock(&core->lock, DUMP_LOCK_ATTEMPTS);
+    unsigned int now = systime();
+
+    _print(&dump, "=== ppos state dump at %u ms ===\n", now);
+    _print(&dump, "runtime: %d workers, %u tasks, %u runnable%s\n",
+           core->nr_workers, core->nr_tasks, core->nr_runnable,
+           locked ? "" : ", core lock busy, snapshot may be inconsistent");
+
+    for (int i = 0; i < core->nr_workers; i++) {
+        worker_t *worker = &core->workers[i];
+        task_t *current = worker->current_task;
+
+        _print(&dump, "worker %d: running %s %d\n", i,
+               current != NULL && current == worker->dispatcher_task ? "dispatcher" : "task",
+               current != NULL ? current->id : -1);
+    }
+
+    _print(&dump, "queues: ready %u, sleep %u, global %u, throttled %u, io waiting %u\n",
+           _ready_length(core), _length(core->sleep_queue), _length(core->global_queue),
+           _length(core->throttled_queue), core->io_waiting);
+
+    int nr_handlers = timer_handlers(handlers, intervals, DUMP_MAX_HANDLERS);
+    for (int i = 0; i < nr_handlers && i < DUMP_MAX_HANDLERS; i++) {
+        _print(&dump, "timer: handler %p every %u ms\n", (void*)handlers[i], intervals[i]);
+    }
+
+    _print(&dump, "%5s %-15s %-10s %4s %5s %-12s %8s %8s %s\n",
+           "id", "name", "status", "prio", "dprio", "queue", "wakeup", "cpu_ms", "stack_peak/size");
+
+    unsigned int walked = 0;
+    for (task_t *task = core->all_tasks; task != NULL && walked < DUMP_MAX_WALK; task = task->all_next, walked++) {
+        _print_task(&dump, core, task, now);
+    }
+
+    _print(&dump, "=== end of dump ===\n");
+
+    if (locked) {
+        spin_unlock(&core->lock);
+    }
+
+    if (blocked) {
+        core->enable_task_switch();
+    }
+
+    _flush(&dump);
+    return dump.error ? -1 : 0;
+}
+
+static void _signal_handler(int signum)
+{
+    (void)signum;
+
+    int saved_errno = errno;
+    ppos_core_t *core = worker_core() != NULL ? worker_core() : _signal_core;
+
+    if (core != NULL && _signal_fd >= 0) {
+        _dump(core, _signal_fd);
+    }
+
+    errno = saved_errno;
+}
+
+int ppos_dump(int fd)
+{
+    ppos_core_t *core = worker_core();
+
+    if (core == NULL || fd < 0) {
+        LOG_ERR0("ppos_dump: no runtime or invalid descriptor");
+        return -1;
+    }
+
+    return _dump(core, fd);
+}
+
+int ppos_dump_signal(int signum, int fd)
+{
+    struct sigaction action;
+
+    if (signum == timer_signal() || signum < 0 || signum >= NSIG) {
+        LOG_ERR("ppos_dump_signal: cannot handle signal %d", signum);
+        return -1;
+    }
+
+    if (_signal_num != 0) {
+        signal(_signal_num, SIG_DFL);
+        _signal_num = 0;
+    }
+
+    if (signum == 0) {
+        _signal_core = NULL;
+        _signal_fd = -1;
+        return 0;
+    }
+
+    _signal_core = worker_core();
+    _signal_fd = fd;
+
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = _signal_handler;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+
+    if (sigaction(signum, &action, NULL) < 0) {
+        LOG_ERR("ppos_dump_signal: failed to handle signal %d", signum);
+        return -1;
+    }
+
+    _signal_num = signum;
+    return 0;
+}
+
+void task_setname(task_t *task, const char *name)
+{
+    if (task == NULL) {
+        task = worker_self()->current_task;
+    }
+
+    if (name == NULL) {
+        task->name[0] = '\0';
+        return;
+    }
+
+    strncpy(task->name, name, sizeof(task->name) - 1);
+    task->name[sizeof(task->name) - 1] = '\0';
+}
+
+void dump_destroy(ppos_core_t *core)
+{
+    if (_signal_core == core) {
+        _signal_core = NULL;
+    }
+}
@@ -0,0 +1,50 @@
+#ifndef __DUMP_H__
+#define __DUMP_H__
+
+#include "ppos_data.h"
+
+/*
+ * State dump of a runtime: its workers, queue lengths, timer handlers and
+ * every user task with its status, priorities, the queue it waits on,
+ * wakeup time, CPU time and stack high-water mark. The dump is formatted
+ * on the stack and written with write(2), so it never allocates
+ */
+
+/*
+ * @brief Write a snapshot of the calling task's runtime. Task switching is
+ *        blocked and the core lock is taken while the snapshot is written;
+ *        when the lock cannot be taken the dump still runs and says so
+ * @param fd: descriptor to write to
+ * @return 0 on success, < 0 on error
+ */
+int ppos_dump(int fd);
+
+/*
+ * @brief Dump the runtime of the calling task when a signal arrives
+ * @param signum: signal to handle, such as SIGUSR1, or 0 to restore the
+ *        default action of the signal handled so far
+ * @param fd: descriptor the dumps are written to
+ * @return 0 on success, < 0 on error
+ */
+int ppos_dump_signal(int signum, int fd);
+
+/*
+ * @brief Name a task for the dumps; longer names are truncated
+ * @param task: task to name, NULL for the current task
+ * @param name: name to copy
+ * @return void
+ */
+void task_setname(task_t *task, const char *name);
+
+/*
+ * Runtime internals, used by the core
+ */
+
+/*
+ * @brief Stop dumping a runtime from the signal handler
+ * @param core: pointer to the ppos core
+ * @return void
+ */
+void dump_destroy(ppos_core_t *core);
+
+#endif
@@ -0,0 +1,546 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "group.h"
+#include "queue.h"
+#include "quantum.h"
+#include "worker.h"
+#include "stats.h"
+#include "readyset.h"
+#include "ppos.h"
+#include "logger.h"
+
+#define VRUNTIME_SCALE 1000ULL
+
+static unsigned long long _vruntime_delta(unsigned int elapsed_ms, unsigned int weight)
+{
+    return (unsigned long long)elapsed_ms * VRUNTIME_SCALE * GROUP_DEFAULT_WEIGHT / weight;
+}
+
+static unsigned int _clamp_weight(unsigned int weight)
+{
+    if (weight == 0) {
+        return GROUP_DEFAULT_WEIGHT;
+    }
+
+    if (weight > GROUP_MAX_WEIGHT) {
+        LOG_WARN("group: weight %u is higher than maximum %d, using maximum", weight, GROUP_MAX_WEIGHT);
+        return GROUP_MAX_WEIGHT;
+    }
+
+    return weight;
+}
+
+static task_group_t* _group_of(task_t *task)
+{
+    return task->group != NULL ? task->group : worker_core()->root_group;
+}
+
+// the ready set of a group is made as its first task gets ready, called
+// with the core lock held
+static readyset_t* _ready_set(task_group_t *group)
+{
+    ppos_core_t *core = worker_core();
+
+    if (group->ready_set == NULL && core->readyset_mode != READYSET_OFF) {
+        group->ready_set = readyset_create(core->readyset_mode);
+
+        if (group->ready_set != NULL) {
+            group->ready_set->next = core->ready_sets;
+            core->ready_sets = group->ready_set;
+        }
+    }
+
+    return group->ready_set;
+}
+
+static bool _is_runnable(task_group_t *group)
+{
+    if (group->throttled || group->nr_ready == 0) {
+        return false;
+    }
+
+    if (group->ready_queue != NULL) {
+        return true;
+    }
+
+    int len = queue_size((queue_t*)group->children);
+    task_group_t *child = group->children;
+    for (int i = 0; i < len; i++, child = child->next) {
+        if (_is_runnable(child)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*
+ * Smallest vruntime among the runnable entities directly below a group: its
+ * child groups and the set of tasks attached to the group itself.
+ */
+static bool _level_min_vruntime(task_group_t *group, unsigned long long *min)
+{
+    bool found = false;
+
+    if (group->ready_queue != NULL) {
+        *min = group->tasks_vruntime;
+        found = true;
+    }
+
+    int len = queue_size((queue_t*)group->children);
+    task_group_t *child = group->children;
+    for (int i = 0; i < len; i++, child = child->next) {
+        if (!_is_runnable(child)) {
+            continue;
+        }
+
+        if (!found || child->vruntime < *min) {
+            *min = child->vruntime;
+            found = true;
+        }
+    }
+
+    return found;
+}
+
+// entities waking up do not get credit for the time they were idle
+static void _place(unsigned long long *vruntime, task_group_t *level)
+{
+    unsigned long long min;
+
+    if (_level_min_vruntime(level, &min) && *vruntime < min) {
+        *vruntime = min;
+    }
+}
+
+static void _refresh_period(task_group_t *group, unsigned int now)
+{
+    if (group->quota_ms == 0 || now - group->period_start < group->period_ms) {
+        return;
+    }
+
+    unsigned int periods = (now - group->period_start) / group->period_ms;
+    group->period_start += periods * group->period_ms;
+    group->period_usage = 0;
+    group->stats.nr_periods += periods;
+
+    if (group->throttled) {
+        LOG_INFO("group_refresh: group %d unthrottled after %u ms", group->id, now - group->throttled_since);
+        group->throttled = false;
+        group->stats.throttled_time += now - group->throttled_since;
+    }
+}
+
+task_group_t* group_setup(ppos_core_t *core)
+{
+    task_group_t *root = calloc(1, sizeof(task_group_t));
+    if (root == NULL) {
+        LOG_ERR0("group_setup: failed to allocate root group");
+        return NULL;
+    }
+
+    root->id = core->group_cnt++;
+    root->weight = GROUP_DEFAULT_WEIGHT;
+    root->period_ms = GROUP_DEFAULT_PERIOD_MS;
+    root->stats.creation_time = systime();
+
+    core->readyset_mode = readyset_requested();
+    core->ready_sets = NULL;
+
+    return root;
+}
+
+void group_destroy(ppos_core_t *core)
+{
+    while (core != NULL && core->ready_sets != NULL) {
+        readyset_t *set = core->ready_sets;
+        core->ready_sets = set->next;
+        readyset_destroy(set);
+    }
+
+    if (core != NULL && core->root_group != NULL) {
+        free(core->root_group);
+        core->root_group = NULL;
+    }
+}
+
+int group_enqueue(task_t *task)
+{
+    task_group_t *group = _group_of(task);
+
+    stats_enqueue(task);
+    worker_core()->lock_core();
+
+    // a task yielding or preempted keeps its groups' lead, only groups that
+    // really were idle are placed
+    bool requeued = worker_self() != NULL && task == worker_self()->current_task;
+
+    if (group->ready_queue == NULL && !requeued) {
+        _place(&group->tasks_vruntime, group);
+    }
+
+    for (task_group_t *g = group; g->parent != NULL && g->nr_ready == 0 && !requeued; g = g->parent) {
+        _place(&g->vruntime, g->parent);
+    }
+
+    if (queue_append((queue_t**)&group->ready_queue, (queue_t*)task) < 0) {
+        worker_core()->unlock_core();
+        LOG_WARN("group_enqueue: failed to append task %d to group %d", task->id, group->id);
+        return -1;
+    }
+
+    if (_ready_set(group) != NULL && readyset_add(group->ready_set, task) < 0) {
+        queue_remove((queue_t**)&group->ready_queue, (queue_t*)task);
+        worker_core()->unlock_core();
+        LOG_WARN("group_enqueue: failed to add task %d to the ready set of group %d", task->id, group->id);
+        return -1;
+    }
+
+    quantum_enqueue(task);
+
+    for (task_group_t *g = group; g != NULL; g = g->parent) {
+        g->nr_ready++;
+    }
+
+    worker_core()->unlock_core();
+    return 0;
+}
+
+int group_dequeue(task_t *task)
+{
+    task_group_t *group = _group_of(task);
+
+    worker_core()->lock_core();
+
+    if (queue_remove((queue_t**)&group->ready_queue, (queue_t*)task) < 0) {
+        worker_core()->unlock_core();
+        LOG_WARN("group_dequeue: failed to remove task %d from group %d", task->id, group->id);
+        return -1;
+    }
+
+    if (group->ready_set != NULL) {
+        readyset_remove(group->ready_set, task);
+    }
+
+    quantum_dequeue(task);
+
+    for (task_group_t *g = group; g != NULL; g = g->parent) {
+        g->nr_ready--;
+    }
+
+    worker_core()->unlock_core();
+    return 0;
+}
+
+void group_setprio(task_t *task)
+{
+    task_group_t *group = _group_of(task);
+
+    worker_core()->lock_core();
+
+    if (group->ready_set != NULL) {
+        readyset_update(group->ready_set, task);
+    }
+
+    worker_core()->unlock_core();
+}
+
+task_group_t* group_pick(task_group_t *root)
+{
+    task_group_t *group = root;
+
+    while (_is_runnable(group)) {
+        task_group_t *next = NULL;
+        bool found = group->ready_queue != NULL;
+        unsigned long long min = group->tasks_vruntime;
+
+        int len = queue_size((queue_t*)group->children);
+        task_group_t *child = group->children;
+        for (int i = 0; i < len; i++, child = child->next) {
+            if (!_is_runnable(child)) {
+                continue;
+            }
+
+            if (!found || child->vruntime < min) {
+                next = child;
+                min = child->vruntime;
+                found = true;
+            }
+        }
+
+        if (next == NULL) {
+            LOG_TRACE("group_pick: selected group %d", group->id);
+            for (task_group_t *g = group; g != NULL; g = g->parent) {
+                g->stats.activations++;
+            }
+            return group;
+        }
+
+        group = next;
+    }
+
+    LOG_TRACE0("group_pick: every ready task is throttled");
+    return NULL;
+}
+
+void group_charge(task_group_t *group, unsigned int elapsed_ms)
+{
+    if (group == NULL || elapsed_ms == 0) {
+        return;
+    }
+
+    unsigned int now = systime();
+    group->tasks_vruntime += _vruntime_delta(elapsed_ms, GROUP_DEFAULT_WEIGHT);
+
+    for (task_group_t *g = group; g != NULL; g = g->parent) {
+        g->stats.total_cpu_time += elapsed_ms;
+
+        if (g->parent != NULL) {
+            g->vruntime += _vruntime_delta(elapsed_ms, g->weight);
+        }
+
+        if (g->quota_ms == 0) {
+            continue;
+        }
+
+        _refresh_period(g, now);
+        g->period_usage += elapsed_ms;
+
+        if (!g->throttled && g->period_usage >= g->quota_ms) {
+            LOG_INFO("group_charge: group %d used %u of %u ms, throttling", g->id, g->period_usage, g->quota_ms);
+            g->throttled = true;
+            g->throttled_since = now;
+            g->stats.nr_throttled++;
+        }
+    }
+}
+
+void group_refresh(task_group_t *group, unsigned int now)
+{
+    _refresh_period(group, now);
+
+    int len = queue_size((queue_t*)group->children);
+    task_group_t *child = group->children;
+    for (int i = 0; i < len; i++, child = child->next) {
+        group_refresh(child, now);
+    }
+}
+
+bool group_is_throttled(task_group_t *group)
+{
+    for (task_group_t *g = group; g != NULL; g = g->parent) {
+        if (g->throttled) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+int task_group_init(task_group_t *group, task_group_t *parent, unsigned int weight)
+{
+    if (group == NULL) {
+        LOG_ERR0("task_group_init: cannot initialize NULL group");
+        return -1;
+    }
+
+    // the workers of a multi-worker runtime pick from their own run queues,
+    // group weights would be silently ignored
+    if (worker_core()->nr_workers > 1 && weight != 0 && weight != GROUP_DEFAULT_WEIGHT) {
+        LOG_ERR("task_group_init: weight %u needs a single worker, the runtime has %d", weight, worker_core()->nr_workers);
+        return -1;
+    }
+
+    if (parent == NULL) {
+        parent = worker_core()->root_group;
+    }
+
+    memset(group, 0, sizeof(task_group_t));
+    group->id = worker_core()->group_cnt++;
+    group->parent = parent;
+    group->weight = _clamp_weight(weight);
+    group->period_ms = GROUP_DEFAULT_PERIOD_MS;
+    group->period_start = systime();
+    group->stats.creation_time = group->period_start;
+
+    worker_core()->lock_core();
+    int ret = queue_append((queue_t**)&parent->children, (queue_t*)group);
+    worker_core()->unlock_core();
+
+    if (ret < 0) {
+        LOG_ERR("task_group_init: failed to attach group %d to parent %d", group->id, parent->id);
+        return -1;
+    }
+
+    LOG_INFO("task_group_init: group %d created under group %d with weight %u", group->id, parent->id, group->weight);
+    return group->id;
+}
+
+// called with the core lock held
+static task_t* _first_task_in(ppos_core_t *core, task_group_t *group)
+{
+    for (task_t *task = core->all_tasks; task != NULL; task = task->all_next) {
+        if (task->group == group) {
+            return task;
+        }
+    }
+
+    return NULL;
+}
+
+int task_group_destroy(task_group_t *group)
+{
+    ppos_core_t *core = worker_core();
+
+    if (group == NULL || group == core->root_group) {
+        LOG_ERR0("task_group_destroy: cannot destroy NULL or root group");
+        return -1;
+    }
+
+    if (group->children != NULL) {
+        LOG_ERR("task_group_destroy: group %d still has child groups", group->id);
+        return -1;
+    }
+
+    // attaching takes the core lock, tasks are moved one at a time
+    while (true) {
+        core->lock_core();
+        task_t *task = _first_task_in(core, group);
+        core->unlock_core();
+
+        if (task == NULL) {
+            break;
+        }
+
+        if (task_group_attach(group->parent, task) < 0) {
+            LOG_ERR("task_group_destroy: failed to move task %d out of group %d", task->id, group->id);
+            return -1;
+        }
+    }
+
+    core->lock_core();
+    int ret = queue_remove((queue_t**)&group->parent->children, (queue_t*)group);
+    core->unlock_core();
+
+    if (ret < 0) {
+        LOG_ERR("task_group_destroy: group %d is not linked to its parent", group->id);
+        return -1;
+    }
+
+    LOG_INFO("task_group_destroy: group %d destroyed, its tasks moved to group %d", group->id, group->parent->id);
+    return 0;
+}
+
+task_group_t* task_group_root()
+{
+    return worker_core()->root_group;
+}
+
+int task_group_setweight(task_group_t *group, unsigned int weight)
+{
+    if (group == NULL) {
+        LOG_ERR0("task_group_setweight: cannot change weight of NULL group");
+        return -1;
+    }
+
+    if (worker_core()->nr_workers > 1) {
+        LOG_ERR("task_group_setweight: weights need a single worker, the runtime has %d", worker_core()->nr_workers);
+        return -1;
+    }
+
+    group->weight = _clamp_weight(weight);
+    return 0;
+}
+
+int task_group_setquota(task_group_t *group, unsigned int quota_ms, unsigned int period_ms)
+{
+    if (group == NULL || group == worker_core()->root_group) {
+        LOG_ERR0("task_group_setquota: cannot limit NULL or root group");
+        return -1;
+    }
+
+    if (period_ms == 0) {
+        period_ms = GROUP_DEFAULT_PERIOD_MS;
+    }
+
+    if (quota_ms > period_ms) {
+        LOG_WARN("task_group_setquota: quota %u ms is longer than period %u ms", quota_ms, period_ms);
+    }
+
+    worker_core()->lock_core();
+    group->quota_ms = quota_ms;
+    group->period_ms = period_ms;
+    group->period_start = systime();
+    group->period_usage = 0;
+
+    if (group->throttled) {
+        group->throttled = false;
+        group->stats.throttled_time += group->period_start - group->throttled_since;
+    }
+    worker_core()->unlock_core();
+
+    LOG_INFO("task_group_setquota: group %d limited to %u ms every %u ms", group->id, quota_ms, period_ms);
+    return 0;
+}
+
+int task_group_attach(task_group_t *group, task_t *task)
+{
+    if (group == NULL) {
+        LOG_ERR0("task_group_attach: cannot attach to NULL group");
+        return -1;
+    }
+
+    if (task == NULL) {
+        task = worker_self()->current_task;
+    }
+
+    if (task->type == TASK_TYPE_SYSTEM) {
+        LOG_ERR("task_group_attach: task %d is a system task", task->id);
+        return -1;
+    }
+
+    bool ready = (task->status == TASK_STATUS_CREATED || task->status == TASK_STATUS_READY) && task != worker_self()->current_task;
+
+    // a task picked meanwhile by another worker joins the group when it yields
+    if (ready && worker_core()->ready_dequeue(task) < 0) {
+        ready = false;
+    }
+
+    task->group = group;
+
+    if (ready && worker_core()->ready_enqueue(task) < 0) {
+        LOG_ERR("task_group_attach: failed to add task %d to group %d", task->id, group->id);
+        return -1;
+    }
+
+    LOG_INFO("task_group_attach: task %d attached to group %d", task->id, group->id);
+    return 0;
+}
+
+task_group_t* task_group_get(task_t *task)
+{
+    if (task == NULL) {
+        task = worker_self()->current_task;
+    }
+
+    return task->group;
+}
+
+int task_group_getstats(task_group_t *group, task_group_stats_t *stats)
+{
+    if (group == NULL || stats == NULL) {
+        LOG_ERR0("task_group_getstats: group and stats must not be NULL");
+        return -1;
+    }
+
+    worker_core()->lock_core();
+    *stats = group->stats;
+
+    if (group->throttled) {
+        stats->throttled_time += systime() - group->throttled_since;
+    }
+    worker_core()->unlock_core();
+
+    return 0;
+}
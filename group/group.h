@@ -0,0 +1,146 @@
+#ifndef __GROUP_H__
+#define __GROUP_H__
+
+#include <stdbool.h>
+
+#include "ppos_data.h"
+
+#define GROUP_DEFAULT_WEIGHT 1024
+#define GROUP_MIN_WEIGHT 1
+#define GROUP_MAX_WEIGHT 10000
+#define GROUP_DEFAULT_PERIOD_MS 100
+
+/*
+ * @brief Initialize a task group as a child of another group
+ * @param group: group descriptor to initialize
+ * @param parent: parent group, or NULL for the root group
+ * @param weight: CPU share relative to the sibling groups, 0 for the default;
+ *        only the default is accepted on a runtime with several workers
+ * @return the group id (> 0) or < 0 on error
+ */
+int task_group_init(task_group_t *group, task_group_t *parent, unsigned int weight);
+
+/*
+ * @brief Unlink a group without child groups from its parent, moving the
+ *        tasks still in it to the parent; the descriptor may then be reused
+ * @param group: group to destroy, not the root group
+ * @return 0 on success, < 0 on error
+ */
+int task_group_destroy(task_group_t *group);
+
+/*
+ * @brief Get the root group, which holds every task not attached elsewhere
+ * @return pointer to the root group
+ */
+task_group_t* task_group_root();
+
+/*
+ * @brief Change the CPU share of a group
+ * @param group: group to change
+ * @param weight: new weight, clamped to [GROUP_MIN_WEIGHT, GROUP_MAX_WEIGHT],
+ *        0 for GROUP_DEFAULT_WEIGHT
+ * @return 0 on success, < 0 on error or on a runtime with several workers
+ */
+int task_group_setweight(task_group_t *group, unsigned int weight);
+
+/*
+ * @brief Limit a group to quota_ms of CPU time every period_ms
+ * @param group: group to limit
+ * @param quota_ms: CPU time allowed per period, 0 removes the limit
+ * @param period_ms: length of the period, 0 uses GROUP_DEFAULT_PERIOD_MS
+ * @return 0 on success, < 0 on error
+ */
+int task_group_setquota(task_group_t *group, unsigned int quota_ms, unsigned int period_ms);
+
+/*
+ * @brief Move a task into a group
+ * @param group: destination group
+ * @param task: task to move, or NULL for the current task
+ * @return 0 on success, < 0 on error
+ */
+int task_group_attach(task_group_t *group, task_t *task);
+
+/*
+ * @brief Get the group of a task
+ * @param task: task to query, or NULL for the current task
+ * @return pointer to the task group, NULL for system tasks
+ */
+task_group_t* task_group_get(task_t *task);
+
+/*
+ * @brief Copy the accounting counters of a group
+ * @param group: group to query
+ * @param stats: destination of the counters
+ * @return 0 on success, < 0 on error
+ */
+int task_group_getstats(task_group_t *group, task_group_stats_t *stats);
+
+/*
+ * Runtime internals, used by the core and the dispatcher
+ */
+
+/*
+ * @brief Bind the group module to the ppos core and create the root group
+ * @param core: pointer to the ppos core
+ * @return pointer to the root group, or NULL on error
+ */
+task_group_t* group_setup(ppos_core_t *core);
+
+/*
+ * @brief Release the root group
+ * @return void
+ */
+void group_destroy(ppos_core_t *core);
+
+/*
+ * @brief Append a task to the ready queue of its group
+ * @param task: task to enqueue
+ * @return 0 on success, < 0 on error
+ */
+int group_enqueue(task_t *task);
+
+/*
+ * @brief Remove a task from the ready queue of its group
+ * @param task: task to dequeue
+ * @return 0 on success, < 0 if the task was not ready
+ */
+int group_dequeue(task_t *task);
+
+/*
+ * @brief Propagate a new dynamic priority of a ready task to its group
+ * @param task: task whose priority changed
+ * @return void
+ */
+void group_setprio(task_t *task);
+
+/*
+ * @brief Select the group whose ready queue should run next
+ * @param root: root of the group hierarchy
+ * @return the selected group, or NULL when every ready task is throttled
+ */
+task_group_t* group_pick(task_group_t *root);
+
+/*
+ * @brief Charge CPU time to a group and its ancestors, throttling on quota
+ * @param group: group that consumed the time
+ * @param elapsed_ms: CPU time consumed
+ * @return void
+ */
+void group_charge(task_group_t *group, unsigned int elapsed_ms);
+
+/*
+ * @brief Start new bandwidth periods, unthrottling groups whose period ended
+ * @param group: root of the hierarchy to refresh
+ * @param now: current system time
+ * @return void
+ */
+void group_refresh(task_group_t *group, unsigned int now);
+
+/*
+ * @brief Check if a group or any of its ancestors is throttled
+ * @param group: group to check
+ * @return true if tasks of the group must not run
+ */
+bool group_is_throttled(task_group_t *group);
+
+#endif
@@ -0,0 +1,456 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+
+#include "io.h"
+#include "queue.h"
+#include "quantum.h"
+#include "worker.h"
+#include "trace.h"
+#include "ppos.h"
+#include "logger.h"
+
+#define IO_TABLE_MIN 64
+
+static unsigned int _from_epoll(unsigned int events)
+{
+    unsigned int ready = 0;
+
+    if (events & (EPOLLIN | EPOLLRDHUP)) {
+        ready |= IO_READ;
+    }
+
+    if (events & EPOLLOUT) {
+        ready |= IO_WRITE;
+    }
+
+    // a failed or hung up descriptor never blocks again, so it wakes everyone
+    if (events & (EPOLLERR | EPOLLHUP)) {
+        ready |= IO_READ | IO_WRITE | IO_ERROR;
+    }
+
+    return ready;
+}
+
+static int _grow_table(ppos_core_t *core, int fd)
+{
+    int nfds = core->io_nfds > 0 ? core->io_nfds : IO_TABLE_MIN;
+    while (nfds <= fd) {
+        nfds *= 2;
+    }
+
+    io_fd_t **fds = realloc(core->io_fds, nfds * sizeof(io_fd_t*));
+    if (fds == NULL) {
+        return -1;
+    }
+
+    memset(fds + core->io_nfds, 0, (nfds - core->io_nfds) * sizeof(io_fd_t*));
+    core->io_fds = fds;
+    core->io_nfds = nfds;
+    return 0;
+}
+
+// called with the core lock held: the first wait on a descriptor makes it
+// non-blocking and registers it edge-triggered for good
+static io_fd_t* _get_fd(ppos_core_t *core, int fd)
+{
+    if (fd < core->io_nfds && core->io_fds[fd] != NULL) {
+        return core->io_fds[fd];
+    }
+
+    if (fd >= core->io_nfds && _grow_table(core, fd) < 0) {
+        LOG_ERR("io_get_fd: failed to grow descriptor table for fd %d", fd);
+        return NULL;
+    }
+
+    io_fd_t *entry = calloc(1, sizeof(io_fd_t));
+    if (entry == NULL) {
+        LOG_ERR("io_get_fd: failed to allocate entry for fd %d", fd);
+        return NULL;
+    }
+
+    int flags = fcntl(fd, F_GETFL);
+    if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+        LOG_ERR("io_get_fd: failed to make fd %d non-blocking: \"%s\"", fd, strerror(errno));
+        free(entry);
+        return NULL;
+    }
+
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    event.data.fd = fd;
+
+    entry->fd = fd;
+    entry->pollable = true;
+
+    if (epoll_ctl(core->epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0) {
+        if (errno != EPERM) {
+            LOG_ERR("io_get_fd: failed to register fd %d: \"%s\"", fd, strerror(errno));
+            free(entry);
+            return NULL;
+        }
+
+        // regular files cannot be polled and are always ready
+        entry->pollable = false;
+        entry->ready = IO_READ | IO_WRITE;
+    }
+
+    core->io_fds[fd] = entry;
+    LOG_DEBUG("io_get_fd: fd %d registered (pollable %d)", fd, entry->pollable);
+    return entry;
+}
+
+// called with the core lock held: takes the readiness a waiter asked for
+static unsigned int _consume(io_fd_t *entry, unsigned int events)
+{
+    unsigned int revents = entry->ready & (events | IO_ERROR);
+
+    if (entry->pollable) {
+        entry->ready &= ~(revents & ~IO_ERROR);
+    }
+
+    return revents;
+}
+
+// called with the core lock held
+static void _wake(ppos_core_t *core, io_fd_t *entry, task_t *task, unsigned int revents, task_t **woken)
+{
+    queue_remove((queue_t**)&entry->waiting, (queue_t*)task);
+
+    if (task->io_timed) {
+        task->io_timed = false;
+        core->io_timed--;
+    }
+
+    task->io_revents = revents;
+    task->status = TASK_STATUS_READY;
+    TRACE(TRACE_WAKE, task->id, 0);
+    core->io_waiting--;
+    __atomic_add_fetch(&core->nr_runnable, 1, __ATOMIC_RELAXED);
+    queue_append((queue_t**)woken, (queue_t*)task);
+}
+
+// called with the core lock held
+static void _wake_ready(ppos_core_t *core, io_fd_t *entry, task_t **woken)
+{
+    int len = queue_size((queue_t*)entry->waiting);
+    task_t *task = entry->waiting;
+
+    for (int visited = 0; visited < len && entry->ready != 0; visited++) {
+        task_t *next = task->next;
+        unsigned int revents = _consume(entry, task->io_events);
+
+        if (revents != 0) {
+            LOG_INFO("io_poll: fd %d ready (%u), waking up task %d", entry->fd, revents, task->id);
+            _wake(core, entry, task, revents, woken);
+        }
+
+        task = next;
+    }
+}
+
+// called with the core lock held
+static void _expire_waiters(ppos_core_t *core, unsigned int now, task_t **woken)
+{
+    unsigned int next_deadline = (unsigned int)-1;
+
+    for (int fd = 0; fd < core->io_nfds && core->io_timed > 0; fd++) {
+        io_fd_t *entry = core->io_fds[fd];
+        if (entry == NULL || entry->waiting == NULL) {
+            continue;
+        }
+
+        int len = queue_size((queue_t*)entry->waiting);
+        task_t *task = entry->waiting;
+
+        for (int visited = 0; visited < len; visited++) {
+            task_t *next = task->next;
+
+            if (task->io_timed && task->wakeup_time <= now) {
+                LOG_INFO("io_poll: task %d timed out waiting on fd %d", task->id, fd);
+                _wake(core, entry, task, 0, woken);
+            } else if (task->io_timed && task->wakeup_time < next_deadline) {
+                next_deadline = task->wakeup_time;
+            }
+
+            task = next;
+        }
+    }
+
+    core->io_next_deadline = next_deadline;
+}
+
+// descriptors must be non-blocking before the first call on them
+static int _prepare(int fd)
+{
+    ppos_core_t *core = worker_core();
+
+    core->lock_core();
+    io_fd_t *entry = _get_fd(core, fd);
+    core->unlock_core();
+
+    return entry != NULL ? 0 : -1;
+}
+
+static bool _would_block(ssize_t ret)
+{
+    return ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+}
+
+int io_setup(ppos_core_t *core)
+{
+    core->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (core->epoll_fd < 0) {
+        LOG_ERR("io_setup: failed to create epoll instance: \"%s\"", strerror(errno));
+        return -1;
+    }
+
+    core->io_fds = NULL;
+    core->io_nfds = 0;
+    core->io_next_deadline = (unsigned int)-1;
+    return 0;
+}
+
+void io_destroy(ppos_core_t *core)
+{
+    if (core == NULL) {
+        return;
+    }
+
+    for (int fd = 0; fd < core->io_nfds; fd++) {
+        free(core->io_fds[fd]);
+    }
+
+    free(core->io_fds);
+    core->io_fds = NULL;
+    core->io_nfds = 0;
+
+    if (core->epoll_fd >= 0) {
+        close(core->epoll_fd);
+        core->epoll_fd = -1;
+    }
+}
+
+int io_poll(int timeout_ms)
+{
+    ppos_core_t *core = worker_core();
+    struct epoll_event events[IO_MAX_EVENTS];
+
+    int nr_events = epoll_wait(core->epoll_fd, events, IO_MAX_EVENTS, timeout_ms);
+    if (nr_events < 0) {
+        // ticks interrupt the wait, which is fine for a poller
+        if (errno != EINTR) {
+            LOG_WARN("io_poll: epoll_wait failed: \"%s\"", strerror(errno));
+        }
+        nr_events = 0;
+    }
+
+    task_t *woken = NULL;
+    int nr_woken = 0;
+
+    core->lock_core();
+
+    for (int i = 0; i < nr_events; i++) {
+        int fd = events[i].data.fd;
+
+        // events of a descriptor closed meanwhile are dropped
+        if (fd >= core->io_nfds || core->io_fds[fd] == NULL) {
+            continue;
+        }
+
+        io_fd_t *entry = core->io_fds[fd];
+        entry->ready |= _from_epoll(events[i].events);
+        _wake_ready(core, entry, &woken);
+    }
+
+    unsigned int now = systime();
+    if (core->io_timed > 0 && core->io_next_deadline <= now) {
+        _expire_waiters(core, now, &woken);
+    }
+
+    core->unlock_core();
+
+    task_t *task;
+    while ((task = woken) != NULL) {
+        queue_remove((queue_t**)&woken, (queue_t*)task);
+        core->ready_enqueue(task);
+        nr_woken++;
+    }
+
+    return nr_woken;
+}
+
+int task_wait_fd(int fd, int events, int timeout_ms)
+{
+    if (fd < 0 || (events & (IO_READ | IO_WRITE)) == 0) {
+        LOG_ERR("task_wait_fd: invalid fd %d or events %d", fd, events);
+        errno = EINVAL;
+        return -1;
+    }
+
+    ppos_core_t *core = worker_core();
+    task_t *task = worker_self()->current_task;
+
+    core->lock_core();
+    io_fd_t *entry = _get_fd(core, fd);
+    unsigned int revents = entry != NULL ? _consume(entry, events) : 0;
+    core->unlock_core();
+
+    if (entry == NULL) {
+        return -1;
+    }
+
+    if (revents != 0 || timeout_ms == 0) {
+        return revents;
+    }
+
+    quantum_release(task, false);
+    core->ready_dequeue(task);
+
+    core->lock_core();
+
+    // the descriptor may have become ready while the lock was released
+    revents = _consume(entry, events);
+    if (revents != 0) {
+        core->unlock_core();
+        return revents;
+    }
+
+    task->io_events = events;
+    task->io_revents = 0;
+    task->io_timed = timeout_ms > 0;
+
+    if (task->io_timed) {
+        task->wakeup_time = systime() + timeout_ms;
+        core->io_timed++;
+
+        if (task->wakeup_time < core->io_next_deadline) {
+            core->io_next_deadline = task->wakeup_time;
+        }
+    }
+
+    core->io_waiting++;
+    LOG_INFO("task_wait_fd: task %d waiting on fd %d for events %d", task->id, fd, events);
+    core->suspend_locked(&entry->waiting);
+
+    return task->io_revents;
+}
+
+ssize_t task_read(int fd, void *buf, size_t count)
+{
+    if (_prepare(fd) < 0) {
+        return -1;
+    }
+
+    while (true) {
+        ssize_t ret = read(fd, buf, count);
+
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (!_would_block(ret)) {
+            return ret;
+        }
+
+        if (task_wait_fd(fd, IO_READ, -1) < 0) {
+            return -1;
+        }
+    }
+}
+
+ssize_t task_write(int fd, const void *buf, size_t count)
+{
+    const char *data = buf;
+    size_t written = 0;
+
+    if (_prepare(fd) < 0) {
+        return -1;
+    }
+
+    while (written < count) {
+        ssize_t ret = write(fd, data + written, count - written);
+
+        if (ret >= 0) {
+            written += ret;
+            continue;
+        }
+
+        if (errno == EINTR) {
+            continue;
+        }
+
+        if (!_would_block(ret)) {
+            return written > 0 ? (ssize_t)written : -1;
+        }
+
+        if (task_wait_fd(fd, IO_WRITE, -1) < 0) {
+            return -1;
+        }
+    }
+
+    return written;
+}
+
+int task_accept(int fd, struct sockaddr *addr, socklen_t *addrlen)
+{
+    if (_prepare(fd) < 0) {
+        return -1;
+    }
+
+    while (true) {
+        int ret = accept(fd, addr, addrlen);
+
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (!_would_block(ret)) {
+            return ret;
+        }
+
+        if (task_wait_fd(fd, IO_READ, -1) < 0) {
+            return -1;
+        }
+    }
+}
+
+int task_close(int fd)
+{
+    ppos_core_t *core = worker_core();
+    task_t *woken = NULL;
+
+    core->lock_core();
+
+    if (fd >= 0 && fd < core->io_nfds && core->io_fds[fd] != NULL) {
+        io_fd_t *entry = core->io_fds[fd];
+
+        // tasks still waiting would never be woken, they get an error instead
+        if (entry->waiting != NULL) {
+            LOG_WARN("task_close: closing fd %d with tasks still waiting on it", fd);
+            entry->ready = IO_READ | IO_WRITE | IO_ERROR;
+            _wake_ready(core, entry, &woken);
+        }
+
+        if (entry->pollable) {
+            epoll_ctl(core->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+        }
+
+        core->io_fds[fd] = NULL;
+        free(entry);
+    }
+
+    core->unlock_core();
+
+    task_t *task;
+    while ((task = woken) != NULL) {
+        queue_remove((queue_t**)&woken, (queue_t*)task);
+        core->ready_enqueue(task);
+    }
+
+    return close(fd);
+}
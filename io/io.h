@@ -0,0 +1,96 @@
+#ifndef __IO_H__
+#define __IO_H__
+
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include "ppos_data.h"
+
+#define IO_READ 0x1
+#define IO_WRITE 0x2
+#define IO_ERROR 0x4
+
+#define IO_MAX_EVENTS 256
+#define IO_IDLE_MS 1
+
+/*
+ * Descriptors used with these calls are made non-blocking: a task waiting
+ * on one is suspended while the other tasks keep running, and the
+ * dispatcher wakes it once epoll reports the descriptor ready
+ */
+
+/*
+ * @brief Suspend the current task until a descriptor is ready
+ * @param fd: descriptor to wait on
+ * @param events: IO_READ and/or IO_WRITE
+ * @param timeout_ms: longest wait, < 0 waits forever, 0 only polls
+ * @return the ready events (IO_ERROR on error or hangup), 0 on timeout,
+ *         < 0 on error. Readiness may be stale, so the next call on the
+ *         descriptor can still fail with EAGAIN
+ */
+int task_wait_fd(int fd, int events, int timeout_ms);
+
+/*
+ * @brief Read from a descriptor, suspending the current task until data is
+ *        available
+ * @param fd: descriptor to read from
+ * @param buf: destination buffer
+ * @param count: size of the buffer
+ * @return bytes read, 0 at end of file, < 0 on error (see errno)
+ */
+ssize_t task_read(int fd, void *buf, size_t count);
+
+/*
+ * @brief Write a whole buffer to a descriptor, suspending the current task
+ *        while the descriptor is full
+ * @param fd: descriptor to write to
+ * @param buf: source buffer
+ * @param count: bytes to write
+ * @return bytes written, < 0 on error (see errno)
+ */
+ssize_t task_write(int fd, const void *buf, size_t count);
+
+/*
+ * @brief Accept a connection, suspending the current task until one arrives
+ * @param fd: listening socket
+ * @param addr: peer address, may be NULL
+ * @param addrlen: size of addr, may be NULL
+ * @return the connected socket, < 0 on error (see errno)
+ */
+int task_accept(int fd, struct sockaddr *addr, socklen_t *addrlen);
+
+/*
+ * @brief Close a descriptor used with the task I/O calls, dropping it from
+ *        the poller so its number can be reused
+ * @param fd: descriptor to close
+ * @return 0 on success, < 0 on error (see errno)
+ */
+int task_close(int fd);
+
+/*
+ * Runtime internals, used by the core and the dispatcher
+ */
+
+/*
+ * @brief Create the poller of a runtime
+ * @param core: pointer to the ppos core
+ * @return 0 on success, < 0 on error
+ */
+int io_setup(ppos_core_t *core);
+
+/*
+ * @brief Close the poller of a runtime and release its descriptor table
+ * @param core: pointer to the ppos core
+ * @return void
+ */
+void io_destroy(ppos_core_t *core);
+
+/*
+ * @brief Collect descriptor readiness with a single epoll_wait and make the
+ *        tasks waiting on ready descriptors, or past their timeout, ready
+ * @param timeout_ms: longest time to block, 0 only polls, < 0 waits forever
+ * @return number of tasks made ready
+ */
+int io_poll(int timeout_ms);
+
+#endif
@@ -0,0 +1,269 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#include "logger.h"
+#include "worker.h"
+
+/*
+ * Bounded ring shared by every thread and signal handler of the process.
+ * The sequence of a record tells its state for the lap of the ring the
+ * position belongs to: 2 * lap while free, 2 * lap + 1 once published.
+ * A zeroed ring is therefore empty, so records logged before log_init
+ * are kept
+ */
+typedef struct log_record_t
+{
+    unsigned long seq;
+    int fd;
+    int len;
+    char text[LOG_RECORD_SIZE];
+} log_record_t;
+
+static log_record_t _ring[LOG_RING_SIZE];
+static unsigned long _head;
+static unsigned long _tail;
+static unsigned long _dropped;
+static unsigned long _reported;
+static int _draining;
+static int _initialized;
+
+static const int _fatal_signals[] = { SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT };
+#define NR_FATAL_SIGNALS (int)(sizeof(_fatal_signals) / sizeof(_fatal_signals[0]))
+static struct sigaction _old_actions[NR_FATAL_SIGNALS];
+
+static unsigned long _lap(unsigned long pos)
+{
+    return pos / LOG_RING_SIZE;
+}
+
+static log_record_t* _record(unsigned long pos)
+{
+    return &_ring[pos % LOG_RING_SIZE];
+}
+
+// a task preempted between claiming a record and publishing it would stall
+// the drain of every record after it. The counter is raised directly: the
+// core's block_task_switch logs, and would come back here
+static task_t* _block_task_switch()
+{
+    worker_t *worker = worker_self();
+    task_t *task = worker != NULL ? worker->current_task : NULL;
+
+    if (task != NULL) {
+        task->switch_blocked++;
+    }
+
+    return task;
+}
+
+static void _enable_task_switch(task_t *task)
+{
+    if (task != NULL) {
+        task->switch_blocked--;
+    }
+}
+
+// writes the whole vector, going on after partial writes and signals
+static void _writev_all(int fd, struct iovec *iov, int count)
+{
+    while (count > 0) {
+        ssize_t ret = writev(fd, iov, count);
+
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+
+        while (count > 0 && (size_t)ret >= iov->iov_len) {
+            ret -= iov->iov_len;
+            iov++;
+            count--;
+        }
+
+        if (count > 0) {
+            iov->iov_base = (char*)iov->iov_base + ret;
+            iov->iov_len -= ret;
+        }
+    }
+}
+
+static void _report_dropped()
+{
+    unsigned long dropped = __atomic_load_n(&_dropped, __ATOMIC_RELAXED);
+
+    if (dropped == _reported) {
+        return;
+    }
+
+    char line[LOG_RECORD_SIZE];
+    int len = snprintf(line, sizeof(line), LOG_YELLOW "[WARN] logger: dropped %lu records" LOG_RESET "\n",
+                       dropped - _reported);
+    struct iovec iov = { line, (size_t)len };
+
+    _reported = dropped;
+    _writev_all(2, &iov, 1);
+}
+
+// drains the published records in batches of consecutive records for the
+// same descriptor; only one thread drains at a time
+static int _drain()
+{
+    int expected = 0;
+
+    if (!__atomic_compare_exchange_n(&_draining, &expected, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        return 0;
+    }
+
+    struct iovec iov[LOG_BATCH];
+    int written = 0;
+
+    while (true) {
+        unsigned long head = _head;
+        int count = 0;
+        int fd = -1;
+
+        while (count < LOG_BATCH) {
+            log_record_t *record = _record(head + count);
+
+            if (__atomic_load_n(&record->seq, __ATOMIC_ACQUIRE) != 2 * _lap(head + count) + 1 ||
+                (count > 0 && record->fd != fd)) {
+                break;
+            }
+
+            fd = record->fd;
+            iov[count].iov_base = record->text;
+            iov[count].iov_len = record->len;
+            count++;
+        }
+
+        if (count == 0) {
+            break;
+        }
+
+        _writev_all(fd, iov, count);
+
+        for (int i = 0; i < count; i++) {
+            __atomic_store_n(&_record(head + i)->seq, 2 * (_lap(head + i) + 1), __ATOMIC_RELEASE);
+        }
+
+        __atomic_store_n(&_head, head + count, __ATOMIC_RELEASE);
+        written += count;
+    }
+
+    _report_dropped();
+    __atomic_store_n(&_draining, 0, __ATOMIC_RELEASE);
+
+    return written;
+}
+
+static void _flush_at_exit()
+{
+    _drain();
+}
+
+// a crashing process still writes what it logged, then the signal gets the
+// action it had before
+static void _fatal_handler(int signum)
+{
+    _drain();
+
+    for (int i = 0; i < NR_FATAL_SIGNALS; i++) {
+        if (_fatal_signals[i] == signum) {
+            sigaction(signum, &_old_actions[i], NULL);
+        }
+    }
+
+    raise(signum);
+}
+
+void log_init()
+{
+    if (__atomic_exchange_n(&_initialized, 1, __ATOMIC_ACQ_REL)) {
+        return;
+    }
+
+    struct sigaction action;
+
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = _fatal_handler;
+    sigemptyset(&action.sa_mask);
+
+    for (int i = 0; i < NR_FATAL_SIGNALS; i++) {
+        sigaction(_fatal_signals[i], &action, &_old_actions[i]);
+    }
+
+    atexit(_flush_at_exit);
+}
+
+void log_write(int fd, const char *fmt, ...)
+{
+    task_t *task = _block_task_switch();
+    unsigned long pos = __atomic_load_n(&_tail, __ATOMIC_RELAXED);
+    log_record_t *record;
+
+    while (true) {
+        record = _record(pos);
+
+        long diff = (long)(__atomic_load_n(&record->seq, __ATOMIC_ACQUIRE) - 2 * _lap(pos));
+
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&_tail, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // the record of the previous lap is not drained yet: never wait
+            __atomic_add_fetch(&_dropped, 1, __ATOMIC_RELAXED);
+            _enable_task_switch(task);
+            return;
+        } else {
+            pos = __atomic_load_n(&_tail, __ATOMIC_RELAXED);
+        }
+    }
+
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(record->text, LOG_RECORD_SIZE, fmt, args);
+    va_end(args);
+
+    // truncated records still end the line
+    if (len < 0) {
+        len = 0;
+    } else if (len >= LOG_RECORD_SIZE) {
+        len = LOG_RECORD_SIZE - 1;
+        record->text[len - 1] = '\n';
+    }
+
+    record->fd = fd;
+    record->len = len;
+    __atomic_store_n(&record->seq, 2 * _lap(pos) + 1, __ATOMIC_RELEASE);
+    _enable_task_switch(task);
+}
+
+int log_poll(bool idle)
+{
+    unsigned long pending = __atomic_load_n(&_tail, __ATOMIC_RELAXED) - __atomic_load_n(&_head, __ATOMIC_RELAXED);
+
+    if (pending == 0 || (!idle && pending < LOG_RING_SIZE / 2)) {
+        return 0;
+    }
+
+    return _drain();
+}
+
+int log_flush()
+{
+    return _drain();
+}
+
+unsigned long log_dropped()
+{
+    return __atomic_load_n(&_dropped, __ATOMIC_RELAXED);
+}
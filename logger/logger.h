@@ -2,6 +2,7 @@
 #define LOGGER_H
 
 #include <stdio.h>
+#include <stdbool.h>
 
 // Log colors
 #define LOG_RED     "\033[31m"
@@ -24,42 +25,88 @@
 
 #define LOG(fmt, ...) printf(fmt "\n", ##__VA_ARGS__)
 
+// Asynchronous log ring
+#define LOG_RING_SIZE 2048
+#define LOG_RECORD_SIZE 256
+#define LOG_BATCH 64
+
+/*
+ * The log macros only format a record into a lock-free ring, which is
+ * safe from any thread and from signal handlers. Records are written with
+ * batched writev by the dispatchers, when idle or once the ring is half
+ * full, at exit and when the process crashes. A full ring drops records
+ * and counts them instead of waiting
+ */
+
+/*
+ * @brief Flush the ring at exit and on fatal signals; called once by the runtime
+ * @return void
+ */
+void log_init();
+
+/*
+ * @brief Format a record into the ring, dropping it if the ring is full
+ * @param fd: descriptor the record is written to
+ * @param fmt: printf format of the record
+ * @return void
+ */
+void log_write(int fd, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+/*
+ * @brief Drain the ring if idle or if it is half full
+ * @param idle: whether the caller has nothing else to do
+ * @return number of records written
+ */
+int log_poll(bool idle);
+
+/*
+ * @brief Drain the ring, unless another thread is already draining it
+ * @return number of records written
+ */
+int log_flush();
+
+/*
+ * @brief Get the number of records dropped because the ring was full
+ * @return the number of dropped records
+ */
+unsigned long log_dropped();
+
 // Define log macros
 #if defined(LOG_LEVEL) && (LOG_LEVEL >= LOG_LEVEL_ERR)
-#define LOG_ERR(fmt, ...) fprintf(stderr, LOG_RED "[ERR] " fmt LOG_RESET "\n", ##__VA_ARGS__)
-#define LOG_ERR0(fmt) fprintf(stderr, LOG_RED "[ERR] " fmt LOG_RESET "\n")
+#define LOG_ERR(fmt, ...) log_write(2, LOG_RED "[ERR] " fmt LOG_RESET "\n", ##__VA_ARGS__)
+#define LOG_ERR0(fmt) log_write(2, LOG_RED "[ERR] " fmt LOG_RESET "\n")
 #else
 #define LOG_ERR(fmt, ...) ((void)0)
 #define LOG_ERR0(fmt) ((void)0)
 #endif
 
 #if defined(LOG_LEVEL) && (LOG_LEVEL >= LOG_LEVEL_WARN)
-#define LOG_WARN(fmt, ...) printf(LOG_YELLOW "[WARN] " fmt LOG_RESET "\n", ##__VA_ARGS__)
-#define LOG_WARN0(fmt) printf(LOG_YELLOW "[WARN] " fmt LOG_RESET "\n")
+#define LOG_WARN(fmt, ...) log_write(1, LOG_YELLOW "[WARN] " fmt LOG_RESET "\n", ##__VA_ARGS__)
+#define LOG_WARN0(fmt) log_write(1, LOG_YELLOW "[WARN] " fmt LOG_RESET "\n")
 #else
 #define LOG_WARN(fmt, ...) ((void)0)
 #define LOG_WARN0(fmt) ((void)0)
 #endif
 
 #if defined(LOG_LEVEL) && (LOG_LEVEL >= LOG_LEVEL_INFO)
-#define LOG_INFO(fmt, ...) printf(LOG_GREEN "[INFO] " fmt LOG_RESET "\n", ##__VA_ARGS__)
-#define LOG_INFO0(fmt) printf(LOG_GREEN "[INFO] " fmt LOG_RESET "\n")
+#define LOG_INFO(fmt, ...) log_write(1, LOG_GREEN "[INFO] " fmt LOG_RESET "\n", ##__VA_ARGS__)
+#define LOG_INFO0(fmt) log_write(1, LOG_GREEN "[INFO] " fmt LOG_RESET "\n")
 #else
 #define LOG_INFO(fmt, ...) ((void)0)
 #define LOG_INFO0(fmt) ((void)0)
 #endif
 
 #if defined(LOG_LEVEL) && (LOG_LEVEL >= LOG_LEVEL_DEBUG)
-#define LOG_DEBUG(fmt, ...) printf(LOG_BLUE "[DEBUG] " fmt LOG_RESET "\n", ##__VA_ARGS__)
-#define LOG_DEBUG0(fmt) printf(LOG_BLUE "[DEBUG] " fmt LOG_RESET "\n")
+#define LOG_DEBUG(fmt, ...) log_write(1, LOG_BLUE "[DEBUG] " fmt LOG_RESET "\n", ##__VA_ARGS__)
+#define LOG_DEBUG0(fmt) log_write(1, LOG_BLUE "[DEBUG] " fmt LOG_RESET "\n")
 #else
 #define LOG_DEBUG(fmt, ...) ((void)0)
 #define LOG_DEBUG0(fmt) ((void)0)
 #endif
 
 #if defined(LOG_LEVEL) && (LOG_LEVEL >= LOG_LEVEL_TRACE)
-#define LOG_TRACE(fmt, ...) printf(LOG_CYAN "[TRACE] " fmt LOG_RESET "\n", ##__VA_ARGS__)
-#define LOG_TRACE0(fmt) printf(LOG_CYAN "[TRACE] " fmt LOG_RESET "\n")
+#define LOG_TRACE(fmt, ...) log_write(1, LOG_CYAN "[TRACE] " fmt LOG_RESET "\n", ##__VA_ARGS__)
+#define LOG_TRACE0(fmt) log_write(1, LOG_CYAN "[TRACE] " fmt LOG_RESET "\n")
 #else
 #define LOG_TRACE(fmt, ...) ((void)0)
 #define LOG_TRACE0(fmt) ((void)0)
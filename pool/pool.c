@@ -0,0 +1,241 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "pool.h"
+#include "queue.h"
+#include "quantum.h"
+#include "worker.h"
+#include "trace.h"
+#include "ppos.h"
+#include "logger.h"
+
+// called with the core lock held: makes the first task of queue ready,
+// it is enqueued with the lock released
+static task_t* _take_one(ppos_core_t *core, task_t **queue)
+{
+    task_t *task = *queue;
+
+    if (task != NULL) {
+        queue_remove((queue_t**)queue, (queue_t*)task);
+        task->status = TASK_STATUS_READY;
+        TRACE(TRACE_WAKE, task->id, 0);
+        __atomic_add_fetch(&core->nr_runnable, 1, __ATOMIC_RELAXED);
+    }
+
+    return task;
+}
+
+static void _wake_all(ppos_core_t *core, task_t **queue)
+{
+    task_t *woken = NULL;
+    task_t *task;
+
+    core->lock_core();
+    while ((task = _take_one(core, queue)) != NULL) {
+        queue_append((queue_t**)&woken, (queue_t*)task);
+    }
+    core->unlock_core();
+
+    while ((task = woken) != NULL) {
+        queue_remove((queue_t**)&woken, (queue_t*)task);
+        core->ready_enqueue(task);
+    }
+}
+
+// ready tasks are dequeued before suspending, as task_suspend does
+static void _prepare_suspend(ppos_core_t *core)
+{
+    task_t *task = worker_self()->current_task;
+
+    quantum_release(task, false);
+    core->ready_dequeue(task);
+}
+
+static void _worker_body(void *arg)
+{
+    task_pool_t *pool = arg;
+    ppos_core_t *core = worker_core();
+
+    while (true) {
+        _prepare_suspend(core);
+        core->lock_core();
+
+        if (pool->count == 0) {
+            if (pool->stopping) {
+                core->unlock_core();
+                break;
+            }
+
+            core->suspend_locked(&pool->idle_queue);
+            continue;
+        }
+
+        pool_job_t job = pool->jobs[pool->head];
+        pool->head = (pool->head + 1) % pool->capacity;
+        pool->count--;
+
+        core->unlock_core();
+
+        job.func(job.arg);
+
+        core->lock_core();
+        bool flushed = --pool->pending == 0 && pool->flush_queue != NULL;
+        core->unlock_core();
+
+        if (flushed) {
+            _wake_all(core, &pool->flush_queue);
+        }
+    }
+
+    task_exit(0);
+}
+
+// called with task switch blocked, under the core lock once the pool is
+// shared; the jobs are unwrapped to the start of the new ring
+static int _grow(task_pool_t *pool)
+{
+    unsigned int capacity = pool->capacity > 0 ? 2 * pool->capacity : POOL_MIN_JOBS;
+    pool_job_t *jobs = malloc(capacity * sizeof(pool_job_t));
+
+    if (jobs == NULL) {
+        LOG_WARN("task_pool_submit: failed to grow to %u jobs", capacity);
+        return -1;
+    }
+
+    for (unsigned int i = 0; i < pool->count; i++) {
+        jobs[i] = pool->jobs[(pool->head + i) % pool->capacity];
+    }
+
+    free(pool->jobs);
+    pool->jobs = jobs;
+    pool->head = 0;
+    pool->capacity = capacity;
+
+    return 0;
+}
+
+task_pool_t* task_pool_create(int nr_workers)
+{
+    if (nr_workers <= 0 || worker_core() == NULL) {
+        LOG_ERR("task_pool_create: invalid number of workers %d or no runtime", nr_workers);
+        return NULL;
+    }
+
+    ppos_core_t *core = worker_core();
+
+    // the allocator is not reentrant, so no other task may run meanwhile
+    core->block_task_switch();
+
+    task_pool_t *pool = calloc(1, sizeof(task_pool_t));
+    bool failed = pool == NULL || (pool->workers = calloc(nr_workers, sizeof(task_handle_t))) == NULL ||
+                  _grow(pool) < 0;
+
+    if (failed && pool != NULL) {
+        free(pool->workers);
+        free(pool);
+    }
+
+    core->enable_task_switch();
+
+    if (failed) {
+        LOG_ERR0("task_pool_create: failed to allocate pool");
+        return NULL;
+    }
+
+    for (int i = 0; i < nr_workers; i++) {
+        pool->workers[i] = task_spawn(_worker_body, pool);
+
+        if (pool->workers[i].generation == 0) {
+            LOG_ERR("task_pool_create: failed to spawn worker %d", i);
+            task_pool_destroy(pool);
+            return NULL;
+        }
+
+        pool->nr_workers++;
+    }
+
+    return pool;
+}
+
+int task_pool_submit(task_pool_t *pool, void (*func)(void *), void *arg)
+{
+    if (pool == NULL || func == NULL) {
+        LOG_ERR0("task_pool_submit: invalid pool or job");
+        return -1;
+    }
+
+    ppos_core_t *core = worker_core();
+
+    core->lock_core();
+
+    if (pool->stopping || (pool->count == pool->capacity && _grow(pool) < 0)) {
+        core->unlock_core();
+        return -1;
+    }
+
+    pool->jobs[(pool->head + pool->count) % pool->capacity] = (pool_job_t){ func, arg };
+    pool->count++;
+    pool->pending++;
+
+    task_t *idle = _take_one(core, &pool->idle_queue);
+
+    core->unlock_core();
+
+    if (idle != NULL) {
+        core->ready_enqueue(idle);
+    }
+
+    return 0;
+}
+
+int task_pool_flush(task_pool_t *pool)
+{
+    if (pool == NULL) {
+        LOG_ERR0("task_pool_flush: invalid pool");
+        return -1;
+    }
+
+    ppos_core_t *core = worker_core();
+
+    while (true) {
+        _prepare_suspend(core);
+        core->lock_core();
+
+        if (pool->pending == 0) {
+            core->unlock_core();
+            return 0;
+        }
+
+        core->suspend_locked(&pool->flush_queue);
+    }
+}
+
+int task_pool_destroy(task_pool_t *pool)
+{
+    if (pool == NULL) {
+        LOG_ERR0("task_pool_destroy: invalid pool");
+        return -1;
+    }
+
+    ppos_core_t *core = worker_core();
+
+    task_pool_flush(pool);
+
+    core->lock_core();
+    pool->stopping = true;
+    core->unlock_core();
+
+    _wake_all(core, &pool->idle_queue);
+
+    for (int i = 0; i < pool->nr_workers; i++) {
+        task_join(pool->workers[i], NULL);
+    }
+
+    core->block_task_switch();
+    free(pool->jobs);
+    free(pool->workers);
+    free(pool);
+    core->enable_task_switch();
+
+    return 0;
+}
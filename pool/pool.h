@@ -0,0 +1,71 @@
+#ifndef __POOL_H__
+#define __POOL_H__
+
+#include <stdbool.h>
+
+#include "ppos_data.h"
+#include "ppos_runtime.h"
+
+/*
+ * Task pool. A fixed set of long-lived worker tasks run submitted jobs,
+ * taken in submission order from a ring shared by the pool, so a job costs
+ * no stack, context or descriptor of its own. A worker finding the ring
+ * empty suspends on the pool and the next submit awakes one. Jobs must
+ * return instead of calling task_exit, and must not flush or destroy their
+ * own pool
+ */
+
+#define POOL_MIN_JOBS 64
+
+typedef struct pool_job_t
+{
+    void (*func)(void *);
+    void *arg;
+} pool_job_t;
+
+typedef struct task_pool_t
+{
+    task_handle_t *workers;
+    int nr_workers;
+    pool_job_t *jobs;           // ring of the jobs not taken yet
+    unsigned int head;
+    unsigned int count;
+    unsigned int capacity;
+    unsigned int pending;       // submitted and not finished
+    task_t *idle_queue;         // workers waiting for a job
+    task_t *flush_queue;        // tasks waiting for pending to reach 0
+    bool stopping;
+} task_pool_t;
+
+/*
+ * @brief Create a pool of worker tasks in the runtime of the caller
+ * @param nr_workers: number of worker tasks, > 0
+ * @return the pool, NULL on error
+ */
+task_pool_t* task_pool_create(int nr_workers);
+
+/*
+ * @brief Queue a job on a pool, waking an idle worker
+ * @param pool: pool to run the job
+ * @param func: job body
+ * @param arg: argument passed to func
+ * @return 0 on success, < 0 on error
+ */
+int task_pool_submit(task_pool_t *pool, void (*func)(void *), void *arg);
+
+/*
+ * @brief Wait until every job submitted to a pool so far has finished
+ * @param pool: pool to wait for
+ * @return 0 on success, < 0 on error
+ */
+int task_pool_flush(task_pool_t *pool);
+
+/*
+ * @brief Finish the submitted jobs, then stop the workers of a pool and
+ *        free it
+ * @param pool: pool to destroy
+ * @return 0 on success, < 0 on error
+ */
+int task_pool_destroy(task_pool_t *pool);
+
+#endif
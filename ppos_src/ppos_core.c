@@ -2,38 +2,82 @@
 #include <valgrind/valgrind.h>
 #include <string.h>
 #include <signal.h>
+#include <sched.h>
 
 #include "logger.h"
 #include "timer.h"
+#include "replay.h"
+#include "slab.h"
 #include "queue.h"
 #include "dispatcher.h"
+#include "group.h"
+#include "tls.h"
+#include "arena.h"
+#include "quantum.h"
+#include "worker.h"
+#include "io.h"
+#include "uring.h"
+#include "disk.h"
+#include "cache.h"
+#include "trace.h"
+#include "stats.h"
+#include "latency.h"
+#include "dump.h"
 #include "ppos.h"
 #include "ppos_data.h"
+#include "ppos_runtime.h"
 
 #define STACKSIZE 64*1024
 
 #define QUANTUM_INTERVAL_MS (long)1
-#define TASK_QUANTUM (short)20
 
 #define MAX_SKIP_TASK_SWITCH 10
 
-static ppos_core_t* _ppos_core = NULL;
+static task_t* _current_task()
+{
+    return worker_self()->current_task;
+}
+
+static task_t* _dispatcher_task()
+{
+    return worker_self()->dispatcher_task;
+}
 
 static void _enable_task_switch()
 {
     LOG_TRACE("enable_task_switch: task %d enabling task switch", task_id());
-    _ppos_core->current_task->switch_enabled = true;
+    _current_task()->switch_blocked--;
+
+    // a replayed tick that found task switch blocked lands here
+    if (replay_pending && _current_task()->switch_blocked == 0) {
+        replay_poll();
+    }
 }
 
 static void _block_task_switch()
 {
     LOG_TRACE("block_task_switch: task %d blocking task switch", task_id());
-    _ppos_core->current_task->switch_enabled = false;
+    _current_task()->switch_blocked++;
 }
 
+// a worker halfway through a context switch has switch_from set
 static bool _is_task_switch_enabled()
 {
-    return _ppos_core->current_task->switch_enabled;
+    return worker_self()->switch_from == NULL && _current_task()->switch_blocked == 0;
+}
+
+// the core lock is only held with task switch blocked, so a tick never
+// preempts a task holding it
+static void _lock_core()
+{
+    _block_task_switch();
+    spin_lock(&worker_core()->lock);
+}
+
+static void _unlock_core()
+{
+    spin_unlock(&worker_core()->lock);
+    _enable_task_switch();
 }
 
 static int _add_task_to_queue(task_t *task, task_t **queue)
@@ -45,9 +89,9 @@ static int _add_task_to_queue(task_t *task, task_t **queue)
     
     LOG_DEBUG("add_task_to_queue: adding task %d to queue %p", task->id, *queue);
 
-    _ppos_core->block_task_switch();
+    _lock_core();
     int ret = queue_append((queue_t **)queue, (queue_t*)task);
-    _ppos_core->enable_task_switch();
+    _unlock_core();
 
     if (ret < 0) {
         LOG_WARN("add_task_to_queue: failed to append task %d to queue %p", task->id, *queue);
@@ -65,9 +109,9 @@ static int _remove_task_from_queue(task_t *task, task_t **queue)
     
     LOG_DEBUG("remove_task_from_queue: removing task %d from queue %p", task->id, queue);
 
-    _ppos_core->block_task_switch();
+    _lock_core();
     int ret = queue_remove((queue_t**)queue, (queue_t*)task);
-    _ppos_core->enable_task_switch();
+    _unlock_core();
 
     if (ret < 0) {
         LOG_WARN("remove_task_from_queue: failed to remove task %d from queue %p", task->id, queue);
@@ -76,6 +120,12 @@ static int _remove_task_from_queue(task_t *task, task_t **queue)
     return ret;
 }
 
+static int _worker_dequeue(task_t *task)
+{
+    // run queue entries cannot be unlinked, claiming the task makes them stale
+    return worker_claim(task) ? 0 : -1;
+}
+
 static void _update_total_time(task_t *task) {
     if (task == NULL) {
         LOG_WARN0("update_total_time: task is NULL, skipping");
@@ -97,6 +147,17 @@ static void _update_total_time(task_t *task) {
     }
 
     task->time.total_cpu_time += elapsed;
+
+    if (task->group != NULL) {
+        _lock_core();
+        group_charge(task->group, elapsed);
+        _unlock_core();
+    }
+}
+
+static void _checkpoint_timing(task_t *task) {
+    _update_total_time(task);
+    task->time.last_start = systime();
 }
 
 static void _start_timing(task_t *task) {
@@ -116,10 +177,85 @@ static void _finish_task_timing(task_t *task) {
          task->id, total_time, task->time.total_cpu_time, task->time.activations);
 }
 
+// runtime-owned descriptors come from the slab of the runtime, a recycled
+// one keeps the stack of its previous task
+static task_t* _alloc_task()
+{
+    ppos_core_t *core = worker_core();
+    bool preemptible = _current_task() != NULL;
+    uint32_t index;
+
+    if (preemptible) {
+        _lock_core();
+    } else {
+        spin_lock(&core->lock);
+    }
+
+    task_t *task = slab_alloc(core->task_slab, &index);
+
+    if (preemptible) {
+        _unlock_core();
+    } else {
+        spin_unlock(&core->lock);
+    }
+
+    if (task == NULL) {
+        return NULL;
+    }
+
+    stack_t stack = task->context.uc_stack;
+    memset(task, 0, sizeof(task_t));
+    task->context.uc_stack = stack;
+    task->slot = index + 1;
+
+    return task;
+}
+
+// a spawned task holds a reference while it runs and one for its handle,
+// until joined or detached; the last one gives the descriptor back and
+// makes the handle stale
+static void _put_task_locked(task_t *task)
+{
+    if (--task->refs == 0) {
+        slab_free(worker_core()->task_slab, task->slot - 1);
+    }
+}
+
 static task_t* _setup_task_stack(task_t *task, int stack_size)
 {
+    void *old_stack = NULL;
+
+    // a recycled descriptor runs on the stack of its previous task
+    if (task->slot != 0 && task->context.uc_stack.ss_sp != NULL) {
+        if (task->context.uc_stack.ss_size == (size_t)stack_size) {
+            char *stack = task->context.uc_stack.ss_sp;
+            size_t peak = stats_stack_peak(task);
+
+            // the stack peak is found by the first used word, only the part
+            // the previous task reached needs clearing
+            memset(stack + stack_size - peak, 0, peak);
+            task->vg_id = VALGRIND_STACK_REGISTER(stack, stack + stack_size);
+            return task;
+        }
+
+        old_stack = task->context.uc_stack.ss_sp;
+        task->context.uc_stack.ss_sp = NULL;
+    }
+
+    // a tick inside the allocator would let another task reenter it
+    bool preemptible = worker_self() != NULL && _current_task() != NULL;
+
+    if (preemptible) {
+        _block_task_switch();
+    }
+
+    free(old_stack);
     stack_t *stack = calloc(1, stack_size);
 
+    if (preemptible) {
+        _enable_task_switch();
+    }
+
     if (stack == NULL) {
         LOG_WARN0("setup_task_stack: failed to allocate stack");
         return NULL;
@@ -142,23 +278,127 @@ static void _free_task_stack(task_t *task)
     }
 }
 
+
+// clears on_cpu of the task switched away from, once its context is saved
+static void _finish_task_switch()
+{
+    _block_task_switch();
+
+    worker_t *worker = worker_self();
+    task_t *from = worker->switch_from;
+
+    if (from != NULL) {
+        __atomic_store_n(&from->on_cpu, 0, __ATOMIC_RELEASE);
+        worker->switch_from = NULL;
+
+        // an exited spawned task is off its stack from here on
+        if (from->status == TASK_STATUS_TERMINATED && from->refs > 0) {
+            _lock_core();
+            _put_task_locked(from);
+            _unlock_core();
+        }
+    }
+
+    _enable_task_switch();
+}
+
+static void _task_entry()
+{
+    _finish_task_switch();
+
+    task_t *task = _current_task();
+    task->start_func(task->arg);
+    task_exit(0);
+}
+
+// user tasks stay listed until they exit, for the state dump
+static void _register_task(task_t *task)
+{
+    ppos_core_t *core = worker_core();
+    bool preemptible = _current_task() != NULL;
+
+    if (preemptible) {
+        _lock_core();
+    } else {
+        spin_lock(&core->lock);
+    }
+
+    task->all_prev = NULL;
+    task->all_next = core->all_tasks;
+    if (core->all_tasks != NULL) {
+        core->all_tasks->all_prev = task;
+    }
+    core->all_tasks = task;
+    core->nr_tasks++;
+
+    if (preemptible) {
+        _unlock_core();
+    } else {
+        spin_unlock(&core->lock);
+    }
+}
+
+static void _unregister_task_locked(task_t *task)
+{
+    ppos_core_t *core = worker_core();
+
+    if (task->all_prev != NULL) {
+        task->all_prev->all_next = task->all_next;
+    } else if (core->all_tasks == task) {
+        core->all_tasks = task->all_next;
+    } else {
+        return;
+    }
+
+    if (task->all_next != NULL) {
+        task->all_next->all_prev = task->all_prev;
+    }
+
+    task->all_prev = task->all_next = NULL;
+    core->nr_tasks--;
+}
+
 static task_t* _create_task(task_t* task, task_type_t type, int stack_size, struct ucontext_t *link, void (*start_func)(void *), void *arg)
 {
     if (task == NULL) {
-        task = calloc(1, sizeof(task_t));
+        task = _alloc_task();
 
         if (task == NULL) {
             LOG_WARN0("create_task: failed to allocate task");
             return NULL;
         }
+    } else {
+        task->slot = 0;
     }
     
-    task->id = _ppos_core->task_cnt++;
+
+    task->id = __atomic_fetch_add(&worker_core()->task_cnt, 1, __ATOMIC_RELAXED);
     task->type = type;
     task->quantum = TASK_QUANTUM;
     task->remaining_quantum = TASK_QUANTUM;
-    task->switch_enabled = true;
+    task->switch_blocked = 0;
+    task->ready = 0;
+    // not runnable until fully set up, so no worker can switch to it early
+    __atomic_store_n(&task->on_cpu, 1, __ATOMIC_RELAXED);
+    task->start_func = start_func;
+    task->arg = arg;
+    task->last_worker = -1;
+    task->affinity = WORKER_ALL;
+    // a task_t may be reused once its previous task exited
+    memset(&task->time, 0, sizeof(task_time_t));
     task->time.creation_time = systime();
+    task->blocked_on = NULL;
+    task->name[0] = '\0';
+    task->refs = 0;
+    task->detached = false;
+    tls_init(task);
+    task->arena = NULL;
+
+    if (type == TASK_TYPE_USER) {
+        task_t *parent = _current_task();
+        task->group = (parent != NULL && parent->group != NULL) ? parent->group : worker_core()->root_group;
+        task->affinity = (parent != NULL) ? parent->affinity : WORKER_ALL;
+    }
     
     if (link != NULL) {
         task->context.uc_link = link;
@@ -166,10 +406,16 @@ static task_t* _create_task(task_t* task, task_type_t type, int stack_size, stru
         task->context.uc_link = NULL;
     }
 
+    stack_t stack = task->context.uc_stack;
+
     if (getcontext(&task->context) < 0) {
         LOG_WARN0("create_task: failed to get context");
         return NULL;
     }
+
+    if (task->slot != 0) {
+        task->context.uc_stack = stack;
+    }
    
     if (stack_size > 0)
     {
@@ -181,28 +427,41 @@ static task_t* _create_task(task_t* task, task_type_t type, int stack_size, stru
     }
     
     if (start_func != NULL) {
-        makecontext(&task->context, (void (*)(void))start_func, 1, arg);
+        makecontext(&task->context, _task_entry, 0);
     }
 
     task->status = TASK_STATUS_CREATED;
+
+    if (type == TASK_TYPE_USER) {
+        _register_task(task);
+    }
+
+    __atomic_store_n(&task->on_cpu, 0, __ATOMIC_RELEASE);
     LOG_INFO("create_task: task %d created", task->id);
     return task;
 }
 
-static void _create_dispatcher_task() {
-    _ppos_core->dispatcher_task = _create_task(
+static void _create_dispatcher_task(ppos_core_t *core, worker_t *worker) {
+    worker->dispatcher_task = _create_task(
         NULL, 
         TASK_TYPE_SYSTEM, 
         STACKSIZE, 
         NULL, 
         (void (*)(void *))dispatcher,
-        _ppos_core 
+        core 
     );
 
-    if (_ppos_core->dispatcher_task == NULL) {
+    if (worker->dispatcher_task == NULL) {
         LOG_ERR0("ppos_init: failed to create dispatcher task");
         exit(-1);
     }
+
+    // only the first dispatcher takes a task id, user task ids do not
+    // depend on the number of workers
+    if (worker->id > 0) {
+        worker->dispatcher_task->id = -worker->id;
+        core->task_cnt--;
+    }
 }
 
 static void _set_current_task(task_t *prev_task, task_t *task)
@@ -219,9 +478,93 @@ static void _set_current_task(task_t *prev_task, task_t *task)
         return;
     }
     
-    _ppos_core->current_task = task;
-    _ppos_core->current_task->status = TASK_STATUS_RUNNING;    
-    _start_timing(_ppos_core->current_task);
+    worker_t *worker = worker_self();
+
+    stats_switch(prev_task, task);
+
+    if (task->last_worker >= 0 && task->last_worker != worker->id) {
+        task->time.migrations++;
+        worker->migrations++;
+    }
+
+    task->last_worker = worker->id;
+    worker->current_task = task;
+    task->status = TASK_STATUS_RUNNING;    
+    _start_timing(task);
+}
+
+static int _switch_to(task_t *task)
+{
+    task_t *prev_task = _current_task();
+
+    _finish_task_switch();
+
+    // a task made ready by another worker may still be saving its context
+    while (__atomic_exchange_n(&task->on_cpu, 1, __ATOMIC_ACQUIRE)) {
+        sched_yield();
+    }
+
+    worker_self()->switch_from = prev_task;
+    _set_current_task(prev_task, task);
+    TRACE(TRACE_SWITCH, task->id, prev_task->id);
+    LOG_INFO("task_switch: switching from task %d to task %d", prev_task->id, task->id);
+
+    if (swapcontext(&prev_task->context, &task->context) < 0) {
+        LOG_ERR0("task_switch: failed to switch context");
+        return -1;
+    }
+
+    _finish_task_switch();
+    LOG_DEBUG("task_switch: switched back to task %d", prev_task->id);
+
+    return 0;
+}
+
+static void _yield_current_task()
+{
+    task_t *task = _current_task();
+
+    LOG_TRACE("yield_current_task: yielding task %d", task->id);
+    _block_task_switch();
+    task->status = TASK_STATUS_READY;
+    stats_wait(task, TASK_WAIT_READY);
+    worker_core()->ready_enqueue(task);
+    _switch_to(_dispatcher_task());
+    _enable_task_switch();
+}
+
+static void _preempt_current_task()
+{
+    task_t *task = _current_task();
+
+    // a throttled group or a bursty task may cut a quantum short, only the
+    // ticks used count then
+    quantum_release(task, task->remaining_quantum <= 0);
+    task->time.preempted = true;
+    TRACE(TRACE_PREEMPT, task->id, task->remaining_quantum);
+    task->remaining_quantum = task->quantum;
+    _yield_current_task();
+}
+
+// called with the core lock held: parks the current task on the queue and
+// runs the dispatcher, task switch stays blocked until the task runs again
+static void _suspend_current_locked(task_t **queue)
+{
+    task_t *task = _current_task();
+
+    task->status = TASK_STATUS_SUSPENDED;
+    task->blocked_on = queue;
+    stats_wait(task, TASK_WAIT_BLOCKED);
+    __atomic_sub_fetch(&worker_core()->nr_runnable, 1, __ATOMIC_RELAXED);
+    TRACE(TRACE_SUSPEND, task->id, 0);
+
+    if (queue != NULL && queue_append((queue_t**)queue, (queue_t*)task) < 0) {
+        LOG_WARN("suspend_current_locked: failed to append task %d to queue %p", task->id, *queue);
+    }
+
+    spin_unlock(&worker_core()->lock);
+    _switch_to(_dispatcher_task());
+    _enable_task_switch();
 }
 
 static void _tick_handler(int signum)
@@ -238,101 +581,358 @@ static void _tick_handler(int signum)
         return;
     }
 
-    LOG_TRACE("tick_handler: task %d quantum is %d", _ppos_core->current_task->id, _ppos_core->current_task->remaining_quantum);
-    _ppos_core->current_task->remaining_quantum--;
+    task_t *task = _current_task();
 
-    if (_ppos_core->current_task->remaining_quantum <= 0)
+    if (task->type == TASK_TYPE_SYSTEM || !replay_tick(task))
     {
-        LOG_INFO("tick_handler: task %d quantum expired, yielding", _ppos_core->current_task->id);
-        _ppos_core->current_task->remaining_quantum = _ppos_core->current_task->quantum;
-        task_yield();
+        return;
+    }
+
+    _checkpoint_timing(task);
+
+    bool preempt = true;
+
+    if (group_is_throttled(task->group))
+    {
+        LOG_INFO("tick_handler: task %d group is throttled, yielding", task->id);
+    }
+    else
+    {
+        LOG_TRACE("tick_handler: task %d quantum is %d", task->id, task->remaining_quantum);
+        task->remaining_quantum--;
+
+        if (task->remaining_quantum <= 0)
+        {
+            LOG_INFO("tick_handler: task %d quantum expired, yielding", task->id);
+        }
+        else if (quantum_should_preempt(task))
+        {
+            LOG_INFO("tick_handler: task %d extended quantum cut short by a bursty task", task->id);
+        }
+        else
+        {
+            preempt = false;
+        }
+    }
+
+    // a replayed run repeats the recorded decision
+    if (replay_preempt(task, preempt))
+    {
+        _preempt_current_task();
     }
 }
 
-static void _awake_all()
+static void _awake_all(task_t *task, task_t *waiting)
 {
-    if (_ppos_core->current_task->waiting_queue == NULL) {
+    (void)task;
+
+    if (waiting == NULL) {
         return;
     }
 
-    LOG_INFO("awake_all: waking up all tasks waiting for task %d", task_id());
+    LOG_INFO("awake_all: waking up all tasks waiting for task %d", task->id);
     
-    for (task_t *task = (task_t*)_ppos_core->current_task->waiting_queue; queue_size(_ppos_core->current_task->waiting_queue) > 0; task = task->next) {
-        task_awake(task, (task_t**)(&_ppos_core->current_task->waiting_queue));
+    while (waiting != NULL) {
+        task_t *waiter = waiting;
+        queue_remove((queue_t**)&waiting, (queue_t*)waiter);
+
+        __atomic_add_fetch(&worker_core()->nr_runnable, 1, __ATOMIC_RELAXED);
+        waiter->status = TASK_STATUS_READY;
+        TRACE(TRACE_WAKE, waiter->id, 0);
+        worker_core()->ready_enqueue(waiter);
     }
 }
 
 static void _terminate_current_task(int exit_code)
 {
-    _finish_task_timing(_ppos_core->current_task);
+    task_t *task = _current_task();
+
+    _finish_task_timing(task);
+    stats_wait(task, TASK_WAIT_NONE);
+
+    worker_core()->ready_dequeue(task);
+    worker_core()->remove_task_from_queue(task, &worker_core()->sleep_queue);
+
+    _lock_core();
+    task->status = TASK_STATUS_TERMINATED;
+    task->exit_code = exit_code;
+    if (task->type == TASK_TYPE_USER) {
+        _unregister_task_locked(task);
+    }
+    task_t *waiting = (task_t*)task->waiting_queue;
+    task->waiting_queue = NULL;
+    _unlock_core();
+
+    _free_task_stack(task);
+    arena_release(task);
+    _awake_all(task, waiting);
+
+    if (task->type == TASK_TYPE_USER) {
+        __atomic_sub_fetch(&worker_core()->nr_runnable, 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&worker_core()->tasks_exited, 1, __ATOMIC_RELAXED);
+    }
+}
+
+// dispatcher stacks are freed with their workers, every other stack still
+// held by a descriptor goes with the slab
+static void _free_task_slab(ppos_core_t *core)
+{
+    slab_t *slab = core->task_slab;
+
+    if (slab == NULL) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < slab->nr_slots; i++) {
+        task_t *task = slab_object(slab, i);
 
-    _ppos_core->remove_task_from_queue(_ppos_core->current_task, &_ppos_core->ready_queue);
-    _ppos_core->remove_task_from_queue(_ppos_core->current_task, &_ppos_core->sleep_queue);
-    _ppos_core->current_task->status = TASK_STATUS_TERMINATED;
-    _ppos_core->current_task->exit_code = exit_code;
-    _free_task_stack(_ppos_core->current_task);
+        if (task->type == TASK_TYPE_USER && task->context.uc_stack.ss_sp != NULL) {
+            free(task->context.uc_stack.ss_sp);
+        }
+    }
 
-    _awake_all(&_ppos_core->current_task->waiting_queue);
+    slab_destroy(slab);
+    core->task_slab = NULL;
 }
 
-static void _ppos_destroy()
+static void _ppos_destroy(ppos_core_t *core)
 {
-    if (_ppos_core != NULL)
+    if (core != NULL)
     {
-        if (_ppos_core->dispatcher_task != NULL)
+        worker_shutdown(core);
+
+        for (int i = 0; i < core->nr_workers; i++)
         {
-            if (_ppos_core->dispatcher_task->context.uc_stack.ss_sp)
+            task_t *dispatcher_task = core->workers[i].dispatcher_task;
+
+            if (dispatcher_task == NULL)
             {
-                //free(_ppos_core->dispatcher_task->context.uc_stack.ss_sp);
-                VALGRIND_STACK_DEREGISTER(_ppos_core->dispatcher_task->vg_id);
+                continue;
+            }
+
+            if (dispatcher_task->context.uc_stack.ss_sp)
+            {
+                VALGRIND_STACK_DEREGISTER(dispatcher_task->vg_id);
+
+                // the default runtime is destroyed from a dispatcher stack
+                if (core->embedded)
+                {
+                    free(dispatcher_task->context.uc_stack.ss_sp);
+                }
             }
 
-            free(_ppos_core->dispatcher_task);
         }
 
-        free(_ppos_core);
+        _free_task_slab(core);
+        free(core->workers);
+        arena_destroy(core);
+        group_destroy(core);
+        dump_destroy(core);
+        trace_destroy(core);
+        latency_destroy(core);
+        replay_finish();
+        cache_destroy(core);
+        disk_destroy(core);
+        uring_destroy(core);
+        io_destroy(core);
+
+        free(core);
+        timer_runtime_stop();
+        log_flush();
     }
 }
 
-void ppos_init()
+static ppos_core_t* _ppos_create()
 {
     setvbuf(stdout, 0, _IONBF, 0);
+    log_init();
+    if (replay_setup() < 0) {
+        return NULL;
+    }
+
     timer_init();
 
-    _ppos_core = calloc(1, sizeof(ppos_core_t));
-    if (_ppos_core == NULL) {
-        LOG_ERR0("ppos_init: failed to allocate ppos_core");
+    // a recording or replay set up above belongs to this runtime
+    if (timer_runtime_start() < 0) {
+        replay_finish();
+        return NULL;
+    }
+
+    ppos_core_t *core = calloc(1, sizeof(ppos_core_t));
+    if (core == NULL) {
+        LOG_ERR0("ppos_create: failed to allocate ppos_core");
+        timer_runtime_stop();
+        return NULL;
+    }
+
+    core->sleep_queue = NULL;
+    core->add_task_to_queue = _add_task_to_queue;
+    core->remove_task_from_queue = _remove_task_from_queue;
+    core->enable_task_switch = _enable_task_switch;
+    core->block_task_switch = _block_task_switch;
+    core->lock_core = _lock_core;
+    core->unlock_core = _unlock_core;
+    core->suspend_locked = _suspend_current_locked;
+
+    core->task_slab = slab_create(sizeof(task_t));
+    if (core->task_slab == NULL) {
+        LOG_ERR0("ppos_create: failed to create task slab");
+        free(core);
+        timer_runtime_stop();
+        return NULL;
+    }
+
+    if (io_setup(core) < 0) {
+        LOG_ERR0("ppos_create: failed to create poller");
+        slab_destroy(core->task_slab);
+        free(core);
+        timer_runtime_stop();
+        return NULL;
+    }
+
+    uring_setup(core);
+
+    if (worker_setup(core) < 0) {
+        LOG_ERR0("ppos_create: failed to setup workers");
+        uring_destroy(core);
+        io_destroy(core);
+        slab_destroy(core->task_slab);
+        free(core);
+        timer_runtime_stop();
+        return NULL;
+    }
+
+    // group shares need a single ready set, with several workers tasks run
+    // from per-worker queues, each picked by priority
+    if (core->nr_workers > 1) {
+        core->ready_enqueue = worker_enqueue;
+        core->ready_dequeue = _worker_dequeue;
+    } else {
+        core->ready_enqueue = group_enqueue;
+        core->ready_dequeue = group_dequeue;
+    }
+
+    quantum_setup(core);
+    latency_setup(core);
+    core->root_group = group_setup(core);
+    if (core->root_group == NULL) {
+        LOG_ERR0("ppos_create: failed to create root group");
         exit(-1);
     }
 
-    _ppos_core->ready_queue = NULL;
-    _ppos_core->sleep_queue = NULL;
-    _ppos_core->add_task_to_queue = _add_task_to_queue;
-    _ppos_core->remove_task_from_queue = _remove_task_from_queue;
-    _ppos_core->enable_task_switch = _enable_task_switch;
-    _ppos_core->block_task_switch = _block_task_switch;
-    _create_dispatcher_task();
-    
-    _ppos_core->main_task = _create_task(
+    _create_dispatcher_task(core, &core->workers[0]);
+    return core;
+}
+
+static void _create_secondary_dispatchers(ppos_core_t *core)
+{
+    for (int i = 1; i < core->nr_workers; i++) {
+        _create_dispatcher_task(core, &core->workers[i]);
+    }
+
+    core->nr_runnable = 1;
+    register_timer(_tick_handler, QUANTUM_INTERVAL_MS);
+}
+
+void ppos_init()
+{
+    ppos_core_t *core = _ppos_create();
+    if (core == NULL) {
+        exit(-1);
+    }
+
+    core->main_task = _create_task(
         NULL, 
         TASK_TYPE_USER, 
         0,
-        &_ppos_core->dispatcher_task->context,
+        &core->workers[0].dispatcher_task->context,
         NULL,
         NULL
     );
 
-    if (_ppos_core->main_task == NULL)
+    if (core->main_task == NULL)
     {
         LOG_ERR0("ppos_init: failed to create main task");
         exit(-1);
     }
 
-    register_timer(_tick_handler, QUANTUM_INTERVAL_MS);
-    _set_current_task(NULL, _ppos_core->main_task);
+    _create_secondary_dispatchers(core);
+    core->main_task->on_cpu = 1;
+    _set_current_task(NULL, core->main_task);
+
+    if (worker_start(core) < 0) {
+        LOG_ERR0("ppos_init: failed to start workers");
+        exit(-1);
+    }
+
     task_yield();
 }
 
+int ppos_run(void (*main_func)(void *), void *arg)
+{
+    if (main_func == NULL) {
+        LOG_ERR0("ppos_run: cannot run NULL main function");
+        return -1;
+    }
+
+    if (worker_self() != NULL) {
+        LOG_ERR0("ppos_run: the calling thread already runs a runtime");
+        return -1;
+    }
+
+    ppos_core_t *core = _ppos_create();
+    if (core == NULL) {
+        return -1;
+    }
+
+    core->embedded = true;
+    core->main_task = _create_task(NULL, TASK_TYPE_USER, STACKSIZE, NULL, main_func, arg);
+
+    if (core->main_task == NULL)
+    {
+        LOG_ERR0("ppos_run: failed to create main task");
+        _ppos_destroy(core);
+        return -1;
+    }
+
+    // the host thread acts as the dispatcher of worker 0 until it runs
+    core->workers[0].current_task = core->workers[0].dispatcher_task;
+    _create_secondary_dispatchers(core);
+    core->ready_enqueue(core->main_task);
+
+    if (worker_start(core) < 0) {
+        LOG_ERR0("ppos_run: failed to start workers");
+        exit(-1);
+    }
+
+    worker_run(&core->workers[0]);
+
+    int exit_code = core->main_task->exit_code;
+    _ppos_destroy(core);
+
+    return exit_code;
+}
+
+ppos_runtime_t* ppos_runtime()
+{
+    return worker_core();
+}
+
+// makes a created task runnable
+static int _start_task(task_t *task)
+{
+    __atomic_add_fetch(&worker_core()->nr_runnable, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&worker_core()->tasks_created, 1, __ATOMIC_RELAXED);
+    stats_wait(task, TASK_WAIT_READY);
+
+    if (worker_core()->ready_enqueue(task) < 0) {
+        return -1;
+    }
+
+    TRACE(TRACE_CREATE, task->id, _current_task() != NULL ? _current_task()->id : -1);
+    return 0;
+}
+
 int task_init(task_t *task, void (*start_func)(void *), void *arg)
 {
     if (task == NULL) {
@@ -344,7 +944,7 @@ int task_init(task_t *task, void (*start_func)(void *), void *arg)
         task, 
         TASK_TYPE_USER, 
         STACKSIZE, 
-        &_ppos_core->dispatcher_task->context,
+        &_dispatcher_task()->context,
         start_func,
         arg
     );
@@ -354,7 +954,7 @@ int task_init(task_t *task, void (*start_func)(void *), void *arg)
         return -1;
     }
 
-    if (_ppos_core->add_task_to_queue(task, &_ppos_core->ready_queue) < 0) {
+    if (_start_task(task) < 0) {
         LOG_ERR0("task_init: failed to append task to ready queue");
         return -1;
     }
@@ -363,26 +963,157 @@ int task_init(task_t *task, void (*start_func)(void *), void *arg)
     return task->id;
 }
 
+task_handle_t task_spawn(void (*start_func)(void *), void *arg)
+{
+    task_handle_t handle = TASK_HANDLE_NONE;
+
+    if (start_func == NULL || worker_self() == NULL) {
+        LOG_ERR0("task_spawn: cannot spawn a NULL function or outside a runtime");
+        return handle;
+    }
+
+    task_t *task = _create_task(
+        NULL,
+        TASK_TYPE_USER,
+        STACKSIZE,
+        &_dispatcher_task()->context,
+        start_func,
+        arg
+    );
+
+    if (task == NULL) {
+        LOG_ERR0("task_spawn: failed to create task");
+        return handle;
+    }
+
+    task->refs = 2;
+    handle.index = task->slot - 1;
+    handle.generation = slab_generation(worker_core()->task_slab, handle.index);
+
+    if (_start_task(task) < 0) {
+        LOG_ERR0("task_spawn: failed to append task to ready queue");
+        return TASK_HANDLE_NONE;
+    }
+
+    LOG_INFO("task_spawn: task %d spawned in slot %u", task->id, handle.index);
+    return handle;
+}
+
+task_t* task_lookup(task_handle_t handle)
+{
+    if (worker_self() == NULL) {
+        return NULL;
+    }
+
+    task_t *task = slab_lookup(worker_core()->task_slab, handle.index, handle.generation);
+    return (task != NULL && task->refs > 0) ? task : NULL;
+}
+
+// takes the reference of the handle, called with the core lock held
+static task_t* _claim_handle_locked(task_handle_t handle)
+{
+    task_t *task = task_lookup(handle);
+
+    if (task == NULL || task->detached) {
+        return NULL;
+    }
+
+    task->detached = true;
+    return task;
+}
+
+int task_join(task_handle_t handle, int *exit_code)
+{
+    task_t *current = _current_task();
+    task_t *task = task_lookup(handle);
+
+    if (task == current) {
+        LOG_ERR0("task_join: a task cannot join itself");
+        return -1;
+    }
+
+    if (task != NULL && task->status != TASK_STATUS_TERMINATED) {
+        quantum_release(current, false);
+        worker_core()->ready_dequeue(current);
+    }
+
+    _lock_core();
+
+    if ((task = _claim_handle_locked(handle)) == NULL) {
+        _unlock_core();
+        LOG_WARN("task_join: stale handle to slot %u", handle.index);
+        return -1;
+    }
+
+    if (task->status != TASK_STATUS_TERMINATED) {
+        LOG_INFO("task_join: task %d will join task %d", current->id, task->id);
+        _suspend_current_locked((task_t**)&task->waiting_queue);
+        _lock_core();
+    }
+
+    if (exit_code != NULL) {
+        *exit_code = task->exit_code;
+    }
+
+    _put_task_locked(task);
+    _unlock_core();
+    return 0;
+}
+
+int task_detach(task_handle_t handle)
+{
+    _lock_core();
+
+    task_t *task = _claim_handle_locked(handle);
+    if (task == NULL) {
+        _unlock_core();
+        LOG_WARN("task_detach: stale handle to slot %u", handle.index);
+        return -1;
+    }
+
+    _put_task_locked(task);
+    _unlock_core();
+    return 0;
+}
+
 int task_id()
 {  
-    return _ppos_core->current_task->id;
+    return _current_task()->id;
 }
 
 void task_exit(int exit_code)
 {
+    task_t *task = _current_task();
+
+    // destructors are user code, they run before the task stops being one
+    tls_exit(task);
+
+    _block_task_switch();
+    TRACE(TRACE_EXIT, task->id, exit_code);
     _terminate_current_task(exit_code);
 
-    if (_ppos_core->current_task == _ppos_core->dispatcher_task)
+    if (task == _dispatcher_task())
     {
-        LOG_INFO("task_exit: dispatcher task (%d) exiting", task_id());
-        _ppos_destroy();
+        if (worker_self()->id > 0 || worker_core()->embedded)
+        {
+            LOG_INFO("task_exit: worker %d dispatcher exiting", worker_self()->id);
+            worker_exit();
+        }
+
+        LOG_INFO("task_exit: dispatcher task (%d) exiting", task->id);
+        _ppos_destroy(worker_core());
         exit(exit_code);
     }
 
-    LOG_INFO("task_exit: switching from task %d to dispatcher on exit", task_id());
+    LOG_INFO("task_exit: switching from task %d to dispatcher on exit", task->id);
+
+    task_t *dispatcher_task = _dispatcher_task();
 
-    _set_current_task(_ppos_core->current_task, _ppos_core->dispatcher_task);
-    setcontext(&_ppos_core->dispatcher_task->context);
+    _finish_task_switch();
+    dispatcher_task->on_cpu = 1;
+    worker_self()->switch_from = task;
+    _set_current_task(task, dispatcher_task);
+    setcontext(&dispatcher_task->context);
     
     LOG_ERR0("task_exit: should never reach here after task exit");
     exit(-1);
@@ -390,12 +1121,12 @@ void task_exit(int exit_code)
 
 int task_switch(task_t *task)
 {
-    if (task == NULL || _ppos_core == NULL || _ppos_core->current_task == NULL) {
+    if (task == NULL || worker_self() == NULL || _current_task() == NULL) {
         LOG_ERR0("task_switch: invalid task, ppos_core or current_task is NULL, skipping");
         return -1;
     }
 
-    if (_ppos_core->current_task == task) {
+    if (_current_task() == task) {
         LOG_INFO("task_switch: ignoring switch to same task %d", task_id());
         return 0;
     }
@@ -404,29 +1135,38 @@ int task_switch(task_t *task)
         LOG_WARN("task_switch: task switch is disabled, cannot switch to task %d", task->id);
         return -1;
     }
-    
-    task_t *prev_task = _ppos_core->current_task;
 
-    _set_current_task(prev_task, task);
-    LOG_INFO("task_switch: switching from task %d to task %d", prev_task->id, task->id);
+    if (task->status == TASK_STATUS_TERMINATED) {
+        LOG_WARN("task_switch: task %d is terminated, cannot switch to it", task->id);
+        return -1;
+    }
 
-    if (swapcontext(&prev_task->context, &task->context) < 0) {
-        LOG_ERR0("task_switch: failed to switch context");
+    // a task run directly must not be picked again from a run queue, the
+    // dispatcher has already claimed the tasks it runs
+    bool claimed = worker_claim(task) || _current_task()->type == TASK_TYPE_SYSTEM;
+
+    if (!claimed && __atomic_load_n(&task->on_cpu, __ATOMIC_ACQUIRE)) {
+        LOG_WARN("task_switch: task %d is running on another worker", task->id);
         return -1;
     }
-    
-    _set_current_task(task, prev_task);
-    LOG_DEBUG("task_switch: switched back from task %d to task %d", task->id, prev_task->id);
 
-    return 0;
+    // a user task switching away directly is left out of the ready set
+    if (_current_task()->type == TASK_TYPE_USER) {
+        __atomic_sub_fetch(&worker_core()->nr_runnable, 1, __ATOMIC_RELAXED);
+
+        if (!claimed && task->type == TASK_TYPE_USER) {
+            __atomic_add_fetch(&worker_core()->nr_runnable, 1, __ATOMIC_RELAXED);
+        }
+    }
+
+    return _switch_to(task);
 }
 
 void task_yield()
 {
-    LOG_TRACE("task_yield: yielding task %d", task_id());
-    _ppos_core->current_task->status = TASK_STATUS_READY;
-    _add_task_to_queue(_ppos_core->current_task, &_ppos_core->ready_queue);
-    task_switch(_ppos_core->dispatcher_task);
+    TRACE(TRACE_YIELD, _current_task()->id, 0);
+    quantum_release(_current_task(), false);
+    _yield_current_task();
 }
 
 void task_setprio(task_t *task, int prio)
@@ -444,37 +1184,76 @@ void task_setprio(task_t *task, int prio)
 
     if (task == NULL)
     {
-        task = _ppos_core->current_task;
+        task = _current_task();
     }
     
     LOG_TRACE("task_setprio: setting task %d priority to %d", task->id, prio);
 
     task->priority = prio;
     task->dynamic_priority = prio;
+
+    group_setprio(task);
 }
 
 int task_getprio(task_t *task)
 {
     if (task == NULL)
     {
-        task = _ppos_core->current_task;
+        task = _current_task();
     }
     
     LOG_TRACE("task_getprio: getting task %d priority (%d)", task->id, task->priority);
     return task->priority;
 }
 
-void task_suspend(task_t **queue)
+int task_setaffinity(task_t *task, unsigned long long mask)
 {
-    LOG_INFO("task_suspend: suspending task %d", task_id());
-    _ppos_core->remove_task_from_queue(_ppos_core->current_task, &_ppos_core->ready_queue);
+    if (task == NULL)
+    {
+        task = _current_task();
+    }
+
+    int nr_workers = worker_core()->nr_workers;
+    unsigned long long existing = nr_workers >= WORKER_MAX ? WORKER_ALL : (1ULL << nr_workers) - 1;
+
+    if ((mask & existing) == 0)
+    {
+        LOG_ERR("task_setaffinity: mask %#llx allows none of the %d workers", mask, nr_workers);
+        return -1;
+    }
+
+    __atomic_store_n(&task->affinity, mask, __ATOMIC_RELAXED);
+    LOG_TRACE("task_setaffinity: task %d may run on workers %#llx", task->id, mask & existing);
+
+    // the yield sends the task to a worker it may run on
+    if (task == _current_task() && !((mask >> worker_self()->id) & 1ULL))
+    {
+        task_yield();
+    }
+
+    return 0;
+}
 
-    if (queue != NULL) {
-        _ppos_core->add_task_to_queue(_ppos_core->current_task, queue);
+unsigned long long task_getaffinity(task_t *task)
+{
+    if (task == NULL)
+    {
+        task = _current_task();
     }
 
-    _ppos_core->current_task->status = TASK_STATUS_SUSPENDED;
-    task_switch(_ppos_core->dispatcher_task);
+    return __atomic_load_n(&task->affinity, __ATOMIC_RELAXED);
+}
+
+void task_suspend(task_t **queue)
+{
+    task_t *task = _current_task();
+
+    LOG_INFO("task_suspend: suspending task %d", task->id);
+    quantum_release(task, false);
+    worker_core()->ready_dequeue(task);
+
+    _lock_core();
+    _suspend_current_locked(queue);
 }
 
 void task_awake(task_t *task, task_t **queue)
@@ -483,20 +1262,30 @@ void task_awake(task_t *task, task_t **queue)
         LOG_ERR("task_awake: cannot awake NULL task");
         return;
     }
+
+    _block_task_switch();
+    spin_lock(&worker_core()->lock);
     
     if (task->status != TASK_STATUS_SUSPENDED) {
+        spin_unlock(&worker_core()->lock);
+        _enable_task_switch();
         LOG_TRACE("task_awake: task %d is not suspended, skipping", task->id);
         return;
     }
     
     LOG_DEBUG("task_awake: awaking task %d", task->id);
 
-    if (queue != NULL) {
-        _ppos_core->remove_task_from_queue(task, queue);
+    if (queue != NULL && queue_remove((queue_t**)queue, (queue_t*)task) < 0) {
+        LOG_WARN("task_awake: failed to remove task %d from queue %p", task->id, queue);
     }
     
     task->status = TASK_STATUS_READY;
-    _ppos_core->add_task_to_queue(task, &_ppos_core->ready_queue);
+    __atomic_add_fetch(&worker_core()->nr_runnable, 1, __ATOMIC_RELAXED);
+    TRACE(TRACE_WAKE, task->id, 0);
+    spin_unlock(&worker_core()->lock);
+
+    worker_core()->ready_enqueue(task);
+    _enable_task_switch();
 }
 
 int task_wait(task_t *task)
@@ -506,10 +1295,20 @@ int task_wait(task_t *task)
         return -1;
     }
 
+    task_t *current = _current_task();
+
+    if (task->status != TASK_STATUS_TERMINATED) {
+        quantum_release(current, false);
+        worker_core()->ready_dequeue(current);
+    }
+
+    _lock_core();
+
     if (task->status != TASK_STATUS_TERMINATED) {
-        LOG_INFO("task_wait: task %d will wait for task %d", task_id(), task->id);
-        task_suspend((task_t**)&task->waiting_queue);    
+        LOG_INFO("task_wait: task %d will wait for task %d", current->id, task->id);
+        _suspend_current_locked((task_t**)&task->waiting_queue);
     } else {
+        _unlock_core();
         LOG_TRACE("task_wait: task %d is terminated, not waiting", task->id);
     }
 
@@ -521,9 +1320,20 @@ void task_sleep(int t) {
         LOG_WARN("task_sleep: cannot sleep for %d ms", t);
         return;
     }
+
+    task_t *task = _current_task();
+
+    TRACE(TRACE_SLEEP, task->id, t);
+    quantum_release(task, false);
+    worker_core()->ready_dequeue(task);
+
+    _lock_core();
+    task->wakeup_time = systime() + t;
+
+    if (worker_core()->sleep_queue == NULL || task->wakeup_time < worker_core()->next_wakeup) {
+        worker_core()->next_wakeup = task->wakeup_time;
+    }
     
-    _ppos_core->current_task->wakeup_time = systime() + t;
-    
-    LOG_INFO("task_sleep: task %d sleeping for %d ms (until %u)", task_id(), t, _ppos_core->current_task->wakeup_time);
-    task_suspend(&_ppos_core->sleep_queue);
+    LOG_INFO("task_sleep: task %d sleeping for %d ms (until %u)", task->id, t, task->wakeup_time);
+    _suspend_current_locked(&worker_core()->sleep_queue);
 }
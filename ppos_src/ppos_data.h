@@ -3,6 +3,7 @@
 
 #include <ucontext.h> 
 #include <stdbool.h>
+#include <stddef.h>
 
 #include "queue.h"
 
@@ -22,44 +23,200 @@ typedef enum {
     TASK_TYPE_USER,
 } task_type_t;
 
+typedef enum {
+    TASK_WAIT_NONE = 0,
+    TASK_WAIT_READY,
+    TASK_WAIT_BLOCKED,
+} task_wait_t;
+
 typedef struct task_time_t
 {
     unsigned int creation_time;
     unsigned int total_cpu_time;
     unsigned int activations;
     unsigned int last_start;
+    unsigned int migrations;
+    unsigned int ready_time;
+    unsigned int blocked_time;
+    unsigned int wait_start;
+    task_wait_t wait;
+    unsigned int voluntary_switches;
+    unsigned int involuntary_switches;
+    bool preempted;
+    unsigned long long ready_ns;
+    bool woken;
 } task_time_t;
 
+struct task_group_t;
+struct worker_t;
+struct uring_t;
+struct disk_t;
+struct cache_t;
+struct trace_t;
+struct latency_t;
+struct slab_t;
+struct readyset_t;
+struct arena_chunk_t;
+
+// task-local values kept in the descriptor, the other keys in overflow
+#define TASK_KEYS_INLINE 4
+
+// a value is set for a key while seq matches the current use of the key
+typedef struct task_specific_t
+{
+  void *value;
+  unsigned int seq;
+} task_specific_t;
+
+/*
+ * Fields are grouped by how often the scheduler touches them. The first
+ * cache line holds what a ready queue scan and the tick handler read, the
+ * second what a dispatch or a wakeup reads; the statistics, the rarely
+ * used fields and the ~1 KB saved context come after them, so walking a
+ * queue does not pull the context in. prev and next stay first, tasks are
+ * linked as queue_t. Runtime-owned descriptors are cache-line aligned by
+ * the slab, a caller-owned task_t may start mid-line
+ */
 typedef struct task_t
 {
+  // hot: ready queue scans and ticks
   struct task_t *prev, *next;
   int id;
-  ucontext_t context;
   task_status_t status;
   task_type_t type;
-  int vg_id;
   int priority;
-  int dynamic_priority;	
-  short quantum;			
+  int dynamic_priority;
+  short quantum;
   short remaining_quantum;
-  task_time_t time;
+  unsigned short run_avg;
+  bool short_burst;
+  bool queued_short;
+  int switch_blocked;
+  int on_cpu;
+  int ready;
+  int last_worker;
   unsigned int wakeup_time;
+
+  // warm: dispatch, wakeup and I/O completion
+  unsigned long long affinity;
+  struct task_group_t *group;
+  struct task_t **blocked_on;
+  unsigned int io_events;
+  unsigned int io_revents;
+  int io_result;
+  bool io_timed;
+  bool detached;
+  int refs;
+  unsigned int slot;
+
+  // cold: statistics, creation, exit and the saved context
+  task_time_t time;
+  void (*start_func)(void *);
+  void *arg;
   int exit_code;
+  int vg_id;
   queue_t *waiting_queue;
-  bool switch_enabled;
+  struct task_t *all_prev, *all_next;
+  char name[16];
+  task_specific_t specific[TASK_KEYS_INLINE];
+  task_specific_t *specific_overflow;
+  struct arena_chunk_t *arena;
+  ucontext_t context;
 } task_t;
 
+// adding a field to a block must not push it past its cache line
+_Static_assert(offsetof(task_t, wakeup_time) + sizeof(unsigned int) <= 64,
+               "task_t hot fields do not fit the first cache line");
+_Static_assert(offsetof(task_t, slot) + sizeof(unsigned int) <= 128,
+               "task_t warm fields do not fit the second cache line");
+
+typedef struct io_fd_t
+{
+  int fd;
+  bool pollable;
+  unsigned int ready;
+  task_t *waiting;
+} io_fd_t;
+
+typedef struct task_group_stats_t
+{
+    unsigned int creation_time;
+    unsigned int total_cpu_time;
+    unsigned int activations;
+    unsigned int nr_periods;
+    unsigned int nr_throttled;
+    unsigned int throttled_time;
+} task_group_stats_t;
+
+typedef struct task_group_t
+{
+  struct task_group_t *prev, *next;
+  int id;
+  struct task_group_t *parent;
+  struct task_group_t *children;
+  task_t *ready_queue;
+  struct readyset_t *ready_set;
+  unsigned int nr_ready;
+  unsigned int weight;
+  unsigned int quota_ms;
+  unsigned int period_ms;
+  unsigned int period_start;
+  unsigned int period_usage;
+  unsigned int throttled_since;
+  bool throttled;
+  unsigned long long vruntime;
+  unsigned long long tasks_vruntime;
+  task_group_stats_t stats;
+} task_group_t;
+
 typedef struct ppos_core {
   unsigned int task_cnt;
-  task_t *current_task;
-  task_t *dispatcher_task;
+  unsigned int tasks_created;
+  unsigned int tasks_exited;
+  unsigned int group_cnt;
+  unsigned int nr_runnable;
+  struct worker_t *workers;
+  int nr_workers;
+  void *threads;
+  bool embedded;
+  int lock;
   task_t *main_task;
-  task_t *ready_queue;
+  task_t *all_tasks;
+  unsigned int nr_tasks;
+  task_group_t *root_group;
+  int readyset_mode;
+  struct readyset_t *ready_sets;
+  task_t *global_queue;
+  task_t *throttled_queue;
   task_t *sleep_queue;
+  unsigned int next_wakeup;
+  bool adaptive_quantum;
+  short min_quantum;
+  short max_quantum;
+  unsigned int nr_short_ready;
+  int epoll_fd;
+  io_fd_t **io_fds;
+  int io_nfds;
+  unsigned int io_waiting;
+  unsigned int io_timed;
+  unsigned int io_next_deadline;
+  struct uring_t *uring;
+  struct disk_t *disk;
+  struct cache_t *cache;
+  struct trace_t *trace;
+  struct latency_t *latency;
+  struct slab_t *task_slab;
+  struct arena_chunk_t *arena_pool;
+  unsigned int nr_arena_pool;
   int (*add_task_to_queue)(task_t *task, task_t **queue);
   int (*remove_task_from_queue)(task_t *task, task_t **queue);
+  int (*ready_enqueue)(task_t *task);
+  int (*ready_dequeue)(task_t *task);
   void (*enable_task_switch)(void);
   void (*block_task_switch)(void);
+  void (*lock_core)(void);
+  void (*unlock_core)(void);
+  void (*suspend_locked)(task_t **queue);
 } ppos_core_t;
 
 typedef struct
@@ -0,0 +1,78 @@
+#ifndef __PPOS_RUNTIME__
+#define __PPOS_RUNTIME__
+
+#include <stdint.h>
+
+#include "ppos_data.h"
+
+/*
+ * A runtime owns its workers, dispatchers, ready and sleep queues, groups
+ * and task counter; task_* calls act on the runtime of the calling task.
+ * ppos_init starts the default runtime, which ends the process when its
+ * last task exits
+ */
+typedef ppos_core_t ppos_runtime_t;
+
+/*
+ * @brief Run an independent runtime on the calling host thread, with
+ *        main_func as its main task, until all of its tasks are done
+ * @param main_func: body of the main task
+ * @param arg: argument passed to main_func
+ * @return exit code of the main task, < 0 on error
+ */
+int ppos_run(void (*main_func)(void *), void *arg);
+
+/*
+ * @brief Get the runtime of the calling task
+ * @return runtime handle, NULL outside a runtime
+ */
+ppos_runtime_t* ppos_runtime();
+
+/*
+ * Spawned tasks live in descriptors owned by the runtime: cache-line
+ * aligned slots of a slab, recycled with their stacks once the task exited
+ * and was joined or detached. A handle names one task in one slot, by the
+ * slot index and the generation of the slot, and goes stale in O(1) when
+ * the slot is recycled
+ */
+typedef struct task_handle_t
+{
+    uint32_t index;
+    uint32_t generation;
+} task_handle_t;
+
+#define TASK_HANDLE_NONE ((task_handle_t){ 0, 0 })
+
+/*
+ * @brief Create a task in a runtime-owned descriptor
+ * @param start_func: body of the task
+ * @param arg: argument passed to start_func
+ * @return handle to the task, TASK_HANDLE_NONE on error
+ */
+task_handle_t task_spawn(void (*start_func)(void *), void *arg);
+
+/*
+ * @brief Get the descriptor of a spawned task, which stays valid until the
+ *        task exits and is joined or detached
+ * @param handle: handle returned by task_spawn
+ * @return the task, NULL if the handle is stale
+ */
+task_t* task_lookup(task_handle_t handle);
+
+/*
+ * @brief Wait for a spawned task to exit and recycle its descriptor; a
+ *        handle is joined or detached once
+ * @param handle: handle returned by task_spawn
+ * @param exit_code: set to the exit code of the task, may be NULL
+ * @return 0 on success, < 0 if the handle is stale
+ */
+int task_join(task_handle_t handle, int *exit_code);
+
+/*
+ * @brief Let a spawned task be recycled as soon as it exits
+ * @param handle: handle returned by task_spawn
+ * @return 0 on success, < 0 if the handle is stale
+ */
+int task_detach(task_handle_t handle);
+
+#endif
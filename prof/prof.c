@@ -0,0 +1,288 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <signal.h>
+#include <ucontext.h>
+#include <dlfcn.h>
+
+#include "prof.h"
+#include "timer.h"
+#include "worker.h"
+#include "logger.h"
+
+typedef struct prof_sample_t
+{
+    int task;
+    unsigned int depth;
+    uintptr_t pcs[PROF_DEPTH];
+} prof_sample_t;
+
+static prof_sample_t *_samples = NULL;
+static unsigned int _capacity = 0;
+static unsigned int _count = 0;
+static unsigned long _lost = 0;
+static unsigned int _every = 1;
+static _Thread_local unsigned int _ticks = 0;
+
+// a tick handler on another worker thread may have loaded the sampler just
+// before it was cleared: it counts itself in flight before checking that
+// sampling is still on, and stopping waits for it
+static bool _active = false;
+static int _in_flight = 0;
+
+static void _take_sample(void *context);
+
+// runs in the tick signal handler: no allocation, no lock
+static void _sample(void *context)
+{
+    __atomic_add_fetch(&_in_flight, 1, __ATOMIC_SEQ_CST);
+
+    if (__atomic_load_n(&_active, __ATOMIC_SEQ_CST)) {
+        _take_sample(context);
+    }
+
+    __atomic_sub_fetch(&_in_flight, 1, __ATOMIC_RELEASE);
+}
+
+// stops sampling, once it returns the buffer may be freed or sorted
+static void _stop_sampling()
+{
+    __atomic_store_n(&_active, false, __ATOMIC_SEQ_CST);
+    timer_set_sampler(NULL);
+
+    while (__atomic_load_n(&_in_flight, __ATOMIC_SEQ_CST) > 0);
+}
+
+static void _take_sample(void *context)
+{
+    if (++_ticks % _every != 0) {
+        return;
+    }
+
+    ucontext_t *uc = context;
+    uintptr_t pc, fp, sp;
+
+#if defined(__x86_64__)
+    pc = uc->uc_mcontext.gregs[REG_RIP];
+    fp = uc->uc_mcontext.gregs[REG_RBP];
+    sp = uc->uc_mcontext.gregs[REG_RSP];
+#elif defined(__aarch64__)
+    pc = uc->uc_mcontext.pc;
+    fp = uc->uc_mcontext.regs[29];
+    sp = uc->uc_mcontext.sp;
+#else
+    (void)uc;
+    return;
+#endif
+
+    unsigned int slot = __atomic_fetch_add(&_count, 1, __ATOMIC_RELAXED);
+    if (slot >= _capacity) {
+        __atomic_add_fetch(&_lost, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    prof_sample_t *sample = &_samples[slot];
+    worker_t *worker = worker_self();
+    task_t *task = worker != NULL ? worker->current_task : NULL;
+
+    // the main task runs on the thread stack, recorded when the worker
+    // started; with no bounds at all only the pc is kept
+    uintptr_t low = worker != NULL ? (uintptr_t)worker->stack_base : 0;
+    uintptr_t high = worker != NULL ? low + worker->stack_size : 0;
+
+    if (task != NULL && task->context.uc_stack.ss_sp != NULL) {
+        low = (uintptr_t)task->context.uc_stack.ss_sp;
+        high = low + task->context.uc_stack.ss_size;
+    }
+
+    // live frames lie above the stack pointer
+    if (sp > low && sp < high) {
+        low = sp;
+    }
+
+    sample->task = task != NULL ? task->id : -1;
+    sample->pcs[0] = pc;
+    sample->depth = 1;
+
+    // a frame record is the caller's frame pointer followed by the return
+    // address; the walk stops at the first record outside the stack
+    while (sample->depth < PROF_DEPTH && fp >= low && fp + 2 * sizeof(uintptr_t) <= high &&
+           fp % sizeof(uintptr_t) == 0) {
+        uintptr_t *frame = (uintptr_t*)fp;
+
+        if (frame[1] == 0) {
+            break;
+        }
+
+        sample->pcs[sample->depth++] = frame[1];
+
+        if (frame[0] <= fp) {
+            break;
+        }
+
+        fp = frame[0];
+    }
+}
+
+static int _compare_samples(const void *a, const void *b)
+{
+    const prof_sample_t *x = a;
+    const prof_sample_t *y = b;
+
+    if (x->task != y->task) {
+        return x->task < y->task ? -1 : 1;
+    }
+
+    if (x->depth != y->depth) {
+        return x->depth < y->depth ? -1 : 1;
+    }
+
+    for (unsigned int i = 0; i < x->depth; i++) {
+        if (x->pcs[i] != y->pcs[i]) {
+            return x->pcs[i] < y->pcs[i] ? -1 : 1;
+        }
+    }
+
+    return 0;
+}
+
+static void _print_frame(FILE *file, uintptr_t pc)
+{
+    Dl_info info;
+
+    if (dladdr((void*)pc, &info) == 0 || info.dli_fname == NULL) {
+        fprintf(file, "0x%lx", (unsigned long)pc);
+        return;
+    }
+
+    if (info.dli_sname != NULL) {
+        fprintf(file, "%s", info.dli_sname);
+        return;
+    }
+
+    const char *module = strrchr(info.dli_fname, '/');
+    fprintf(file, "%s+0x%lx", module != NULL ? module + 1 : info.dli_fname,
+            (unsigned long)(pc - (uintptr_t)info.dli_fbase));
+}
+
+static void _print_stack(FILE *file, prof_sample_t *sample, unsigned long count)
+{
+    fprintf(file, "task %d", sample->task);
+
+    for (int i = sample->depth - 1; i >= 0; i--) {
+        fputc(';', file);
+        // return addresses point past the call, inside the next line
+        _print_frame(file, i > 0 ? sample->pcs[i] - 1 : sample->pcs[i]);
+    }
+
+    fprintf(file, " %lu\n", count);
+}
+
+int prof_start(unsigned int every_ticks, unsigned int samples)
+{
+    if (samples == 0) {
+        LOG_ERR0("prof_start: cannot profile into an empty buffer");
+        return -1;
+    }
+
+    _stop_sampling();
+
+    ppos_core_t *core = worker_core();
+    bool preemptible = core != NULL && worker_self()->current_task != NULL;
+
+    if (preemptible) {
+        core->block_task_switch();
+    }
+
+    free(_samples);
+    _samples = calloc(samples, sizeof(prof_sample_t));
+
+    if (preemptible) {
+        core->enable_task_switch();
+    }
+
+    if (_samples == NULL) {
+        LOG_ERR("prof_start: failed to allocate %u samples", samples);
+        _capacity = 0;
+        return -1;
+    }
+
+    _capacity = samples;
+    _every = every_ticks > 0 ? every_ticks : 1;
+    __atomic_store_n(&_count, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&_lost, 0, __ATOMIC_RELAXED);
+
+    __atomic_store_n(&_active, true, __ATOMIC_SEQ_CST);
+    timer_set_sampler(_sample);
+    LOG_INFO("prof_start: sampling every %u ticks into %u samples", _every, samples);
+    return 0;
+}
+
+void prof_stop()
+{
+    _stop_sampling();
+}
+
+long prof_dump(const char *path)
+{
+    if (path == NULL || _samples == NULL) {
+        LOG_ERR0("prof_dump: no path or no profile");
+        return -1;
+    }
+
+    // the samples are sorted in place
+    prof_stop();
+
+    // stdio and qsort are not reentrant, so no other task may run meanwhile
+    ppos_core_t *core = worker_core();
+    bool preemptible = core != NULL && worker_self()->current_task != NULL;
+
+    if (preemptible) {
+        core->block_task_switch();
+    }
+
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        if (preemptible) {
+            core->enable_task_switch();
+        }
+        LOG_ERR("prof_dump: failed to open %s", path);
+        return -1;
+    }
+
+    unsigned int count = __atomic_load_n(&_count, __ATOMIC_RELAXED);
+    if (count > _capacity) {
+        count = _capacity;
+    }
+
+    qsort(_samples, count, sizeof(prof_sample_t), _compare_samples);
+
+    unsigned int start = 0;
+    for (unsigned int i = 1; i <= count; i++) {
+        if (i == count || _compare_samples(&_samples[start], &_samples[i]) != 0) {
+            _print_stack(file, &_samples[start], i - start);
+            start = i;
+        }
+    }
+
+    int closed = fclose(file);
+
+    if (preemptible) {
+        core->enable_task_switch();
+    }
+
+    if (closed != 0) {
+        LOG_ERR("prof_dump: failed to write %s", path);
+        return -1;
+    }
+
+    return count;
+}
+
+unsigned long prof_lost()
+{
+    return __atomic_load_n(&_lost, __ATOMIC_RELAXED);
+}
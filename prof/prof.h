@@ -0,0 +1,47 @@
+#ifndef __PROF_H__
+#define __PROF_H__
+
+/*
+ * Sampling CPU profiler driven by the tick. Every task shares the host
+ * threads, so samples are tagged with the task that was running: each
+ * sample holds the task id, the interrupted program counter and a short
+ * frame-pointer backtrace, taken from the signal context into a buffer
+ * preallocated by prof_start. Backtraces need frame pointers, which the
+ * -O0 build keeps
+ */
+
+#define PROF_DEPTH 16
+
+/*
+ * @brief Start sampling, dropping the samples of a previous profile
+ * @param every_ticks: take a sample every every_ticks ticks of each worker,
+ *        1 samples at the tick rate of 1 kHz
+ * @param samples: capacity of the sample buffer; samples past it are
+ *        counted as lost
+ * @return 0 on success, < 0 on error
+ */
+int prof_start(unsigned int every_ticks, unsigned int samples);
+
+/*
+ * @brief Stop sampling, keeping the samples for prof_dump
+ * @return void
+ */
+void prof_stop();
+
+/*
+ * @brief Write the samples as folded stacks for flame graphs: one line per
+ *        distinct stack, "task <id>;<root frame>;...;<leaf frame> <count>".
+ *        Frames are symbol names when the binary exports them (-rdynamic),
+ *        otherwise <module>+0x<offset> for addr2line. Sampling stops
+ * @param path: file to write
+ * @return number of samples written, < 0 on error
+ */
+long prof_dump(const char *path);
+
+/*
+ * @brief Get the number of samples dropped because the buffer was full
+ * @return number of lost samples
+ */
+unsigned long prof_lost();
+
+#endif
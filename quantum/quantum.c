@@ -0,0 +1,118 @@
+#include "quantum.h"
+#include "worker.h"
+#include "ppos.h"
+#include "logger.h"
+
+// moving average kept in fixed point, 1/8 of a tick
+#define RUN_AVG_SHIFT 3
+// weight of the newest sample is 1/4
+#define RUN_AVG_DECAY 2
+// tasks averaging less than this many ticks per activation are bursty
+#define SHORT_BURST_TICKS (TASK_QUANTUM / 4)
+
+static short _clamp_quantum(int ticks)
+{
+    if (ticks < worker_core()->min_quantum) {
+        return worker_core()->min_quantum;
+    }
+
+    if (ticks > worker_core()->max_quantum) {
+        return worker_core()->max_quantum;
+    }
+
+    return (short)ticks;
+}
+
+void quantum_setup(ppos_core_t *core)
+{
+    core->adaptive_quantum = false;
+    core->min_quantum = QUANTUM_DEFAULT_MIN;
+    core->max_quantum = QUANTUM_DEFAULT_MAX;
+    core->nr_short_ready = 0;
+}
+
+void quantum_release(task_t *task, bool preempted)
+{
+    if (!worker_core()->adaptive_quantum) {
+        task->quantum = TASK_QUANTUM;
+        task->short_burst = false;
+        return;
+    }
+
+    int used = preempted ? task->quantum : task->quantum - task->remaining_quantum;
+    if (used < 0) {
+        used = 0;
+    }
+
+    int avg = task->run_avg;
+    if (avg == 0) {
+        avg = used << RUN_AVG_SHIFT;
+    } else {
+        avg += ((used << RUN_AVG_SHIFT) - avg) >> RUN_AVG_DECAY;
+    }
+    task->run_avg = (unsigned short)avg;
+
+    // leave room to grow: a task using its whole quantum doubles it
+    task->quantum = _clamp_quantum((2 * avg) >> RUN_AVG_SHIFT);
+    task->short_burst = (avg >> RUN_AVG_SHIFT) < SHORT_BURST_TICKS;
+
+    LOG_TRACE("quantum_release: task %d used %d ticks (avg %d), quantum set to %d",
+              task->id, used, avg >> RUN_AVG_SHIFT, task->quantum);
+}
+
+void quantum_enqueue(task_t *task)
+{
+    task->queued_short = task->short_burst;
+
+    if (task->queued_short) {
+        worker_core()->nr_short_ready++;
+    }
+}
+
+void quantum_dequeue(task_t *task)
+{
+    if (task->queued_short) {
+        task->queued_short = false;
+        worker_core()->nr_short_ready--;
+    }
+}
+
+bool quantum_should_preempt(task_t *task)
+{
+    if (!worker_core()->adaptive_quantum || task->quantum - task->remaining_quantum < TASK_QUANTUM) {
+        return false;
+    }
+
+    if (worker_core()->nr_short_ready > 0) {
+        return true;
+    }
+
+    return worker_core()->sleep_queue != NULL && worker_core()->next_wakeup <= systime();
+}
+
+void task_adaptive_quantum(bool enabled)
+{
+    LOG_INFO("task_adaptive_quantum: adaptive quantum %s", enabled ? "enabled" : "disabled");
+    worker_core()->adaptive_quantum = enabled;
+}
+
+int task_quantum_bounds(short min_ticks, short max_ticks)
+{
+    if (min_ticks <= 0 || max_ticks < min_ticks) {
+        LOG_ERR("task_quantum_bounds: invalid bounds [%d, %d]", min_ticks, max_ticks);
+        return -1;
+    }
+
+    worker_core()->min_quantum = min_ticks;
+    worker_core()->max_quantum = max_ticks;
+    return 0;
+}
+
+short task_getquantum(task_t *task)
+{
+    if (task == NULL) {
+        task = worker_self()->current_task;
+    }
+
+    return task->quantum;
+}
@@ -0,0 +1,77 @@
+#ifndef __QUANTUM_H__
+#define __QUANTUM_H__
+
+#include <stdbool.h>
+
+#include "ppos_data.h"
+
+#define TASK_QUANTUM (short)20
+#define QUANTUM_DEFAULT_MIN (short)2
+#define QUANTUM_DEFAULT_MAX (short)200
+
+/*
+ * @brief Turn the adaptive quantum on or off for every task
+ * @param enabled: true sizes each quantum from the task run-length history,
+ *                 false restores the fixed TASK_QUANTUM
+ * @return void
+ */
+void task_adaptive_quantum(bool enabled);
+
+/*
+ * @brief Set the bounds used when sizing adaptive quanta
+ * @param min_ticks: shortest quantum a task can get
+ * @param max_ticks: longest quantum a task can get
+ * @return 0 on success, < 0 if the bounds are invalid
+ */
+int task_quantum_bounds(short min_ticks, short max_ticks);
+
+/*
+ * @brief Get the quantum currently assigned to a task
+ * @param task: task to query, or NULL for the current task
+ * @return the quantum in ticks
+ */
+short task_getquantum(task_t *task);
+
+/*
+ * Runtime internals, used by the core and the group module
+ */
+
+/*
+ * @brief Bind the quantum module to the ppos core
+ * @param core: pointer to the ppos core
+ * @return void
+ */
+void quantum_setup(ppos_core_t *core);
+
+/*
+ * @brief Record how much of its quantum a task used before releasing the CPU
+ *        and resize its quantum accordingly
+ * @param task: task leaving the processor
+ * @param preempted: true if the quantum expired
+ * @return void
+ */
+void quantum_release(task_t *task, bool preempted);
+
+/*
+ * @brief Track short-burst tasks entering the ready queue
+ * @param task: task being enqueued
+ * @return void
+ */
+void quantum_enqueue(task_t *task);
+
+/*
+ * @brief Track short-burst tasks leaving the ready queue
+ * @param task: task being dequeued
+ * @return void
+ */
+void quantum_dequeue(task_t *task);
+
+/*
+ * @brief Check if a task running past TASK_QUANTUM must give way to a
+ *        short-burst task, so longer quanta never delay bursty tasks
+ * @param task: task currently running
+ * @return true if the task must be preempted
+ */
+bool quantum_should_preempt(task_t *task);
+
+#endif
@@ -0,0 +1,367 @@
+#define _DEFAULT_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define READYSET_X86
+#endif
+
+#include "readyset.h"
+#include "dispatcher.h"
+#include "logger.h"
+
+#define READYSET_ALIGN 32
+#define READYSET_MIN_CAPACITY 64
+
+static readyset_mode_t _requested_mode = READYSET_OFF;
+static bool _mode_set = false;
+
+static const char *_mode_names[] = { "off", "auto", "scalar", "sse", "avx2" };
+
+static bool _supported(readyset_mode_t mode)
+{
+#ifdef READYSET_X86
+    if (mode == READYSET_SSE) {
+        return __builtin_cpu_supports("sse4.1");
+    }
+
+    if (mode == READYSET_AVX2) {
+        return __builtin_cpu_supports("avx2");
+    }
+#else
+    if (mode == READYSET_SSE || mode == READYSET_AVX2) {
+        return false;
+    }
+#endif
+
+    return true;
+}
+
+static readyset_mode_t _resolve(readyset_mode_t mode)
+{
+    if (mode != READYSET_AUTO) {
+        return mode;
+    }
+
+    return _supported(READYSET_AVX2) ? READYSET_AVX2 : _supported(READYSET_SSE) ? READYSET_SSE : READYSET_SCALAR;
+}
+
+static unsigned int _argmin_scalar(const int32_t *values, unsigned int count)
+{
+    unsigned int min_pos = 0;
+    int32_t min = values[0];
+
+    for (unsigned int i = 1; i < count; i++) {
+        bool lower = values[i] < min;
+        min_pos = lower ? i : min_pos;
+        min = lower ? values[i] : min;
+    }
+
+    return min_pos;
+}
+
+static void _age_scalar(int32_t *values, unsigned int count)
+{
+    for (unsigned int i = 0; i < count; i++) {
+        values[i] -= TASK_AGING_DECAY;
+    }
+}
+
+#ifdef READYSET_X86
+
+// the lowest value is found first, then its first position: both loops
+// only branch once per vector
+__attribute__((target("sse4.1")))
+static unsigned int _argmin_sse(const int32_t *values, unsigned int count)
+{
+    unsigned int i = 0;
+    int32_t min = INT32_MAX;
+
+    if (count >= 4) {
+        __m128i lowest = _mm_set1_epi32(INT32_MAX);
+
+        for (; i + 4 <= count; i += 4) {
+            lowest = _mm_min_epi32(lowest, _mm_load_si128((const __m128i*)(values + i)));
+        }
+
+        lowest = _mm_min_epi32(lowest, _mm_shuffle_epi32(lowest, _MM_SHUFFLE(1, 0, 3, 2)));
+        lowest = _mm_min_epi32(lowest, _mm_shuffle_epi32(lowest, _MM_SHUFFLE(2, 3, 0, 1)));
+        min = _mm_cvtsi128_si32(lowest);
+    }
+
+    for (; i < count; i++) {
+        min = values[i] < min ? values[i] : min;
+    }
+
+    __m128i target = _mm_set1_epi32(min);
+
+    for (i = 0; i + 4 <= count; i += 4) {
+        __m128i equal = _mm_cmpeq_epi32(_mm_load_si128((const __m128i*)(values + i)), target);
+        int mask = _mm_movemask_ps(_mm_castsi128_ps(equal));
+
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+
+    for (; values[i] != min; i++);
+    return i;
+}
+
+__attribute__((target("sse4.1")))
+static void _age_sse(int32_t *values, unsigned int count)
+{
+    __m128i decay = _mm_set1_epi32(TASK_AGING_DECAY);
+    unsigned int i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        __m128i *vector = (__m128i*)(values + i);
+        _mm_store_si128(vector, _mm_sub_epi32(_mm_load_si128(vector), decay));
+    }
+
+    _age_scalar(values + i, count - i);
+}
+
+__attribute__((target("avx2")))
+static unsigned int _argmin_avx2(const int32_t *values, unsigned int count)
+{
+    unsigned int i = 0;
+    int32_t min = INT32_MAX;
+
+    if (count >= 8) {
+        __m256i lowest = _mm256_set1_epi32(INT32_MAX);
+
+        for (; i + 8 <= count; i += 8) {
+            lowest = _mm256_min_epi32(lowest, _mm256_load_si256((const __m256i*)(values + i)));
+        }
+
+        __m128i half = _mm_min_epi32(_mm256_castsi256_si128(lowest), _mm256_extracti128_si256(lowest, 1));
+        half = _mm_min_epi32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(1, 0, 3, 2)));
+        half = _mm_min_epi32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(2, 3, 0, 1)));
+        min = _mm_cvtsi128_si32(half);
+    }
+
+    for (; i < count; i++) {
+        min = values[i] < min ? values[i] : min;
+    }
+
+    __m256i target = _mm256_set1_epi32(min);
+
+    for (i = 0; i + 8 <= count; i += 8) {
+        __m256i equal = _mm256_cmpeq_epi32(_mm256_load_si256((const __m256i*)(values + i)), target);
+        int mask = _mm256_movemask_ps(_mm256_castsi256_ps(equal));
+
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+
+    for (; values[i] != min; i++);
+    return i;
+}
+
+__attribute__((target("avx2")))
+static void _age_avx2(int32_t *values, unsigned int count)
+{
+    __m256i decay = _mm256_set1_epi32(TASK_AGING_DECAY);
+    unsigned int i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        __m256i *vector = (__m256i*)(values + i);
+        _mm256_store_si256(vector, _mm256_sub_epi32(_mm256_load_si256(vector), decay));
+    }
+
+    _age_scalar(values + i, count - i);
+}
+
+#endif
+
+static void _age(readyset_mode_t mode, int32_t *values, unsigned int count)
+{
+#ifdef READYSET_X86
+    if (mode == READYSET_AVX2) {
+        _age_avx2(values, count);
+        return;
+    }
+
+    if (mode == READYSET_SSE) {
+        _age_sse(values, count);
+        return;
+    }
+#endif
+
+    (void)mode;
+    _age_scalar(values, count);
+}
+
+unsigned int readyset_argmin(readyset_mode_t mode, const int32_t *values, unsigned int count)
+{
+#ifdef READYSET_X86
+    if (mode == READYSET_AVX2) {
+        return _argmin_avx2(values, count);
+    }
+
+    if (mode == READYSET_SSE) {
+        return _argmin_sse(values, count);
+    }
+#endif
+
+    return _argmin_scalar(values, count);
+}
+
+int ppos_readyset(readyset_mode_t mode)
+{
+    if (mode > READYSET_AVX2 || !_supported(mode)) {
+        LOG_ERR("ppos_readyset: ready set %d is not supported by this CPU", mode);
+        return -1;
+    }
+
+    _requested_mode = mode;
+    _mode_set = true;
+    return 0;
+}
+
+readyset_mode_t readyset_requested()
+{
+    if (_mode_set) {
+        return _resolve(_requested_mode);
+    }
+
+    char *env = getenv("PPOS_READYSET");
+    if (env == NULL) {
+        return READYSET_OFF;
+    }
+
+    for (int mode = READYSET_OFF; mode <= READYSET_AVX2; mode++) {
+        if (strcasecmp(env, _mode_names[mode]) == 0 && _supported(mode)) {
+            return _resolve(mode);
+        }
+    }
+
+    LOG_WARN("readyset_requested: ignoring PPOS_READYSET=%s", env);
+    return READYSET_OFF;
+}
+
+static int _grow(readyset_t *set)
+{
+    unsigned int capacity = set->capacity > 0 ? 2 * set->capacity : READYSET_MIN_CAPACITY;
+    void *priority = NULL;
+    void *task = NULL;
+
+    if (posix_memalign(&priority, READYSET_ALIGN, capacity * sizeof(int32_t)) != 0 ||
+        posix_memalign(&task, READYSET_ALIGN, capacity * sizeof(task_t*)) != 0) {
+        LOG_WARN("readyset_add: failed to grow to %u tasks", capacity);
+        free(priority);
+        return -1;
+    }
+
+    if (set->count > 0) {
+        memcpy(priority, set->priority, set->count * sizeof(int32_t));
+        memcpy(task, set->task, set->count * sizeof(task_t*));
+    }
+
+    free(set->priority);
+    free(set->task);
+    set->priority = priority;
+    set->task = task;
+    set->capacity = capacity;
+
+    return 0;
+}
+
+readyset_t* readyset_create(readyset_mode_t mode)
+{
+    readyset_t *set = calloc(1, sizeof(readyset_t));
+
+    if (set == NULL || _grow(set) < 0) {
+        LOG_ERR0("readyset_create: failed to allocate ready set");
+        free(set);
+        return NULL;
+    }
+
+    set->mode = mode;
+    return set;
+}
+
+void readyset_destroy(readyset_t *set)
+{
+    if (set != NULL) {
+        free(set->priority);
+        free(set->task);
+        free(set);
+    }
+}
+
+int readyset_add(readyset_t *set, task_t *task)
+{
+    if (set->count == set->capacity && _grow(set) < 0) {
+        return -1;
+    }
+
+    set->priority[set->count] = task->dynamic_priority;
+    set->task[set->count] = task;
+    set->count++;
+
+    return 0;
+}
+
+static int _position(readyset_t *set, task_t *task)
+{
+    if (set->picked < set->count && set->task[set->picked] == task) {
+        return set->picked;
+    }
+
+    for (unsigned int i = 0; i < set->count; i++) {
+        if (set->task[i] == task) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+int readyset_remove(readyset_t *set, task_t *task)
+{
+    int pos = _position(set, task);
+
+    if (pos < 0) {
+        return -1;
+    }
+
+    // the tasks behind move up, keeping the queue order ties are broken by
+    unsigned int behind = set->count - pos - 1;
+
+    task->dynamic_priority = set->priority[pos];
+    memmove(set->priority + pos, set->priority + pos + 1, behind * sizeof(int32_t));
+    memmove(set->task + pos, set->task + pos + 1, behind * sizeof(task_t*));
+    set->count--;
+
+    return 0;
+}
+
+void readyset_update(readyset_t *set, task_t *task)
+{
+    int pos = _position(set, task);
+
+    if (pos >= 0) {
+        set->priority[pos] = task->dynamic_priority;
+    }
+}
+
+task_t* readyset_pick(readyset_t *set)
+{
+    unsigned int pos = readyset_argmin(set->mode, set->priority, set->count);
+
+    // the queue walk ages every task it passes over, and the head once more
+    // when it compares it against the pick at the end of the lap
+    _age(set->mode, set->priority, set->count);
+    if (pos != 0) {
+        set->priority[0] -= TASK_AGING_DECAY;
+    }
+
+    set->picked = pos;
+    return set->task[pos];
+}
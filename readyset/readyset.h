@@ -0,0 +1,111 @@
+#ifndef __READYSET_H__
+#define __READYSET_H__
+
+#include <stdint.h>
+
+#include "ppos_data.h"
+
+/*
+ * Ready set kept as arrays, next to the ready queue of each group: the
+ * dynamic priorities and the tasks, in queue order, in dense 32-byte
+ * aligned arrays. The priority scheduler then picks with an argmin over
+ * the priority array and ages the other tasks with one vector subtract,
+ * instead of walking the queue. The pick is the one of the queue walk:
+ * the first task with the lowest dynamic priority, counting from the head
+ * of the queue, and the head ages twice when it is not picked. The ready
+ * queue itself is still kept, for everything but the pick
+ */
+
+typedef enum {
+    READYSET_OFF = 0,   // walk the ready queue
+    READYSET_AUTO,      // the widest of the following the CPU supports
+    READYSET_SCALAR,
+    READYSET_SSE,       // SSE4.1
+    READYSET_AVX2,
+} readyset_mode_t;
+
+typedef struct readyset_t
+{
+    int32_t *priority;
+    task_t **task;
+    unsigned int count;
+    unsigned int capacity;
+    unsigned int picked;    // position of the last pick, checked first on remove
+    readyset_mode_t mode;
+    struct readyset_t *next;    // sets of the runtime, freed with it
+} readyset_t;
+
+/*
+ * @brief Select the ready set of the runtimes started afterwards; must be
+ *        called before ppos_init or ppos_run. PPOS_READYSET=off, auto,
+ *        scalar, sse or avx2 is used when this is not called
+ * @param mode: representation, and instruction set of the pick
+ * @return 0 on success, < 0 if the CPU lacks the instruction set
+ */
+int ppos_readyset(readyset_mode_t mode);
+
+/*
+ * Runtime internals, used by the group module and the dispatcher
+ */
+
+/*
+ * @brief Get the ready set for the next runtime, resolving READYSET_AUTO
+ * @return the mode, READYSET_OFF when the queue walk is used
+ */
+readyset_mode_t readyset_requested();
+
+/*
+ * @brief Create an empty ready set
+ * @param mode: instruction set of the pick, READYSET_SCALAR and up
+ * @return the set, NULL on error
+ */
+readyset_t* readyset_create(readyset_mode_t mode);
+
+/*
+ * @brief Free a ready set
+ * @param set: set to free, may be NULL
+ * @return void
+ */
+void readyset_destroy(readyset_t *set);
+
+/*
+ * @brief Append a task, with its dynamic priority, at the tail
+ * @param set: set to append to
+ * @param task: task to append
+ * @return 0 on success, < 0 on error
+ */
+int readyset_add(readyset_t *set, task_t *task);
+
+/*
+ * @brief Remove a task, writing its aged dynamic priority back to it
+ * @param set: set to remove from
+ * @param task: task to remove
+ * @return 0 on success, < 0 if the task is not in the set
+ */
+int readyset_remove(readyset_t *set, task_t *task);
+
+/*
+ * @brief Copy a new dynamic priority of a task into the set
+ * @param set: set holding the task
+ * @param task: task whose priority changed
+ * @return void
+ */
+void readyset_update(readyset_t *set, task_t *task);
+
+/*
+ * @brief Pick the task to run and age the others, like the queue walk
+ * @param set: non-empty set to pick from
+ * @return the picked task, still in the set
+ */
+task_t* readyset_pick(readyset_t *set);
+
+/*
+ * @brief Find the first lowest value, as the pick does
+ * @param mode: instruction set to use, READYSET_SCALAR and up
+ * @param values: values to scan
+ * @param count: number of values, > 0
+ * @return position of the first lowest value
+ */
+unsigned int readyset_argmin(readyset_mode_t mode, const int32_t *values, unsigned int count);
+
+#endif
@@ -0,0 +1,431 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "replay.h"
+#include "timer.h"
+#include "worker.h"
+#include "logger.h"
+
+#define REPLAY_BUFFER 4096
+#define REPLAY_MAX_READS ((1U << REPLAY_READS_BITS) - 1)
+
+typedef enum {
+    REPLAY_OFF = 0,
+    REPLAY_RECORDING,
+    REPLAY_REPLAYING,
+} replay_mode_t;
+
+int replay_pending = 0;
+
+// set by replay_record and replay_start for the next runtime
+static replay_mode_t _requested = REPLAY_OFF;
+static char _requested_path[PATH_MAX];
+
+static replay_mode_t _mode = REPLAY_OFF;
+static uint64_t _reads = 0;
+
+// recording: events are written out whenever the buffer fills, with
+// write(2), since the tick handler records too
+static int _fd = -1;
+static replay_event_t _buffer[REPLAY_BUFFER];
+static unsigned int _buffered = 0;
+static uint64_t _last_event_reads = 0;
+static unsigned long _recorded = 0;
+static unsigned int _last_clock = 0;
+static bool _clock_known = false;
+
+// replaying: the event at _cursor is due after _due clock reads
+static replay_event_t *_log = NULL;
+static long _events = 0;
+static long _cursor = 0;
+static uint64_t _due = 0;
+static unsigned int _clock_value = 0;
+static long _divergence = -1;
+
+static void _flush()
+{
+    size_t size = _buffered * sizeof(replay_event_t);
+    const char *data = (const char*)_buffer;
+
+    while (size > 0) {
+        ssize_t written = write(_fd, data, size);
+        if (written <= 0) {
+            break;
+        }
+
+        data += written;
+        size -= written;
+    }
+
+    _buffered = 0;
+}
+
+static void _push(replay_kind_t kind, uint32_t reads, uint32_t value)
+{
+    _buffer[_buffered].kind = kind;
+    _buffer[_buffered].reads = reads;
+    _buffer[_buffered].value = value;
+    _recorded++;
+
+    if (++_buffered == REPLAY_BUFFER) {
+        _flush();
+    }
+}
+
+static void _emit(replay_kind_t kind, uint32_t value)
+{
+    uint64_t reads = _reads - _last_event_reads;
+
+    while (reads > REPLAY_MAX_READS) {
+        _push(REPLAY_SKIP, REPLAY_MAX_READS, 0);
+        reads -= REPLAY_MAX_READS;
+    }
+
+    _push(kind, reads, value);
+    _last_event_reads = _reads;
+}
+
+static unsigned int _record_clock(unsigned int now)
+{
+    if (!_clock_known || now != _last_clock) {
+        _emit(REPLAY_CLOCK, now);
+        _last_clock = now;
+        _clock_known = true;
+    }
+
+    _reads++;
+    return now;
+}
+
+static void _advance()
+{
+    if (++_cursor < _events) {
+        _due += _log[_cursor].reads;
+    }
+}
+
+// the run no longer matches the log: it goes on with virtual time
+static void _stop_replay()
+{
+    _mode = REPLAY_OFF;
+    replay_pending = 0;
+    timer_set_clock_hook(NULL, false);
+}
+
+static void _diverge(const char *where)
+{
+    (void)where;
+
+    _divergence = _cursor;
+    LOG_WARN("replay: run diverged from the log at event %ld of %ld, %s", _cursor, _events, where);
+    _stop_replay();
+}
+
+static bool _due_now(replay_kind_t kind)
+{
+    while (_cursor < _events && _due == _reads && _log[_cursor].kind == REPLAY_SKIP) {
+        _advance();
+    }
+
+    return _cursor < _events && _due == _reads && _log[_cursor].kind == kind;
+}
+
+static unsigned int _replay_clock(unsigned int now)
+{
+    (void)now;
+
+    // every event due before this read is a clock change; a tick or pick
+    // still due means the run took another path
+    while (_cursor < _events && _due <= _reads) {
+        replay_kind_t kind = _log[_cursor].kind;
+
+        if (_due < _reads || (kind != REPLAY_CLOCK && kind != REPLAY_SKIP)) {
+            _diverge("at a clock read");
+            return _clock_value;
+        }
+
+        if (kind == REPLAY_CLOCK) {
+            _clock_value = _log[_cursor].value;
+            timer_idle_until(_clock_value);
+        }
+
+        _advance();
+    }
+
+    _reads++;
+
+    if (_cursor >= _events) {
+        LOG_INFO("replay: all %ld events repeated", _events);
+        _stop_replay();
+    } else if (_due_now(REPLAY_TICK)) {
+        // held by the timer until this read returns
+        replay_pending = 1;
+        timer_raise_tick();
+    }
+
+    return _clock_value;
+}
+
+static int _load(const char *path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        LOG_ERR("replay_setup: failed to open %s", path);
+        return -1;
+    }
+
+    struct stat st;
+    replay_header_t header;
+
+    if (fstat(fd, &st) < 0 || read(fd, &header, sizeof(header)) != sizeof(header) ||
+        header.magic != REPLAY_MAGIC || header.version != REPLAY_VERSION) {
+        LOG_ERR("replay_setup: %s is not a schedule recording", path);
+        close(fd);
+        return -1;
+    }
+
+    _events = (st.st_size - sizeof(header)) / sizeof(replay_event_t);
+    _log = malloc(_events * sizeof(replay_event_t) + 1);
+    if (_log == NULL) {
+        LOG_ERR("replay_setup: failed to allocate %ld events", _events);
+        close(fd);
+        return -1;
+    }
+
+    size_t size = _events * sizeof(replay_event_t);
+    char *data = (char*)_log;
+
+    while (size > 0) {
+        ssize_t got = read(fd, data, size);
+        if (got <= 0) {
+            break;
+        }
+
+        data += got;
+        size -= got;
+    }
+
+    close(fd);
+
+    if (size > 0 || _events == 0) {
+        LOG_ERR("replay_setup: %s is truncated or empty", path);
+        free(_log);
+        _log = NULL;
+        return -1;
+    }
+
+    return 0;
+}
+
+static int _request(replay_mode_t mode, const char *path)
+{
+    if (path == NULL || strlen(path) >= sizeof(_requested_path)) {
+        LOG_ERR0("replay: invalid recording path");
+        return -1;
+    }
+
+    strcpy(_requested_path, path);
+    _requested = mode;
+    return 0;
+}
+
+int replay_record(const char *path)
+{
+    return _request(REPLAY_RECORDING, path);
+}
+
+int replay_start(const char *path)
+{
+    return _request(REPLAY_REPLAYING, path);
+}
+
+long replay_divergence()
+{
+    return _divergence;
+}
+
+int replay_setup()
+{
+    replay_mode_t mode = _requested;
+    const char *path = _requested_path;
+    _requested = REPLAY_OFF;
+
+    if (mode == REPLAY_OFF && (path = getenv("PPOS_RECORD")) != NULL) {
+        mode = REPLAY_RECORDING;
+    } else if (mode == REPLAY_OFF && (path = getenv("PPOS_REPLAY")) != NULL) {
+        mode = REPLAY_REPLAYING;
+    }
+
+    // the clock hook and the log are process-wide, so no other runtime may
+    // start while one is recorded or replayed
+    if (_mode != REPLAY_OFF) {
+        LOG_ERR0("replay_setup: another runtime is being recorded or replayed");
+        return -1;
+    }
+
+    if (mode == REPLAY_OFF) {
+        return 0;
+    }
+
+    _reads = 0;
+    replay_pending = 0;
+
+    if (mode == REPLAY_RECORDING) {
+        _fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        replay_header_t header = { REPLAY_MAGIC, REPLAY_VERSION };
+
+        if (_fd < 0 || write(_fd, &header, sizeof(header)) != sizeof(header)) {
+            LOG_ERR("replay_setup: failed to create %s", path);
+            if (_fd >= 0) {
+                close(_fd);
+                _fd = -1;
+            }
+            return 0;
+        }
+
+        // ticks of several workers would not be ordered against each other
+        ppos_workers(1);
+        _buffered = 0;
+        _recorded = 0;
+        _last_event_reads = 0;
+        _clock_known = false;
+        _mode = REPLAY_RECORDING;
+        timer_set_clock_hook(_record_clock, false);
+        LOG_INFO("replay_setup: recording the schedule into %s", path);
+        return 0;
+    }
+
+    if (_load(path) < 0) {
+        return 0;
+    }
+
+    // no host tick may reach the run, and it stays on one worker
+    if (ppos_virtual_time(0, 0) < 0) {
+        free(_log);
+        _log = NULL;
+        return 0;
+    }
+
+    _cursor = 0;
+    _due = _log[0].reads;
+    _clock_value = 0;
+    _divergence = -1;
+    _mode = REPLAY_REPLAYING;
+    timer_set_clock_hook(_replay_clock, true);
+    LOG_INFO("replay_setup: replaying %ld events from %s", _events, path);
+    return 0;
+}
+
+void replay_finish()
+{
+    if (_mode == REPLAY_RECORDING) {
+        timer_set_clock_hook(NULL, false);
+        _flush();
+        close(_fd);
+        _fd = -1;
+        _mode = REPLAY_OFF;
+        LOG_INFO("replay_finish: recorded %lu events", _recorded);
+        return;
+    }
+
+    if (_mode == REPLAY_REPLAYING && _cursor < _events) {
+        _diverge("as the run ended");
+    } else if (_mode == REPLAY_REPLAYING) {
+        _stop_replay();
+    }
+
+    free(_log);
+    _log = NULL;
+}
+
+bool replay_tick(task_t *task)
+{
+    if (_mode == REPLAY_RECORDING) {
+        _emit(REPLAY_TICK, task->id);
+        return true;
+    }
+
+    if (_mode != REPLAY_REPLAYING) {
+        return true;
+    }
+
+    // a tick raised again after it was taken
+    if (!replay_pending) {
+        return false;
+    }
+
+    replay_pending = 0;
+
+    if (!_due_now(REPLAY_TICK) || _log[_cursor].value != (uint32_t)task->id) {
+        _diverge("at a tick");
+        return true;
+    }
+
+    _advance();
+    return true;
+}
+
+bool replay_preempt(task_t *task, bool preempt)
+{
+    if (_mode == REPLAY_RECORDING) {
+        if (preempt) {
+            _emit(REPLAY_PREEMPT, task->id);
+        }
+        return preempt;
+    }
+
+    if (_mode != REPLAY_REPLAYING) {
+        return preempt;
+    }
+
+    if (_due_now(REPLAY_PREEMPT) && _log[_cursor].value == (uint32_t)task->id) {
+        _advance();
+        return true;
+    }
+
+    return false;
+}
+
+task_t* replay_pick(task_t *ready, task_t *picked)
+{
+    if (_mode == REPLAY_RECORDING) {
+        _emit(REPLAY_PICK, picked->id);
+        return picked;
+    }
+
+    if (_mode != REPLAY_REPLAYING) {
+        return picked;
+    }
+
+    if (!_due_now(REPLAY_PICK)) {
+        _diverge("at a dispatch");
+        return picked;
+    }
+
+    int id = _log[_cursor].value;
+    task_t *task = ready;
+
+    // the scheduler may prefer another task, the recorded one must be ready
+    do {
+        if (task->id == id) {
+            _advance();
+            return task;
+        }
+        task = task->next;
+    } while (task != ready);
+
+    _diverge("at a dispatch, the recorded task is not ready");
+    return picked;
+}
+
+void replay_poll()
+{
+    if (_mode == REPLAY_REPLAYING && replay_pending) {
+        timer_raise_tick();
+    }
+}
@@ -0,0 +1,123 @@
+#ifndef __REPLAY_H__
+#define __REPLAY_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "ppos_data.h"
+
+/*
+ * Schedule record and replay. Recording logs, against the number of clock
+ * reads made so far, every change of the value systime returns, every tick
+ * that reached a task with task switch enabled, every preemption and every
+ * task picked by the dispatcher. Replaying runs on virtual time, answers
+ * each clock read from the log, raises each tick after the same read and
+ * forces the same preemptions and picks, until the run diverges from the
+ * log. Both need one worker and one runtime, other runtimes are refused
+ * while one is recorded or replayed; ticks are placed between
+ * clock reads, so a task computing without entering the runtime may still
+ * run a little further before a replayed tick than before the recorded one
+ */
+
+#define REPLAY_MAGIC 0x50525052  // "RPRP"
+#define REPLAY_VERSION 1
+
+typedef enum {
+    REPLAY_CLOCK = 0,   // from this read on, systime returns value
+    REPLAY_TICK,        // a tick reached task value
+    REPLAY_PREEMPT,     // that tick preempted task value
+    REPLAY_PICK,        // the dispatcher picked task value
+    REPLAY_SKIP,        // only carries reads, when they overflow an event
+    REPLAY_KINDS,
+} replay_kind_t;
+
+#define REPLAY_KIND_BITS 3
+#define REPLAY_READS_BITS (32 - REPLAY_KIND_BITS)
+
+typedef struct replay_header_t
+{
+    uint32_t magic;
+    uint32_t version;
+} replay_header_t;
+
+// reads is the number of clock reads since the previous event
+typedef struct replay_event_t
+{
+    uint32_t kind : REPLAY_KIND_BITS;
+    uint32_t reads : REPLAY_READS_BITS;
+    uint32_t value;
+} replay_event_t;
+
+/*
+ * @brief Record the schedule of the next runtime to start;
+ *        PPOS_RECORD=<path> does the same for every runtime
+ * @param path: file to write
+ * @return 0 on success, < 0 on error
+ */
+int replay_record(const char *path);
+
+/*
+ * @brief Replay a recorded schedule in the next runtime to start;
+ *        PPOS_REPLAY=<path> does the same for every runtime
+ * @param path: file written by a recording
+ * @return 0 on success, < 0 on error
+ */
+int replay_start(const char *path);
+
+/*
+ * @brief Get where the last replay left the log
+ * @return index of the first event the run did not repeat, -1 if the run
+ *         repeated every event so far
+ */
+long replay_divergence();
+
+/*
+ * Runtime internals, used by the core and the dispatcher
+ */
+
+extern int replay_pending;
+
+/*
+ * @brief Start the requested recording or replay as a runtime is created,
+ *        before its workers
+ * @return 0 on success, < 0 while another runtime is recorded or replayed
+ */
+int replay_setup();
+
+/*
+ * @brief Flush the recording or end the replay as a runtime is destroyed
+ * @return void
+ */
+void replay_finish();
+
+/*
+ * @brief Account a tick that reached a task with task switch enabled
+ * @param task: task the tick interrupted
+ * @return false when a replay has no tick due, and the tick is dropped
+ */
+bool replay_tick(task_t *task);
+
+/*
+ * @brief Account the preemption decision of a tick
+ * @param task: task the tick interrupted
+ * @param preempt: decision of the tick handler
+ * @return the decision to apply: the recorded one on replay
+ */
+bool replay_preempt(task_t *task, bool preempt);
+
+/*
+ * @brief Account the task picked by the dispatcher
+ * @param ready: first task of the ready queue the task was picked from
+ * @param picked: task the scheduler picked
+ * @return the task to run: the recorded one on replay
+ */
+task_t* replay_pick(task_t *ready, task_t *picked);
+
+/*
+ * @brief Raise again a replayed tick held back while task switch was
+ *        blocked; called when task switch is enabled with replay_pending set
+ * @return void
+ */
+void replay_poll();
+
+#endif
@@ -0,0 +1,134 @@
+#define _DEFAULT_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "slab.h"
+#include "logger.h"
+
+// a slot is in use while its generation is odd
+#define _LIVE(generation) ((generation) & 1)
+
+static slab_chunk_t* _chunk(slab_t *slab, uint32_t index)
+{
+    if (index / SLAB_CHUNK >= SLAB_MAX_CHUNKS) {
+        return NULL;
+    }
+
+    return __atomic_load_n(&slab->chunks[index / SLAB_CHUNK], __ATOMIC_ACQUIRE);
+}
+
+static int _grow(slab_t *slab)
+{
+    uint32_t first = slab->nr_slots;
+
+    if (first / SLAB_CHUNK >= SLAB_MAX_CHUNKS) {
+        LOG_WARN("slab_alloc: slab is full with %u slots", first);
+        return -1;
+    }
+
+    slab_chunk_t *chunk = calloc(1, sizeof(slab_chunk_t));
+    void *objects = NULL;
+
+    if (chunk == NULL || posix_memalign(&objects, SLAB_ALIGN, SLAB_CHUNK * slab->stride) != 0) {
+        LOG_WARN0("slab_alloc: failed to allocate chunk");
+        free(chunk);
+        return -1;
+    }
+
+    memset(objects, 0, SLAB_CHUNK * slab->stride);
+    chunk->objects = objects;
+
+    // the new slots go to the free list in index order
+    for (uint32_t i = 0; i < SLAB_CHUNK; i++) {
+        chunk->next_free[i] = (i + 1 < SLAB_CHUNK) ? first + i + 2 : slab->free_head;
+    }
+
+    slab->free_head = first + 1;
+    slab->nr_slots += SLAB_CHUNK;
+    __atomic_store_n(&slab->chunks[first / SLAB_CHUNK], chunk, __ATOMIC_RELEASE);
+
+    return 0;
+}
+
+slab_t* slab_create(size_t object_size)
+{
+    slab_t *slab = calloc(1, sizeof(slab_t));
+
+    if (slab == NULL) {
+        LOG_ERR0("slab_create: failed to allocate slab");
+        return NULL;
+    }
+
+    slab->stride = (object_size + SLAB_ALIGN - 1) & ~(size_t)(SLAB_ALIGN - 1);
+    return slab;
+}
+
+void slab_destroy(slab_t *slab)
+{
+    if (slab == NULL) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < slab->nr_slots / SLAB_CHUNK; i++) {
+        free(slab->chunks[i]->objects);
+        free(slab->chunks[i]);
+    }
+
+    free(slab);
+}
+
+void* slab_alloc(slab_t *slab, uint32_t *index)
+{
+    if (slab->free_head == 0 && _grow(slab) < 0) {
+        return NULL;
+    }
+
+    uint32_t slot = slab->free_head - 1;
+    slab_chunk_t *chunk = slab->chunks[slot / SLAB_CHUNK];
+
+    slab->free_head = chunk->next_free[slot % SLAB_CHUNK];
+    slab->nr_used++;
+    __atomic_add_fetch(&chunk->generation[slot % SLAB_CHUNK], 1, __ATOMIC_RELEASE);
+
+    *index = slot;
+    return chunk->objects + (slot % SLAB_CHUNK) * slab->stride;
+}
+
+void slab_free(slab_t *slab, uint32_t index)
+{
+    slab_chunk_t *chunk = _chunk(slab, index);
+
+    if (chunk == NULL || !_LIVE(chunk->generation[index % SLAB_CHUNK])) {
+        LOG_WARN("slab_free: slot %u is not in use", index);
+        return;
+    }
+
+    __atomic_add_fetch(&chunk->generation[index % SLAB_CHUNK], 1, __ATOMIC_RELEASE);
+    chunk->next_free[index % SLAB_CHUNK] = slab->free_head;
+    slab->free_head = index + 1;
+    slab->nr_used--;
+}
+
+void* slab_object(slab_t *slab, uint32_t index)
+{
+    slab_chunk_t *chunk = _chunk(slab, index);
+
+    return chunk != NULL ? chunk->objects + (index % SLAB_CHUNK) * slab->stride : NULL;
+}
+
+uint32_t slab_generation(slab_t *slab, uint32_t index)
+{
+    slab_chunk_t *chunk = _chunk(slab, index);
+
+    return chunk != NULL ? __atomic_load_n(&chunk->generation[index % SLAB_CHUNK], __ATOMIC_ACQUIRE) : 0;
+}
+
+void* slab_lookup(slab_t *slab, uint32_t index, uint32_t generation)
+{
+    if (!_LIVE(generation) || slab_generation(slab, index) != generation) {
+        return NULL;
+    }
+
+    return slab_object(slab, index);
+}
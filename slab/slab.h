@@ -0,0 +1,93 @@
+#ifndef __SLAB_H__
+#define __SLAB_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Slab of fixed-size objects. Objects are carved from chunks of
+ * SLAB_CHUNK contiguous, cache-line aligned slots and are never returned
+ * to the allocator before the slab is destroyed, so a freed slot keeps its
+ * contents until it is reused. Every slot has a generation, bumped when it
+ * is freed: an (index, generation) pair names one use of a slot and goes
+ * stale once that use ends. The slab takes no lock, its owner serializes
+ * alloc and free; lookups may run concurrently with them
+ */
+
+#define SLAB_ALIGN 64
+#define SLAB_CHUNK 64
+#define SLAB_MAX_CHUNKS 4096
+
+typedef struct slab_chunk_t
+{
+    uint32_t generation[SLAB_CHUNK];
+    uint32_t next_free[SLAB_CHUNK];
+    char *objects;
+} slab_chunk_t;
+
+typedef struct slab_t
+{
+    size_t stride;
+    uint32_t nr_slots;
+    uint32_t nr_used;
+    uint32_t free_head;     // index + 1 of the first free slot, 0 if none
+    slab_chunk_t *chunks[SLAB_MAX_CHUNKS];
+} slab_t;
+
+/*
+ * @brief Create a slab
+ * @param object_size: size of each object, rounded up to SLAB_ALIGN
+ * @return the slab, NULL on error
+ */
+slab_t* slab_create(size_t object_size);
+
+/*
+ * @brief Free a slab with all of its chunks
+ * @param slab: slab to free, may be NULL
+ * @return void
+ */
+void slab_destroy(slab_t *slab);
+
+/*
+ * @brief Take a free slot, adding a chunk when none is left. A slot never
+ *        used before is zeroed, a reused one keeps its old contents
+ * @param slab: slab to take the slot from
+ * @param index: set to the index of the slot
+ * @return the object, NULL when the slab is full or out of memory
+ */
+void* slab_alloc(slab_t *slab, uint32_t *index);
+
+/*
+ * @brief Give a slot back, making its current generation stale
+ * @param slab: slab the slot belongs to
+ * @param index: index of the slot
+ * @return void
+ */
+void slab_free(slab_t *slab, uint32_t index);
+
+/*
+ * @brief Get the object of a slot, in use or not
+ * @param slab: slab the slot belongs to
+ * @param index: index of the slot
+ * @return the object, NULL if index is past the allocated chunks
+ */
+void* slab_object(slab_t *slab, uint32_t index);
+
+/*
+ * @brief Get the current generation of a slot
+ * @param slab: slab the slot belongs to
+ * @param index: index of the slot
+ * @return the generation, 0 if index is past the allocated chunks
+ */
+uint32_t slab_generation(slab_t *slab, uint32_t index);
+
+/*
+ * @brief Find the object of a use of a slot, in O(1)
+ * @param slab: slab the slot belongs to
+ * @param index: index of the slot
+ * @param generation: generation of the use
+ * @return the object, NULL if that use of the slot ended
+ */
+void* slab_lookup(slab_t *slab, uint32_t index, uint32_t generation);
+
+#endif
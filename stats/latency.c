@@ -0,0 +1,276 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "latency.h"
+#include "worker.h"
+#include "timer.h"
+#include "logger.h"
+
+typedef struct latency_hist_t
+{
+    unsigned long long sum;
+    unsigned long long max;
+    unsigned long long buckets[LATENCY_BUCKETS];
+} latency_hist_t;
+
+// allocated zeroed, the pages of unused priorities and groups are never
+// touched; records are relaxed atomic adds, no lock is taken
+typedef struct latency_t
+{
+    latency_hist_t prio[LATENCY_KINDS][LATENCY_PRIORITIES];
+    latency_hist_t group[LATENCY_KINDS][LATENCY_GROUPS];
+} latency_t;
+
+static uint64_t _now_ns()
+{
+    if (timer_is_virtual()) {
+        return timer_virtual_ns();
+    }
+
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static unsigned int _bucket(uint64_t ns)
+{
+    if (ns < (1U << LATENCY_SUB_BITS)) {
+        return ns;
+    }
+
+    int shift = 63 - __builtin_clzll(ns) - LATENCY_SUB_BITS;
+
+    if (shift > LATENCY_MAX_SHIFT) {
+        return LATENCY_BUCKETS - 1;
+    }
+
+    return ((shift + 1) << LATENCY_SUB_BITS) + (ns >> shift) - (1U << LATENCY_SUB_BITS);
+}
+
+// highest value that falls into a bucket
+static uint64_t _bucket_value(unsigned int bucket)
+{
+    if (bucket < (1U << LATENCY_SUB_BITS)) {
+        return bucket;
+    }
+
+    int shift = (bucket >> LATENCY_SUB_BITS) - 1;
+    uint64_t sub = bucket & ((1U << LATENCY_SUB_BITS) - 1);
+
+    return (((1ULL << LATENCY_SUB_BITS) + sub + 1) << shift) - 1;
+}
+
+static void _record(latency_hist_t *hist, uint64_t ns)
+{
+    __atomic_add_fetch(&hist->buckets[_bucket(ns)], 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&hist->sum, ns, __ATOMIC_RELAXED);
+
+    unsigned long long max = __atomic_load_n(&hist->max, __ATOMIC_RELAXED);
+    while (ns > max && !__atomic_compare_exchange_n(&hist->max, &max, ns, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+static uint64_t _percentile(const unsigned long long *buckets, unsigned long long count, unsigned int per_100k)
+{
+    unsigned long long rank = (count * per_100k + 99999) / 100000;
+    unsigned long long seen = 0;
+
+    if (rank == 0) {
+        rank = 1;
+    }
+
+    for (unsigned int i = 0; i < LATENCY_BUCKETS; i++) {
+        seen += buckets[i];
+
+        if (seen >= rank) {
+            return _bucket_value(i);
+        }
+    }
+
+    return 0;
+}
+
+// merges histograms into a summary; a record racing with the copy may be
+// missing from the buckets but counted in the sum, which only skews the mean
+static void _summarize(latency_hist_t **hists, int nr_hists, latency_summary_t *summary)
+{
+    unsigned long long buckets[LATENCY_BUCKETS];
+    unsigned long long sum = 0;
+
+    memset(buckets, 0, sizeof(buckets));
+    memset(summary, 0, sizeof(latency_summary_t));
+
+    for (int h = 0; h < nr_hists; h++) {
+        for (unsigned int i = 0; i < LATENCY_BUCKETS; i++) {
+            unsigned long long n = __atomic_load_n(&hists[h]->buckets[i], __ATOMIC_RELAXED);
+
+            buckets[i] += n;
+            summary->count += n;
+        }
+
+        sum += __atomic_load_n(&hists[h]->sum, __ATOMIC_RELAXED);
+
+        unsigned long long max = __atomic_load_n(&hists[h]->max, __ATOMIC_RELAXED);
+        if (max > summary->max_ns) {
+            summary->max_ns = max;
+        }
+    }
+
+    if (summary->count == 0) {
+        return;
+    }
+
+    summary->mean_ns = sum / summary->count;
+    summary->p50_ns = _percentile(buckets, summary->count, 50000);
+    summary->p99_ns = _percentile(buckets, summary->count, 99000);
+    summary->p999_ns = _percentile(buckets, summary->count, 99900);
+
+    // the buckets round up, the maximum is exact
+    if (summary->p50_ns > summary->max_ns) {
+        summary->p50_ns = summary->max_ns;
+    }
+    if (summary->p99_ns > summary->max_ns) {
+        summary->p99_ns = summary->max_ns;
+    }
+    if (summary->p999_ns > summary->max_ns) {
+        summary->p999_ns = summary->max_ns;
+    }
+}
+
+static latency_t* _latency(latency_kind_t kind, latency_summary_t *summary)
+{
+    ppos_core_t *core = worker_core();
+
+    if (core == NULL || core->latency == NULL || summary == NULL || kind < 0 || kind >= LATENCY_KINDS) {
+        return NULL;
+    }
+
+    return core->latency;
+}
+
+int latency_prio(int prio, latency_kind_t kind, latency_summary_t *summary)
+{
+    latency_t *latency = _latency(kind, summary);
+
+    if (latency == NULL || prio < MIN_PRIORITY || prio > MAX_PRIORITY) {
+        LOG_ERR("latency_prio: invalid priority %d or no histograms", prio);
+        return -1;
+    }
+
+    latency_hist_t *hist = &latency->prio[kind][prio - MIN_PRIORITY];
+    _summarize(&hist, 1, summary);
+    return 0;
+}
+
+int latency_group(task_group_t *group, latency_kind_t kind, latency_summary_t *summary)
+{
+    latency_t *latency = _latency(kind, summary);
+
+    if (group == NULL && worker_core() != NULL) {
+        group = worker_core()->root_group;
+    }
+
+    if (latency == NULL || group == NULL || group->id < 0 || group->id >= LATENCY_GROUPS) {
+        LOG_ERR0("latency_group: group not recorded or no histograms");
+        return -1;
+    }
+
+    latency_hist_t *hist = &latency->group[kind][group->id];
+    _summarize(&hist, 1, summary);
+    return 0;
+}
+
+int latency_total(latency_kind_t kind, latency_summary_t *summary)
+{
+    latency_t *latency = _latency(kind, summary);
+
+    if (latency == NULL) {
+        LOG_ERR0("latency_total: no histograms");
+        return -1;
+    }
+
+    // every record lands in exactly one priority histogram
+    latency_hist_t *hists[LATENCY_PRIORITIES];
+    for (int i = 0; i < LATENCY_PRIORITIES; i++) {
+        hists[i] = &latency->prio[kind][i];
+    }
+
+    _summarize(hists, LATENCY_PRIORITIES, summary);
+    return 0;
+}
+
+void latency_reset()
+{
+    ppos_core_t *core = worker_core();
+
+    if (core == NULL || core->latency == NULL) {
+        return;
+    }
+
+    // records racing with the reset may survive it
+    memset(core->latency, 0, sizeof(latency_t));
+}
+
+int latency_setup(ppos_core_t *core)
+{
+    core->latency = calloc(1, sizeof(latency_t));
+
+    if (core->latency == NULL) {
+        LOG_WARN0("latency_setup: failed to allocate histograms, latency is not recorded");
+        return -1;
+    }
+
+    return 0;
+}
+
+void latency_enqueue(task_t *task, bool wakeup)
+{
+    if (task->type != TASK_TYPE_USER) {
+        return;
+    }
+
+    task->time.ready_ns = _now_ns();
+    task->time.woken = wakeup;
+}
+
+void latency_dispatch(task_t *task)
+{
+    latency_t *latency = worker_core()->latency;
+
+    if (task->time.ready_ns == 0) {
+        return;
+    }
+
+    uint64_t delay = _now_ns() - task->time.ready_ns;
+    task->time.ready_ns = 0;
+
+    if (latency == NULL) {
+        return;
+    }
+
+    int prio = task->priority - MIN_PRIORITY;
+    int group = task->group != NULL ? task->group->id : 0;
+
+    if (prio < 0 || prio >= LATENCY_PRIORITIES) {
+        prio = -MIN_PRIORITY;
+    }
+
+    for (int kind = LATENCY_READY; kind <= (task->time.woken ? LATENCY_WAKEUP : LATENCY_READY); kind++) {
+        _record(&latency->prio[kind][prio], delay);
+
+        if (group >= 0 && group < LATENCY_GROUPS) {
+            _record(&latency->group[kind][group], delay);
+        }
+    }
+}
+
+void latency_destroy(ppos_core_t *core)
+{
+    if (core != NULL) {
+        free(core->latency);
+        core->latency = NULL;
+    }
+}
@@ -0,0 +1,104 @@
+#ifndef __LATENCY_H__
+#define __LATENCY_H__
+
+#include <stdbool.h>
+
+#include "ppos_data.h"
+
+/*
+ * Scheduling latency histograms: the delay between a task entering the
+ * ready set and running, per static priority and per task group. Buckets
+ * are log-linear, 2^LATENCY_SUB_BITS linear buckets per power of two of
+ * nanoseconds, so a percentile is off by at most 1/2^LATENCY_SUB_BITS
+ */
+
+#define LATENCY_SUB_BITS 4
+#define LATENCY_MAX_SHIFT 32
+#define LATENCY_BUCKETS ((LATENCY_MAX_SHIFT + 2) << LATENCY_SUB_BITS)
+#define LATENCY_PRIORITIES (MAX_PRIORITY - MIN_PRIORITY + 1)
+#define LATENCY_GROUPS 64
+
+typedef enum {
+    LATENCY_READY = 0,  // every enqueue: new, yielded, preempted and woken tasks
+    LATENCY_WAKEUP,     // tasks woken from sleep, a wait, I/O or a suspension
+    LATENCY_KINDS,
+} latency_kind_t;
+
+typedef struct latency_summary_t
+{
+    unsigned long long count;
+    unsigned long long mean_ns;
+    unsigned long long p50_ns;
+    unsigned long long p99_ns;
+    unsigned long long p999_ns;
+    unsigned long long max_ns;
+} latency_summary_t;
+
+/*
+ * @brief Summarize the latency of the tasks of a static priority
+ * @param prio: priority, from MIN_PRIORITY to MAX_PRIORITY
+ * @param kind: LATENCY_READY or LATENCY_WAKEUP
+ * @param summary: receives the count and percentiles, in ns
+ * @return 0 on success, < 0 on error
+ */
+int latency_prio(int prio, latency_kind_t kind, latency_summary_t *summary);
+
+/*
+ * @brief Summarize the latency of the tasks of a group
+ * @param group: group to query, NULL for the root group. Only the first
+ *        LATENCY_GROUPS groups of a runtime are recorded
+ * @param kind: LATENCY_READY or LATENCY_WAKEUP
+ * @param summary: receives the count and percentiles, in ns
+ * @return 0 on success, < 0 on error
+ */
+int latency_group(task_group_t *group, latency_kind_t kind, latency_summary_t *summary);
+
+/*
+ * @brief Summarize the latency of every task of the runtime
+ * @param kind: LATENCY_READY or LATENCY_WAKEUP
+ * @param summary: receives the count and percentiles, in ns
+ * @return 0 on success, < 0 on error
+ */
+int latency_total(latency_kind_t kind, latency_summary_t *summary);
+
+/*
+ * @brief Clear every histogram of the calling task's runtime
+ * @return void
+ */
+void latency_reset();
+
+/*
+ * Runtime internals, used by the core and the statistics
+ */
+
+/*
+ * @brief Allocate the histograms of a runtime. Without them the runtime
+ *        runs with latency recording off
+ * @param core: pointer to the ppos core
+ * @return 0 on success, < 0 on error
+ */
+int latency_setup(ppos_core_t *core);
+
+/*
+ * @brief Stamp a task entering the ready set
+ * @param task: task being enqueued
+ * @param wakeup: whether the task was blocked
+ * @return void
+ */
+void latency_enqueue(task_t *task, bool wakeup);
+
+/*
+ * @brief Record the delay of a task since its enqueue, as it starts running
+ * @param task: task being dispatched
+ * @return void
+ */
+void latency_dispatch(task_t *task);
+
+/*
+ * @brief Release the histograms of a runtime
+ * @param core: pointer to the ppos core
+ * @return void
+ */
+void latency_destroy(ppos_core_t *core);
+
+#endif
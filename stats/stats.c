@@ -0,0 +1,162 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "stats.h"
+#include "latency.h"
+#include "queue.h"
+#include "worker.h"
+#include "ppos.h"
+#include "logger.h"
+
+// stacks are allocated zeroed, so the deepest word written since the task
+// started is the lowest non-zero one
+size_t stats_stack_peak(task_t *task)
+{
+    unsigned long *stack = task->context.uc_stack.ss_sp;
+    size_t words = task->context.uc_stack.ss_size / sizeof(unsigned long);
+
+    if (stack == NULL) {
+        return 0;
+    }
+
+    size_t i = 0;
+    while (i < words && stack[i] == 0) {
+        i++;
+    }
+
+    return (words - i) * sizeof(unsigned long);
+}
+
+void stats_wait(task_t *task, task_wait_t wait)
+{
+    unsigned int now = systime();
+
+    if (task->time.wait == TASK_WAIT_READY) {
+        task->time.ready_time += now - task->time.wait_start;
+    } else if (task->time.wait == TASK_WAIT_BLOCKED) {
+        task->time.blocked_time += now - task->time.wait_start;
+    }
+
+    task->time.wait = wait;
+    task->time.wait_start = now;
+}
+
+void stats_enqueue(task_t *task)
+{
+    bool wakeup = task->time.wait == TASK_WAIT_BLOCKED;
+
+    if (wakeup) {
+        stats_wait(task, TASK_WAIT_READY);
+    }
+
+    latency_enqueue(task, wakeup);
+}
+
+void stats_switch(task_t *prev, task_t *next)
+{
+    worker_t *worker = worker_self();
+
+    worker->switches++;
+
+    if (prev != NULL && prev->type == TASK_TYPE_USER) {
+        if (prev->time.preempted) {
+            prev->time.preempted = false;
+            prev->time.involuntary_switches++;
+            worker->involuntary++;
+        } else {
+            prev->time.voluntary_switches++;
+            worker->voluntary++;
+        }
+    }
+
+    if (next->time.wait != TASK_WAIT_NONE) {
+        stats_wait(next, TASK_WAIT_NONE);
+    }
+
+    latency_dispatch(next);
+}
+
+int task_getstats(task_t *task, task_stats_t *stats)
+{
+    if (stats == NULL || worker_self() == NULL) {
+        LOG_ERR0("task_getstats: NULL stats or no runtime");
+        return -1;
+    }
+
+    if (task == NULL) {
+        task = worker_self()->current_task;
+    }
+
+    ppos_core_t *core = worker_core();
+    unsigned int now = systime();
+
+    memset(stats, 0, sizeof(task_stats_t));
+
+    // the counters of a running task change under the lock holder only
+    // through its own worker, the snapshot is consistent enough for polling
+    core->lock_core();
+
+    stats->id = task->id;
+    stats->status = task->status;
+    stats->age_ms = now - task->time.creation_time;
+    stats->cpu_ms = task->time.total_cpu_time;
+    stats->ready_ms = task->time.ready_time;
+    stats->blocked_ms = task->time.blocked_time;
+    stats->activations = task->time.activations;
+    stats->voluntary = task->time.voluntary_switches;
+    stats->involuntary = task->time.involuntary_switches;
+    stats->migrations = task->time.migrations;
+
+    // the current wait and run are not accounted yet
+    if (task->time.wait == TASK_WAIT_READY) {
+        stats->ready_ms += now - task->time.wait_start;
+    } else if (task->time.wait == TASK_WAIT_BLOCKED) {
+        stats->blocked_ms += now - task->time.wait_start;
+    }
+
+    if (task->status == TASK_STATUS_RUNNING && task->time.last_start != 0) {
+        stats->cpu_ms += now - task->time.last_start;
+    }
+
+    core->unlock_core();
+
+    stats->stack_size = task->context.uc_stack.ss_size;
+    stats->stack_peak = stats_stack_peak(task);
+
+    return 0;
+}
+
+int ppos_getstats(ppos_stats_t *stats)
+{
+    ppos_core_t *core = worker_core();
+
+    if (stats == NULL || core == NULL) {
+        LOG_ERR0("ppos_getstats: NULL stats or no runtime");
+        return -1;
+    }
+
+    memset(stats, 0, sizeof(ppos_stats_t));
+
+    stats->uptime_ms = systime();
+    stats->workers = core->nr_workers;
+    stats->tasks_created = __atomic_load_n(&core->tasks_created, __ATOMIC_RELAXED);
+    stats->tasks_exited = __atomic_load_n(&core->tasks_exited, __ATOMIC_RELAXED);
+    stats->runnable = __atomic_load_n(&core->nr_runnable, __ATOMIC_RELAXED);
+
+    for (int i = 0; i < core->nr_workers; i++) {
+        worker_t *worker = &core->workers[i];
+
+        stats->switches += __atomic_load_n(&worker->switches, __ATOMIC_RELAXED);
+        stats->voluntary += __atomic_load_n(&worker->voluntary, __ATOMIC_RELAXED);
+        stats->involuntary += __atomic_load_n(&worker->involuntary, __ATOMIC_RELAXED);
+        stats->migrations += __atomic_load_n(&worker->migrations, __ATOMIC_RELAXED);
+        stats->steals += __atomic_load_n(&worker->steals, __ATOMIC_RELAXED);
+    }
+
+    core->lock_core();
+    stats->sleeping = queue_size((queue_t*)core->sleep_queue);
+    stats->io_waiting = core->io_waiting;
+    core->unlock_core();
+
+    return 0;
+}
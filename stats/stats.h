@@ -0,0 +1,100 @@
+#ifndef __STATS_H__
+#define __STATS_H__
+
+#include <stddef.h>
+
+#include "ppos_data.h"
+
+/*
+ * Snapshot of a task. Times are in ms of systime: a task is either
+ * running, ready (waiting for a worker) or blocked (sleeping, waiting for
+ * another task, for I/O or suspended). A switch is involuntary when the
+ * tick preempted the task and voluntary otherwise
+ */
+typedef struct task_stats_t
+{
+    int id;
+    task_status_t status;
+    unsigned int age_ms;
+    unsigned int cpu_ms;
+    unsigned int ready_ms;
+    unsigned int blocked_ms;
+    unsigned int activations;
+    unsigned int voluntary;
+    unsigned int involuntary;
+    unsigned int migrations;
+    size_t stack_size;
+    size_t stack_peak;
+} task_stats_t;
+
+/*
+ * Snapshot of a runtime, summed over its workers
+ */
+typedef struct ppos_stats_t
+{
+    unsigned int uptime_ms;
+    int workers;
+    unsigned int tasks_created;
+    unsigned int tasks_exited;
+    unsigned int runnable;
+    unsigned int sleeping;
+    unsigned int io_waiting;
+    unsigned long long switches;
+    unsigned long long voluntary;
+    unsigned long long involuntary;
+    unsigned long long migrations;
+    unsigned long long steals;
+} ppos_stats_t;
+
+/*
+ * @brief Get a snapshot of the statistics of a task
+ * @param task: task to query, NULL for the current task
+ * @param stats: receives the statistics
+ * @return 0 on success, < 0 on error
+ */
+int task_getstats(task_t *task, task_stats_t *stats);
+
+/*
+ * @brief Get a snapshot of the statistics of the calling task's runtime
+ * @param stats: receives the statistics
+ * @return 0 on success, < 0 on error
+ */
+int ppos_getstats(ppos_stats_t *stats);
+
+/*
+ * Runtime internals, used by the core and the ready queues
+ */
+
+/*
+ * @brief Close the current wait of a task and start a new one
+ * @param task: task whose wait changes
+ * @param wait: TASK_WAIT_READY, TASK_WAIT_BLOCKED or TASK_WAIT_NONE when
+ *        the task starts running or exits
+ * @return void
+ */
+void stats_wait(task_t *task, task_wait_t wait);
+
+/*
+ * @brief Account a task made ready: a blocked task starts waiting for a
+ *        worker
+ * @param task: task being enqueued
+ * @return void
+ */
+void stats_enqueue(task_t *task);
+
+/*
+ * @brief Account a context switch on the current worker
+ * @param prev: task switched out, NULL if none
+ * @param next: task switched in
+ * @return void
+ */
+void stats_switch(task_t *prev, task_t *next);
+
+/*
+ * @brief Measure the deepest stack use of a task, without allocating
+ * @param task: task to measure
+ * @return bytes of stack used at the peak, 0 if the task has no own stack
+ */
+size_t stats_stack_peak(task_t *task);
+
+#endif
@@ -0,0 +1,95 @@
+// PingPongOS - PingPong Operating System
+
+// Teste do log assincrono: varias tarefas registram mensagens no anel sem
+// fazer chamadas de sistema; o esvaziamento grava as mensagens de cada
+// tarefa na ordem, e as que nao couberam no anel sao contadas
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "ppos.h"
+#include "logger.h"
+
+#define TASKS 4
+#define RECORDS 1000
+#define FILENAME "/tmp/ppos_logger_test.txt"
+
+task_t tasks[TASKS] ;
+int fd ;
+
+// registra mensagens numeradas, cedendo o processador de vez em quando
+void Body (void * arg)
+{
+   int id = (int)(long) arg ;
+   int i ;
+
+   for (i=0; i<RECORDS; i++)
+   {
+      log_write (fd, "tarefa %d registro %d\n", id, i) ;
+      if (i % 100 == 99)
+         task_yield () ;
+   }
+   task_exit (0) ;
+}
+
+int main (int argc, char *argv[])
+{
+   int i, id, record, lines = 0, ordered = 1, last[TASKS] ;
+   unsigned long dropped ;
+   FILE *file ;
+
+   printf ("main: inicio\n");
+
+   ppos_init () ;
+
+   fd = open (FILENAME, O_WRONLY | O_CREAT | O_TRUNC, 0644) ;
+   if (fd < 0)
+   {
+      printf ("main: erro ao criar %s\n", FILENAME) ;
+      exit (1) ;
+   }
+
+   for (i=0; i<TASKS; i++)
+   {
+      last[i] = -1 ;
+      task_init (&tasks[i], Body, (void *)(long) i) ;
+   }
+   for (i=0; i<TASKS; i++)
+      task_wait (&tasks[i]) ;
+
+   log_flush () ;
+   dropped = log_dropped () ;
+   close (fd) ;
+
+   // confere a ordem das mensagens de cada tarefa
+   file = fopen (FILENAME, "r") ;
+   while (file && fscanf (file, "tarefa %d registro %d\n", &id, &record) == 2)
+   {
+      if (id < 0 || id >= TASKS || record <= last[id])
+         ordered = 0 ;
+      else
+         last[id] = record ;
+      lines++ ;
+   }
+   if (file)
+      fclose (file) ;
+
+   printf ("main: %d mensagens, gravadas ou contadas como descartadas: %s\n", TASKS * RECORDS,
+           lines + dropped == TASKS * RECORDS ? "sim" : "nao") ;
+   printf ("main: mensagens de cada tarefa em ordem: %s\n", ordered ? "sim" : "nao") ;
+
+   // com o anel cheio e sem esvaziamento, as mensagens sao descartadas
+   fd = open ("/dev/null", O_WRONLY) ;
+   for (i=0; i<2*LOG_RING_SIZE; i++)
+      log_write (fd, "registro %d\n", i) ;
+   printf ("main: anel cheio descarta sem bloquear: %s\n", log_dropped () > dropped ? "sim" : "nao") ;
+   log_flush () ;
+   close (fd) ;
+
+   unlink (FILENAME) ;
+   printf ("main: fim\n");
+
+   task_exit (0) ;
+}
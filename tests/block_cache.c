@@ -0,0 +1,121 @@
+// PingPongOS - PingPong Operating System
+
+// Teste da cache de blocos: escritas ficam na cache ate o flush em lotes
+// ordenados, leituras sequenciais disparam leitura antecipada e blocos em
+// cache sao lidos sem acessar o disco
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "ppos.h"
+#include "disk.h"
+#include "cache.h"
+
+#define TASKS 4
+#define WRITES 32
+#define IMAGE "/tmp/ppos_cache_test.img"
+
+task_t tasks[TASKS] ;
+int num_blocks, block_size, errors = 0 ;
+
+// escreve blocos intercalados com as outras tarefas, do fim para o inicio
+void Writer (void * arg)
+{
+   int id = (int)(long) arg ;
+   char buf[64] ;
+   int i, block ;
+
+   for (i=WRITES-1; i>=0; i--)
+   {
+      block = i * TASKS + id ;
+      memset (buf, block, block_size) ;
+      if (cache_block_write (block, buf) < 0)
+         errors++ ;
+   }
+   task_exit (0) ;
+}
+
+// le sequencialmente a segunda metade do disco
+void Scanner (void * arg)
+{
+   char buf[64] ;
+   int block ;
+
+   for (block=num_blocks/2; block<num_blocks; block++)
+      if (cache_block_read (block, buf) < 0)
+         errors++ ;
+   task_exit (0) ;
+}
+
+int main (int argc, char *argv[])
+{
+   disk_config_t config ;
+   cache_stats_t before, after ;
+   char buf[64], expected[64] ;
+   int i, block, ok ;
+
+   printf ("main: inicio\n");
+
+   ppos_init () ;
+
+   memset (&config, 0, sizeof(config)) ;
+   config.image = IMAGE ;
+   config.block_size = 64 ;
+   config.num_blocks = 256 ;
+   config.blocks_per_track = 4 ;
+   disk_mgr_config (&config) ;
+
+   if (cache_init (&num_blocks, &block_size) < 0)
+   {
+      printf ("main: erro ao iniciar a cache\n") ;
+      exit (1) ;
+   }
+   printf ("main: cache com %d blocos de %d bytes\n", num_blocks, block_size) ;
+
+   // escritas: nenhuma tarefa espera pelo disco
+   for (i=0; i<TASKS; i++)
+      task_init (&tasks[i], Writer, (void *)(long) i) ;
+   for (i=0; i<TASKS; i++)
+      task_wait (&tasks[i]) ;
+
+   cache_getstats (&before) ;
+   printf ("main: %d escritas, %u blocos sujos, %d erros\n", TASKS * WRITES, before.dirty, errors) ;
+
+   cache_sync () ;
+   cache_getstats (&after) ;
+   printf ("main: flush em lotes de ate %d blocos: %s\n", CACHE_FLUSH_BATCH,
+           after.flushed == TASKS * WRITES && after.dirty == 0 && after.max_batch <= CACHE_FLUSH_BATCH ? "sim" : "nao") ;
+
+   // o disco (sem a cache) deve ter o conteudo escrito
+   ok = 1 ;
+   for (block=0; block<TASKS*WRITES; block++)
+   {
+      memset (expected, block, block_size) ;
+      if (disk_block_read (block, buf) < 0 || memcmp (buf, expected, block_size))
+         ok = 0 ;
+   }
+   printf ("main: escritas chegaram ao disco: %s\n", ok ? "sim" : "nao") ;
+
+   // varredura sequencial: a leitura antecipada traz os proximos blocos
+   task_init (&tasks[0], Scanner, NULL) ;
+   task_wait (&tasks[0]) ;
+
+   cache_getstats (&before) ;
+   printf ("main: varredura com leitura antecipada: %s\n",
+           before.readahead > 0 && before.readahead_hits > 0 ? "sim" : "nao") ;
+
+   // segunda varredura: todos os blocos ja estao na cache
+   task_init (&tasks[0], Scanner, NULL) ;
+   task_wait (&tasks[0]) ;
+
+   cache_getstats (&after) ;
+   printf ("main: releitura sem faltas: %s\n",
+           after.misses == before.misses && after.hits - before.hits == (unsigned int) num_blocks / 2 ? "sim" : "nao") ;
+   printf ("main: %d erros\n", errors) ;
+
+   unlink (IMAGE) ;
+   printf ("main: fim\n");
+
+   task_exit (0) ;
+}
@@ -0,0 +1,95 @@
+// PingPongOS - PingPong Operating System
+
+// Teste do profiler por amostragem: duas tarefas gastam CPU, uma o dobro
+// da outra; as pilhas dobradas gravadas por prof_dump devem atribuir as
+// amostras a cada tarefa, na proporcao do tempo de CPU de cada uma
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "ppos.h"
+#include "prof.h"
+
+#define FILENAME "/tmp/ppos_prof_test.txt"
+
+task_t longer, shorter ;
+
+void spin (unsigned int ms)
+{
+   unsigned int start = systime () ;
+
+   while (systime () - start < ms) ;
+}
+
+void LongBody (void * arg)
+{
+   spin (200) ;
+   task_exit (0) ;
+}
+
+void ShortBody (void * arg)
+{
+   spin (100) ;
+   task_exit (0) ;
+}
+
+int main (int argc, char *argv[])
+{
+   unsigned long counts[2] = { 0, 0 }, count, total = 0 ;
+   int deep = 0, id ;
+   char line[4096], *space ;
+   long written ;
+   FILE *file ;
+
+   printf ("main: inicio\n");
+
+   ppos_init () ;
+
+   if (prof_start (1, 10000) < 0)
+   {
+      printf ("main: erro ao iniciar o profiler\n") ;
+      exit (1) ;
+   }
+
+   task_init (&longer, LongBody, NULL) ;
+   task_init (&shorter, ShortBody, NULL) ;
+   task_wait (&longer) ;
+   task_wait (&shorter) ;
+
+   prof_stop () ;
+   written = prof_dump (FILENAME) ;
+   printf ("main: amostras gravadas: %s\n", written > 0 ? "sim" : "nao") ;
+
+   file = fopen (FILENAME, "r") ;
+   while (file && fgets (line, sizeof(line), file))
+   {
+      space = strrchr (line, ' ') ;
+      if (!space || sscanf (line, "task %d", &id) != 1)
+         continue ;
+      count = strtoul (space + 1, NULL, 10) ;
+      total += count ;
+      if (id == longer.id)
+         counts[0] += count ;
+      if (id == shorter.id)
+         counts[1] += count ;
+      if (strchr (strchr (line, ';') ? strchr (line, ';') + 1 : line, ';'))
+         deep = 1 ;
+   }
+   if (file)
+      fclose (file) ;
+
+   printf ("main: pilhas somam as amostras: %s\n", total == (unsigned long) written ? "sim" : "nao") ;
+   printf ("main: amostras das duas tarefas: %s\n", counts[0] > 0 && counts[1] > 0 ? "sim" : "nao") ;
+   printf ("main: tarefa mais longa com mais amostras: %s\n", counts[0] > counts[1] ? "sim" : "nao") ;
+   printf ("main: pilhas com mais de um quadro: %s\n", deep ? "sim" : "nao") ;
+   printf ("main: nenhuma amostra perdida: %s\n", prof_lost () == 0 ? "sim" : "nao") ;
+
+   if (argc > 1)
+      printf ("main: pilhas em %s\n", FILENAME) ;
+   else
+      unlink (FILENAME) ;
+   printf ("main: fim\n");
+
+   task_exit (0) ;
+}
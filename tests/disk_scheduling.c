@@ -0,0 +1,92 @@
+// PingPongOS - PingPong Operating System
+
+// Teste do disco simulado: varias tarefas escrevem e leem blocos espalhados
+// pelo disco com cada politica de escalonamento de pedidos
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "ppos.h"
+#include "disk.h"
+
+#define TASKS 8
+#define REQUESTS 16
+#define IMAGE "/tmp/ppos_disk_test.img"
+
+task_t tasks[TASKS] ;
+int num_blocks, block_size, errors = 0 ;
+
+// bloco do i-esimo pedido de uma tarefa, espalhado pelo disco e sem
+// repetir entre as tarefas
+int block_of (int id, int i)
+{
+   return ((i * TASKS + id) * 389) % num_blocks ;
+}
+
+// escreve seus blocos e depois confere o conteudo de cada um
+void Body (void * arg)
+{
+   int id = (int)(long) arg ;
+   char out[512], in[512] ;
+   int i, block ;
+
+   for (i=0; i<REQUESTS; i++)
+   {
+      block = block_of (id, i) ;
+      memset (out, id * REQUESTS + i, block_size) ;
+      if (disk_block_write (block, out) < 0)
+         errors++ ;
+      if (disk_block_read (block, in) < 0 || memcmp (in, out, block_size))
+         errors++ ;
+   }
+   task_exit (0) ;
+}
+
+int main (int argc, char *argv[])
+{
+   disk_config_t config ;
+   disk_stats_t stats[DISK_POLICIES] ;
+   int i, policy ;
+
+   printf ("main: inicio\n");
+
+   ppos_init () ;
+
+   memset (&config, 0, sizeof(config)) ;
+   config.image = IMAGE ;
+   config.block_size = 64 ;
+   config.num_blocks = 1024 ;
+   config.blocks_per_track = 4 ;
+   disk_mgr_config (&config) ;
+
+   if (disk_mgr_init (&num_blocks, &block_size) < 0)
+   {
+      printf ("main: erro ao iniciar o disco\n") ;
+      exit (1) ;
+   }
+   printf ("main: disco com %d blocos de %d bytes\n", num_blocks, block_size) ;
+
+   for (policy=0; policy<DISK_POLICIES; policy++)
+   {
+      disk_set_policy (policy) ;
+
+      for (i=0; i<TASKS; i++)
+         task_init (&tasks[i], Body, (void *)(long) i) ;
+      for (i=0; i<TASKS; i++)
+         task_wait (&tasks[i]) ;
+
+      disk_getstats (policy, &stats[policy]) ;
+      printf ("main: %s atendeu %u pedidos, %d erros\n", disk_policy_name (policy), stats[policy].requests, errors) ;
+   }
+
+   printf ("main: SSTF moveu a cabeca menos que FCFS: %s\n",
+           stats[DISK_SSTF].head_travel < stats[DISK_FCFS].head_travel ? "sim" : "nao") ;
+   printf ("main: tempos de servico registrados: %s\n",
+           stats[DISK_FCFS].mean_us > 0 && stats[DISK_FCFS].p99_us >= stats[DISK_FCFS].mean_us ? "sim" : "nao") ;
+
+   unlink (IMAGE) ;
+   printf ("main: fim\n");
+
+   task_exit (0) ;
+}
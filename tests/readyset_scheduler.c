@@ -0,0 +1,127 @@
+// PingPongOS - PingPong Operating System
+
+// Teste do conjunto de prontas em vetores: o argmin de cada conjunto de
+// instrucoes suportado deve achar a primeira menor prioridade, como a
+// varredura da fila, e o mesmo cenario de tarefas com prioridades variadas
+// deve executar na mesma ordem com a fila e com cada modo do vetor
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ppos.h"
+#include "readyset.h"
+#include "timer.h"
+#include "worker.h"
+#include "ppos_runtime.h"
+
+#define NUM_TASKS 24
+#define ROUNDS 6
+#define MAX_RUNS ((NUM_TASKS + 1) * (ROUNDS + 2))
+#define MAX_VALUES 100
+
+const char *mode_names[] = { "fila", "auto", "escalar", "sse", "avx2" } ;
+
+task_t tasks[NUM_TASKS] ;
+int order[MAX_RUNS], num_runs ;
+
+// a primeira posicao da menor prioridade
+unsigned int reference (const int32_t *values, unsigned int count)
+{
+   unsigned int i, pos = 0 ;
+
+   for (i=1; i<count; i++)
+      if (values[i] < values[pos])
+         pos = i ;
+   return pos ;
+}
+
+// vetores aleatorios com muitos empates, de todos os tamanhos ate MAX_VALUES
+int argmin_ok (readyset_mode_t mode)
+{
+   int32_t values[MAX_VALUES] __attribute__((aligned(32))) ;
+   unsigned int count, i, trial ;
+
+   srand (1) ;
+   for (trial=0; trial<20; trial++)
+      for (count=1; count<=MAX_VALUES; count++)
+      {
+         for (i=0; i<count; i++)
+            values[i] = (rand () % 9) - 4 - (trial % 3) * 20 ;
+         if (readyset_argmin (mode, values, count) != reference (values, count))
+            return 0 ;
+      }
+   return 1 ;
+}
+
+void Body (void * arg)
+{
+   long id = (long) arg ;
+   int i ;
+
+   for (i=0; i<ROUNDS; i++)
+   {
+      if (num_runs < MAX_RUNS)
+         order[num_runs++] = id ;
+
+      // uma tarefa pronta muda de prioridade no meio do cenario
+      if (id == 0 && i == 2)
+         task_setprio (&tasks[NUM_TASKS - 1], -20) ;
+      task_yield () ;
+   }
+   task_exit (0) ;
+}
+
+void Scenario (void * arg)
+{
+   long i ;
+
+   for (i=0; i<NUM_TASKS; i++)
+   {
+      task_init (&tasks[i], Body, (void *) i) ;
+      task_setprio (&tasks[i], (i * 7) % 11 - 5) ;
+   }
+   for (i=0; i<NUM_TASKS; i++)
+      task_wait (&tasks[i]) ;
+   task_exit (0) ;
+}
+
+// executa o cenario, deixando em order a sequencia de tarefas
+int run (readyset_mode_t mode)
+{
+   num_runs = 0 ;
+   if (ppos_readyset (mode) < 0 || ppos_virtual_time (42, 0) < 0 || ppos_run (Scenario, NULL) < 0)
+   {
+      printf ("main: erro ao executar com %s\n", mode_names[mode]) ;
+      exit (1) ;
+   }
+   return num_runs ;
+}
+
+int main (int argc, char *argv[])
+{
+   int expected[MAX_RUNS], num_expected, mode, same ;
+
+   printf ("main: inicio\n");
+
+   ppos_workers (1) ;
+   num_expected = run (READYSET_OFF) ;
+   memcpy (expected, order, sizeof(order)) ;
+
+   for (mode=READYSET_AUTO; mode<=READYSET_AVX2; mode++)
+   {
+      if (mode != READYSET_AUTO && mode != READYSET_SCALAR && ppos_readyset (mode) < 0)
+      {
+         printf ("main: %s nao suportado pela CPU\n", mode_names[mode]) ;
+         continue ;
+      }
+      if (mode != READYSET_AUTO)
+         printf ("main: argmin %s igual a referencia: %s\n", mode_names[mode],
+                 argmin_ok (mode) ? "sim" : "nao") ;
+
+      same = run (mode) == num_expected && memcmp (order, expected, num_expected * sizeof(int)) == 0 ;
+      printf ("main: %s executa na ordem da fila: %s\n", mode_names[mode], same ? "sim" : "nao") ;
+   }
+
+   printf ("main: fim\n");
+   exit (0) ;
+}
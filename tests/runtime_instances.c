@@ -0,0 +1,104 @@
+// PingPongOS - PingPong Operating System
+
+// Teste de varias instancias independentes do runtime no mesmo processo:
+// cada instancia tem suas proprias tarefas, filas e contador de ids
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "ppos.h"
+#include "worker.h"
+#include "ppos_runtime.h"
+
+#define INSTANCES 3
+#define TASKS 4
+#define ROUNDS 20
+
+typedef struct
+{
+   int id ;
+   task_t tasks[TASKS] ;
+   int rounds[TASKS] ;
+   int task_ids[TASKS] ;
+   int own_runtime ;
+} instance_t ;
+
+instance_t instance[INSTANCES] ;
+
+// corpo das tarefas de cada instancia
+void Body (void * arg)
+{
+   int *rounds = arg ;
+   int i ;
+
+   for (i=0; i<ROUNDS; i++)
+   {
+      (*rounds)++ ;
+      if (i % 5 == 0)
+         task_sleep (1) ;
+      else
+         task_yield () ;
+   }
+   task_exit (*rounds) ;
+}
+
+// tarefa principal de cada instancia
+void InstanceMain (void * arg)
+{
+   instance_t *inst = arg ;
+   ppos_runtime_t *runtime ;
+   int i, total = 0 ;
+
+   for (i=0; i<TASKS; i++)
+   {
+      task_init (&inst->tasks[i], Body, &inst->rounds[i]) ;
+      inst->task_ids[i] = task_id (&inst->tasks[i]) ;
+   }
+
+   runtime = ppos_runtime () ;
+
+   for (i=0; i<TASKS; i++)
+      total += task_wait (&inst->tasks[i]) ;
+
+   // a tarefa principal continua no mesmo runtime apos as esperas
+   inst->own_runtime = (runtime != NULL && runtime == ppos_runtime ()) ;
+
+   task_exit (inst->id * 1000 + total) ;
+}
+
+int main (int argc, char *argv[])
+{
+   ppos_host_t *host[INSTANCES] ;
+   int i, j, code, ok = 1 ;
+
+   printf ("main: inicio\n");
+
+   for (i=0; i<INSTANCES; i++)
+   {
+      instance[i].id = i + 1 ;
+      host[i] = ppos_spawn (InstanceMain, &instance[i]) ;
+      if (!host[i])
+      {
+         printf ("main: erro ao criar instancia %d\n", i + 1) ;
+         exit (1) ;
+      }
+   }
+
+   for (i=0; i<INSTANCES; i++)
+   {
+      code = ppos_join (host[i]) ;
+      printf ("main: instancia %d terminou com codigo %d\n", instance[i].id, code) ;
+
+      if (code != instance[i].id * 1000 + TASKS * ROUNDS || !instance[i].own_runtime)
+         ok = 0 ;
+
+      // os ids de tarefa sao contados por instancia
+      for (j=0; j<TASKS; j++)
+         if (instance[i].task_ids[j] != instance[0].task_ids[j])
+            ok = 0 ;
+   }
+
+   printf ("main: instancias %s\n", ok ? "independentes" : "com erro") ;
+   printf ("main: fim\n");
+
+   exit (0) ;
+}
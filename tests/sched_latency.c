@@ -0,0 +1,88 @@
+// PingPongOS - PingPong Operating System
+
+// Teste dos histogramas de latencia do escalonador: tarefas de duas
+// prioridades cedem o processador e uma tarefa de um grupo dorme; cada
+// histograma deve contar as entradas na fila de prontas correspondentes,
+// com percentis ordenados, e zerar apos latency_reset
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "ppos.h"
+#include "group.h"
+#include "latency.h"
+
+#define ROUNDS 50
+#define SLEEPS 10
+
+task_t high, low, sleeper ;
+task_group_t group ;
+
+void YieldBody (void * arg)
+{
+   int i ;
+
+   for (i=0; i<ROUNDS; i++)
+      task_yield () ;
+   task_exit (0) ;
+}
+
+void SleepBody (void * arg)
+{
+   int i ;
+
+   for (i=0; i<SLEEPS; i++)
+      task_sleep (2) ;
+   task_exit (0) ;
+}
+
+int ordered (latency_summary_t *s)
+{
+   return s->p50_ns <= s->p99_ns && s->p99_ns <= s->p999_ns && s->p999_ns <= s->max_ns ;
+}
+
+int main (int argc, char *argv[])
+{
+   latency_summary_t hs, ls, gs, ws, ts ;
+
+   printf ("main: inicio\n");
+
+   ppos_init () ;
+
+   task_group_init (&group, NULL, GROUP_DEFAULT_WEIGHT) ;
+
+   task_init (&high, YieldBody, NULL) ;
+   task_setprio (&high, -5) ;
+   task_init (&low, YieldBody, NULL) ;
+   task_setprio (&low, 5) ;
+   task_init (&sleeper, SleepBody, NULL) ;
+   task_group_attach (&group, &sleeper) ;
+
+   task_wait (&high) ;
+   task_wait (&low) ;
+   task_wait (&sleeper) ;
+
+   latency_prio (-5, LATENCY_READY, &hs) ;
+   latency_prio (5, LATENCY_READY, &ls) ;
+   latency_group (&group, LATENCY_WAKEUP, &ws) ;
+   latency_group (&group, LATENCY_READY, &gs) ;
+   latency_total (LATENCY_READY, &ts) ;
+
+   printf ("main: prioridade -5 registrada: %s\n", hs.count >= ROUNDS ? "sim" : "nao") ;
+   printf ("main: prioridade 5 registrada: %s\n", ls.count >= ROUNDS ? "sim" : "nao") ;
+   printf ("main: despertares do grupo registrados: %s\n", ws.count >= SLEEPS ? "sim" : "nao") ;
+   printf ("main: entradas do grupo incluem os despertares: %s\n", gs.count >= ws.count ? "sim" : "nao") ;
+   printf ("main: total soma as prioridades: %s\n", ts.count >= hs.count + ls.count + gs.count ? "sim" : "nao") ;
+   printf ("main: percentis ordenados: %s\n",
+           ordered (&hs) && ordered (&ls) && ordered (&ws) && ordered (&ts) ? "sim" : "nao") ;
+   printf ("main: latencia medida: %s\n", ts.max_ns > 0 && ts.mean_ns <= ts.max_ns ? "sim" : "nao") ;
+   printf ("main: prioridade invalida rejeitada: %s\n", latency_prio (MAX_PRIORITY + 1, LATENCY_READY, &hs) < 0 ? "sim" : "nao") ;
+
+   latency_reset () ;
+   latency_total (LATENCY_READY, &ts) ;
+   latency_total (LATENCY_WAKEUP, &ws) ;
+   printf ("main: histogramas zerados: %s\n", ts.count == 0 && ws.count == 0 && ts.max_ns == 0 ? "sim" : "nao") ;
+
+   printf ("main: fim\n");
+
+   task_exit (0) ;
+}
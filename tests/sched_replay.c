@@ -0,0 +1,163 @@
+// PingPongOS - PingPong Operating System
+
+// Teste de gravacao e reproducao do escalonamento: tres tarefas disputam o
+// processador em tempo real enquanto o escalonamento e gravado; a
+// reproducao deve repetir as mesmas trocas de tarefa, vendo os mesmos
+// valores de systime, e um cenario diferente deve divergir da gravacao.
+// Durante a gravacao nenhum outro runtime pode rodar
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "ppos.h"
+#include "replay.h"
+#include "ppos_runtime.h"
+#include "worker.h"
+
+#define FILENAME "/tmp/ppos_replay_test.rec"
+#define SPINNERS 3
+#define SPIN_MS 70
+#define MAX_TASKS 8
+#define MAX_MS 1000
+
+// instantes de systime vistos por cada tarefa: cada leitura e feita pela
+// mesma tarefa nas duas execucoes, mesmo que a preempcao caia em outro ponto
+// do laco, entao a ordem dos registros nao importa
+typedef struct
+{
+   char seen[MAX_TASKS][MAX_MS] ;
+} run_t ;
+
+run_t runs[2] ;
+run_t *current ;
+task_t spinners[SPINNERS], sleeper ;
+int num_spinners, refused ;
+
+void mark (unsigned int now)
+{
+   int id = task_id () ;
+
+   if (current && id < MAX_TASKS && now < MAX_MS)
+      current->seen[id][now] = 1 ;
+}
+
+// alguma tarefa parou de ler o relogio e voltou a ler mais tarde
+int interleaved (run_t *run)
+{
+   int id, ms, first, gap ;
+
+   for (id=0; id<MAX_TASKS; id++)
+   {
+      first = -1 ;
+      gap = 0 ;
+      for (ms=0; ms<MAX_MS; ms++)
+      {
+         if (!run->seen[id][ms] && first >= 0)
+            gap = 1 ;
+         if (run->seen[id][ms] && first < 0)
+            first = ms ;
+         else if (run->seen[id][ms] && gap)
+            return 1 ;
+      }
+   }
+   return 0 ;
+}
+
+void Spinner (void * arg)
+{
+   unsigned int start = systime (), now ;
+
+   while ((now = systime ()) - start < SPIN_MS)
+      mark (now) ;
+   task_exit (0) ;
+}
+
+void Sleeper (void * arg)
+{
+   task_sleep (30) ;
+   mark (systime ()) ;
+   task_yield () ;
+   mark (systime ()) ;
+   task_exit (0) ;
+}
+
+void Scenario (void * arg)
+{
+   int i ;
+
+   for (i=0; i<num_spinners; i++)
+      task_init (&spinners[i], Spinner, NULL) ;
+   task_init (&sleeper, Sleeper, NULL) ;
+
+   for (i=0; i<num_spinners; i++)
+      task_wait (&spinners[i]) ;
+   task_wait (&sleeper) ;
+   task_exit (0) ;
+}
+
+void Nothing (void * arg)
+{
+   task_exit (0) ;
+}
+
+// tenta outro runtime enquanto este e gravado
+void Probe (void * arg)
+{
+   refused = ppos_join (ppos_spawn (Nothing, NULL)) < 0 ;
+   task_exit (0) ;
+}
+
+int main (int argc, char *argv[])
+{
+   int same ;
+
+   printf ("main: inicio\n");
+
+   if (replay_record (FILENAME) < 0 || ppos_run (Probe, NULL) < 0)
+   {
+      printf ("main: erro ao gravar\n") ;
+      exit (1) ;
+   }
+
+   // gravacao em tempo real
+   num_spinners = SPINNERS ;
+   current = &runs[0] ;
+   if (replay_record (FILENAME) < 0 || ppos_run (Scenario, NULL) < 0)
+   {
+      printf ("main: erro ao gravar\n") ;
+      exit (1) ;
+   }
+
+   // reproducao do mesmo cenario
+   current = &runs[1] ;
+   if (replay_start (FILENAME) < 0 || ppos_run (Scenario, NULL) < 0)
+   {
+      printf ("main: erro ao reproduzir\n") ;
+      exit (1) ;
+   }
+
+   same = memcmp (&runs[0], &runs[1], sizeof(run_t)) == 0 ;
+
+   printf ("main: tarefas intercaladas: %s\n", interleaved (&runs[0]) ? "sim" : "nao") ;
+   printf ("main: reproducao completa: %s\n", replay_divergence () < 0 ? "sim" : "nao") ;
+   printf ("main: mesmas tarefas nos mesmos instantes: %s\n", same ? "sim" : "nao") ;
+
+   // um cenario com uma tarefa a menos nao segue a gravacao
+   num_spinners = SPINNERS - 1 ;
+   current = NULL ;
+   if (replay_start (FILENAME) < 0 || ppos_run (Scenario, NULL) < 0)
+   {
+      printf ("main: erro ao reproduzir\n") ;
+      exit (1) ;
+   }
+   printf ("main: cenario diferente diverge: %s\n", replay_divergence () >= 0 ? "sim" : "nao") ;
+   printf ("main: outro runtime recusado durante a gravacao: %s\n", refused ? "sim" : "nao") ;
+
+   if (argc > 1)
+      printf ("main: gravacao em %s\n", FILENAME) ;
+   else
+      unlink (FILENAME) ;
+   printf ("main: fim\n");
+   exit (0) ;
+}
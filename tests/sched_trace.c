@@ -0,0 +1,100 @@
+// PingPongOS - PingPong Operating System
+
+// Teste do rastreamento do escalonador: tarefas cedem o processador e
+// dormem com o rastreamento ligado; o arquivo gerado por trace_dump deve
+// conter os eventos de cada uma, em ordem de tempo em cada worker
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "ppos.h"
+#include "trace.h"
+
+#define TASKS 4
+#define ROUNDS 5
+#define FILENAME "/tmp/ppos_trace_test.bin"
+
+task_t tasks[TASKS] ;
+
+void Body (void * arg)
+{
+   int i ;
+
+   for (i=0; i<ROUNDS; i++)
+   {
+      task_yield () ;
+      task_sleep (2) ;
+   }
+   task_exit (0) ;
+}
+
+int main (int argc, char *argv[])
+{
+   trace_header_t header ;
+   trace_event_t event ;
+   unsigned long counts[TRACE_EVENTS] ;
+   unsigned long long last[64] ;
+   int i, ordered = 1 ;
+   long written ;
+   FILE *file ;
+
+   printf ("main: inicio\n");
+
+   ppos_init () ;
+
+   if (trace_start (4096) < 0)
+   {
+      printf ("main: erro ao iniciar o rastreamento\n") ;
+      exit (1) ;
+   }
+
+   for (i=0; i<TASKS; i++)
+      task_init (&tasks[i], Body, NULL) ;
+   for (i=0; i<TASKS; i++)
+      task_wait (&tasks[i]) ;
+
+   trace_stop () ;
+
+   // tarefas criadas com o rastreamento desligado nao aparecem
+   task_init (&tasks[0], Body, NULL) ;
+   task_wait (&tasks[0]) ;
+
+   written = trace_dump (FILENAME) ;
+   printf ("main: eventos gravados: %s\n", written > 0 ? "sim" : "nao") ;
+
+   memset (counts, 0, sizeof(counts)) ;
+   memset (last, 0, sizeof(last)) ;
+
+   file = fopen (FILENAME, "rb") ;
+   if (!file || fread (&header, sizeof(header), 1, file) != 1 || memcmp (header.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC)))
+   {
+      printf ("main: arquivo de rastreamento invalido\n") ;
+      exit (1) ;
+   }
+
+   while (fread (&event, sizeof(event), 1, file) == 1)
+   {
+      if (event.type < TRACE_EVENTS)
+         counts[event.type]++ ;
+      if (event.worker < 64)
+      {
+         if (event.ts_ns < last[event.worker])
+            ordered = 0 ;
+         last[event.worker] = event.ts_ns ;
+      }
+   }
+   fclose (file) ;
+
+   printf ("main: cabecalho confere: %s\n", header.nr_events == (unsigned long) written && header.lost == 0 ? "sim" : "nao") ;
+   printf ("main: %lu criacoes, %lu terminos\n", counts[TRACE_CREATE], counts[TRACE_EXIT]) ;
+   printf ("main: %lu yields, %lu sleeps\n", counts[TRACE_YIELD], counts[TRACE_SLEEP]) ;
+   printf ("main: trocas de contexto e despertares registrados: %s\n",
+           counts[TRACE_SWITCH] > 0 && counts[TRACE_WAKE] >= TASKS * ROUNDS ? "sim" : "nao") ;
+   printf ("main: eventos em ordem de tempo: %s\n", ordered ? "sim" : "nao") ;
+
+   unlink (FILENAME) ;
+   printf ("main: fim\n");
+
+   task_exit (0) ;
+}
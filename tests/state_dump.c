@@ -0,0 +1,125 @@
+// PingPongOS - PingPong Operating System
+
+// Teste do despejo de estado: com uma tarefa dormindo, uma esperando outra
+// e uma pronta, o despejo pela API e pelo sinal SIGUSR1 deve listar cada
+// tarefa com seu nome, estado e fila
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "ppos.h"
+#include "dump.h"
+
+#define FILENAME "/tmp/ppos_dump_test.txt"
+
+task_t sleeper, joiner, yielder ;
+char text[16384] ;
+
+void SleepBody (void * arg)
+{
+   task_sleep (100) ;
+   task_exit (0) ;
+}
+
+void JoinBody (void * arg)
+{
+   task_wait (&sleeper) ;
+   task_exit (0) ;
+}
+
+void YieldBody (void * arg)
+{
+   int i ;
+
+   for (i=0; i<100; i++)
+      task_yield () ;
+   task_exit (0) ;
+}
+
+// le o arquivo inteiro em text
+int load ()
+{
+   int fd = open (FILENAME, O_RDONLY) ;
+   int n ;
+
+   if (fd < 0)
+      return 0 ;
+   n = read (fd, text, sizeof(text) - 1) ;
+   close (fd) ;
+   text[n > 0 ? n : 0] = 0 ;
+   return n ;
+}
+
+// procura uma linha com as duas palavras
+int line_has (const char *a, const char *b)
+{
+   char *line = text ;
+
+   while (line && *line)
+   {
+      char *end = strchr (line, '\n') ;
+      if (end)
+         *end = 0 ;
+      int found = strstr (line, a) && strstr (line, b) ;
+      if (end)
+         *end = '\n' ;
+      if (found)
+         return 1 ;
+      line = end ? end + 1 : NULL ;
+   }
+   return 0 ;
+}
+
+int main (int argc, char *argv[])
+{
+   int fd ;
+
+   printf ("main: inicio\n");
+
+   ppos_init () ;
+
+   task_init (&sleeper, SleepBody, NULL) ;
+   task_setname (&sleeper, "dorminhoca") ;
+   task_init (&joiner, JoinBody, NULL) ;
+   task_setname (&joiner, "esperando") ;
+   task_init (&yielder, YieldBody, NULL) ;
+   task_setname (&yielder, "cedendo") ;
+   task_setname (NULL, "principal") ;
+
+   // deixa as tarefas dormirem e esperarem
+   task_sleep (10) ;
+
+   fd = open (FILENAME, O_WRONLY | O_CREAT | O_TRUNC, 0600) ;
+   printf ("main: despejo pela API: %s\n", ppos_dump (fd) == 0 ? "sim" : "nao") ;
+   close (fd) ;
+
+   load () ;
+   printf ("main: tarefa dormindo listada: %s\n", line_has ("dorminhoca", "sleep") ? "sim" : "nao") ;
+   printf ("main: tarefa esperando listada: %s\n", line_has ("esperando", "join") ? "sim" : "nao") ;
+   printf ("main: tarefa corrente em execucao: %s\n", line_has ("principal", "running") ? "sim" : "nao") ;
+   printf ("main: filas e temporizador listados: %s\n",
+           line_has ("queues:", "sleep 1") && line_has ("timer:", "every") ? "sim" : "nao") ;
+   printf ("main: despejo completo: %s\n", strstr (text, "=== end of dump ===") ? "sim" : "nao") ;
+
+   fd = open (FILENAME, O_WRONLY | O_CREAT | O_TRUNC, 0600) ;
+   ppos_dump_signal (SIGUSR1, fd) ;
+   raise (SIGUSR1) ;
+   ppos_dump_signal (0, -1) ;
+   close (fd) ;
+
+   load () ;
+   printf ("main: despejo pelo sinal: %s\n", line_has ("dorminhoca", "sleep") && line_has ("principal", "running") ? "sim" : "nao") ;
+
+   task_wait (&joiner) ;
+   task_wait (&yielder) ;
+
+   if (argc > 1)
+      printf ("%s", text) ;
+   unlink (FILENAME) ;
+   printf ("main: fim\n");
+
+   task_exit (0) ;
+}
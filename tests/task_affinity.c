@@ -0,0 +1,83 @@
+// PingPongOS - PingPong Operating System
+
+// Teste da afinidade de tarefas com varios workers: tarefas fixadas num
+// worker nunca migram, as demais podem circular entre os workers
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "ppos.h"
+#include "worker.h"
+
+#define WORKERS 4
+#define PINNED 3
+#define FREE 3
+#define ROUNDS 200
+
+task_t pinned[PINNED], floating[FREE] ;
+
+// simula um processamento pesado
+int hardwork (int n)
+{
+   int i, j, soma ;
+
+   soma = 0 ;
+   for (i=0; i<n; i++)
+      for (j=0; j<n; j++)
+         soma += j ;
+   return (soma) ;
+}
+
+// corpo das threads
+void Body (void * arg)
+{
+   int i ;
+
+   for (i=0; i<ROUNDS; i++)
+   {
+      hardwork (100) ;
+      task_yield () ;
+   }
+   task_exit (0) ;
+}
+
+int main (int argc, char *argv[])
+{
+   int i ;
+   unsigned int migrations ;
+
+   printf ("main: inicio\n");
+
+   ppos_workers (WORKERS) ;
+   ppos_init () ;
+
+   for (i=0; i<PINNED; i++)
+   {
+      task_init (&pinned[i], Body, NULL) ;
+      task_setaffinity (&pinned[i], 1ULL << (i + 1)) ;
+   }
+
+   for (i=0; i<FREE; i++)
+      task_init (&floating[i], Body, NULL) ;
+
+   printf ("main: mascara invalida rejeitada: %s\n",
+           task_setaffinity (NULL, 1ULL << WORKERS) < 0 ? "sim" : "nao") ;
+   printf ("main: mascara da tarefa fixada 0: %#llx\n",
+           task_getaffinity (&pinned[0])) ;
+
+   // a propria main passa para o ultimo worker
+   task_setaffinity (NULL, 1ULL << (WORKERS - 1)) ;
+
+   for (i=0; i<PINNED; i++)
+      task_wait (&pinned[i]) ;
+   for (i=0; i<FREE; i++)
+      task_wait (&floating[i]) ;
+
+   migrations = 0 ;
+   for (i=0; i<PINNED; i++)
+      migrations += pinned[i].time.migrations ;
+   printf ("main: migracoes das tarefas fixadas: %u\n", migrations) ;
+   printf ("main: mascara da main: %#llx\n", task_getaffinity (NULL)) ;
+
+   printf ("main: fim\n");
+   task_exit (0);
+}
@@ -0,0 +1,140 @@
+// PingPongOS - PingPong Operating System
+
+// Teste da arena por tarefa: varias tarefas alocam blocos pequenos,
+// intercalando-se, e cada uma deve achar seus blocos intactos e alinhados;
+// uma alocacao grande ganha um bloco proprio, task_arena_reset reaproveita
+// a memoria, e os blocos de uma tarefa que termina voltam ao pool do
+// sistema, de onde a proxima tarefa os tira. Por fim, tarefas preemptadas
+// alocam blocos grandes e fazem reset sem parar, indo e voltando ao heap
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "ppos.h"
+#include "arena.h"
+#include "ppos_runtime.h"
+
+#define NUM_TASKS 4
+#define NUM_ALLOCS 3000
+#define NUM_CHURNERS 3
+#define CHURN_MS 300
+
+task_t tasks[NUM_TASKS], late, churners[NUM_CHURNERS] ;
+int intact = 1, aligned = 1, large_ok = 0, reset_ok = 0, pooled_taken = 0 ;
+int churn_ok = 1, churn_rounds = 0 ;
+unsigned int pool_after_exit ;
+
+void Body (void * arg)
+{
+   long id = (long) arg ;
+   unsigned char *blocks[NUM_ALLOCS], *first, *large ;
+   size_t sizes[NUM_ALLOCS] ;
+   int i ;
+
+   // tamanhos de 1 a 200 bytes, uns 300 KB por tarefa, varios blocos
+   for (i=0; i<NUM_ALLOCS; i++)
+   {
+      sizes[i] = 1 + (i * 37 + id) % 200 ;
+      blocks[i] = task_alloc (sizes[i]) ;
+      if (blocks[i] == NULL || (uintptr_t) blocks[i] % ARENA_ALIGN)
+         aligned = 0 ;
+      else
+         memset (blocks[i], id + 1, sizes[i]) ;
+      if (i % 500 == 0)
+         task_yield () ;
+   }
+
+   for (i=0; i<NUM_ALLOCS; i++)
+      if (blocks[i] && (blocks[i][0] != id + 1 || blocks[i][sizes[i] - 1] != id + 1))
+         intact = 0 ;
+
+   if (id == 0)
+   {
+      large = task_alloc (3 * ARENA_CHUNK) ;
+      if (large != NULL && (uintptr_t) large % ARENA_ALIGN == 0)
+      {
+         memset (large, 1, 3 * ARENA_CHUNK) ;
+         large_ok = 1 ;
+      }
+
+      task_arena_reset () ;
+      first = task_alloc (64) ;
+      for (i=0; i<NUM_ALLOCS; i++)
+         if (blocks[i] == first)
+            reset_ok = 1 ;
+   }
+   task_exit (0) ;
+}
+
+void Late (void * arg)
+{
+   unsigned int before = ppos_runtime ()->nr_arena_pool ;
+
+   task_alloc (100) ;
+   pooled_taken = ppos_runtime ()->nr_arena_pool == before - 1 ;
+   task_exit (0) ;
+}
+
+// alocacoes maiores que um bloco vao direto ao heap, e o reset as devolve
+void Churn (void * arg)
+{
+   long id = (long) arg ;
+   unsigned int start = systime () ;
+   unsigned char *large ;
+   size_t size ;
+
+   while (systime () - start < CHURN_MS)
+   {
+      size = ARENA_CHUNK + 1 + ((churn_rounds % 97) * 4096 + id) % (3 * ARENA_CHUNK) ;
+      large = task_alloc (size) ;
+      if (large == NULL)
+         churn_ok = 0 ;
+      else
+      {
+         // so as pontas: o tempo fica quase todo no alocador
+         large[0] = large[size - 1] = id + 1 ;
+         if (large[0] != id + 1 || large[size - 1] != id + 1)
+            churn_ok = 0 ;
+      }
+      task_arena_reset () ;
+      __atomic_add_fetch (&churn_rounds, 1, __ATOMIC_RELAXED) ;
+   }
+   task_exit (0) ;
+}
+
+int main (int argc, char *argv[])
+{
+   long i ;
+
+   printf ("main: inicio\n");
+
+   ppos_init () ;
+
+   for (i=0; i<NUM_TASKS; i++)
+      task_init (&tasks[i], Body, (void *) i) ;
+   for (i=0; i<NUM_TASKS; i++)
+      task_wait (&tasks[i]) ;
+   pool_after_exit = ppos_runtime ()->nr_arena_pool ;
+
+   task_init (&late, Late, NULL) ;
+   task_wait (&late) ;
+
+   for (i=0; i<NUM_CHURNERS; i++)
+      task_init (&churners[i], Churn, (void *) i) ;
+   for (i=0; i<NUM_CHURNERS; i++)
+      task_wait (&churners[i]) ;
+
+   printf ("main: blocos alinhados: %s\n", aligned ? "sim" : "nao") ;
+   printf ("main: blocos de cada tarefa intactos: %s\n", intact ? "sim" : "nao") ;
+   printf ("main: alocacao maior que um bloco: %s\n", large_ok ? "sim" : "nao") ;
+   printf ("main: reset reaproveita a memoria: %s\n", reset_ok ? "sim" : "nao") ;
+   printf ("main: blocos voltam ao pool na saida: %s\n", pool_after_exit >= NUM_TASKS ? "sim" : "nao") ;
+   printf ("main: nova tarefa usa o pool: %s\n", pooled_taken ? "sim" : "nao") ;
+   printf ("main: alocacoes grandes e resets concorrentes: %s\n",
+           churn_ok && churn_rounds > NUM_CHURNERS ? "sim" : "nao") ;
+
+   printf ("main: fim\n");
+   task_exit (0) ;
+   exit (0) ;
+}
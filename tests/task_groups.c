@@ -0,0 +1,116 @@
+// PingPongOS - PingPong Operating System
+
+// Teste dos grupos de tarefas: o grupo de peso triplo deve receber cerca
+// de tres vezes a CPU do grupo leve enquanto os dois disputam, o grupo com
+// cota nao passa dela, e um grupo destruido devolve suas tarefas ao pai
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "ppos.h"
+#include "group.h"
+#include "worker.h"
+
+#define WORKLOAD 20000
+#define LIGHT_TASKS 8
+
+task_group_t Light, Heavy, Limited ;
+task_t light[LIGHT_TASKS], Heavy1, Limited1 ;
+
+// simula um processamento pesado
+int hardwork (int n)
+{
+   int i, j, soma ;
+
+   soma = 0 ;
+   for (i=0; i<n; i++)
+      for (j=0; j<n; j++)
+         soma += j ;
+   return (soma) ;
+}
+
+// corpo das threads
+void Body (void * arg)
+{
+   hardwork (WORKLOAD / (arg ? 1 : 4)) ;
+   task_exit (0) ;
+}
+
+unsigned int cpu_time (task_group_t *group)
+{
+   task_group_stats_t stats ;
+
+   task_group_getstats (group, &stats) ;
+   return stats.total_cpu_time ;
+}
+
+int main (int argc, char *argv[])
+{
+   task_group_t Temp, Parent, Child ;
+   task_group_stats_t limited ;
+   task_t moved ;
+   unsigned int light_ms, heavy_ms, now ;
+   double ratio ;
+   int i ;
+
+   printf ("main: inicio\n");
+
+   // os pesos dos grupos valem so com um worker
+   ppos_workers (1) ;
+   ppos_init () ;
+
+   // muitas tarefas no grupo leve nao devem roubar a CPU do grupo pesado
+   task_group_init (&Light, NULL, 1024) ;
+   task_group_init (&Heavy, NULL, 3072) ;
+
+   // no maximo 10 ms a cada 50 ms
+   task_group_init (&Limited, NULL, 1024) ;
+   task_group_setquota (&Limited, 10, 50) ;
+
+   for (i=0; i<LIGHT_TASKS; i++)
+   {
+      task_init (&light[i], Body, NULL) ;
+      task_group_attach (&Light, &light[i]) ;
+   }
+
+   task_init (&Heavy1, Body, "heavy") ;
+   task_group_attach (&Heavy, &Heavy1) ;
+
+   task_init (&Limited1, Body, "limited") ;
+   task_group_attach (&Limited, &Limited1) ;
+
+   // as tarefas leves tem o dobro do trabalho da pesada, os dois grupos
+   // disputam a CPU ate a pesada terminar
+   task_wait (&Heavy1) ;
+   now = systime () ;
+   light_ms = cpu_time (&Light) ;
+   heavy_ms = cpu_time (&Heavy) ;
+   task_group_getstats (&Limited, &limited) ;
+   ratio = light_ms ? (double) heavy_ms / light_ms : 0 ;
+
+   printf ("main: pesado recebe ~3x a CPU do leve: %s\n", ratio > 2.4 && ratio < 3.6 ? "sim" : "nao") ;
+   printf ("main: limitado respeita a cota: %s\n",
+           limited.nr_throttled > 0 && limited.total_cpu_time <= now / 4 ? "sim" : "nao") ;
+
+   task_wait (&Limited1) ;
+   printf ("main: limitado termina: %s\n", Limited1.status == TASK_STATUS_TERMINATED ? "sim" : "nao") ;
+
+   // um grupo destruido devolve as tarefas ao pai e sai da hierarquia
+   task_group_init (&Parent, NULL, 1024) ;
+   task_group_init (&Child, &Parent, 1024) ;
+   task_group_init (&Temp, &Parent, 1024) ;
+   task_init (&moved, Body, NULL) ;
+   task_group_attach (&Temp, &moved) ;
+
+   printf ("main: destroy recusa a raiz e grupos com filhos: %s\n",
+           task_group_destroy (task_group_root ()) < 0 && task_group_destroy (&Parent) < 0 ? "sim" : "nao") ;
+   printf ("main: destroy move as tarefas para o pai: %s\n",
+           task_group_destroy (&Temp) == 0 && task_group_get (&moved) == &Parent ? "sim" : "nao") ;
+   task_wait (&moved) ;
+   printf ("main: tarefa movida termina: %s\n", moved.status == TASK_STATUS_TERMINATED ? "sim" : "nao") ;
+   printf ("main: pai fica so com o outro filho: %s\n",
+           Parent.children == &Child && Child.next == &Child && task_group_destroy (&Child) == 0
+           && task_group_destroy (&Parent) == 0 ? "sim" : "nao") ;
+
+   printf ("main: fim\n");
+   task_exit (0);
+}
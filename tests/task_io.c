@@ -0,0 +1,112 @@
+// PingPongOS - PingPong Operating System
+
+// Teste de E/S assincrona: tarefas bloqueadas em descritores nao impedem
+// as demais tarefas de executar
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include "ppos.h"
+#include "io.h"
+
+#define MESSAGES 5
+
+task_t reader, writer, counter, waiter ;
+int sv[2], pipefd[2] ;
+int writer_done = 0 ;
+long count = 0 ;
+
+// recebe as mensagens do escritor
+void Reader (void * arg)
+{
+   char buf[32] ;
+   int i ;
+   ssize_t n ;
+
+   for (i=0; i<MESSAGES; i++)
+   {
+      n = task_read (sv[0], buf, sizeof(buf) - 1) ;
+      if (n <= 0)
+      {
+         printf ("Reader: erro na leitura\n") ;
+         break ;
+      }
+      buf[n] = 0 ;
+      printf ("Reader: recebeu \"%s\"\n", buf) ;
+   }
+   task_exit (0) ;
+}
+
+// envia uma mensagem a cada 20 ms
+void Writer (void * arg)
+{
+   char buf[32] ;
+   int i ;
+
+   for (i=0; i<MESSAGES; i++)
+   {
+      task_sleep (20) ;
+      sprintf (buf, "mensagem %d", i) ;
+      task_write (sv[1], buf, strlen (buf)) ;
+      printf ("Writer: enviou \"%s\"\n", buf) ;
+   }
+   writer_done = 1 ;
+   task_exit (0) ;
+}
+
+// executa enquanto as demais tarefas esperam
+void Counter (void * arg)
+{
+   while (!writer_done)
+   {
+      count++ ;
+      task_yield () ;
+   }
+   task_exit (0) ;
+}
+
+// espera por dados que nunca chegam
+void Waiter (void * arg)
+{
+   int ret ;
+
+   ret = task_wait_fd (pipefd[0], IO_READ, 50) ;
+   printf ("Waiter: task_wait_fd retornou %d apos o timeout\n", ret) ;
+   task_exit (0) ;
+}
+
+int main (int argc, char *argv[])
+{
+   printf ("main: inicio\n");
+
+   ppos_init () ;
+
+   if (socketpair (AF_UNIX, SOCK_STREAM, 0, sv) < 0 || pipe (pipefd) < 0)
+   {
+      perror ("main: erro ao criar descritores") ;
+      exit (1) ;
+   }
+
+   task_init (&reader, Reader, NULL) ;
+   task_init (&writer, Writer, NULL) ;
+   task_init (&counter, Counter, NULL) ;
+   task_init (&waiter, Waiter, NULL) ;
+
+   task_wait (&reader) ;
+   task_wait (&writer) ;
+   task_wait (&counter) ;
+   task_wait (&waiter) ;
+
+   printf ("main: contador %s enquanto o leitor esperava\n", count > 0 ? "executou" : "NAO executou") ;
+
+   task_close (sv[0]) ;
+   task_close (sv[1]) ;
+   task_close (pipefd[0]) ;
+   task_close (pipefd[1]) ;
+
+   printf ("main: fim\n");
+
+   task_exit (0) ;
+}
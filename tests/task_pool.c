@@ -0,0 +1,87 @@
+// PingPongOS - PingPong Operating System
+
+// Teste do pool de tarefas: muitos trabalhos submetidos a um pool de poucas
+// tarefas devem rodar todos, uma vez cada, so nas tarefas do pool; o flush
+// espera todos terminarem, o pool aceita trabalhos depois dele, alguns
+// trabalhos cedem o processador no meio, e o destroy termina as tarefas
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "ppos.h"
+#include "pool.h"
+
+#define NUM_WORKERS 4
+#define NUM_JOBS 1000
+#define MAX_IDS 64
+
+int runs[2 * NUM_JOBS] ;
+int ran_on[MAX_IDS] ;
+int finished = 0, outside = 0 ;
+
+void Job (void * arg)
+{
+   long job = (long) arg ;
+   int id = task_id () ;
+
+   if (id < MAX_IDS)
+      __atomic_store_n (&ran_on[id], 1, __ATOMIC_RELAXED) ;
+   else
+      __atomic_add_fetch (&outside, 1, __ATOMIC_RELAXED) ;
+
+   if (job % 7 == 0)
+      task_yield () ;
+   __atomic_add_fetch (&runs[job], 1, __ATOMIC_RELAXED) ;
+   __atomic_add_fetch (&finished, 1, __ATOMIC_RELAXED) ;
+}
+
+int all_once (int first, int last)
+{
+   int i ;
+
+   for (i=first; i<last; i++)
+      if (runs[i] != 1)
+         return 0 ;
+   return 1 ;
+}
+
+int main (int argc, char *argv[])
+{
+   task_pool_t *pool ;
+   long i ;
+   int tasks_used, done ;
+
+   printf ("main: inicio\n");
+
+   ppos_init () ;
+
+   pool = task_pool_create (NUM_WORKERS) ;
+   if (pool == NULL)
+   {
+      printf ("main: erro ao criar o pool\n") ;
+      exit (1) ;
+   }
+
+   for (i=0; i<NUM_JOBS; i++)
+      task_pool_submit (pool, Job, (void *) i) ;
+   task_pool_flush (pool) ;
+   done = __atomic_load_n (&finished, __ATOMIC_RELAXED) ;
+
+   for (i=0, tasks_used=0; i<MAX_IDS; i++)
+      tasks_used += ran_on[i] ;
+
+   printf ("main: flush espera todos os trabalhos: %s\n", done == NUM_JOBS ? "sim" : "nao") ;
+   printf ("main: cada trabalho rodou uma vez: %s\n", all_once (0, NUM_JOBS) ? "sim" : "nao") ;
+   printf ("main: so as tarefas do pool rodaram trabalhos: %s\n",
+           tasks_used <= NUM_WORKERS && outside == 0 ? "sim" : "nao") ;
+
+   // os trabalhadores estao suspensos, a submissao acorda um deles
+   for (i=NUM_JOBS; i<2 * NUM_JOBS; i++)
+      task_pool_submit (pool, Job, (void *) i) ;
+   task_pool_destroy (pool) ;
+
+   printf ("main: destroy termina os trabalhos pendentes: %s\n", all_once (NUM_JOBS, 2 * NUM_JOBS) ? "sim" : "nao") ;
+
+   printf ("main: fim\n");
+   task_exit (0) ;
+   exit (0) ;
+}
@@ -0,0 +1,86 @@
+// PingPongOS - PingPong Operating System
+
+// Teste das tarefas criadas pelo proprio sistema: descritores alinhados a
+// linha de cache, reciclados com sua pilha depois do join ou do detach, e
+// handles que deixam de valer quando o descritor e reciclado
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "ppos.h"
+#include "ppos_runtime.h"
+#include "slab.h"
+
+#define WAVES 400
+#define WAVE_SIZE 50
+
+int finished ;
+
+void Quick (void * arg)
+{
+   finished++ ;
+   task_exit ((int)(long)arg) ;
+}
+
+void Sleepy (void * arg)
+{
+   task_sleep (20) ;
+   finished++ ;
+   task_exit ((int)(long)arg) ;
+}
+
+void Scenario (void * arg)
+{
+   task_handle_t handle, again, wave[WAVE_SIZE] ;
+   task_t *task ;
+   int code = -1, i, j, stale ;
+   unsigned int slots ;
+
+   // join de uma tarefa que ainda dorme
+   handle = task_spawn (Sleepy, (void *) 7) ;
+   task = task_lookup (handle) ;
+   printf ("Main: descritor alinhado: %s\n", task && ((uintptr_t) task % 64) == 0 ? "sim" : "nao") ;
+   printf ("Main: join devolve o codigo de saida: %s\n", task_join (handle, &code) == 0 && code == 7 ? "sim" : "nao") ;
+
+   // o handle antigo nao vale mais, mesmo com o descritor reciclado
+   again = task_spawn (Quick, (void *) 3) ;
+   printf ("Main: descritor reciclado: %s\n", task_lookup (again) == task && again.index == handle.index ? "sim" : "nao") ;
+   printf ("Main: handle antigo detectado: %s\n",
+           task_lookup (handle) == NULL && task_join (handle, &code) < 0 && task_detach (handle) < 0 ? "sim" : "nao") ;
+   task_yield () ;
+   printf ("Main: join de tarefa ja terminada: %s\n", task_join (again, &code) == 0 && code == 3 ? "sim" : "nao") ;
+
+   // detach: o descritor volta ao slab quando a tarefa termina
+   handle = task_spawn (Sleepy, NULL) ;
+   task_detach (handle) ;
+   stale = task_lookup (handle) != NULL ;
+   task_sleep (40) ;
+   printf ("Main: detach recicla ao terminar: %s\n", stale && task_lookup (handle) == NULL ? "sim" : "nao") ;
+
+   // muitas tarefas em ondas: a memoria fica constante
+   finished = 0 ;
+   for (i=0; i<WAVES; i++)
+   {
+      for (j=0; j<WAVE_SIZE; j++)
+         wave[j] = task_spawn (Quick, NULL) ;
+      for (j=0; j<WAVE_SIZE; j++)
+         if (j % 2)
+            task_detach (wave[j]) ;
+         else
+            task_join (wave[j], NULL) ;
+   }
+   task_sleep (10) ;
+   slots = ppos_runtime ()->task_slab->nr_slots ;
+   printf ("Main: %d tarefas executadas: %s\n", WAVES * WAVE_SIZE, finished == WAVES * WAVE_SIZE ? "sim" : "nao") ;
+   printf ("Main: memoria constante: %s\n", slots <= 2 * WAVE_SIZE + SLAB_CHUNK ? "sim" : "nao") ;
+
+   task_exit (0) ;
+}
+
+int main (int argc, char *argv[])
+{
+   printf ("main: inicio\n");
+   ppos_run (Scenario, NULL) ;
+   printf ("main: fim\n");
+   exit (0) ;
+}
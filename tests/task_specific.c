@@ -0,0 +1,99 @@
+// PingPongOS - PingPong Operating System
+
+// Teste dos valores locais de tarefa: varias tarefas guardam valores nas
+// mesmas chaves, dentro do descritor e no vetor de transbordo, e cada uma
+// deve ler so os seus; os destrutores rodam na saida de cada tarefa, e uma
+// chave apagada e recriada nao ve os valores antigos
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "ppos.h"
+#include "tls.h"
+
+#define NUM_TASKS 5
+#define NUM_KEYS 10
+
+task_t tasks[NUM_TASKS] ;
+task_key_t keys[NUM_KEYS], again_key ;
+int values[NUM_TASKS][NUM_KEYS] ;
+int own_values = 1, destroyed = 0, wrong_task = 0, again = 0 ;
+
+// roda na tarefa que sai, ainda com os outros valores dela
+void destroy (void *value)
+{
+   int *v = value, *first = task_getspecific (keys[0]) ;
+
+   if (first == NULL || (v - &values[0][0]) / NUM_KEYS != (first - &values[0][0]) / NUM_KEYS)
+      wrong_task++ ;
+   destroyed++ ;
+}
+
+// guarda o valor de novo uma vez, pedindo mais uma rodada de destrutores
+void destroy_again (void *value)
+{
+   again++ ;
+   if (again == 1)
+      task_setspecific (again_key, value) ;
+}
+
+void Body (void * arg)
+{
+   long id = (long) arg ;
+   int i, round ;
+
+   for (i=0; i<NUM_KEYS; i++)
+      task_setspecific (keys[i], &values[id][i]) ;
+   if (id == 0)
+      task_setspecific (again_key, &values[id][0]) ;
+
+   for (round=0; round<3; round++)
+   {
+      task_yield () ;
+      for (i=0; i<NUM_KEYS; i++)
+         if (task_getspecific (keys[i]) != &values[id][i])
+            own_values = 0 ;
+   }
+   task_exit (0) ;
+}
+
+int main (int argc, char *argv[])
+{
+   task_key_t key, stale ;
+   long i ;
+   int created, found ;
+
+   printf ("main: inicio\n");
+
+   ppos_init () ;
+
+   for (i=0; i<NUM_KEYS; i++)
+      task_key_create (&keys[i], (i % 2) ? destroy : NULL) ;
+   task_key_create (&again_key, destroy_again) ;
+
+   for (i=0; i<NUM_TASKS; i++)
+      task_init (&tasks[i], Body, (void *) i) ;
+   for (i=0; i<NUM_TASKS; i++)
+      task_wait (&tasks[i]) ;
+
+   printf ("main: cada tarefa le os seus valores: %s\n", own_values ? "sim" : "nao") ;
+   printf ("main: destrutores rodaram na saida: %s\n",
+           destroyed == NUM_TASKS * NUM_KEYS / 2 && wrong_task == 0 ? "sim" : "nao") ;
+   printf ("main: destrutor roda de novo se o valor volta: %s\n", again == 2 ? "sim" : "nao") ;
+   printf ("main: main nao ve os valores das tarefas: %s\n", task_getspecific (keys[NUM_KEYS - 1]) == NULL ? "sim" : "nao") ;
+
+   // a chave recriada reusa o indice, mas nao o valor antigo
+   stale = keys[NUM_KEYS - 1] ;
+   task_setspecific (stale, &values[0][0]) ;
+   task_key_delete (stale) ;
+   task_key_create (&key, NULL) ;
+   printf ("main: chave recriada comeca vazia: %s\n",
+           key == stale && task_getspecific (key) == NULL ? "sim" : "nao") ;
+
+   for (created=0; task_key_create (&key, NULL) == 0; created++) ;
+   found = NUM_KEYS + 1 + created ;
+   printf ("main: limite de %d chaves: %s\n", TASK_KEYS_MAX, found == TASK_KEYS_MAX ? "sim" : "nao") ;
+
+   printf ("main: fim\n");
+   task_exit (0) ;
+   exit (0) ;
+}
@@ -0,0 +1,118 @@
+// PingPongOS - PingPong Operating System
+
+// Teste das estatisticas de tarefas: uma tarefa cede o processador, outra
+// dorme e outra gasta CPU sem ceder; as estatisticas de cada uma e o
+// resumo do sistema devem refletir o que cada tarefa fez. Uma tarefa criada
+// com task_spawn num descritor reciclado mede so a sua propria pilha
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ppos.h"
+#include "stats.h"
+#include "ppos_runtime.h"
+
+#define ROUNDS 20
+#define DEEP_STACK 40000
+
+task_t yielder, sleeper, spinner ;
+task_stats_t deep_stats, shallow_stats ;
+
+void YieldBody (void * arg)
+{
+   int i ;
+
+   for (i=0; i<ROUNDS; i++)
+      task_yield () ;
+   task_exit (0) ;
+}
+
+void SleepBody (void * arg)
+{
+   int i ;
+
+   for (i=0; i<ROUNDS/4; i++)
+      task_sleep (10) ;
+   task_exit (0) ;
+}
+
+void SpinBody (void * arg)
+{
+   unsigned int start = systime () ;
+
+   // gasta CPU ate ser preemptada varias vezes
+   while (systime () - start < 200) ;
+   task_exit (0) ;
+}
+
+// poe DEEP_STACK bytes na pilha
+void DeepBody (void * arg)
+{
+   volatile char buffer[DEEP_STACK] ;
+
+   memset ((char *) buffer, 1, sizeof(buffer)) ;
+   task_getstats (NULL, &deep_stats) ;
+   task_exit (0) ;
+}
+
+void ShallowBody (void * arg)
+{
+   task_getstats (NULL, &shallow_stats) ;
+   task_exit (0) ;
+}
+
+int main (int argc, char *argv[])
+{
+   task_stats_t ys, ss, ps, ms ;
+   ppos_stats_t rs ;
+
+   printf ("main: inicio\n");
+
+   ppos_init () ;
+
+   task_init (&yielder, YieldBody, NULL) ;
+   task_init (&sleeper, SleepBody, NULL) ;
+   task_init (&spinner, SpinBody, NULL) ;
+
+   task_wait (&yielder) ;
+   task_wait (&sleeper) ;
+   task_wait (&spinner) ;
+
+   task_getstats (&yielder, &ys) ;
+   task_getstats (&sleeper, &ss) ;
+   task_getstats (&spinner, &ps) ;
+
+   printf ("main: trocas voluntarias da tarefa que cede: %s\n", ys.voluntary >= ROUNDS ? "sim" : "nao") ;
+   printf ("main: tempo bloqueado da tarefa que dorme: %s\n", ss.blocked_ms >= (ROUNDS/4) * 10 ? "sim" : "nao") ;
+   printf ("main: trocas involuntarias da tarefa que gasta CPU: %s\n", ps.involuntary > 0 ? "sim" : "nao") ;
+   printf ("main: tempo de CPU da tarefa que gasta CPU: %s\n", ps.cpu_ms >= 150 ? "sim" : "nao") ;
+   // tempos de execucao, espera e bloqueio nao se sobrepoem
+   printf ("main: tempos contidos na idade da tarefa: %s\n",
+           ss.cpu_ms + ss.ready_ms + ss.blocked_ms <= ss.age_ms + 5 &&
+           ps.cpu_ms + ps.ready_ms + ps.blocked_ms <= ps.age_ms + 5 ? "sim" : "nao") ;
+   printf ("main: uso de pilha medido: %s\n",
+           ys.stack_peak > 0 && ys.stack_peak <= ys.stack_size ? "sim" : "nao") ;
+
+   // a segunda tarefa reaproveita o descritor e a pilha da primeira
+   task_join (task_spawn (DeepBody, NULL), NULL) ;
+   task_join (task_spawn (ShallowBody, NULL), NULL) ;
+   printf ("main: pilha reciclada mede so a nova tarefa: %s\n",
+           deep_stats.stack_peak >= DEEP_STACK && shallow_stats.stack_peak < DEEP_STACK / 2 ? "sim" : "nao") ;
+
+   // a tarefa corrente
+   if (task_getstats (NULL, &ms) < 0)
+      printf ("main: erro ao ler as estatisticas da tarefa corrente\n") ;
+   printf ("main: tarefa corrente em execucao: %s\n",
+           ms.id == task_id () && ms.status == TASK_STATUS_RUNNING ? "sim" : "nao") ;
+
+   if (ppos_getstats (&rs) < 0)
+      printf ("main: erro ao ler as estatisticas do sistema\n") ;
+   printf ("main: %u tarefas criadas, %u terminadas\n", rs.tasks_created, rs.tasks_exited) ;
+   printf ("main: trocas de contexto somadas: %s\n",
+           rs.switches > 0 && rs.voluntary + rs.involuntary <= rs.switches ? "sim" : "nao") ;
+   printf ("main: nenhuma tarefa dormindo: %s\n", rs.sleeping == 0 ? "sim" : "nao") ;
+
+   printf ("main: fim\n");
+
+   task_exit (0) ;
+}
@@ -0,0 +1,87 @@
+// PingPongOS - PingPong Operating System
+
+// Teste de E/S de arquivos com io_uring: varias tarefas escrevem e leem
+// blocos de um arquivo ao mesmo tempo, cada uma suspensa ate sua requisicao
+// terminar
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "ppos.h"
+#include "uring.h"
+
+#define TASKS 8
+#define BLOCKS 16
+#define BLOCK_SIZE 4096
+
+task_t tasks[TASKS] ;
+int fd, errors = 0 ;
+
+// escreve seus blocos, sincroniza o arquivo e confere o que foi escrito
+void Body (void * arg)
+{
+   int id = (int)(long) arg ;
+   char out[BLOCK_SIZE], in[BLOCK_SIZE] ;
+   int i, block ;
+   off_t offset ;
+
+   for (i=0; i<BLOCKS; i++)
+   {
+      block = i * TASKS + id ;
+      offset = (off_t) block * BLOCK_SIZE ;
+      memset (out, 'A' + block % 26, sizeof(out)) ;
+      if (task_pwrite (fd, out, sizeof(out), offset) != sizeof(out))
+         errors++ ;
+   }
+
+   if (task_fsync (fd) < 0)
+      errors++ ;
+
+   for (i=BLOCKS-1; i>=0; i--)
+   {
+      block = i * TASKS + id ;
+      offset = (off_t) block * BLOCK_SIZE ;
+      memset (out, 'A' + block % 26, sizeof(out)) ;
+      if (task_pread (fd, in, sizeof(in), offset) != sizeof(in) || memcmp (in, out, sizeof(in)))
+         errors++ ;
+   }
+
+   task_exit (0) ;
+}
+
+int main (int argc, char *argv[])
+{
+   char path[] = "/tmp/ppos_uringXXXXXX" ;
+   char buf[16] ;
+   int i ;
+
+   printf ("main: inicio\n");
+
+   ppos_init () ;
+
+   fd = mkstemp (path) ;
+   if (fd < 0)
+   {
+      perror ("main: erro ao criar arquivo") ;
+      exit (1) ;
+   }
+   unlink (path) ;
+
+   for (i=0; i<TASKS; i++)
+      task_init (&tasks[i], Body, (void *)(long) i) ;
+
+   for (i=0; i<TASKS; i++)
+      task_wait (&tasks[i]) ;
+
+   printf ("main: %d blocos escritos e lidos, %d erros\n", TASKS * BLOCKS, errors) ;
+
+   // leitura alem do fim do arquivo
+   printf ("main: leitura apos o fim retornou %ld\n",
+           (long) task_pread (fd, buf, sizeof(buf), (off_t) TASKS * BLOCKS * BLOCK_SIZE)) ;
+
+   close (fd) ;
+   printf ("main: fim\n");
+
+   task_exit (0) ;
+}
@@ -0,0 +1,138 @@
+// PingPongOS - PingPong Operating System
+
+// Teste do tempo virtual: tres tarefas disputam o processador lendo o
+// relogio e uma dorme 10 s. Com a mesma semente, duas execucoes devem ter
+// exatamente as mesmas trocas de tarefa nos mesmos instantes virtuais; com
+// outra semente, as trocas mudam. O sono de 10 s nao espera tempo real. O
+// relogio virtual e do processo, um segundo runtime e recusado
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "ppos.h"
+#include "timer.h"
+#include "ppos_runtime.h"
+#include "worker.h"
+
+#define SPINNERS 3
+#define SPIN_MS 100
+#define MAX_EVENTS 1000
+
+typedef struct
+{
+   int task ;
+   uint64_t ns ;
+} event_t ;
+
+typedef struct
+{
+   event_t events[MAX_EVENTS] ;
+   int num_events ;
+   unsigned int slept ;
+} run_t ;
+
+run_t runs[3] ;
+run_t *current ;
+task_t spinners[SPINNERS], sleeper ;
+int refused ;
+
+// registra cada troca observada: a tarefa e o instante virtual
+void mark ()
+{
+   int id = task_id () ;
+
+   if (current->num_events > 0 && current->events[current->num_events - 1].task == id)
+      return ;
+   if (current->num_events < MAX_EVENTS)
+   {
+      current->events[current->num_events].task = id ;
+      current->events[current->num_events].ns = timer_virtual_ns () ;
+      current->num_events++ ;
+   }
+}
+
+void Spinner (void * arg)
+{
+   unsigned int start = systime () ;
+
+   while (systime () - start < SPIN_MS)
+      mark () ;
+   task_exit (0) ;
+}
+
+void Sleeper (void * arg)
+{
+   unsigned int start = systime () ;
+
+   task_sleep (10000) ;
+   current->slept = systime () - start ;
+   task_exit (0) ;
+}
+
+void Scenario (void * arg)
+{
+   int i ;
+
+   for (i=0; i<SPINNERS; i++)
+      task_init (&spinners[i], Spinner, NULL) ;
+   task_init (&sleeper, Sleeper, NULL) ;
+
+   for (i=0; i<SPINNERS; i++)
+      task_wait (&spinners[i]) ;
+   task_wait (&sleeper) ;
+   task_exit (0) ;
+}
+
+void Nothing (void * arg)
+{
+   task_exit (0) ;
+}
+
+// tenta outro runtime enquanto este roda
+void Probe (void * arg)
+{
+   refused = ppos_join (ppos_spawn (Nothing, NULL)) < 0 ;
+   task_exit (0) ;
+}
+
+int run (int index, unsigned long seed)
+{
+   current = &runs[index] ;
+   if (ppos_virtual_time (seed, 0) < 0)
+      return -1 ;
+   return ppos_run (Scenario, NULL) ;
+}
+
+int main (int argc, char *argv[])
+{
+   int i, same_ids = 1 ;
+
+   printf ("main: inicio\n");
+
+   if (run (0, 42) < 0 || run (1, 42) < 0 || run (2, 7) < 0 || ppos_run (Probe, NULL) < 0)
+   {
+      printf ("main: erro ao executar o cenario\n") ;
+      exit (1) ;
+   }
+
+   for (i=0; i<runs[0].num_events; i++)
+      if (runs[0].events[i].task != runs[1].events[i].task)
+         same_ids = 0 ;
+
+   printf ("main: tarefas intercaladas: %s\n", runs[0].num_events > 2 * SPINNERS ? "sim" : "nao") ;
+   printf ("main: mesma semente, mesmas trocas: %s\n",
+           runs[0].num_events == runs[1].num_events && same_ids ? "sim" : "nao") ;
+   printf ("main: mesma semente, mesmos instantes: %s\n",
+           runs[0].num_events == runs[1].num_events &&
+           memcmp (runs[0].events, runs[1].events, runs[0].num_events * sizeof(event_t)) == 0 ? "sim" : "nao") ;
+   printf ("main: outra semente, outros instantes: %s\n",
+           runs[0].num_events != runs[2].num_events ||
+           memcmp (runs[0].events, runs[2].events, runs[0].num_events * sizeof(event_t)) != 0 ? "sim" : "nao") ;
+   printf ("main: sono de 10 s em tempo virtual: %s\n",
+           runs[0].slept >= 10000 && runs[0].slept < 10100 ? "sim" : "nao") ;
+   printf ("main: segundo runtime recusado: %s\n", refused ? "sim" : "nao") ;
+
+   printf ("main: fim\n");
+   exit (0) ;
+}
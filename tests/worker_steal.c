@@ -0,0 +1,94 @@
+// PingPongOS - PingPong Operating System
+
+// Teste do escalonamento com varios workers: todas as tarefas criadas pela
+// main caem na fila do seu worker, os outros workers roubam parte delas e
+// todas terminam; com as tarefas fixadas num so worker, a de maior
+// prioridade roda antes, mesmo criada por ultimo
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "ppos.h"
+#include "ppos_runtime.h"
+#include "worker.h"
+#include "group.h"
+
+#define WORKERS 4
+#define TASKS 64
+#define ROUNDS 50
+
+task_t tasks[TASKS], low, high ;
+int finished = 0, order = 0, low_order, high_order ;
+
+// simula um processamento pesado
+int hardwork (int n)
+{
+   int i, j, soma ;
+
+   soma = 0 ;
+   for (i=0; i<n; i++)
+      for (j=0; j<n; j++)
+         soma += j ;
+   return (soma) ;
+}
+
+// corpo das threads
+void Body (void * arg)
+{
+   int i ;
+
+   for (i=0; i<ROUNDS; i++)
+   {
+      hardwork (100) ;
+      task_yield () ;
+   }
+   __atomic_add_fetch (&finished, 1, __ATOMIC_RELAXED) ;
+   task_exit (0) ;
+}
+
+void Ordered (void * arg)
+{
+   *(int *) arg = __atomic_add_fetch (&order, 1, __ATOMIC_RELAXED) ;
+   task_exit (0) ;
+}
+
+int main (int argc, char *argv[])
+{
+   ppos_runtime_t *runtime ;
+   unsigned int steals ;
+   int i ;
+
+   printf ("main: inicio\n");
+
+   ppos_workers (WORKERS) ;
+   ppos_init () ;
+
+   for (i=0; i<TASKS; i++)
+      task_init (&tasks[i], Body, NULL) ;
+   for (i=0; i<TASKS; i++)
+      task_wait (&tasks[i]) ;
+
+   runtime = ppos_runtime () ;
+   steals = 0 ;
+   for (i=0; i<runtime->nr_workers; i++)
+      steals += runtime->workers[i].steals ;
+
+   printf ("main: todas as tarefas terminaram: %s\n", finished == TASKS ? "sim" : "nao") ;
+   printf ("main: houve roubos entre workers: %s\n", steals > 0 ? "sim" : "nao") ;
+
+   // as tarefas herdam a afinidade da main, fixada no worker 0; a main so
+   // cede o processador apos criar ambas
+   task_setaffinity (NULL, 1ULL) ;
+   task_init (&low, Ordered, &low_order) ;
+   task_setprio (&low, 10) ;
+   task_init (&high, Ordered, &high_order) ;
+   task_setprio (&high, -10) ;
+   task_wait (&low) ;
+   task_wait (&high) ;
+
+   printf ("main: prioridade respeitada no worker: %s\n", high_order < low_order ? "sim" : "nao") ;
+   printf ("main: peso de grupo recusado: %s\n",
+           task_group_setweight (task_group_root (), 2 * GROUP_DEFAULT_WEIGHT) < 0 ? "sim" : "nao") ;
+
+   printf ("main: fim\n");
+   task_exit (0);
+}
@@ -4,13 +4,19 @@
 #include <sys/time.h>
 #include <string.h>
 #include <errno.h>
+#include <time.h>
+#include <stdbool.h>
+#include <stdint.h>
 
 #include "ppos.h"
 #include "logger.h"
 
 #define TIMER_SIGNAL (int)SIGALRM
+#define THREAD_TIMER_SIGNAL (int)(SIGRTMIN)
 #define MAX_HANDLERS 2
 #define BASE_INTERVAL_MS (long)1
+#define NS_PER_MS 1000000ULL
+#define VIRTUAL_OP_NS 1000
 
 typedef struct {
     void (*handler)(int);
@@ -21,20 +27,64 @@ typedef struct {
 static timer_handler_t _handlers[MAX_HANDLERS];
 static int _next_handler = 0;
 
+// every runtime in the process shares the clock and the handler table
+static int _timer_started = 0;
+static int _handlers_lock = 0;
+
+// called first on every tick with the interrupted context, before a
+// handler may switch tasks
+static void (*_sampler)(void *context) = NULL;
+
 static struct sigaction _action;
 static struct itimerval _timer;
 static unsigned int _system_ticks = 0;
 
+// set once worker threads get their own tick source
+static bool _thread_timers = false;
+static _Thread_local timer_t _thread_timer;
+static _Thread_local unsigned int _thread_ticks = 0;
+
+// virtual time: the clock moves on each read and the ticks are raised on
+// the reading thread, so they land at the same points of every run
+enum { VIRTUAL_UNSET = -1, VIRTUAL_OFF, VIRTUAL_ON };
+static int _virtual = VIRTUAL_UNSET;
+static unsigned int _virtual_op_ns = VIRTUAL_OP_NS;
+static uint64_t _virtual_rng = 0;
+static uint64_t _virtual_now_ns = 0;
+static _Thread_local bool _thread_virtual = false;
+
+// runtimes running in the process; the virtual clock and the clock hook
+// are process-wide, so they admit a single one
+static int _runtimes = 0;
+
+// clock reads may be observed or replaced, e.g. to record or replay them
+static unsigned int (*_clock_hook)(unsigned int now) = NULL;
+static bool _clock_hook_replaces = false;
+static _Thread_local bool _in_clock_hook = false;
+static _Thread_local bool _tick_held = false;
+
+static unsigned int _clock();
+
 int timer_signal()
 {
     return TIMER_SIGNAL;
 }
 
-static void tick_handler(int signum) {
-    _system_ticks++;
+static void tick_handler(int signum, siginfo_t *info, void *context) {
+    (void)info;
+    __atomic_add_fetch(&_system_ticks, 1, __ATOMIC_RELAXED);
+
+    if (_thread_timers) {
+        return;
+    }
+
+    void (*sampler)(void *) = __atomic_load_n(&_sampler, __ATOMIC_ACQUIRE);
+    if (sampler != NULL) {
+        sampler(context);
+    }
     
     for (int i = 0; i < _next_handler; i++) {
-        if (systime() < _handlers[i].next_tick) {
+        if (_clock() < _handlers[i].next_tick) {
             continue;
         }
         
@@ -43,11 +93,132 @@ static void tick_handler(int signum) {
     }
 }
 
+// runs the handlers for the task on the calling worker thread
+static void thread_tick_handler(int signum, siginfo_t *info, void *context) {
+    (void)signum;
+    (void)info;
+
+    if (_in_clock_hook) {
+        _tick_held = true;
+        return;
+    }
+
+    _thread_ticks++;
+
+    void (*sampler)(void *) = __atomic_load_n(&_sampler, __ATOMIC_ACQUIRE);
+    if (sampler != NULL) {
+        sampler(context);
+    }
+
+    for (int i = 0; i < _next_handler; i++) {
+        if (_thread_ticks % _handlers[i].interval_ms != 0) {
+            continue;
+        }
+
+        _handlers[i].handler(timer_signal());
+    }
+}
+
+static void _virtual_reset(unsigned long seed, unsigned int op_ns)
+{
+    _virtual_op_ns = op_ns > 0 ? op_ns : VIRTUAL_OP_NS;
+    _virtual_rng = seed * 0x9E3779B97F4A7C15ULL + 1;
+    _virtual_now_ns = 0;
+    _virtual = VIRTUAL_ON;
+}
+
+// xorshift64*: the same seed draws the same costs
+static unsigned int _virtual_cost()
+{
+    _virtual_rng ^= _virtual_rng >> 12;
+    _virtual_rng ^= _virtual_rng << 25;
+    _virtual_rng ^= _virtual_rng >> 27;
+
+    uint64_t draw = (_virtual_rng * 0x2545F4914F6CDD1DULL) >> 32;
+    return _virtual_op_ns / 2 + draw % (_virtual_op_ns + 1);
+}
+
+// moves the clock; a tick crossed on a runtime thread is raised there, and
+// the handler runs before raise returns unless the signal is blocked
+static uint64_t _virtual_advance(uint64_t to_ns, bool deliver)
+{
+    uint64_t from_ns = _virtual_now_ns;
+    if (to_ns <= from_ns) {
+        return from_ns;
+    }
+
+    _virtual_now_ns = to_ns;
+
+    unsigned int crossed = to_ns / NS_PER_MS - from_ns / NS_PER_MS;
+    if (crossed > 0 && _thread_virtual) {
+        _thread_ticks += deliver ? crossed - 1 : crossed;
+        if (deliver) {
+            raise(THREAD_TIMER_SIGNAL);
+        }
+    }
+
+    return to_ns;
+}
+
+int ppos_virtual_time(unsigned long seed, unsigned int op_ns)
+{
+    if (__atomic_load_n(&_runtimes, __ATOMIC_RELAXED) > 0) {
+        LOG_ERR0("ppos_virtual_time: cannot change the clock while a runtime runs");
+        return -1;
+    }
+
+    _virtual_reset(seed, op_ns);
+    LOG_INFO("ppos_virtual_time: seed %lu, %u ns per clock read", seed, _virtual_op_ns);
+    return 0;
+}
+
+bool timer_is_virtual()
+{
+    if (_virtual == VIRTUAL_UNSET) {
+        const char *env = getenv("PPOS_VIRTUAL_TIME");
+        char *end = NULL;
+        unsigned long seed = env != NULL ? strtoul(env, &end, 10) : 0;
+
+        if (env == NULL || end == env) {
+            _virtual = VIRTUAL_OFF;
+        } else {
+            _virtual_reset(seed, *end == ':' ? strtoul(end + 1, NULL, 10) : 0);
+        }
+    }
+
+    return _virtual == VIRTUAL_ON;
+}
+
+uint64_t timer_virtual_ns()
+{
+    return _virtual_now_ns;
+}
+
+int timer_runtime_start()
+{
+    int running = __atomic_load_n(&_runtimes, __ATOMIC_RELAXED);
+
+    do {
+        if (running > 0 && (timer_is_virtual() || __atomic_load_n(&_clock_hook, __ATOMIC_ACQUIRE) != NULL)) {
+            LOG_ERR0("timer_runtime_start: virtual time and clock hooks run one runtime at a time");
+            return -1;
+        }
+    } while (!__atomic_compare_exchange_n(&_runtimes, &running, running + 1, true, __ATOMIC_ACQ_REL,
+                                          __ATOMIC_RELAXED));
+
+    return 0;
+}
+
+void timer_runtime_stop()
+{
+    __atomic_sub_fetch(&_runtimes, 1, __ATOMIC_RELEASE);
+}
+
 static void _register_signal()
 {
-    _action.sa_handler = tick_handler;
+    _action.sa_sigaction = tick_handler;
     sigemptyset(&_action.sa_mask);
-    _action.sa_flags = 0;
+    _action.sa_flags = SA_SIGINFO;
     if (sigaction(timer_signal(), &_action, 0) < 0)
     {
         LOG_ERR("register_signal: failed to register signal %d, exiting", timer_signal());
@@ -74,23 +245,153 @@ static void _set_timer(long interval_ms)
 static void _register_handler(void (*usr_tick_handler)(int), long interval_ms) {
     _handlers[_next_handler].handler = usr_tick_handler;
     _handlers[_next_handler].interval_ms = interval_ms;
-    _handlers[_next_handler].next_tick = systime() + _system_ticks * interval_ms;
+    // a clock read would cost virtual time only on the first run
+    _handlers[_next_handler].next_tick = (timer_is_virtual() ? 0 : _clock()) + _system_ticks * interval_ms;
     _next_handler++;
 }
 
-unsigned int systime()
+static unsigned int _clock()
 {
+    if (_virtual == VIRTUAL_ON) {
+        return _virtual_advance(_virtual_now_ns + _virtual_cost(), true) / NS_PER_MS;
+    }
+
     int interval_ms = _timer.it_value.tv_usec / 1000;
     return _system_ticks * interval_ms;
 }
 
+unsigned int systime()
+{
+    unsigned int (*hook)(unsigned int) = __atomic_load_n(&_clock_hook, __ATOMIC_ACQUIRE);
+    if (hook == NULL || _in_clock_hook) {
+        return _clock();
+    }
+
+    // a tick taken while the clock is sampled lands after this read
+    _in_clock_hook = true;
+    unsigned int now = hook(_clock_hook_replaces ? 0 : _clock());
+    _in_clock_hook = false;
+
+    if (_tick_held) {
+        _tick_held = false;
+        raise(THREAD_TIMER_SIGNAL);
+    }
+
+    return now;
+}
+
 void timer_init()
 {    
+    if (__atomic_exchange_n(&_timer_started, 1, __ATOMIC_ACQ_REL)) {
+        return;
+    }
+
+    if (timer_is_virtual()) {
+        LOG_INFO0("timer_init: running on virtual time");
+        return;
+    }
+
     LOG_INFO("timer_init: starting timer with interval %ld ms", BASE_INTERVAL_MS);
     _register_signal();
     _set_timer(BASE_INTERVAL_MS);
 }
 
+void timer_thread_start(int tid)
+{
+    struct sigaction action;
+    action.sa_sigaction = thread_tick_handler;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_SIGINFO;
+    if (sigaction(THREAD_TIMER_SIGNAL, &action, 0) < 0)
+    {
+        LOG_ERR("timer_thread_start: failed to register signal %d, exiting", THREAD_TIMER_SIGNAL);
+        exit(-1);
+    }
+
+    if (timer_is_virtual()) {
+        _thread_virtual = true;
+        _thread_timers = true;
+        LOG_INFO("timer_thread_start: thread %d ticking on virtual time", tid);
+        return;
+    }
+
+    struct sigevent event;
+    memset(&event, 0, sizeof(event));
+    event.sigev_notify = SIGEV_THREAD_ID;
+    event.sigev_signo = THREAD_TIMER_SIGNAL;
+    event._sigev_un._tid = tid;
+
+    if (timer_create(CLOCK_MONOTONIC, &event, &_thread_timer) < 0)
+    {
+        LOG_ERR("timer_thread_start: failed to create timer with error: \"%s\", exiting", strerror(errno));
+        exit(-1);
+    }
+
+    struct itimerspec interval;
+    interval.it_value.tv_sec = 0;
+    interval.it_value.tv_nsec = BASE_INTERVAL_MS * 1000000L;
+    interval.it_interval = interval.it_value;
+
+    if (timer_settime(_thread_timer, 0, &interval, NULL) < 0)
+    {
+        LOG_ERR("timer_thread_start: failed to set timer with error: \"%s\", exiting", strerror(errno));
+        exit(-1);
+    }
+
+    _thread_timers = true;
+    LOG_INFO("timer_thread_start: thread %d ticking every %ld ms", tid, BASE_INTERVAL_MS);
+}
+
+void timer_thread_stop()
+{
+    if (_thread_virtual) {
+        _thread_virtual = false;
+        return;
+    }
+
+    timer_delete(_thread_timer);
+}
+
+void timer_set_clock_hook(unsigned int (*hook)(unsigned int now), bool replace)
+{
+    _clock_hook_replaces = replace;
+    __atomic_store_n(&_clock_hook, hook, __ATOMIC_RELEASE);
+}
+
+void timer_raise_tick()
+{
+    if (_thread_timers) {
+        raise(THREAD_TIMER_SIGNAL);
+    }
+}
+
+void timer_idle_until(unsigned int deadline_ms)
+{
+    if (_virtual != VIRTUAL_ON) {
+        return;
+    }
+
+    // nothing runs before the deadline, so no tick is raised on the way
+    _virtual_advance(deadline_ms * NS_PER_MS, false);
+}
+
+void timer_set_sampler(void (*sampler)(void *context))
+{
+    __atomic_store_n(&_sampler, sampler, __ATOMIC_RELEASE);
+}
+
+int timer_handlers(void (**handlers)(int), unsigned int *intervals_ms, int max)
+{
+    int count = __atomic_load_n(&_next_handler, __ATOMIC_ACQUIRE);
+
+    for (int i = 0; i < count && i < max; i++) {
+        handlers[i] = _handlers[i].handler;
+        intervals_ms[i] = _handlers[i].interval_ms;
+    }
+
+    return count;
+}
+
 void register_timer(void (*usr_tick_handler)(int), long interval_ms)
 {
     if (usr_tick_handler == NULL)
@@ -99,6 +400,19 @@ void register_timer(void (*usr_tick_handler)(int), long interval_ms)
         exit(-1);
     }
     
+    while (__atomic_exchange_n(&_handlers_lock, 1, __ATOMIC_ACQUIRE)) {
+        // registrations only happen while a runtime starts
+    }
+
+    for (int i = 0; i < _next_handler; i++)
+    {
+        if (_handlers[i].handler == usr_tick_handler)
+        {
+            __atomic_store_n(&_handlers_lock, 0, __ATOMIC_RELEASE);
+            return;
+        }
+    }
+
     if (_next_handler >= MAX_HANDLERS)
     {
         LOG_ERR("register_timer: maximum number of handlers reached (%d), exiting", MAX_HANDLERS);
@@ -107,4 +421,5 @@ void register_timer(void (*usr_tick_handler)(int), long interval_ms)
 
     LOG_INFO("register_timer: registering timer with interval %ld ms", interval_ms);
     _register_handler(usr_tick_handler, interval_ms);
+    __atomic_store_n(&_handlers_lock, 0, __ATOMIC_RELEASE);
 }
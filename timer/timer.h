@@ -1,6 +1,9 @@
 #ifndef __TIMER_H__
 #define __TIMER_H__
 
+#include <stdbool.h>
+#include <stdint.h>
+
 /**
  * @brief Get the timer signal
  * @return The timer signal
@@ -21,4 +24,102 @@ int timer_init();
  */
 void register_timer(void (*usr_tick_handler)(int), long interval_ms);
 
+/**
+ * @brief Set a function called on every tick with the interrupted context,
+ *        before the handlers run
+ * @param sampler The function, receiving the ucontext_t of the signal, or
+ *        NULL to remove it
+ * @return void
+ */
+void timer_set_sampler(void (*sampler)(void *context));
+
+/**
+ * @brief Copy the registered timer handlers, without allocating
+ * @param handlers Receives up to max handlers
+ * @param intervals_ms Receives the interval of each handler
+ * @param max Size of both arrays
+ * @return The number of registered handlers
+ */
+int timer_handlers(void (**handlers)(int), unsigned int *intervals_ms, int max);
+
+/**
+ * @brief Give the calling thread its own tick source, running the registered
+ *        handlers on that thread; the process timer then only keeps systime
+ * @param tid The kernel id of the calling thread
+ * @return void
+ */
+void timer_thread_start(int tid);
+
+/**
+ * @brief Stop the tick source of the calling thread
+ * @return void
+ */
+void timer_thread_stop();
+
+/**
+ * @brief Count a runtime starting in the process; on virtual time or with
+ *        a clock hook the clock is shared, so a second runtime is refused
+ * @return 0 on success, < 0 if the shared clock already has a runtime
+ */
+int timer_runtime_start();
+
+/**
+ * @brief Count a runtime ending, after timer_runtime_start succeeded
+ * @return void
+ */
+void timer_runtime_stop();
+
+/**
+ * @brief Run the next runtimes on virtual time instead of the host clock.
+ *        Every systime call advances the clock by a cost drawn between
+ *        op_ns / 2 and 3 * op_ns / 2 from a generator seeded with seed, ticks
+ *        are delivered when the clock crosses them and an idle runtime jumps
+ *        to its next wakeup, so the same seed always gives the same
+ *        interleaving. Admits one runtime at a time, refusing the others,
+ *        runs on one worker and does not cover host I/O. PPOS_VIRTUAL_TIME=<seed>[:<op_ns>] selects
+ *        it without code changes
+ * @param seed Seed of the clock read costs
+ * @param op_ns Mean cost of a clock read, 0 for the default of 1 us
+ * @return 0 on success, < 0 while a runtime runs
+ */
+int ppos_virtual_time(unsigned long seed, unsigned int op_ns);
+
+/**
+ * @brief Check whether the clock is virtual
+ * @return true on virtual time
+ */
+bool timer_is_virtual();
+
+/**
+ * @brief Read the virtual clock without advancing it
+ * @return The virtual time in ns
+ */
+uint64_t timer_virtual_ns();
+
+/**
+ * @brief Route every systime call through a hook; a tick that lands while
+ *        the hook runs is held until it returns, so ticks always fall
+ *        between two clock reads
+ * @param hook Receives the time systime would return and returns the time
+ *        to return instead, NULL to remove it
+ * @param replace When true the clock is not read at all and hook receives 0
+ * @return void
+ */
+void timer_set_clock_hook(unsigned int (*hook)(unsigned int now), bool replace);
+
+/**
+ * @brief Raise a tick on the calling runtime thread, as if its tick source
+ *        had fired
+ * @return void
+ */
+void timer_raise_tick();
+
+/**
+ * @brief Let an idle runtime skip to a deadline; on the host clock the
+ *        runtime keeps waiting for it instead
+ * @param deadline_ms The systime to skip to
+ * @return void
+ */
+void timer_idle_until(unsigned int deadline_ms);
+
 #endif
\ No newline at end of file
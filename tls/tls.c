@@ -0,0 +1,168 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "tls.h"
+#include "worker.h"
+#include "logger.h"
+
+// a key is in use while its sequence number is odd
+#define _LIVE(seq) ((seq) & 1)
+
+static unsigned int _seq[TASK_KEYS_MAX];
+static void (*_destructor[TASK_KEYS_MAX])(void *);
+
+// keys past the highest one ever created were never set
+static unsigned int _nr_keys = 0;
+
+static task_t* _current_task()
+{
+    worker_t *worker = worker_self();
+
+    return worker != NULL ? worker->current_task : NULL;
+}
+
+static task_specific_t* _slot(task_t *task, task_key_t key, bool create)
+{
+    if (key < TASK_KEYS_INLINE) {
+        return &task->specific[key];
+    }
+
+    if (task->specific_overflow == NULL && create) {
+        // the allocator is not reentrant, so no other task may run meanwhile
+        worker_core()->block_task_switch();
+        task->specific_overflow = calloc(TASK_KEYS_MAX - TASK_KEYS_INLINE, sizeof(task_specific_t));
+        worker_core()->enable_task_switch();
+
+        if (task->specific_overflow == NULL) {
+            LOG_WARN("task_setspecific: failed to allocate overflow values of task %d", task->id);
+        }
+    }
+
+    return task->specific_overflow != NULL ? &task->specific_overflow[key - TASK_KEYS_INLINE] : NULL;
+}
+
+int task_key_create(task_key_t *key, void (*destructor)(void *))
+{
+    for (task_key_t k = 0; k < TASK_KEYS_MAX; k++) {
+        unsigned int seq = __atomic_load_n(&_seq[k], __ATOMIC_RELAXED);
+
+        if (_LIVE(seq) || !__atomic_compare_exchange_n(&_seq[k], &seq, seq + 1, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+            continue;
+        }
+
+        __atomic_store_n(&_destructor[k], destructor, __ATOMIC_RELEASE);
+
+        unsigned int nr_keys = __atomic_load_n(&_nr_keys, __ATOMIC_RELAXED);
+        while (nr_keys <= k && !__atomic_compare_exchange_n(&_nr_keys, &nr_keys, k + 1, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+        *key = k;
+        return 0;
+    }
+
+    LOG_WARN("task_key_create: all %d keys are in use", TASK_KEYS_MAX);
+    return -1;
+}
+
+int task_key_delete(task_key_t key)
+{
+    if (key >= TASK_KEYS_MAX) {
+        LOG_WARN("task_key_delete: invalid key %u", key);
+        return -1;
+    }
+
+    unsigned int seq = __atomic_load_n(&_seq[key], __ATOMIC_RELAXED);
+
+    if (!_LIVE(seq) || !__atomic_compare_exchange_n(&_seq[key], &seq, seq + 1, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+        LOG_WARN("task_key_delete: key %u is not in use", key);
+        return -1;
+    }
+
+    __atomic_store_n(&_destructor[key], NULL, __ATOMIC_RELEASE);
+    return 0;
+}
+
+int task_setspecific(task_key_t key, const void *value)
+{
+    task_t *task = _current_task();
+
+    if (task == NULL || key >= TASK_KEYS_MAX) {
+        LOG_WARN("task_setspecific: invalid key %u or no current task", key);
+        return -1;
+    }
+
+    unsigned int seq = __atomic_load_n(&_seq[key], __ATOMIC_ACQUIRE);
+
+    if (!_LIVE(seq)) {
+        LOG_WARN("task_setspecific: key %u is not in use", key);
+        return -1;
+    }
+
+    task_specific_t *slot = _slot(task, key, true);
+
+    if (slot == NULL) {
+        return -1;
+    }
+
+    slot->value = (void *)value;
+    slot->seq = seq;
+    return 0;
+}
+
+void* task_getspecific(task_key_t key)
+{
+    task_t *task = _current_task();
+
+    if (task == NULL || key >= TASK_KEYS_MAX) {
+        return NULL;
+    }
+
+    task_specific_t *slot = _slot(task, key, false);
+
+    if (slot == NULL || slot->seq != __atomic_load_n(&_seq[key], __ATOMIC_ACQUIRE) || !_LIVE(slot->seq)) {
+        return NULL;
+    }
+
+    return slot->value;
+}
+
+void tls_init(task_t *task)
+{
+    memset(task->specific, 0, sizeof(task->specific));
+    task->specific_overflow = NULL;
+}
+
+void tls_exit(task_t *task)
+{
+    unsigned int nr_keys = __atomic_load_n(&_nr_keys, __ATOMIC_ACQUIRE);
+
+    // a destructor may set values again, they get a few more rounds
+    for (int round = 0; round < TASK_KEYS_DESTRUCTOR_ITERATIONS; round++) {
+        bool called = false;
+
+        for (task_key_t key = 0; key < nr_keys; key++) {
+            task_specific_t *slot = _slot(task, key, false);
+            void (*destructor)(void *) = __atomic_load_n(&_destructor[key], __ATOMIC_ACQUIRE);
+
+            if (slot == NULL || slot->value == NULL || destructor == NULL ||
+                slot->seq != __atomic_load_n(&_seq[key], __ATOMIC_ACQUIRE)) {
+                continue;
+            }
+
+            void *value = slot->value;
+            slot->value = NULL;
+            destructor(value);
+            called = true;
+        }
+
+        if (!called) {
+            break;
+        }
+    }
+
+    // the destructors above run preemptible, only the free is guarded
+    worker_core()->block_task_switch();
+    free(task->specific_overflow);
+    worker_core()->enable_task_switch();
+
+    task->specific_overflow = NULL;
+}
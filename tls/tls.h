@@ -0,0 +1,72 @@
+#ifndef __TLS_H__
+#define __TLS_H__
+
+#include "ppos_data.h"
+
+/*
+ * Task-local storage. A key names one value per task, shared by all the
+ * runtimes of the process. The values of the first TASK_KEYS_INLINE keys
+ * live in the descriptor, the others in an overflow array the task gets on
+ * its first use of such a key; either way a key is an index, so set and
+ * get take constant time. Every use of a key has a sequence number, kept
+ * with each value set, so a deleted and recreated key reads NULL in every
+ * task. On task_exit, the destructor of each key runs on the task's
+ * non-NULL value, in the exiting task
+ */
+
+#define TASK_KEYS_MAX 128
+#define TASK_KEYS_DESTRUCTOR_ITERATIONS 4
+
+typedef unsigned int task_key_t;
+
+/*
+ * @brief Create a key
+ * @param key: set to the new key
+ * @param destructor: called with the value of an exiting task, may be NULL
+ * @return 0 on success, < 0 when all TASK_KEYS_MAX keys are in use
+ */
+int task_key_create(task_key_t *key, void (*destructor)(void *));
+
+/*
+ * @brief Delete a key; no destructor runs, the values of live tasks are
+ *        dropped without being freed
+ * @param key: key to delete
+ * @return 0 on success, < 0 if the key is not in use
+ */
+int task_key_delete(task_key_t key);
+
+/*
+ * @brief Set the value of a key for the current task
+ * @param key: key to set
+ * @param value: value to keep
+ * @return 0 on success, < 0 on an invalid key or out of memory
+ */
+int task_setspecific(task_key_t key, const void *value);
+
+/*
+ * @brief Get the value of a key for the current task
+ * @param key: key to get
+ * @return the value, NULL if it was not set or the key is invalid
+ */
+void* task_getspecific(task_key_t key);
+
+/*
+ * Runtime internals, used by the core
+ */
+
+/*
+ * @brief Clear the task-local values of a new task
+ * @param task: task being created
+ * @return void
+ */
+void tls_init(task_t *task);
+
+/*
+ * @brief Run the destructors of the values of the current task and free
+ *        its overflow values, before it exits
+ * @param task: exiting task
+ * @return void
+ */
+void tls_exit(task_t *task);
+
+#endif
@@ -0,0 +1,190 @@
+// Converts a trace written by trace_dump into the Chrome trace JSON format,
+// which chrome://tracing and ui.perfetto.dev open. Tasks get one track each,
+// with a slice for every time they ran and markers for the other events,
+// and the workers get one track each with the task they were running.
+// Usage: trace_convert <trace> [output.json]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "trace_format.h"
+
+typedef struct running_t
+{
+    int task;
+    uint64_t start_ns;
+    int valid;
+} running_t;
+
+static const char *_names[TRACE_EVENTS] = {
+    "create", "exit", "switch", "yield", "preempt", "sleep", "suspend", "wake", "lock contended",
+};
+
+static uint64_t _first_ns;
+
+static int _compare_events(const void *a, const void *b)
+{
+    const trace_event_t *x = a;
+    const trace_event_t *y = b;
+
+    if (x->ts_ns != y->ts_ns) {
+        return x->ts_ns < y->ts_ns ? -1 : 1;
+    }
+
+    return (int)x->worker - (int)y->worker;
+}
+
+static double _us(uint64_t ts_ns)
+{
+    return (ts_ns - _first_ns) / 1000.0;
+}
+
+static void _slice(FILE *out, running_t *running, int worker, uint64_t end_ns, int *first)
+{
+    if (!running->valid) {
+        return;
+    }
+
+    fprintf(out, "%s\n{\"name\":\"run\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d,\"args\":{\"worker\":%d}}",
+            *first ? "" : ",", _us(running->start_ns), (end_ns - running->start_ns) / 1000.0, running->task, worker);
+    fprintf(out, ",\n{\"name\":\"task %d\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":2,\"tid\":%d}",
+            running->task, _us(running->start_ns), (end_ns - running->start_ns) / 1000.0, worker);
+    *first = 0;
+}
+
+static void _metadata(FILE *out, trace_event_t *events, uint64_t count, uint32_t nr_workers)
+{
+    int max_task = -1;
+
+    for (uint64_t i = 0; i < count; i++) {
+        if (events[i].task > max_task) {
+            max_task = events[i].task;
+        }
+    }
+
+    char *seen = calloc(max_task + 2, 1);
+
+    // secondary dispatchers have negative ids
+    char seen_dispatchers[64] = { 0 };
+
+    fprintf(out, ",\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"tasks\"}}");
+    fprintf(out, ",\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":2,\"args\":{\"name\":\"workers\"}}");
+
+    for (uint64_t i = 0; i < count && seen != NULL; i++) {
+        int task = events[i].task;
+
+        if (task >= 0 && !seen[task]) {
+            seen[task] = 1;
+            fprintf(out, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"task %d\"}}",
+                    task, task);
+        } else if (task < 0 && task > -64 && !seen_dispatchers[-task]) {
+            seen_dispatchers[-task] = 1;
+            fprintf(out, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"dispatcher %d\"}}",
+                    task, -task);
+        }
+    }
+
+    for (uint32_t i = 0; i < nr_workers; i++) {
+        fprintf(out, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":2,\"tid\":%u,\"args\":{\"name\":\"worker %u\"}}",
+                i, i);
+    }
+
+    free(seen);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <trace> [output.json]\n", argv[0]);
+        return 1;
+    }
+
+    FILE *in = fopen(argv[1], "rb");
+    if (in == NULL) {
+        perror(argv[1]);
+        return 1;
+    }
+
+    trace_header_t header;
+    if (fread(&header, sizeof(header), 1, in) != 1 || memcmp(header.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC)) ||
+        header.version != TRACE_VERSION) {
+        fprintf(stderr, "%s: not a trace of version %d\n", argv[1], TRACE_VERSION);
+        fclose(in);
+        return 1;
+    }
+
+    trace_event_t *events = malloc((header.nr_events + 1) * sizeof(trace_event_t));
+    running_t *running = calloc(header.nr_workers + 1, sizeof(running_t));
+
+    if (events == NULL || running == NULL || fread(events, sizeof(trace_event_t), header.nr_events, in) != header.nr_events) {
+        fprintf(stderr, "%s: truncated trace\n", argv[1]);
+        fclose(in);
+        return 1;
+    }
+    fclose(in);
+
+    FILE *out = argc > 2 ? fopen(argv[2], "w") : stdout;
+    if (out == NULL) {
+        perror(argv[2]);
+        return 1;
+    }
+
+    qsort(events, header.nr_events, sizeof(trace_event_t), _compare_events);
+    _first_ns = header.nr_events > 0 ? events[0].ts_ns : 0;
+
+    unsigned long counts[TRACE_EVENTS] = { 0 };
+    int first = 1;
+
+    fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+
+    for (uint64_t i = 0; i < header.nr_events; i++) {
+        trace_event_t *event = &events[i];
+
+        if (event->type >= TRACE_EVENTS || event->worker >= header.nr_workers) {
+            continue;
+        }
+
+        counts[event->type]++;
+
+        if (event->type == TRACE_SWITCH) {
+            running_t *current = &running[event->worker];
+
+            _slice(out, current, event->worker, event->ts_ns, &first);
+            current->task = event->task;
+            current->start_ns = event->ts_ns;
+            current->valid = 1;
+            continue;
+        }
+
+        fprintf(out, "%s\n{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"pid\":1,\"tid\":%d,\"args\":{\"arg\":%d,\"worker\":%u}}",
+                first ? "" : ",", _names[event->type], _us(event->ts_ns), event->task, event->arg, event->worker);
+        first = 0;
+    }
+
+    // tasks still running when the trace stopped
+    uint64_t last_ns = header.nr_events > 0 ? events[header.nr_events - 1].ts_ns : 0;
+    for (uint32_t i = 0; i < header.nr_workers; i++) {
+        _slice(out, &running[i], i, last_ns, &first);
+    }
+
+    if (!first) {
+        _metadata(out, events, header.nr_events, header.nr_workers);
+    }
+
+    fprintf(out, "\n]}\n");
+
+    if (out != stdout) {
+        fclose(out);
+    }
+
+    fprintf(stderr, "%s: %llu events, %llu lost\n", argv[1], (unsigned long long)header.nr_events,
+            (unsigned long long)header.lost);
+    for (int i = 0; i < TRACE_EVENTS; i++) {
+        fprintf(stderr, "  %-15s %lu\n", _names[i], counts[i]);
+    }
+
+    free(events);
+    free(running);
+    return 0;
+}
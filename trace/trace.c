@@ -0,0 +1,254 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "trace.h"
+#include "worker.h"
+#include "timer.h"
+#include "logger.h"
+
+// one buffer per worker, so recording never takes a lock; a signal handler
+// interrupting a record on the same worker takes the next slot
+typedef struct trace_buffer_t
+{
+    trace_event_t *events;
+    unsigned int count;
+    unsigned int lost;
+} __attribute__((aligned(64))) trace_buffer_t;
+
+typedef struct trace_t
+{
+    bool enabled;
+    unsigned int capacity;
+    int nr_buffers;
+    trace_buffer_t *buffers;
+} trace_t;
+
+int trace_active = 0;
+
+static uint64_t _now_ns()
+{
+    if (timer_is_virtual()) {
+        return timer_virtual_ns();
+    }
+
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void _free(trace_t *trace)
+{
+    for (int i = 0; i < trace->nr_buffers; i++) {
+        free(trace->buffers[i].events);
+    }
+
+    free(trace->buffers);
+    free(trace);
+}
+
+static trace_t* _alloc(int nr_buffers, unsigned int capacity)
+{
+    trace_t *trace = calloc(1, sizeof(trace_t));
+    if (trace == NULL) {
+        return NULL;
+    }
+
+    trace->capacity = capacity;
+    trace->buffers = calloc(nr_buffers, sizeof(trace_buffer_t));
+    if (trace->buffers == NULL) {
+        free(trace);
+        return NULL;
+    }
+
+    for (trace->nr_buffers = 0; trace->nr_buffers < nr_buffers; trace->nr_buffers++) {
+        trace->buffers[trace->nr_buffers].events = malloc(capacity * sizeof(trace_event_t));
+
+        if (trace->buffers[trace->nr_buffers].events == NULL) {
+            _free(trace);
+            return NULL;
+        }
+    }
+
+    return trace;
+}
+
+static int _write_all(int fd, const void *data, size_t size)
+{
+    const char *bytes = data;
+
+    while (size > 0) {
+        ssize_t ret = write(fd, bytes, size);
+
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+
+        bytes += ret;
+        size -= ret;
+    }
+
+    return 0;
+}
+
+int trace_start(unsigned int events)
+{
+    ppos_core_t *core = worker_core();
+    trace_t *trace = core->trace;
+
+    if (events == 0) {
+        LOG_ERR0("trace_start: buffers must hold at least one event");
+        return -1;
+    }
+
+    if (trace != NULL && trace->enabled) {
+        LOG_ERR0("trace_start: runtime is already tracing");
+        return -1;
+    }
+
+    if (trace == NULL || trace->capacity != events) {
+        // the allocator is not reentrant, so no other task may run meanwhile
+        core->block_task_switch();
+
+        if (trace != NULL) {
+            _free(trace);
+            core->trace = NULL;
+        }
+
+        trace = _alloc(core->nr_workers, events);
+        core->enable_task_switch();
+
+        if (trace == NULL) {
+            LOG_ERR0("trace_start: failed to allocate trace buffers");
+            return -1;
+        }
+
+        core->trace = trace;
+    }
+
+    for (int i = 0; i < trace->nr_buffers; i++) {
+        trace->buffers[i].count = 0;
+        trace->buffers[i].lost = 0;
+    }
+
+    __atomic_store_n(&trace->enabled, true, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&trace_active, 1, __ATOMIC_RELEASE);
+
+    LOG_INFO("trace_start: tracing %d workers, %u events each", trace->nr_buffers, events);
+    return 0;
+}
+
+void trace_stop()
+{
+    trace_t *trace = worker_core()->trace;
+
+    if (trace == NULL || !trace->enabled) {
+        return;
+    }
+
+    __atomic_store_n(&trace->enabled, false, __ATOMIC_RELEASE);
+    __atomic_sub_fetch(&trace_active, 1, __ATOMIC_RELEASE);
+
+    LOG_INFO0("trace_stop: tracing stopped");
+}
+
+long trace_dump(const char *path)
+{
+    trace_t *trace = worker_core()->trace;
+
+    if (trace == NULL || path == NULL) {
+        LOG_ERR0("trace_dump: nothing traced or NULL path");
+        return -1;
+    }
+
+    trace_header_t header;
+    unsigned int counts[WORKER_MAX];
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+    header.version = TRACE_VERSION;
+    header.nr_workers = trace->nr_buffers;
+
+    for (int i = 0; i < trace->nr_buffers; i++) {
+        unsigned int count = __atomic_load_n(&trace->buffers[i].count, __ATOMIC_ACQUIRE);
+
+        counts[i] = count < trace->capacity ? count : trace->capacity;
+        header.nr_events += counts[i];
+        header.lost += trace->buffers[i].lost;
+    }
+
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        LOG_ERR("trace_dump: failed to open \"%s\": \"%s\"", path, strerror(errno));
+        return -1;
+    }
+
+    int ret = _write_all(fd, &header, sizeof(header));
+    for (int i = 0; i < trace->nr_buffers && ret == 0; i++) {
+        ret = _write_all(fd, trace->buffers[i].events, counts[i] * sizeof(trace_event_t));
+    }
+
+    close(fd);
+
+    if (ret < 0) {
+        LOG_ERR("trace_dump: failed to write \"%s\"", path);
+        return -1;
+    }
+
+    LOG_INFO("trace_dump: %llu events written to \"%s\"", (unsigned long long)header.nr_events, path);
+    return header.nr_events;
+}
+
+void trace_record(trace_type_t type, int task, int arg)
+{
+    worker_t *worker = worker_self();
+
+    if (worker == NULL) {
+        return;
+    }
+
+    trace_t *trace = worker_core()->trace;
+
+    if (trace == NULL || !__atomic_load_n(&trace->enabled, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+
+    trace_buffer_t *buffer = &trace->buffers[worker->id];
+    unsigned int index = __atomic_fetch_add(&buffer->count, 1, __ATOMIC_RELAXED);
+
+    if (index >= trace->capacity) {
+        __atomic_store_n(&buffer->count, trace->capacity, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&buffer->lost, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    trace_event_t *event = &buffer->events[index];
+
+    event->ts_ns = _now_ns();
+    event->task = task;
+    event->arg = arg;
+    event->type = type;
+    event->worker = worker->id;
+    event->reserved = 0;
+}
+
+void trace_destroy(ppos_core_t *core)
+{
+    if (core == NULL || core->trace == NULL) {
+        return;
+    }
+
+    if (core->trace->enabled) {
+        __atomic_sub_fetch(&trace_active, 1, __ATOMIC_RELEASE);
+    }
+
+    _free(core->trace);
+    core->trace = NULL;
+}
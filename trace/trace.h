@@ -0,0 +1,69 @@
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include "ppos_data.h"
+#include "trace_format.h"
+
+/*
+ * Scheduler tracing into preallocated per-worker buffers of the runtime.
+ * Every trace point is compiled in unless NO_TRACE is defined, and costs a
+ * single branch on trace_active while no runtime is tracing
+ */
+
+extern int trace_active;
+
+#if defined(NO_TRACE)
+#define TRACE(type, task, arg) ((void)0)
+#else
+#define TRACE(type, task, arg) \
+    do { \
+        if (__builtin_expect(trace_active, 0)) { \
+            trace_record((type), (task), (arg)); \
+        } \
+    } while (0)
+#endif
+
+/*
+ * @brief Start tracing the calling task's runtime, dropping the events of
+ *        a previous trace
+ * @param events: capacity of the buffer of each worker
+ * @return 0 on success, < 0 on error
+ */
+int trace_start(unsigned int events);
+
+/*
+ * @brief Stop tracing, keeping the recorded events for trace_dump
+ * @return void
+ */
+void trace_stop();
+
+/*
+ * @brief Write the recorded events to a file, in the format of
+ *        trace_format.h
+ * @param path: file to write
+ * @return number of events written, < 0 on error
+ */
+long trace_dump(const char *path);
+
+/*
+ * @brief Record an event on the buffer of the current worker; events that
+ *        do not fit are counted as lost. Use the TRACE macro instead
+ * @param type: event type
+ * @param task: task id
+ * @param arg: event argument
+ * @return void
+ */
+void trace_record(trace_type_t type, int task, int arg);
+
+/*
+ * Runtime internals, used by the core
+ */
+
+/*
+ * @brief Release the trace buffers of a runtime
+ * @param core: pointer to the ppos core
+ * @return void
+ */
+void trace_destroy(ppos_core_t *core);
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef __TRACE_FORMAT_H__
+#define __TRACE_FORMAT_H__
+
+#include <stdint.h>
+
+#define TRACE_MAGIC "PPOSTRC"
+#define TRACE_VERSION 1
+
+/*
+ * Events of a trace and the meaning of their argument
+ */
+typedef enum {
+    TRACE_CREATE = 0,   // task created, arg: creating task
+    TRACE_EXIT,         // task exited, arg: exit code
+    TRACE_SWITCH,       // task switched in, arg: task switched out
+    TRACE_YIELD,        // task yielded the processor
+    TRACE_PREEMPT,      // task preempted by the tick, arg: remaining quantum
+    TRACE_SLEEP,        // task went to sleep, arg: ms
+    TRACE_SUSPEND,      // task blocked: sleep, wait, I/O or task_suspend
+    TRACE_WAKE,         // task made ready again
+    TRACE_LOCK,         // core lock found taken, arg: 0
+    TRACE_EVENTS,
+} trace_type_t;
+
+/*
+ * A dump is a header followed by nr_events events, grouped by worker and
+ * in time order within each worker
+ */
+typedef struct trace_header_t
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t nr_workers;
+    uint64_t nr_events;
+    uint64_t lost;
+} trace_header_t;
+
+typedef struct trace_event_t
+{
+    uint64_t ts_ns;
+    int32_t task;
+    int32_t arg;
+    uint16_t type;
+    uint16_t worker;
+    uint32_t reserved;
+} trace_event_t;
+
+#endif
@@ -0,0 +1,392 @@
+#define _DEFAULT_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/epoll.h>
+#include <linux/io_uring.h>
+
+#include "uring.h"
+#include "queue.h"
+#include "quantum.h"
+#include "worker.h"
+#include "trace.h"
+#include "ppos.h"
+#include "logger.h"
+
+typedef struct uring_t
+{
+    int fd;
+    unsigned int *sq_head;
+    unsigned int *sq_tail;
+    unsigned int *sq_mask;
+    unsigned int *sq_array;
+    unsigned int *cq_head;
+    unsigned int *cq_tail;
+    unsigned int *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_ptr;
+    size_t sq_len;
+    void *cq_ptr;
+    size_t cq_len;
+    size_t sqes_len;
+    unsigned int entries;
+    unsigned int queued;
+    unsigned int queued_since;
+    unsigned int reserved;      // entries promised to tasks leaving the ready queue
+    unsigned int cq_entries;
+    unsigned int in_flight;     // requests queued or submitted and not reaped
+} uring_t;
+
+static int _enter(uring_t *ring, unsigned int to_submit)
+{
+    return syscall(__NR_io_uring_enter, ring->fd, to_submit, 0, 0, NULL, 0);
+}
+
+// called with the core lock held. A full completion queue is only drained
+// by uring_reap, which the dispatcher of this worker runs, so the rest is
+// left for a later flush instead of being retried here
+static int _flush(uring_t *ring)
+{
+    while (ring->queued > 0) {
+        int ret = _enter(ring, ring->queued);
+
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            if (errno == EAGAIN || errno == EBUSY) {
+                LOG_DEBUG("uring_flush: %u requests wait for the completion queue", ring->queued);
+                return -1;
+            }
+
+            LOG_ERR("uring_flush: io_uring_enter failed: \"%s\"", strerror(errno));
+            return -1;
+        }
+
+        LOG_DEBUG("uring_flush: submitted %d requests", ret);
+        ring->queued -= ret;
+    }
+
+    return 0;
+}
+
+// called with the core lock held: a full submission queue is flushed early
+static struct io_uring_sqe* _get_sqe(uring_t *ring)
+{
+    unsigned int tail = *ring->sq_tail;
+
+    if (tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) >= ring->entries && _flush(ring) < 0) {
+        return NULL;
+    }
+
+    unsigned int index = tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sq_array[index] = index;
+    return sqe;
+}
+
+// called with the core lock held: promises a free entry to the caller, so
+// that it may leave the ready queue before taking it. Requests in flight
+// are capped at the completion queue size, so the kernel never has more
+// completions to post than the queue holds
+static int _reserve_sqe(uring_t *ring)
+{
+    if (ring->in_flight + ring->reserved >= ring->cq_entries) {
+        return -1;
+    }
+
+    unsigned int used = *ring->sq_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) + ring->reserved;
+
+    if (used >= ring->entries && (_flush(ring) < 0 || ring->reserved >= ring->entries)) {
+        return -1;
+    }
+
+    ring->reserved++;
+    return 0;
+}
+
+static void _unmap(uring_t *ring)
+{
+    if (ring->sqes != NULL && ring->sqes != MAP_FAILED) {
+        munmap(ring->sqes, ring->sqes_len);
+    }
+
+    if (ring->cq_ptr != NULL && ring->cq_ptr != MAP_FAILED && ring->cq_ptr != ring->sq_ptr) {
+        munmap(ring->cq_ptr, ring->cq_len);
+    }
+
+    if (ring->sq_ptr != NULL && ring->sq_ptr != MAP_FAILED) {
+        munmap(ring->sq_ptr, ring->sq_len);
+    }
+
+    close(ring->fd);
+}
+
+static uring_t* _create_ring(unsigned int entries)
+{
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    uring_t *ring = calloc(1, sizeof(uring_t));
+    if (ring == NULL) {
+        return NULL;
+    }
+
+    ring->fd = syscall(__NR_io_uring_setup, entries, &params);
+    if (ring->fd < 0) {
+        LOG_INFO("uring_setup: io_uring unavailable: \"%s\"", strerror(errno));
+        free(ring);
+        return NULL;
+    }
+
+    ring->sq_len = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    ring->cq_len = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_len > ring->sq_len) {
+            ring->sq_len = ring->cq_len;
+        }
+        ring->cq_len = ring->sq_len;
+    }
+
+    ring->sq_ptr = mmap(NULL, ring->sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    ring->cq_ptr = ring->sq_ptr;
+
+    if (ring->sq_ptr != MAP_FAILED && !(params.features & IORING_FEAT_SINGLE_MMAP)) {
+        ring->cq_ptr = mmap(NULL, ring->cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+    }
+
+    ring->sqes_len = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+
+    if (ring->sq_ptr == MAP_FAILED || ring->cq_ptr == MAP_FAILED || ring->sqes == MAP_FAILED) {
+        LOG_WARN("uring_setup: failed to map the rings: \"%s\"", strerror(errno));
+        _unmap(ring);
+        free(ring);
+        return NULL;
+    }
+
+    char *sq = ring->sq_ptr;
+    ring->sq_head = (unsigned int*)(sq + params.sq_off.head);
+    ring->sq_tail = (unsigned int*)(sq + params.sq_off.tail);
+    ring->sq_mask = (unsigned int*)(sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned int*)(sq + params.sq_off.array);
+
+    char *cq = ring->cq_ptr;
+    ring->cq_head = (unsigned int*)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned int*)(cq + params.cq_off.tail);
+    ring->cq_mask = (unsigned int*)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+
+    ring->entries = params.sq_entries;
+    ring->cq_entries = params.cq_entries;
+    return ring;
+}
+
+static ssize_t _sync_rw(int opcode, int fd, void *buf, size_t count, off_t offset)
+{
+    while (true) {
+        ssize_t ret;
+
+        if (opcode == IORING_OP_READ) {
+            ret = pread(fd, buf, count, offset);
+        } else if (opcode == IORING_OP_WRITE) {
+            ret = pwrite(fd, buf, count, offset);
+        } else {
+            ret = fsync(fd);
+        }
+
+        if (ret >= 0 || errno != EINTR) {
+            return ret;
+        }
+    }
+}
+
+static ssize_t _submit_and_wait(int opcode, int fd, void *buf, size_t count, off_t offset)
+{
+    ppos_core_t *core = worker_core();
+    uring_t *ring = core->uring;
+
+    if (ring == NULL) {
+        return _sync_rw(opcode, fd, buf, count, offset);
+    }
+
+    core->lock_core();
+    int reserved = _reserve_sqe(ring);
+    core->unlock_core();
+
+    // the task only leaves the ready queue once its request has an entry
+    if (reserved < 0) {
+        return _sync_rw(opcode, fd, buf, count, offset);
+    }
+
+    task_t *task = worker_self()->current_task;
+
+    quantum_release(task, false);
+    core->ready_dequeue(task);
+
+    core->lock_core();
+
+    ring->reserved--;
+    struct io_uring_sqe *sqe = _get_sqe(ring);
+
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->addr = (unsigned long)buf;
+    sqe->len = count;
+    sqe->off = offset;
+    sqe->user_data = (unsigned long)task;
+
+    if (ring->queued == 0) {
+        ring->queued_since = systime();
+    }
+
+    __atomic_store_n(ring->sq_tail, *ring->sq_tail + 1, __ATOMIC_RELEASE);
+    ring->queued++;
+    ring->in_flight++;
+    core->io_waiting++;
+
+    LOG_INFO("uring: task %d queued opcode %d on fd %d", task->id, opcode, fd);
+    core->suspend_locked(NULL);
+
+    if (task->io_result < 0) {
+        errno = -task->io_result;
+        return -1;
+    }
+
+    return task->io_result;
+}
+
+void uring_setup(ppos_core_t *core)
+{
+    const char *env = getenv("PPOS_URING");
+
+    core->uring = NULL;
+
+    if (env != NULL && atoi(env) == 0) {
+        LOG_INFO0("uring_setup: io_uring disabled, using synchronous file I/O");
+        return;
+    }
+
+    uring_t *ring = _create_ring(URING_ENTRIES);
+    if (ring == NULL) {
+        return;
+    }
+
+    // completions wake the dispatcher from the same epoll_wait as sockets
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.fd = ring->fd;
+
+    if (epoll_ctl(core->epoll_fd, EPOLL_CTL_ADD, ring->fd, &event) < 0) {
+        LOG_WARN("uring_setup: failed to poll the ring: \"%s\"", strerror(errno));
+        _unmap(ring);
+        free(ring);
+        return;
+    }
+
+    core->uring = ring;
+    LOG_INFO("uring_setup: ring with %u entries", ring->entries);
+}
+
+void uring_destroy(ppos_core_t *core)
+{
+    if (core == NULL || core->uring == NULL) {
+        return;
+    }
+
+    _unmap(core->uring);
+    free(core->uring);
+    core->uring = NULL;
+}
+
+void uring_submit(bool idle)
+{
+    ppos_core_t *core = worker_core();
+    uring_t *ring = core->uring;
+
+    if (ring == NULL || __atomic_load_n(&ring->queued, __ATOMIC_RELAXED) == 0) {
+        return;
+    }
+
+    core->lock_core();
+
+    if (ring->queued > 0 && (idle || ring->queued >= URING_BATCH || systime() != ring->queued_since)) {
+        _flush(ring);
+    }
+
+    core->unlock_core();
+}
+
+int uring_reap()
+{
+    ppos_core_t *core = worker_core();
+    uring_t *ring = core->uring;
+
+    if (ring == NULL || *ring->cq_head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+        return 0;
+    }
+
+    task_t *woken = NULL;
+    int nr_woken = 0;
+
+    core->lock_core();
+
+    unsigned int head = *ring->cq_head;
+    unsigned int tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+
+    for (; head != tail; head++) {
+        struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+        task_t *task = (task_t*)(unsigned long)cqe->user_data;
+
+        LOG_INFO("uring_reap: task %d request completed with %d", task->id, cqe->res);
+        task->io_result = cqe->res;
+        task->status = TASK_STATUS_READY;
+        TRACE(TRACE_WAKE, task->id, 0);
+        core->io_waiting--;
+        ring->in_flight--;
+        __atomic_add_fetch(&core->nr_runnable, 1, __ATOMIC_RELAXED);
+        queue_append((queue_t**)&woken, (queue_t*)task);
+    }
+
+    __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+    core->unlock_core();
+
+    task_t *task;
+    while ((task = woken) != NULL) {
+        queue_remove((queue_t**)&woken, (queue_t*)task);
+        core->ready_enqueue(task);
+        nr_woken++;
+    }
+
+    return nr_woken;
+}
+
+ssize_t task_pread(int fd, void *buf, size_t count, off_t offset)
+{
+    return _submit_and_wait(IORING_OP_READ, fd, buf, count, offset);
+}
+
+ssize_t task_pwrite(int fd, const void *buf, size_t count, off_t offset)
+{
+    return _submit_and_wait(IORING_OP_WRITE, fd, (void*)buf, count, offset);
+}
+
+int task_fsync(int fd)
+{
+    return _submit_and_wait(IORING_OP_FSYNC, fd, NULL, 0, 0);
+}
+
+bool ppos_uring()
+{
+    return worker_core()->uring != NULL;
+}
@@ -0,0 +1,85 @@
+#ifndef __URING_H__
+#define __URING_H__
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+#include "ppos_data.h"
+
+#define URING_ENTRIES 256
+#define URING_BATCH 32
+
+/*
+ * File I/O through io_uring: each call queues a request and suspends the
+ * calling task, the dispatcher submits queued requests in batches and wakes
+ * the tasks as their completions arrive. Without io_uring (or with
+ * PPOS_URING=0 in the environment) the calls run synchronously
+ */
+
+/*
+ * @brief Read from a file at an offset, suspending the current task
+ * @param fd: file to read from
+ * @param buf: destination buffer
+ * @param count: bytes to read
+ * @param offset: position in the file
+ * @return bytes read, 0 at end of file, < 0 on error (see errno)
+ */
+ssize_t task_pread(int fd, void *buf, size_t count, off_t offset);
+
+/*
+ * @brief Write to a file at an offset, suspending the current task
+ * @param fd: file to write to
+ * @param buf: source buffer
+ * @param count: bytes to write
+ * @param offset: position in the file
+ * @return bytes written, < 0 on error (see errno)
+ */
+ssize_t task_pwrite(int fd, const void *buf, size_t count, off_t offset);
+
+/*
+ * @brief Flush a file to storage, suspending the current task
+ * @param fd: file to flush
+ * @return 0 on success, < 0 on error (see errno)
+ */
+int task_fsync(int fd);
+
+/*
+ * @brief Tell whether the runtime of the calling task uses io_uring
+ * @return true with io_uring, false on the synchronous fallback
+ */
+bool ppos_uring();
+
+/*
+ * Runtime internals, used by the core and the dispatcher
+ */
+
+/*
+ * @brief Create the ring of a runtime and register it with its poller,
+ *        leaving the runtime on the synchronous path if that fails
+ * @param core: pointer to the ppos core
+ * @return void
+ */
+void uring_setup(ppos_core_t *core);
+
+/*
+ * @brief Unmap and close the ring of a runtime
+ * @param core: pointer to the ppos core
+ * @return void
+ */
+void uring_destroy(ppos_core_t *core);
+
+/*
+ * @brief Submit the queued requests in one system call, if the dispatcher
+ *        is about to idle, a batch is full or the oldest request waited a tick
+ * @param idle: true if there is no task ready to run
+ * @return void
+ */
+void uring_submit(bool idle);
+
+/*
+ * @brief Make the tasks whose requests completed ready
+ * @return number of tasks made ready
+ */
+int uring_reap();
+
+#endif
@@ -0,0 +1,602 @@
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "worker.h"
+#include "ppos_runtime.h"
+#include "timer.h"
+#include "queue.h"
+#include "trace.h"
+#include "stats.h"
+#include "dispatcher.h"
+#include "logger.h"
+
+#define WORKER_IDLE_NS 50000L
+#define SPIN_BEFORE_YIELD 64
+
+static int _requested_workers = 0;
+static _Thread_local worker_t *_self = NULL;
+
+struct ppos_host_t
+{
+    pthread_t thread;
+    void (*main_func)(void *);
+    void *arg;
+    int exit_code;
+};
+
+// only the owner pushes, with task switch blocked
+static int _runq_push(runq_t *runq, task_t *task)
+{
+    long bottom = __atomic_load_n(&runq->bottom, __ATOMIC_RELAXED);
+    long top = __atomic_load_n(&runq->top, __ATOMIC_ACQUIRE);
+
+    if (bottom - top >= RUNQ_SIZE) {
+        return -1;
+    }
+
+    __atomic_store_n(&runq->tasks[bottom & (RUNQ_SIZE - 1)], task, __ATOMIC_RELAXED);
+    __atomic_store_n(&runq->bottom, bottom + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+static task_t* _runq_take(runq_t *runq)
+{
+    while (true) {
+        long top = __atomic_load_n(&runq->top, __ATOMIC_ACQUIRE);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        long bottom = __atomic_load_n(&runq->bottom, __ATOMIC_ACQUIRE);
+
+        if (top >= bottom) {
+            return NULL;
+        }
+
+        task_t *task = __atomic_load_n(&runq->tasks[top & (RUNQ_SIZE - 1)], __ATOMIC_RELAXED);
+
+        if (__atomic_compare_exchange_n(&runq->top, &top, top + 1, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+            return task;
+        }
+    }
+}
+
+static task_t* _runq_peek(runq_t *runq)
+{
+    long top = __atomic_load_n(&runq->top, __ATOMIC_ACQUIRE);
+    long bottom = __atomic_load_n(&runq->bottom, __ATOMIC_ACQUIRE);
+
+    if (top >= bottom) {
+        return NULL;
+    }
+
+    return __atomic_load_n(&runq->tasks[top & (RUNQ_SIZE - 1)], __ATOMIC_RELAXED);
+}
+
+static bool _allowed(task_t *task, worker_t *worker)
+{
+    return (__atomic_load_n(&task->affinity, __ATOMIC_RELAXED) >> worker->id) & 1ULL;
+}
+
+// the owner's pick: the first ready task with the lowest dynamic priority,
+// ageing the tasks passed over as the single-worker scheduler does. The
+// task is claimed where it stands, its entry goes stale and is dropped
+// once it reaches the top
+static task_t* _runq_pick(runq_t *runq)
+{
+    long top = __atomic_load_n(&runq->top, __ATOMIC_ACQUIRE);
+    long bottom = __atomic_load_n(&runq->bottom, __ATOMIC_ACQUIRE);
+    task_t *best = NULL;
+
+    for (long i = top; i < bottom; i++) {
+        task_t *task = __atomic_load_n(&runq->tasks[i & (RUNQ_SIZE - 1)], __ATOMIC_RELAXED);
+
+        if (!__atomic_load_n(&task->ready, __ATOMIC_ACQUIRE) || !_allowed(task, _self) || task == best) {
+            continue;
+        }
+
+        if (best == NULL) {
+            best = task;
+        } else if (task->dynamic_priority < best->dynamic_priority) {
+            best->dynamic_priority -= TASK_AGING_DECAY;
+            best = task;
+        } else {
+            task->dynamic_priority -= TASK_AGING_DECAY;
+        }
+    }
+
+    return best;
+}
+
+// worker a task is sent to when the enqueuing worker may not run it
+static worker_t* _home_of(task_t *task)
+{
+    if (task->last_worker >= 0 && _allowed(task, &_self->core->workers[task->last_worker])) {
+        return &_self->core->workers[task->last_worker];
+    }
+
+    for (int i = 0; i < _self->core->nr_workers; i++) {
+        if (_allowed(task, &_self->core->workers[i])) {
+            return &_self->core->workers[i];
+        }
+    }
+
+    return &_self->core->workers[0];
+}
+
+static int _send_to(worker_t *worker, task_t *task)
+{
+    LOG_DEBUG("worker_enqueue: task %d sent to worker %d", task->id, worker->id);
+
+    int ret = 0;
+    _self->core->lock_core();
+    // a stale entry left by a direct task_switch is valid again
+    if (task->next == NULL) {
+        ret = queue_append((queue_t**)&worker->inbox, (queue_t*)task);
+    }
+    _self->core->unlock_core();
+
+    return ret;
+}
+
+static task_t* _take_inbox()
+{
+    if (__atomic_load_n(&_self->inbox, __ATOMIC_RELAXED) == NULL) {
+        return NULL;
+    }
+
+    task_t *task;
+    task_t *moved = NULL;
+
+    _self->core->lock_core();
+    while ((task = _self->inbox) != NULL) {
+        queue_remove((queue_t**)&_self->inbox, (queue_t*)task);
+
+        if (!worker_claim(task)) {
+            continue;
+        }
+
+        // the affinity changed after the task was sent here
+        if (!_allowed(task, _self)) {
+            moved = task;
+            task = NULL;
+        }
+        break;
+    }
+    _self->core->unlock_core();
+
+    if (moved != NULL) {
+        worker_enqueue(moved);
+    }
+
+    return task;
+}
+
+static task_t* _take_global()
+{
+    if (__atomic_load_n(&_self->core->global_queue, __ATOMIC_RELAXED) == NULL) {
+        return NULL;
+    }
+
+    task_t *found = NULL;
+
+    _self->core->lock_core();
+    int queue_len = queue_size((queue_t*)_self->core->global_queue);
+    task_t *task = _self->core->global_queue;
+    for (int visited = 0; visited < queue_len && found == NULL; visited++) {
+        task_t *next = task->next;
+
+        if (_allowed(task, _self) || !__atomic_load_n(&task->ready, __ATOMIC_RELAXED)) {
+            queue_remove((queue_t**)&_self->core->global_queue, (queue_t*)task);
+
+            if (worker_claim(task)) {
+                found = task;
+            }
+        }
+
+        task = next;
+    }
+    _self->core->unlock_core();
+
+    return found;
+}
+
+static void _pin(worker_t *worker)
+{
+    if (worker->cpu < 0) {
+        return;
+    }
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(worker->cpu, &set);
+
+    if (sched_setaffinity(0, sizeof(set), &set) < 0) {
+        LOG_WARN("worker_pin: failed to pin worker %d to cpu %d", worker->id, worker->cpu);
+        return;
+    }
+
+    LOG_INFO("worker_pin: worker %d pinned to cpu %d", worker->id, worker->cpu);
+}
+
+static int _requested()
+{
+    if (_requested_workers > 0) {
+        return _requested_workers;
+    }
+
+    char *env = getenv("PPOS_WORKERS");
+    if (env == NULL) {
+        return 1;
+    }
+
+    int workers = atoi(env);
+    if (workers < 1 || workers > WORKER_MAX) {
+        LOG_WARN("worker_setup: ignoring PPOS_WORKERS=%s, expected 1 to %d", env, WORKER_MAX);
+        return 1;
+    }
+
+    return workers;
+}
+
+// the bounds of the calling thread's stack, for the tasks without a stack
+// of their own
+static void _record_stack(worker_t *worker)
+{
+    pthread_attr_t attr;
+
+    if (pthread_getattr_np(pthread_self(), &attr) != 0) {
+        LOG_WARN("worker_main: worker %d has no stack bounds", worker->id);
+        return;
+    }
+
+    if (pthread_attr_getstack(&attr, &worker->stack_base, &worker->stack_size) != 0) {
+        worker->stack_base = NULL;
+        worker->stack_size = 0;
+    }
+
+    pthread_attr_destroy(&attr);
+}
+
+static void* _worker_main(void *arg)
+{
+    worker_t *worker = arg;
+
+    _self = worker;
+    _record_stack(worker);
+    _pin(worker);
+    timer_thread_start(gettid());
+    LOG_INFO("worker_main: worker %d started", worker->id);
+
+    worker_run(worker);
+
+    timer_thread_stop();
+    LOG_INFO("worker_main: worker %d stopped after %u steals", worker->id, worker->steals);
+    return NULL;
+}
+
+static void* _host_main(void *arg)
+{
+    ppos_host_t *host = arg;
+
+    host->exit_code = ppos_run(host->main_func, host->arg);
+    return NULL;
+}
+
+int ppos_workers(int workers)
+{
+    if (workers < 1 || workers > WORKER_MAX) {
+        LOG_ERR("ppos_workers: %d workers requested, expected 1 to %d", workers, WORKER_MAX);
+        return -1;
+    }
+
+    _requested_workers = workers;
+    return 0;
+}
+
+void spin_lock(int *lock)
+{
+    int spins = 0;
+
+    if (!__atomic_exchange_n(lock, 1, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+
+    TRACE(TRACE_LOCK, worker_self() != NULL && worker_self()->current_task != NULL ?
+          worker_self()->current_task->id : -1, 0);
+
+    while (__atomic_exchange_n(lock, 1, __ATOMIC_ACQUIRE)) {
+        if (++spins >= SPIN_BEFORE_YIELD) {
+            sched_yield();
+            spins = 0;
+        }
+    }
+}
+
+bool spin_trylock(int *lock, int attempts)
+{
+    for (int i = 0; i < attempts; i++) {
+        if (!__atomic_exchange_n(lock, 1, __ATOMIC_ACQUIRE)) {
+            return true;
+        }
+
+        sched_yield();
+    }
+
+    return false;
+}
+
+void spin_unlock(int *lock)
+{
+    __atomic_store_n(lock, 0, __ATOMIC_RELEASE);
+}
+
+int worker_setup(ppos_core_t *core)
+{
+    int workers = _requested();
+    void *memory = NULL;
+
+    // raised ticks only land on the thread that reads the clock
+    if (workers > 1 && timer_is_virtual()) {
+        LOG_WARN("worker_setup: virtual time runs on one worker, ignoring %d workers", workers);
+        workers = 1;
+    }
+
+    if (posix_memalign(&memory, 64, workers * sizeof(worker_t)) != 0) {
+        LOG_ERR0("worker_setup: failed to allocate workers");
+        return -1;
+    }
+
+    core->threads = calloc(workers, sizeof(pthread_t));
+    if (core->threads == NULL) {
+        LOG_ERR0("worker_setup: failed to allocate worker threads");
+        free(memory);
+        return -1;
+    }
+
+    memset(memory, 0, workers * sizeof(worker_t));
+    core->workers = memory;
+    core->nr_workers = workers;
+
+    // workers are spread over the host cpus this process may use
+    int cpus[CPU_SETSIZE];
+    int nr_cpus = 0;
+    cpu_set_t set;
+
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &set)) {
+                cpus[nr_cpus++] = cpu;
+            }
+        }
+    }
+
+    for (int i = 0; i < workers; i++) {
+        core->workers[i].id = i;
+        core->workers[i].core = core;
+        core->workers[i].cpu = nr_cpus > 0 ? cpus[i % nr_cpus] : -1;
+    }
+
+    _self = &core->workers[0];
+    _record_stack(_self);
+    LOG_INFO("worker_setup: runtime with %d workers", workers);
+    return workers;
+}
+
+int worker_start(ppos_core_t *core)
+{
+    pthread_t *threads = core->threads;
+
+    // every runtime ticks on its own threads, so runtimes on different host
+    // threads do not preempt each other
+    timer_thread_start(gettid());
+
+    if (core->nr_workers == 1) {
+        return 0;
+    }
+
+    _pin(&core->workers[0]);
+
+    for (int i = 1; i < core->nr_workers; i++) {
+        worker_t *worker = &core->workers[i];
+
+        if (pthread_create(&threads[i], NULL, _worker_main, worker) != 0) {
+            LOG_ERR("worker_start: failed to start worker %d", i);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+void worker_run(worker_t *worker)
+{
+    worker->current_task = worker->dispatcher_task;
+    worker->dispatcher_task->status = TASK_STATUS_RUNNING;
+    worker->dispatcher_task->on_cpu = 1;
+
+    if (swapcontext(&worker->boot_context, &worker->dispatcher_task->context) < 0) {
+        LOG_ERR("worker_run: worker %d failed to start its dispatcher", worker->id);
+    }
+}
+
+void worker_shutdown(ppos_core_t *core)
+{
+    if (core->workers == NULL) {
+        return;
+    }
+
+    pthread_t *threads = core->threads;
+
+    for (int i = 1; i < core->nr_workers; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    timer_thread_stop();
+    free(core->threads);
+    core->threads = NULL;
+    _self = NULL;
+}
+
+worker_t* worker_self()
+{
+    return _self;
+}
+
+ppos_core_t* worker_core()
+{
+    return _self != NULL ? _self->core : NULL;
+}
+
+int worker_enqueue(task_t *task)
+{
+    stats_enqueue(task);
+    __atomic_store_n(&task->ready, 1, __ATOMIC_RELEASE);
+
+    // a task preempted halfway through the push would later store a stale
+    // bottom over the pushes made meanwhile, or push into the ring of a
+    // worker it no longer runs on
+    ppos_core_t *core = _self->core;
+    bool preemptible = _self->current_task != NULL;
+
+    if (preemptible) {
+        core->block_task_switch();
+    }
+
+    int ret = 0;
+
+    if (!_allowed(task, _self)) {
+        ret = _send_to(_home_of(task), task);
+    } else if (_runq_push(&_self->runq, task) < 0) {
+        LOG_DEBUG("worker_enqueue: worker %d run queue full, task %d sent to global queue", _self->id, task->id);
+
+        core->lock_core();
+        // a stale entry left by a direct task_switch is valid again
+        if (task->next == NULL) {
+            ret = queue_append((queue_t**)&core->global_queue, (queue_t*)task);
+        }
+        core->unlock_core();
+    }
+
+    if (preemptible) {
+        core->enable_task_switch();
+    }
+
+    return ret;
+}
+
+bool worker_claim(task_t *task)
+{
+    return __atomic_exchange_n(&task->ready, 0, __ATOMIC_ACQ_REL) == 1;
+}
+
+task_t* worker_next_task()
+{
+    task_t *task;
+
+    if ((task = _take_inbox()) != NULL) {
+        return task;
+    }
+
+    // stale entries and tasks whose affinity changed leave from the top
+    while ((task = _runq_peek(&_self->runq)) != NULL &&
+           (!__atomic_load_n(&task->ready, __ATOMIC_ACQUIRE) || !_allowed(task, _self))) {
+        if ((task = _runq_take(&_self->runq)) == NULL) {
+            break;
+        }
+
+        if (!worker_claim(task)) {
+            continue;
+        }
+
+        // a thief took the peeked entry first, this one is runnable
+        if (_allowed(task, _self)) {
+            task->dynamic_priority = task->priority;
+            return task;
+        }
+
+        worker_enqueue(task);
+    }
+
+    while ((task = _runq_pick(&_self->runq)) != NULL) {
+        if (worker_claim(task)) {
+            task->dynamic_priority = task->priority;
+            return task;
+        }
+    }
+
+    if ((task = _take_global()) != NULL) {
+        return task;
+    }
+
+    for (int i = 1; i < _self->core->nr_workers; i++) {
+        worker_t *victim = &_self->core->workers[(_self->id + i) % _self->core->nr_workers];
+
+        // leave the victim alone when its next task may not run here
+        while ((task = _runq_peek(&victim->runq)) != NULL && _allowed(task, _self)) {
+            if ((task = _runq_take(&victim->runq)) == NULL || !worker_claim(task)) {
+                continue;
+            }
+
+            if (!_allowed(task, _self)) {
+                worker_enqueue(task);
+                break;
+            }
+
+            LOG_DEBUG("worker_next_task: worker %d stole task %d from worker %d", _self->id, task->id, victim->id);
+            _self->steals++;
+            return task;
+        }
+    }
+
+    return NULL;
+}
+
+ppos_host_t* ppos_spawn(void (*main_func)(void *), void *arg)
+{
+    ppos_host_t *host = calloc(1, sizeof(ppos_host_t));
+    if (host == NULL) {
+        LOG_ERR0("ppos_spawn: failed to allocate host thread");
+        return NULL;
+    }
+
+    host->main_func = main_func;
+    host->arg = arg;
+
+    if (pthread_create(&host->thread, NULL, _host_main, host) != 0) {
+        LOG_ERR0("ppos_spawn: failed to start host thread");
+        free(host);
+        return NULL;
+    }
+
+    return host;
+}
+
+int ppos_join(ppos_host_t *host)
+{
+    if (host == NULL) {
+        LOG_ERR0("ppos_join: cannot join NULL host thread");
+        return -1;
+    }
+
+    pthread_join(host->thread, NULL);
+
+    int exit_code = host->exit_code;
+    free(host);
+
+    return exit_code;
+}
+
+void worker_idle()
+{
+    struct timespec idle = { .tv_sec = 0, .tv_nsec = WORKER_IDLE_NS };
+    nanosleep(&idle, NULL);
+}
+
+void worker_exit()
+{
+    setcontext(&_self->boot_context);
+}
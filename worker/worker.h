@@ -0,0 +1,189 @@
+#ifndef __WORKER_H__
+#define __WORKER_H__
+
+#include <stdbool.h>
+#include <ucontext.h>
+
+#include "ppos_data.h"
+
+#define WORKER_MAX 64
+#define RUNQ_SIZE 256
+#define WORKER_ALL (~0ULL)
+
+/*
+ * Run queue of a worker: a bounded ring with a single producer, the owner,
+ * pushing at the bottom, and several consumers taking from the top with a
+ * CAS. Thieves take the oldest task; the owner picks by priority, claiming
+ * the task in place and dropping the stale entries that reach the top
+ */
+typedef struct runq_t
+{
+    long top __attribute__((aligned(64)));
+    long bottom __attribute__((aligned(64)));
+    task_t *tasks[RUNQ_SIZE];
+} runq_t;
+
+typedef struct worker_t
+{
+    int id;
+    ppos_core_t *core;
+    ucontext_t boot_context;
+    task_t *current_task;
+    task_t *dispatcher_task;
+    task_t *switch_from;
+    task_t *inbox;
+    int cpu;
+    void *stack_base;           // host thread stack, where the main task runs
+    size_t stack_size;
+    unsigned int steals;
+    unsigned long long switches;
+    unsigned long long voluntary;
+    unsigned long long involuntary;
+    unsigned long long migrations;
+    runq_t runq;
+} __attribute__((aligned(64))) worker_t;
+
+/*
+ * @brief Set the number of worker threads started by ppos_init; must be
+ *        called before ppos_init. The PPOS_WORKERS environment variable is
+ *        used when this is not called
+ * @param workers: number of workers, 1 keeps the single-threaded runtime
+ * @return 0 on success, < 0 if the number is out of [1, WORKER_MAX]
+ */
+int ppos_workers(int workers);
+
+typedef struct ppos_host_t ppos_host_t;
+
+/*
+ * @brief Start an independent runtime on a new host thread, running
+ *        main_func as its main task (see ppos_run)
+ * @param main_func: body of the main task
+ * @param arg: argument passed to main_func
+ * @return handle to join the host thread, or NULL on error
+ */
+ppos_host_t* ppos_spawn(void (*main_func)(void *), void *arg);
+
+/*
+ * @brief Wait for a runtime started with ppos_spawn to finish
+ * @param host: handle returned by ppos_spawn
+ * @return exit code of the main task of that runtime, < 0 on error
+ */
+int ppos_join(ppos_host_t *host);
+
+/*
+ * @brief Restrict the workers a task may run on
+ * @param task: task to change, NULL for the current task
+ * @param mask: bit N set allows the task on worker N
+ * @return 0 on success, < 0 if the mask allows no existing worker
+ */
+int task_setaffinity(task_t *task, unsigned long long mask);
+
+/*
+ * @brief Get the workers a task may run on
+ * @param task: task to query, NULL for the current task
+ * @return bitmask of allowed workers
+ */
+unsigned long long task_getaffinity(task_t *task);
+
+/*
+ * Runtime internals, used by the core and the dispatcher
+ */
+
+/*
+ * @brief Allocate the workers, making the calling thread worker 0
+ * @param core: pointer to the ppos core
+ * @return the number of workers, or < 0 on error
+ */
+int worker_setup(ppos_core_t *core);
+
+/*
+ * @brief Start the worker threads and their tick sources
+ * @param core: pointer to the ppos core
+ * @return 0 on success, < 0 on error
+ */
+int worker_start(ppos_core_t *core);
+
+/*
+ * @brief Run the dispatcher of a worker on the calling thread until the
+ *        dispatcher leaves with worker_exit
+ * @param worker: worker to run
+ * @return void
+ */
+void worker_run(worker_t *worker);
+
+/*
+ * @brief Wait for the worker threads to finish and stop their tick sources
+ * @param core: pointer to the ppos core
+ * @return void
+ */
+void worker_shutdown(ppos_core_t *core);
+
+/*
+ * @brief Get the worker running on the calling thread
+ * @return pointer to the worker
+ */
+worker_t* worker_self();
+
+/*
+ * @brief Get the runtime the calling thread works for
+ * @return pointer to the ppos core, NULL outside a runtime
+ */
+ppos_core_t* worker_core();
+
+/*
+ * @brief Make a task ready on the run queue of the calling worker
+ * @param task: task to enqueue
+ * @return 0 on success, < 0 on error
+ */
+int worker_enqueue(task_t *task);
+
+/*
+ * @brief Take the next task to run: tasks sent to this worker first, then
+ *        the local run queue, the global queue, and finally steal from the
+ *        other workers. Tasks are only run on workers in their affinity
+ * @return the claimed task, or NULL if there is nothing to run
+ */
+task_t* worker_next_task();
+
+/*
+ * @brief Claim a ready task, so stale run queue entries are skipped
+ * @param task: task to claim
+ * @return true if the caller now owns the task
+ */
+bool worker_claim(task_t *task);
+
+/*
+ * @brief Back off while there is nothing to run
+ * @return void
+ */
+void worker_idle();
+
+/*
+ * @brief Leave the dispatcher of a worker, returning to worker_run
+ * @return void
+ */
+void worker_exit();
+
+/*
+ * @brief Spin until the lock is acquired
+ * @param lock: lock word
+ * @return void
+ */
+void spin_lock(int *lock);
+
+/*
+ * @brief Try to acquire a lock, yielding the thread between attempts
+ * @param lock: lock word
+ * @param attempts: number of attempts before giving up
+ * @return true if the lock was acquired
+ */
+bool spin_trylock(int *lock, int attempts);
+
+/*
+ * @brief Release a lock taken with spin_lock
+ * @param lock: lock word
+ * @return void
+ */
+void spin_unlock(int *lock);
+
+#endif